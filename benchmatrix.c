@@ -0,0 +1,795 @@
+//
+//	b e n c h m a t r i x . c
+//
+//  Run a matrix of message pool benchmarks and compare the results with a
+//  stored baseline.  This is what "make bench" runs.
+//
+//  The matrix is read from a configuration file (bench.conf by default) that
+//  lists the values to sweep for each dimension:
+//
+//      pool       - Message pool sizes.
+//      writers    - Number of writer processes.
+//      readers    - Number of reader processes.
+//      access     - "sequential" or "random" message IDs.
+//      batch      - Messages per insert call.  A batch of 1 uses
+//                   insertMessage, larger batches use insertMessages.
+//      options    - One line per set of "create" options for the segment.
+//
+//  Every combination is one cell.  For each cell, a fresh segment is created
+//  on a spare bus partition, then the writers and readers are forked and
+//  started together.  Each of them does a fixed number of operations.  The
+//  warmup runs are thrown away.  The median, minimum, maximum and spread of
+//  the aggregate write and read rates over the measured runs are written to
+//  a CSV and a JSON file.
+//
+//  If a baseline CSV file exists, every cell is compared with it.  A cell
+//  whose median is more than the threshold percentage below the baseline is
+//  flagged as a regression, and the program exits with status 1.  "make
+//  bench-baseline" stores the current results as the new baseline.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <locale.h>
+#include <libgen.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "sharedMemory.h"
+#include "workload.h"
+
+//
+// Define the limits of the matrix.
+//
+#define MAX_VALUES   16
+#define MAX_OPTIONS  16
+#define MAX_WORKERS  64
+#define MAX_RUNS     64
+#define MAX_BATCH    256
+#define MAX_BASELINE 4096
+
+//
+// Define the access patterns.
+//
+#define ACCESS_SEQUENTIAL 0
+#define ACCESS_RANDOM     1
+
+static const char* accessNames[] = { "sequential", "random" };
+
+//
+// Define the matrix and the run parameters.  These are the defaults used
+// for anything the configuration file doesn't set.
+//
+typedef struct benchList_t
+{
+	unsigned int count;
+	unsigned int values[MAX_VALUES];
+
+}   benchList_t;
+
+static benchList_t  pools     = { 1, { 1000000 } };
+static benchList_t  writers   = { 1, { 1 } };
+static benchList_t  readers   = { 2, { 0, 1 } };
+static benchList_t  accesses  = { 2, { ACCESS_SEQUENTIAL, ACCESS_RANDOM } };
+static benchList_t  batches   = { 1, { 1 } };
+static unsigned int optionCount = 0;
+static char         options[MAX_OPTIONS][256];
+
+static unsigned int  warmupRuns = 1;
+static unsigned int  repeatRuns = 5;
+static unsigned long operations = 1000000;
+static double        threshold  = 10;
+
+//
+// Define the command line parameters.
+//
+static const char* configName   = "bench.conf";
+static const char* csvName      = "benchResults.csv";
+static const char* jsonName     = "benchResults.json";
+static const char* baselineName = "benchBaseline.csv";
+static int         busId        = SHARED_MEMORY_MAX_BUSES - 1;
+static char        createPath[4096];
+
+//
+// Define the area that the workers report their times in.
+//
+typedef struct benchShared_t
+{
+	volatile int  go;
+	unsigned long startNs;
+	unsigned long endNs[MAX_WORKERS];
+
+}   benchShared_t;
+
+//
+// Define the result of one metric of one cell.
+//
+typedef struct benchResult_t
+{
+	char   key[512];
+	double median;
+	double minimum;
+	double maximum;
+	double spread;
+
+}   benchResult_t;
+
+static benchResult_t baseline[MAX_BASELINE];
+static unsigned int  baselineCount = 0;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -c    Matrix File     string   bench.conf \n\
+    -o    CSV Results     string   benchResults.csv \n\
+    -j    JSON Results    string   benchResults.json \n\
+    -B    Baseline        string   benchBaseline.csv \n\
+    -t    Threshold (%%)   float   From matrix \n\
+    -b    CAN Bus          int          15 \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Return the current monotonic time in nanoseconds.
+//
+static unsigned long nowNs ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// Parse the values of one dimension line into a list.
+//
+// This function returns 0 if the values are valid and -1 if they are not.
+//
+static int parseList ( char* save, benchList_t* list, int isAccess )
+{
+	char* token;
+
+	list->count = 0;
+	while ( ( token = strtok_r ( 0, " \t\r\n", &save ) ) != 0 )
+	{
+		if ( list->count == MAX_VALUES )
+		{
+			return -1;
+		}
+		if ( isAccess )
+		{
+			if ( strcmp ( token, "sequential" ) == 0 )
+			{
+				list->values[list->count++] = ACCESS_SEQUENTIAL;
+			}
+			else if ( strcmp ( token, "random" ) == 0 )
+			{
+				list->values[list->count++] = ACCESS_RANDOM;
+			}
+			else
+			{
+				return -1;
+			}
+			continue;
+		}
+		char*         end;
+		unsigned long value = strtoul ( token, &end, 0 );
+		if ( *end != 0 )
+		{
+			return -1;
+		}
+		list->values[list->count++] = value;
+	}
+	return list->count > 0 ? 0 : -1;
+}
+
+
+//
+// Read the benchmark matrix.
+//
+// This function returns 0 if the matrix was read and -1 if it was not.
+//
+static int readMatrix ( const char* fileName )
+{
+	FILE* file = fopen ( fileName, "r" );
+	if ( file == 0 )
+	{
+		printf ( "Unable to open the benchmark matrix[%s].\n", fileName );
+		return -1;
+	}
+	char         line[1024];
+	unsigned int lineNumber = 0;
+	int          status     = 0;
+
+	while ( status == 0 && fgets ( line, sizeof(line), file ) != 0 )
+	{
+		lineNumber++;
+
+		char* comment = strchr ( line, '#' );
+		if ( comment != 0 )
+		{
+			*comment = 0;
+		}
+		char* save;
+		char* name = strtok_r ( line, " \t\r\n", &save );
+		if ( name == 0 )
+		{
+			continue;
+		}
+		if ( strcmp ( name, "options" ) == 0 )
+		{
+			if ( optionCount == MAX_OPTIONS )
+			{
+				status = -1;
+				continue;
+			}
+			//
+			// The rest of the line is passed to "create" as is.
+			//
+			char* rest = save + strspn ( save, " \t" );
+			rest[strcspn ( rest, "\r\n" )] = 0;
+			(void) strncpy ( options[optionCount], rest,
+							 sizeof(options[optionCount]) - 1 );
+			optionCount++;
+		}
+		else if ( strcmp ( name, "pool" ) == 0 )
+		{
+			status = parseList ( save, &pools, 0 );
+		}
+		else if ( strcmp ( name, "writers" ) == 0 )
+		{
+			status = parseList ( save, &writers, 0 );
+		}
+		else if ( strcmp ( name, "readers" ) == 0 )
+		{
+			status = parseList ( save, &readers, 0 );
+		}
+		else if ( strcmp ( name, "access" ) == 0 )
+		{
+			status = parseList ( save, &accesses, 1 );
+		}
+		else if ( strcmp ( name, "batch" ) == 0 )
+		{
+			status = parseList ( save, &batches, 0 );
+		}
+		else
+		{
+			char* value = strtok_r ( 0, " \t\r\n", &save );
+			if ( value == 0 )
+			{
+				status = -1;
+			}
+			else if ( strcmp ( name, "warmup" ) == 0 )
+			{
+				warmupRuns = atol ( value );
+			}
+			else if ( strcmp ( name, "repeat" ) == 0 )
+			{
+				repeatRuns = atol ( value );
+			}
+			else if ( strcmp ( name, "operations" ) == 0 )
+			{
+				operations = atol ( value );
+			}
+			else if ( strcmp ( name, "threshold" ) == 0 )
+			{
+				threshold = atof ( value );
+			}
+			else
+			{
+				status = -1;
+			}
+		}
+	}
+	(void) fclose ( file );
+
+	if ( status != 0 )
+	{
+		printf ( "Invalid benchmark matrix line %u in [%s].\n", lineNumber,
+				 fileName );
+		return -1;
+	}
+	if ( optionCount == 0 )
+	{
+		optionCount = 1;
+	}
+	for ( unsigned int i = 0; i < writers.count; i++ )
+	{
+		for ( unsigned int j = 0; j < readers.count; j++ )
+		{
+			if ( writers.values[i] + readers.values[j] > MAX_WORKERS ||
+				 writers.values[i] + readers.values[j] == 0 )
+			{
+				printf ( "Invalid number of writers and readers in [%s].\n",
+						 fileName );
+				return -1;
+			}
+		}
+	}
+	for ( unsigned int i = 0; i < batches.count; i++ )
+	{
+		if ( batches.values[i] == 0 || batches.values[i] > MAX_BATCH )
+		{
+			printf ( "Invalid batch size[%u] in [%s].\n", batches.values[i],
+					 fileName );
+			return -1;
+		}
+	}
+	if ( repeatRuns == 0 || repeatRuns > MAX_RUNS )
+	{
+		printf ( "Invalid repeat count[%u] in [%s].\n", repeatRuns, fileName );
+		return -1;
+	}
+	return 0;
+}
+
+
+//
+// Read the baseline results.  A missing baseline is not an error.
+//
+static void readBaseline ( const char* fileName )
+{
+	FILE* file = fopen ( fileName, "r" );
+	if ( file == 0 )
+	{
+		return;
+	}
+	char line[1024];
+
+	while ( baselineCount < MAX_BASELINE && fgets ( line, sizeof(line), file ) != 0 )
+	{
+		//
+		// The key is everything up to the 7th comma (the cell and the metric)
+		// and the median follows it.  The header line has no numbers so it
+		// is skipped.
+		//
+		char* field = line;
+		for ( int i = 0; i < 7 && field != 0; i++ )
+		{
+			field = strchr ( field, ',' );
+			if ( field != 0 )
+			{
+				field++;
+			}
+		}
+		if ( field == 0 )
+		{
+			continue;
+		}
+		benchResult_t* result = &baseline[baselineCount];
+		char*          end;
+
+		result->median = strtod ( field, &end );
+		if ( end == field )
+		{
+			continue;
+		}
+		unsigned int length = field - 1 - line;
+		if ( length >= sizeof(result->key) )
+		{
+			continue;
+		}
+		(void) memcpy ( result->key, line, length );
+		result->key[length] = 0;
+		baselineCount++;
+	}
+	(void) fclose ( file );
+}
+
+
+//
+// Run one writer or reader.
+//
+static void runWorker ( sharedMemory_t* sharedMemory, benchShared_t* shared,
+						unsigned int worker, int isWriter, unsigned int access,
+						unsigned int batch )
+{
+	canMessage_t  messages[MAX_BATCH];
+	unsigned int  poolSize = sharedMemoryGetPoolSize ( sharedMemory );
+	unsigned long random   = worker + 1;
+	unsigned int  next     = worker * ( poolSize / MAX_WORKERS );
+
+	(void) memset ( messages, 0, sizeof(messages) );
+	for ( unsigned int i = 0; i < batch; i++ )
+	{
+		messages[i].canMessage.can_dlc = CAN_MAX_DLEN;
+	}
+	while ( ! shared->go )
+	{
+	}
+	for ( unsigned long done = 0; done < operations; )
+	{
+		unsigned int count = batch;
+		if ( ! isWriter )
+		{
+			count = 1;
+		}
+		for ( unsigned int i = 0; i < count; i++ )
+		{
+			if ( access == ACCESS_RANDOM )
+			{
+				messages[i].canMessage.can_id = workloadRandom ( &random ) % poolSize;
+			}
+			else
+			{
+				messages[i].canMessage.can_id = next;
+				next = next + 1 < poolSize ? next + 1 : 0;
+			}
+		}
+		if ( ! isWriter )
+		{
+			(void) fetchMessage ( sharedMemory, &messages[0] );
+		}
+		else if ( count == 1 )
+		{
+			(void) insertMessage ( sharedMemory, &messages[0] );
+		}
+		else
+		{
+			(void) insertMessages ( sharedMemory, messages, count );
+		}
+		done += count;
+	}
+	shared->endNs[worker] = nowNs();
+	_exit (0);
+}
+
+
+//
+// Run one cell of the matrix once and return the aggregate write and read
+// rates.
+//
+// This function returns 0 if the run worked and -1 if it did not.
+//
+static int runOnce ( sharedMemory_t* sharedMemory, benchShared_t* shared,
+					 unsigned int writerCount, unsigned int readerCount,
+					 unsigned int access, unsigned int batch,
+					 double* writeRate, double* readRate )
+{
+	pid_t        pids[MAX_WORKERS];
+	unsigned int workers = writerCount + readerCount;
+	int          status  = 0;
+
+	(void) memset ( shared, 0, sizeof(benchShared_t) );
+	fflush ( stdout );
+
+	for ( unsigned int i = 0; i < workers; i++ )
+	{
+		pids[i] = fork();
+		if ( pids[i] == 0 )
+		{
+			runWorker ( sharedMemory, shared, i, i < writerCount, access, batch );
+		}
+	}
+	//
+	// Give the workers a moment to get to the starting line and then start
+	// them all at once.
+	//
+	usleep ( 10000 );
+	shared->startNs = nowNs();
+	__atomic_store_n ( &shared->go, 1, __ATOMIC_RELEASE );
+
+	for ( unsigned int i = 0; i < workers; i++ )
+	{
+		int workerStatus;
+		if ( waitpid ( pids[i], &workerStatus, 0 ) != pids[i] ||
+			 ! WIFEXITED ( workerStatus ) || WEXITSTATUS ( workerStatus ) != 0 )
+		{
+			status = -1;
+		}
+	}
+	//
+	// The rate of each role is its total operations over the time from the
+	// start to when its last worker finished.
+	//
+	unsigned long writeEndNs = shared->startNs;
+	unsigned long readEndNs  = shared->startNs;
+	for ( unsigned int i = 0; i < workers; i++ )
+	{
+		unsigned long* endNs = i < writerCount ? &writeEndNs : &readEndNs;
+		if ( shared->endNs[i] > *endNs )
+		{
+			*endNs = shared->endNs[i];
+		}
+	}
+	*writeRate = writerCount == 0 ? 0 : writerCount * operations * 1e9 /
+				 ( writeEndNs - shared->startNs );
+	*readRate  = readerCount == 0 ? 0 : readerCount * operations * 1e9 /
+				 ( readEndNs - shared->startNs );
+
+	return status;
+}
+
+
+//
+// Compare two rates for qsort.
+//
+static int compareRates ( const void* left, const void* right )
+{
+	double a = *(const double*)left;
+	double b = *(const double*)right;
+
+	return a < b ? -1 : a > b;
+}
+
+
+//
+// Summarize the rates of the measured runs of a cell.
+//
+static void summarize ( double* rates, unsigned int count, benchResult_t* result )
+{
+	qsort ( rates, count, sizeof(double), compareRates );
+
+	result->minimum = rates[0];
+	result->maximum = rates[count - 1];
+	result->median  = count % 2 ? rates[count / 2]
+								: ( rates[count / 2 - 1] + rates[count / 2] ) / 2;
+	result->spread  = result->median == 0 ? 0 :
+					  ( result->maximum - result->minimum ) * 100 / result->median;
+}
+
+
+//
+// Write one result to the CSV and JSON files and compare it with the
+// baseline.
+//
+// This function returns 1 if the result is a regression and 0 if not.
+//
+static int report ( benchResult_t* result, FILE* csv, FILE* json, int* first,
+					const char* cellName, const char* metric )
+{
+	fprintf ( csv, "%s,%.0f,%.0f,%.0f,%.1f\n", result->key, result->median,
+			  result->minimum, result->maximum, result->spread );
+
+	fprintf ( json, "%s  { \"cell\": \"%s\", \"metric\": \"%s\", "
+			  "\"median\": %.0f, \"min\": %.0f, \"max\": %.0f, "
+			  "\"spread\": %.1f }", *first ? "" : ",\n", cellName, metric,
+			  result->median, result->minimum, result->maximum, result->spread );
+	*first = 0;
+
+	char comparison[64] = "";
+	int  regression     = 0;
+	for ( unsigned int i = 0; i < baselineCount; i++ )
+	{
+		if ( strcmp ( baseline[i].key, result->key ) == 0 && baseline[i].median > 0 )
+		{
+			double change = ( result->median - baseline[i].median ) * 100 /
+							baseline[i].median;
+
+			regression = change < -threshold;
+			(void) snprintf ( comparison, sizeof(comparison), "%+6.1f%%%s",
+							  change, regression ? "  REGRESSION" : "" );
+			break;
+		}
+	}
+	printf ( "  %-58s %-5s %'13.0f/sec  spread %5.1f%%  %s\n", cellName, metric,
+			 result->median, result->spread, comparison );
+
+	return regression;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char   ch;
+	double thresholdOption = -1;
+
+    while ( ( ch = getopt ( argc, argv, "b:B:c:hj:o:t:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'c':
+			configName = optarg;
+			break;
+
+		  case 'o':
+			csvName = optarg;
+			break;
+
+		  case 'j':
+			jsonName = optarg;
+			break;
+
+		  case 'B':
+			baselineName = optarg;
+			break;
+
+		  case 't':
+		    thresholdOption = atof ( optarg );
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( optind != argc )
+	{
+		printf ( "Invalid parameter encountered: %s\n", argv[optind] );
+		usage ( argv[0] );
+		exit (255);
+	}
+	if ( readMatrix ( configName ) != 0 )
+	{
+		exit (255);
+	}
+	if ( thresholdOption >= 0 )
+	{
+		threshold = thresholdOption;
+	}
+	readBaseline ( baselineName );
+
+	//
+	// The segments are built with the "create" program that sits next to
+	// this one.
+	//
+	char executable[4096];
+	(void) strncpy ( executable, argv[0], sizeof(executable) - 1 );
+	(void) snprintf ( createPath, sizeof(createPath), "%s/create",
+					  dirname ( executable ) );
+
+	FILE* csv  = fopen ( csvName, "w" );
+	FILE* json = fopen ( jsonName, "w" );
+	if ( csv == 0 || json == 0 )
+	{
+		printf ( "Unable to create the result files[%s, %s].\n", csvName,
+				 jsonName );
+		exit (255);
+	}
+	fprintf ( csv, "pool,writers,readers,access,batch,options,metric,median,"
+			  "min,max,spread\n" );
+	fprintf ( json, "[\n" );
+
+	benchShared_t* shared = mmap ( NULL, sizeof(benchShared_t),
+								   PROT_READ|PROT_WRITE,
+								   MAP_SHARED|MAP_ANONYMOUS, -1, 0 );
+	if ( shared == MAP_FAILED )
+	{
+		printf ( "Unable to map the shared results area.\n" );
+		exit (255);
+	}
+	printf ( "Running %u runs (%u warmup) of %'lu operations per worker on "
+			 "bus %d.  Baseline: %s (%u results), threshold %.1f%%.\n\n",
+			 warmupRuns + repeatRuns, warmupRuns, operations, busId,
+			 baselineCount ? baselineName : "none", baselineCount, threshold );
+
+	//
+	// Run every cell of the matrix.
+	//
+	unsigned int regressions = 0;
+	unsigned int failures    = 0;
+	int          first       = 1;
+
+	for ( unsigned int o = 0; o < optionCount; o++ )
+	for ( unsigned int p = 0; p < pools.count; p++ )
+	{
+		char command[8192];
+		(void) snprintf ( command, sizeof(command), "%s -b %d -m %u %s > /dev/null",
+						  createPath, busId, pools.values[p], options[o] );
+		if ( system ( command ) != 0 )
+		{
+			printf ( "Unable to create the segment with [%s].\n", command );
+			failures++;
+			continue;
+		}
+		sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+		if ( sharedMemory == 0 )
+		{
+			failures++;
+			continue;
+		}
+		for ( unsigned int w = 0; w < writers.count; w++ )
+		for ( unsigned int r = 0; r < readers.count; r++ )
+		for ( unsigned int a = 0; a < accesses.count; a++ )
+		for ( unsigned int b = 0; b < batches.count; b++ )
+		{
+			unsigned int writerCount = writers.values[w];
+			unsigned int readerCount = readers.values[r];
+			unsigned int access      = accesses.values[a];
+			unsigned int batch       = batches.values[b];
+			double       writeRates[MAX_RUNS];
+			double       readRates[MAX_RUNS];
+			int          status      = 0;
+
+			for ( unsigned int run = 0; run < warmupRuns + repeatRuns; run++ )
+			{
+				double writeRate;
+				double readRate;
+
+				status |= runOnce ( sharedMemory, shared, writerCount, readerCount,
+									access, batch, &writeRate, &readRate );
+				if ( run >= warmupRuns )
+				{
+					writeRates[run - warmupRuns] = writeRate;
+					readRates[run - warmupRuns]  = readRate;
+				}
+			}
+			if ( status != 0 )
+			{
+				printf ( "A worker failed in cell pool %u, %u writers, %u "
+						 "readers.\n", pools.values[p], writerCount, readerCount );
+				failures++;
+				continue;
+			}
+			char cellName[512];
+			(void) snprintf ( cellName, sizeof(cellName), "pool=%u w=%u r=%u "
+							  "%s batch=%u [%s]", pools.values[p], writerCount,
+							  readerCount, accessNames[access], batch, options[o] );
+
+			benchResult_t result;
+			if ( writerCount > 0 )
+			{
+				summarize ( writeRates, repeatRuns, &result );
+				(void) snprintf ( result.key, sizeof(result.key),
+								  "%u,%u,%u,%s,%u,\"%s\",write", pools.values[p],
+								  writerCount, readerCount, accessNames[access],
+								  batch, options[o] );
+				regressions += report ( &result, csv, json, &first, cellName,
+										"write" );
+			}
+			if ( readerCount > 0 )
+			{
+				summarize ( readRates, repeatRuns, &result );
+				(void) snprintf ( result.key, sizeof(result.key),
+								  "%u,%u,%u,%s,%u,\"%s\",read", pools.values[p],
+								  writerCount, readerCount, accessNames[access],
+								  batch, options[o] );
+				regressions += report ( &result, csv, json, &first, cellName,
+										"read" );
+			}
+			fflush ( stdout );
+		}
+		sharedMemoryClose ( sharedMemory );
+	}
+	fprintf ( json, "\n]\n" );
+	(void) fclose ( csv );
+	(void) fclose ( json );
+
+	printf ( "\nResults written to %s and %s.  %u regressions, %u failures.\n",
+			 csvName, jsonName, regressions, failures );
+
+	return regressions == 0 && failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,139 @@
+//
+//	b u s M e r g e . c
+//
+//  Timestamp ordered k-way merge of the journals of several CAN bus
+//  partitions.  See busMerge.h for a description.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "busMerge.h"
+
+//
+// Open a merge reader on the journals of the specified buses.  Reading
+// starts with the records inserted after this call.  This function will
+// return 0 if the reader was opened and -1 if it was not.
+//
+int busMergeOpen ( busMergeReader_t* reader, const int* buses,
+				   unsigned int busCount, unsigned long maxLag )
+{
+	(void) memset ( reader, 0, sizeof(busMergeReader_t) );
+	reader->maxLag = maxLag;
+
+	if ( busCount == 0 || busCount > SHARED_MEMORY_MAX_BUSES )
+	{
+		printf ( "Invalid number of buses[%u] to merge.\n", busCount );
+		return -1;
+	}
+	for ( unsigned int i = 0; i < busCount; i++ )
+	{
+		busMergePartition_t* partition = &reader->partitions[i];
+
+		partition->bus     = buses[i];
+		partition->segment = sharedMemoryOpenBus ( buses[i] );
+		if ( partition->segment == 0 )
+		{
+			busMergeClose ( reader );
+			return -1;
+		}
+		reader->partitionCount++;
+
+		partition->journal = sharedMemoryGetJournal ( partition->segment );
+		if ( partition->journal == 0 )
+		{
+			printf ( "Shared memory segment for bus %d has no journal.\n",
+					 buses[i] );
+			busMergeClose ( reader );
+			return -1;
+		}
+		partition->cursor  = __atomic_load_n ( &partition->journal->head,
+											   __ATOMIC_ACQUIRE );
+	}
+	return 0;
+}
+
+
+//
+//	b u s M e r g e N e x t
+//
+// Return the next record of the merged stream and the bus it came from.
+//
+// This function will return 1 if a record was returned and 0 if there is
+// no record that can be returned yet.  It never waits.
+//
+int busMergeNext ( busMergeReader_t* reader, journalRecord_t* record,
+				   int* bus )
+{
+	busMergePartition_t* oldest = 0;
+	int                  idle   = 0;
+
+	//
+	// Make sure every partition that has something to read has a pending
+	// record, and find the pending record with the oldest timestamp.
+	//
+	for ( unsigned int i = 0; i < reader->partitionCount; i++ )
+	{
+		busMergePartition_t* partition = &reader->partitions[i];
+
+		while ( ! partition->havePending )
+		{
+			int status = journalRead ( partition->journal, &partition->cursor,
+									   &partition->pending );
+			if ( status > 0 )
+			{
+				partition->havePending = 1;
+			}
+			else if ( status < 0 )
+			{
+				partition->overruns++;
+			}
+			else
+			{
+				break;
+			}
+		}
+		if ( ! partition->havePending )
+		{
+			idle = 1;
+		}
+		else if ( oldest == 0 ||
+				  partition->pending.timestamp < oldest->pending.timestamp )
+		{
+			oldest = partition;
+		}
+	}
+	if ( oldest == 0 )
+	{
+		return 0;
+	}
+	//
+	// If any partition has nothing pending, it could still produce a record
+	// older than the oldest one we have unless it's been long enough.
+	//
+	if ( idle && oldest->pending.timestamp + reader->maxLag > journalTimestamp() )
+	{
+		return 0;
+	}
+	*record = oldest->pending;
+	*bus    = oldest->bus;
+	oldest->havePending = 0;
+
+	return 1;
+}
+
+
+//
+// Close a merge reader.
+//
+void busMergeClose ( busMergeReader_t* reader )
+{
+	for ( unsigned int i = 0; i < reader->partitionCount; i++ )
+	{
+		if ( reader->partitions[i].segment != 0 )
+		{
+			sharedMemoryClose ( reader->partitions[i].segment );
+		}
+	}
+	reader->partitionCount = 0;
+}
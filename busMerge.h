@@ -0,0 +1,58 @@
+#pragma once
+#ifndef BUS_MERGE_H
+#define BUS_MERGE_H
+
+#include "sharedMemory.h"
+
+//
+// The bus merge reader gives a consumer a single, timestamp ordered view of
+// the messages inserted into several CAN bus partitions.
+//
+// Each partition has its own shared memory segment with its own journal and
+// its own writer, so the records in each journal are already in timestamp
+// order.  The merge reader keeps a read cursor in each journal and does a
+// k-way merge of the streams by always returning the pending record with the
+// smallest timestamp.
+//
+// A record can only be returned once we know that no partition can still
+// produce an older one.  That is true if every partition has a pending
+// record, or if the partitions with nothing pending have been idle for at
+// least the configured maximum lag (the longest time between a writer taking
+// a record's timestamp and the record becoming visible in its journal).
+//
+
+typedef struct busMergePartition_t
+{
+	int             bus;
+	sharedMemory_t* segment;
+	journal_t*      journal;
+	unsigned long   cursor;
+	int             havePending;
+	journalRecord_t pending;
+	unsigned long   overruns;
+
+}   busMergePartition_t;
+
+typedef struct busMergeReader_t
+{
+	unsigned int        partitionCount;
+	unsigned long       maxLag;             // nsec
+	busMergePartition_t partitions[SHARED_MEMORY_MAX_BUSES];
+
+}   busMergeReader_t;
+
+//
+// Define the default maximum lag.
+//
+#define BUS_MERGE_DEFAULT_LAG ( 1000 * 1000 )
+
+//
+// Define the bus merge functions.
+//
+int  busMergeOpen  ( busMergeReader_t* reader, const int* buses,
+					 unsigned int busCount, unsigned long maxLag );
+int  busMergeNext  ( busMergeReader_t* reader, journalRecord_t* record,
+					 int* bus );
+void busMergeClose ( busMergeReader_t* reader );
+
+#endif		// End of BUS_MERGE_H
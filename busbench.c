@@ -0,0 +1,216 @@
+//
+//	b u s b e n c h . c
+//
+//  Show that writers on different CAN bus partitions don't interfere with
+//  each other.
+//
+//  The benchmark runs the requested number of writer processes twice.  In
+//  the "shared" run every writer inserts into the partition for bus 0, the
+//  way all of the buses would have to share one message pool and one lock
+//  without partitioning.  In the "partitioned" run writer N inserts into the
+//  partition for bus N.  The insert rate of each writer and the aggregate
+//  rate are reported for both runs.
+//
+//  The partitions for buses 0 through N-1 must have been created first with
+//  "create -b <bus>".
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <locale.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the benchmark parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static unsigned int writerCount     = 4;
+static unsigned int messagesToStore = 10 * 1000 * 1000;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -n    Writers          int          4 \n\
+    -m    Message Count    int     10,000,000 \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Return the current monotonic time in nanoseconds.
+//
+static unsigned long nowNs ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// Run one writer process.  The writer waits for the start pipe to be closed
+// so that all of the writers start together, then inserts its messages into
+// the specified bus partition and stores its elapsed time in the results.
+// The writer uses _exit so that it doesn't flush a copy of the parent's
+// buffered output.
+//
+static void runWriter ( int bus, int startPipe, unsigned long* result )
+{
+	char dummy;
+
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( bus );
+	if ( sharedMemory == 0 )
+	{
+		_exit (255);
+	}
+	unsigned int poolSize = sharedMemoryGetPoolSize ( sharedMemory );
+
+	canMessage_t canMessage;
+	(void) memset ( &canMessage, 0, sizeof(canMessage) );
+
+	(void) read ( startPipe, &dummy, 1 );
+
+	unsigned long startNs = nowNs();
+	for ( unsigned int i = 0; i < messagesToStore; i++ )
+	{
+		canMessage.canMessage.can_id = i % poolSize;
+		(void) insertMessage ( sharedMemory, &canMessage );
+	}
+	*result = nowNs() - startNs;
+
+	_exit (0);
+}
+
+
+//
+// Run all of the writers with either every writer on bus 0 or each writer
+// on its own bus and report the results.
+//
+static void runBenchmark ( const char* name, int partitioned,
+						   unsigned long* results )
+{
+	int startPipe[2];
+
+	if ( pipe ( startPipe ) != 0 )
+	{
+		printf ( "Unable to create the start pipe.\n" );
+		exit (255);
+	}
+	for ( unsigned int i = 0; i < writerCount; i++ )
+	{
+		if ( fork() == 0 )
+		{
+			(void) close ( startPipe[1] );
+			runWriter ( partitioned ? i : 0, startPipe[0], &results[i] );
+		}
+	}
+	(void) close ( startPipe[0] );
+	sleep ( 1 );
+
+	unsigned long startNs = nowNs();
+	(void) close ( startPipe[1] );
+
+	int status;
+	int failed = 0;
+	while ( wait ( &status ) > 0 )
+	{
+		if ( ! WIFEXITED ( status ) || WEXITSTATUS ( status ) != 0 )
+		{
+			failed = 1;
+		}
+	}
+	unsigned long elapsedNs = nowNs() - startNs;
+	if ( failed )
+	{
+		printf ( "A writer failed - have the bus partitions been created?\n" );
+		exit (255);
+	}
+	printf ( "%s:\n", name );
+	for ( unsigned int i = 0; i < writerCount; i++ )
+	{
+		printf ( "  writer %u on bus %u: %'lu records/sec\n", i,
+				 partitioned ? i : 0,
+				 (unsigned long)( messagesToStore / ( results[i] / 1000000000.0 ) ) );
+	}
+	printf ( "  aggregate: %'lu records/sec\n",
+			 (unsigned long)( (double)messagesToStore * writerCount /
+							  ( elapsedNs / 1000000000.0 ) ) );
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "hm:n:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'm':
+		    messagesToStore = atol ( optarg );
+			break;
+
+		  case 'n':
+		    writerCount = atol ( optarg );
+			if ( writerCount <= 0 || writerCount > SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid writer count[%u] specified.\n", writerCount );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	//
+	// The writers report their results through an anonymous shared mapping.
+	//
+	unsigned long* results = mmap ( NULL, SHARED_MEMORY_MAX_BUSES *
+									sizeof(unsigned long),
+									PROT_READ|PROT_WRITE,
+									MAP_SHARED|MAP_ANONYMOUS, -1, 0 );
+	if ( results == MAP_FAILED )
+	{
+		printf ( "Unable to map the results area.\n" );
+		exit (255);
+	}
+	runBenchmark ( "Shared (all writers on bus 0)", 0, results );
+	runBenchmark ( "Partitioned (one writer per bus)", 1, results );
+
+    return 0;
+}
@@ -36,6 +36,17 @@ typedef struct canMessage_t
     //
     canMessageIndex_t nextMessageIndex;
 
+    //
+	// This is the update sequence number of the message.  It is incremented
+	// by the writer before and after the message is changed so it is odd
+	// while an update is in progress.  Readers that don't take the shared
+	// memory lock use it to detect a torn copy and anyone can use it to tell
+	// whether the message has changed since they last looked at it.  It
+	// occupies what was previously alignment padding so it doesn't change the
+	// size of the message.
+    //
+    unsigned int sequence;
+
     //
     // This is the CAN message data itself.
     //
@@ -0,0 +1,183 @@
+//
+//	c h a n g e . c
+//
+//  Change suppression for the writers of the message pool.  See change.h
+//  for a description.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#include "sharedMemorySegment.h"
+#include "change.h"
+
+//
+// Define the bytes of a struct can_frame that are compared: the 4 byte ID,
+// the length and the 8 data bytes.  The 3 padding bytes after the length are
+// never stored in the pool so whatever the caller left in them is ignored.
+//
+#define CHANGE_COMPARE_MASK 0xff1f
+
+
+//
+// Return the number of bytes needed for a change table region.
+//
+unsigned long changeRegionSize ( unsigned int entryCount )
+{
+	return sizeof(changeTable_t) + (unsigned long)entryCount * sizeof(changeEntry_t);
+}
+
+
+//
+// Initialize a change table region.  All of the entries are cleared.
+//
+void changeInitialize ( changeTable_t* table, unsigned int entryCount,
+						int enabled )
+{
+	(void) memset ( table, 0, changeRegionSize ( entryCount ) );
+
+	table->entryCount = entryCount;
+	table->enabled    = enabled != 0;
+}
+
+
+//
+// Turn change suppression on or off.  The writers pick the change up at
+// their next insert.
+//
+void changeEnable ( changeTable_t* table, int enabled )
+{
+	__atomic_store_n ( &table->enabled, enabled != 0, __ATOMIC_RELAXED );
+}
+
+
+//
+// Return true if a frame in the message pool is the same as an incoming
+// frame.  The stored frame is read without the shared memory lock, using its
+// sequence number to detect an update in progress, so this returns false if
+// a writer is in the middle of updating it (the caller then takes the lock
+// and stores the frame as usual).
+//
+int changeUnchanged ( const canMessage_t* stored, const canMessage_t* incoming )
+{
+	unsigned int before = __atomic_load_n ( &stored->sequence, __ATOMIC_ACQUIRE );
+	int          same;
+
+	if ( ( before & 1 ) != 0 )
+	{
+		return 0;
+	}
+#if defined(__SSE2__)
+	__m128i storedFrame   = _mm_loadu_si128 ( (const __m128i*)&stored->canMessage );
+	__m128i incomingFrame = _mm_loadu_si128 ( (const __m128i*)&incoming->canMessage );
+
+	same = ( _mm_movemask_epi8 ( _mm_cmpeq_epi8 ( storedFrame, incomingFrame ) ) &
+			 CHANGE_COMPARE_MASK ) == CHANGE_COMPARE_MASK;
+#else
+	canMessageData_t storedData;
+	canMessageData_t incomingData;
+
+	(void) memcpy ( &storedData, stored->canMessage.data, sizeof(storedData) );
+	(void) memcpy ( &incomingData, incoming->canMessage.data,
+					sizeof(incomingData) );
+
+	same = stored->canMessage.can_id == incoming->canMessage.can_id &&
+		   stored->canMessage.can_dlc == incoming->canMessage.can_dlc &&
+		   storedData == incomingData;
+#endif
+	__atomic_thread_fence ( __ATOMIC_ACQUIRE );
+
+	return same && __atomic_load_n ( &stored->sequence, __ATOMIC_RELAXED ) == before;
+}
+
+
+//
+// Record the arrival of a frame and whether it was stored in the pool.  The
+// intervals are kept the way statsUpdate keeps them.
+//
+void changeSeen ( changeTable_t* table, canMessageIndex_t id, int stored,
+				  unsigned long now )
+{
+	if ( id >= table->entryCount )
+	{
+		return;
+	}
+	changeEntry_t* entry    = &table->entries[id];
+	unsigned long  lastSeen = __atomic_load_n ( &entry->lastSeen, __ATOMIC_RELAXED );
+	unsigned long  seen     = __atomic_load_n ( &entry->seen, __ATOMIC_RELAXED );
+
+	//
+	// The coarse clock can be behind the precise one that the stored frames
+	// are timed with.  Don't let time run backwards.
+	//
+	if ( now < lastSeen )
+	{
+		now = lastSeen;
+	}
+	if ( seen != 0 )
+	{
+		unsigned long interval = now - lastSeen;
+		unsigned long average  = __atomic_load_n ( &entry->averageInterval,
+												   __ATOMIC_RELAXED );
+		if ( seen == 1 )
+		{
+			average = interval;
+		}
+		else
+		{
+			average += ( (long)interval - (long)average ) / STATS_EWMA_WEIGHT;
+		}
+		__atomic_store_n ( &entry->lastInterval, interval, __ATOMIC_RELAXED );
+		__atomic_store_n ( &entry->averageInterval, average, __ATOMIC_RELAXED );
+	}
+	__atomic_store_n ( &entry->lastSeen, now, __ATOMIC_RELAXED );
+	__atomic_store_n ( &entry->seen, seen + 1, __ATOMIC_RELAXED );
+	if ( stored )
+	{
+		__atomic_store_n ( &entry->stored,
+						   __atomic_load_n ( &entry->stored,
+											 __ATOMIC_RELAXED ) + 1,
+						   __ATOMIC_RELAXED );
+	}
+}
+
+
+//
+// Add up the frames seen and stored over all of the IDs in the table.
+//
+void changeTotals ( changeTable_t* table, changeTotals_t* totals )
+{
+	(void) memset ( totals, 0, sizeof(*totals) );
+
+	for ( unsigned int i = 0; i < table->entryCount; i++ )
+	{
+		unsigned long seen = __atomic_load_n ( &table->entries[i].seen,
+											   __ATOMIC_RELAXED );
+		if ( seen != 0 )
+		{
+			totals->seen   += seen;
+			totals->stored += __atomic_load_n ( &table->entries[i].stored,
+												__ATOMIC_RELAXED );
+			totals->ids++;
+		}
+	}
+}
+
+
+//
+// Return the current time in nanoseconds from the coarse monotonic clock.
+//
+unsigned long changeNow ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC_COARSE, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
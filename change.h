@@ -0,0 +1,107 @@
+#pragma once
+#ifndef CHANGE_H
+#define CHANGE_H
+
+#include "canMessage.h"
+
+//
+// The change table is an optional region of the shared memory segment that
+// turns on change suppression for the writers.  Most of the frames on a
+// vehicle bus repeat the payload that the last frame of the same ID carried
+// (a door that stays shut, a gear that stays in drive).  Storing one of these
+// bumps the message's sequence number and rewrites its cache line, so every
+// reader that has the line cached takes a miss on its next read only to
+// find the same data, and the stream ring, journal, mirror and subscribers
+// are all told about an update that changed nothing.
+//
+// With suppression on, insertMessage and insertMessages first compare the
+// 16 bytes of the incoming frame (the ID, the length and the 8 data bytes)
+// with the frame in the pool.  The stored frame is read with the sequence
+// number check that the lock free readers use, so the compare doesn't need
+// the shared memory lock.  If the frames are the same, the insert does
+// nothing to the pool: the lock is not taken, the sequence number is not
+// bumped and nothing is published.  The message's line is only read, so it
+// stays valid in every reader's cache.
+//
+// An insert that finds the frame unchanged is ordered as if it happened at
+// the moment of the compare, when the pool already held the same frame, so
+// a suppressed insert is never lost even with more than one writer per ID.
+//
+// While suppression is on, every insert, suppressed or not, records its
+// arrival time and counts itself in the entry of its ID in this table, which
+// readers of the pool never touch.  The entry gives the number of frames
+// seen and stored for each ID and keeps the last and average interval
+// between them, as the statistics table does for the frames it is given.
+// statsRead takes the count, the intervals, the rate and the timeout from
+// here when this table has the later arrival, so the statistics describe
+// the frames that arrived and not just the ones that changed.
+//
+// Since suppressed frames are not published, the stream ring, the journal
+// and the subscribers only see changes while suppression is on.  A
+// consumer that needs every frame should not be used with it.  Signal group
+// commits are always stored.
+//
+// Suppression can be turned on and off while the segment is in use with
+// changeEnable.  The table is not updated while it is off.
+//
+// All times are CLOCK_MONOTONIC nanoseconds.  The arrival times of the frames
+// that aren't stored are read from the coarse clock (changeNow), which is
+// only as fine as the kernel's tick but costs a fraction of a precise read,
+// and that is plenty for a timeout.  The counts are kept without locked
+// instructions too, so an insert that races with another writer of the same
+// ID can now and then go uncounted.
+//
+
+//
+// Define the arrival record of a single message ID.  Each entry is on its own
+// cache line so the writers of neighbouring IDs don't share one.
+//
+typedef struct changeEntry_t
+{
+	unsigned long lastSeen;
+	unsigned long seen;
+	unsigned long stored;
+	unsigned long lastInterval;
+	unsigned long averageInterval;
+	unsigned long pad[3];
+
+}   changeEntry_t;
+
+//
+// Define the header of the change table region.
+//
+typedef struct changeTable_t
+{
+	unsigned int  entryCount;
+	unsigned int  enabled;
+
+	changeEntry_t entries[0] __attribute__((aligned(64)));
+
+}   changeTable_t;
+
+//
+// Define the totals of the change table that are returned to the readers.
+//
+typedef struct changeTotals_t
+{
+	unsigned long seen;
+	unsigned long stored;
+	unsigned long ids;                      // IDs that were seen at least once
+
+}   changeTotals_t;
+
+//
+// Define the change table functions.
+//
+unsigned long changeRegionSize ( unsigned int entryCount );
+void          changeInitialize ( changeTable_t* table, unsigned int entryCount,
+								 int enabled );
+void          changeEnable     ( changeTable_t* table, int enabled );
+int           changeUnchanged  ( const canMessage_t* stored,
+								 const canMessage_t* incoming );
+void          changeSeen       ( changeTable_t* table, canMessageIndex_t id,
+								 int stored, unsigned long now );
+void          changeTotals     ( changeTable_t* table, changeTotals_t* totals );
+unsigned long changeNow        ( void );
+
+#endif		// End of CHANGE_H
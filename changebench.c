@@ -0,0 +1,507 @@
+//
+//	c h a n g e b e n c h . c
+//
+//  Measure what change suppression (see change.h) saves the writers and the
+//  readers of the message pool.
+//
+//  The program runs the same load twice, first storing every frame and then
+//  with suppression on.  A writer inserts frames for a range of IDs over and
+//  over and changes the payload of a given percentage of them (the rest
+//  repeat the last payload of their ID, as most frames on a real bus do).
+//  Readers read the same IDs with sharedMemoryReadMessage as fast as they
+//  can.
+//
+//  For each run it reports the frames inserted, how many of them were stored
+//  and suppressed, the reads and the reads that found a new sequence number.
+//  A reader that finds a new sequence number had the message's cache line
+//  taken away by the writer, so this is the number of cache misses that the
+//  writer causes the readers.  If the processor's cache miss counter can be
+//  read (perf_event_open), the misses the readers actually took are reported
+//  as well.
+//
+//  The shared memory segment must have been created with a change table
+//  ("create -C").  The suppression setting of the segment is put back the
+//  way it was when the program is done.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <locale.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the largest number of readers.
+//
+#define MAX_READERS 64
+
+//
+// Define the benchmark parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static unsigned int idCount        = 1000;
+static unsigned int changePercent  = 10;
+static unsigned int readers        = 1;
+static unsigned int runSeconds     = 3;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the counters of one process.  Each is on its own cache line.
+//
+typedef struct processCounters_t
+{
+	unsigned long operations;
+	unsigned long changes;
+	unsigned long cacheMisses;
+	int           missesCounted;
+
+}   __attribute__((aligned(64))) processCounters_t;
+
+//
+// Define the results that the children pass back to the parent through an
+// anonymous shared mapping.
+//
+typedef struct benchResults_t
+{
+	volatile int      start;
+	volatile int      stop;
+	processCounters_t writer;
+	processCounters_t readers[MAX_READERS];
+
+}   benchResults_t;
+
+//
+// Define the results of one run.
+//
+typedef struct runResults_t
+{
+	unsigned long frames;
+	unsigned long stored;
+	unsigned long reads;
+	unsigned long newReads;
+	unsigned long cacheMisses;
+	int           missesCounted;
+
+}   runResults_t;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -n    ID Count         int         1,000 \n\
+    -p    Change Percent   int          10 \n\
+    -r    Readers          int           1 \n\
+    -d    Duration (sec)   int           3 \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\
+  Each run lasts -d seconds.  -p percent of the frames carry a new payload\n\
+  and the rest repeat the last payload of their ID.\n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Start counting the cache misses of the calling process.  This returns the
+// counter's file descriptor or -1 if the processor's counters can't be read
+// (in a virtual machine, for instance).
+//
+static int startMissCounter ( void )
+{
+	struct perf_event_attr attributes;
+
+	(void) memset ( &attributes, 0, sizeof(attributes) );
+	attributes.type           = PERF_TYPE_HARDWARE;
+	attributes.size           = sizeof(attributes);
+	attributes.config         = PERF_COUNT_HW_CACHE_MISSES;
+	attributes.disabled       = 1;
+	attributes.exclude_kernel = 1;
+	attributes.exclude_hv     = 1;
+
+	int fd = syscall ( __NR_perf_event_open, &attributes, 0, -1, -1, 0 );
+	if ( fd >= 0 )
+	{
+		(void) ioctl ( fd, PERF_EVENT_IOC_RESET, 0 );
+		(void) ioctl ( fd, PERF_EVENT_IOC_ENABLE, 0 );
+	}
+	return fd;
+}
+
+
+//
+// Run the process that inserts the frames.  The writer keeps a value per ID
+// and adds one to it for the frames that change.
+//
+static void runWriter ( sharedMemory_t* sharedMemory, benchResults_t* results )
+{
+	processCounters_t* counters = &results->writer;
+	unsigned long*     values   = calloc ( idCount, sizeof(unsigned long) );
+	unsigned long      random   = 0x9e3779b97f4a7c15UL;
+	canMessage_t       message;
+
+	if ( values == 0 )
+	{
+		_exit (255);
+	}
+	(void) memset ( &message, 0, sizeof(message) );
+	message.canMessage.can_dlc = CAN_MAX_DLEN;
+
+	while ( ! results->start )
+	{
+		usleep ( 1000 );
+	}
+	while ( ! results->stop )
+	{
+		for ( canMessageIndex_t id = 0; id < idCount; id++ )
+		{
+			random ^= random << 13;
+			random ^= random >> 7;
+			random ^= random << 17;
+
+			if ( random % 100 < changePercent )
+			{
+				values[id]++;
+			}
+			message.canMessage.can_id = id;
+			(void) memcpy ( message.canMessage.data, &values[id],
+							sizeof(values[id]) );
+			(void) insertMessage ( sharedMemory, &message );
+		}
+		counters->operations += idCount;
+	}
+	free ( values );
+	_exit (0);
+}
+
+
+//
+// Run a process that reads the IDs and counts the reads that found a new
+// sequence number.
+//
+static void runReader ( sharedMemory_t* sharedMemory, unsigned int reader,
+						benchResults_t* results )
+{
+	processCounters_t* counters  = &results->readers[reader];
+	unsigned int*      sequences = calloc ( idCount, sizeof(unsigned int) );
+	canMessage_t       message;
+
+	if ( sequences == 0 )
+	{
+		_exit (255);
+	}
+	while ( ! results->start )
+	{
+		usleep ( 1000 );
+	}
+	int missCounter = startMissCounter();
+
+	while ( ! results->stop )
+	{
+		for ( canMessageIndex_t id = 0; id < idCount; id++ )
+		{
+			unsigned int sequence = sharedMemoryReadMessage ( sharedMemory, id,
+															  &message );
+			if ( sequence != sequences[id] )
+			{
+				sequences[id] = sequence;
+				counters->changes++;
+			}
+		}
+		counters->operations += idCount;
+	}
+	if ( missCounter >= 0 )
+	{
+		unsigned long misses = 0;
+
+		if ( read ( missCounter, &misses, sizeof(misses) ) == sizeof(misses) )
+		{
+			counters->cacheMisses   = misses;
+			counters->missesCounted = 1;
+		}
+		(void) close ( missCounter );
+	}
+	free ( sequences );
+	_exit (0);
+}
+
+
+//
+// Run the load once with suppression on or off and return the results.
+//
+static int runOnce ( sharedMemory_t* sharedMemory, changeTable_t* table,
+					 int suppress, runResults_t* run )
+{
+	benchResults_t* results = mmap ( NULL, sizeof(benchResults_t),
+									 PROT_READ|PROT_WRITE,
+									 MAP_SHARED|MAP_ANONYMOUS, -1, 0 );
+	if ( results == MAP_FAILED )
+	{
+		printf ( "Unable to map the results area.\n" );
+		return -1;
+	}
+	changeTotals_t before;
+	changeTotals_t after;
+
+	changeEnable ( table, suppress );
+	changeTotals ( table, &before );
+
+	if ( fork() == 0 )
+	{
+		runWriter ( sharedMemory, results );
+	}
+	for ( unsigned int i = 0; i < readers; i++ )
+	{
+		if ( fork() == 0 )
+		{
+			runReader ( sharedMemory, i, results );
+		}
+	}
+	usleep ( 100 * 1000 );
+	results->start = 1;
+	sleep ( runSeconds );
+	results->stop = 1;
+
+	int failures = 0;
+	int status;
+	while ( wait ( &status ) > 0 )
+	{
+		failures += ! WIFEXITED ( status ) || WEXITSTATUS ( status ) != 0;
+	}
+	changeTotals ( table, &after );
+
+	(void) memset ( run, 0, sizeof(*run) );
+	run->frames        = results->writer.operations;
+	run->stored        = suppress ? after.stored - before.stored : run->frames;
+	run->missesCounted = 1;
+	for ( unsigned int i = 0; i < readers; i++ )
+	{
+		run->reads         += results->readers[i].operations;
+		run->newReads      += results->readers[i].changes;
+		run->cacheMisses   += results->readers[i].cacheMisses;
+		run->missesCounted &= results->readers[i].missesCounted;
+	}
+	(void) munmap ( results, sizeof(benchResults_t) );
+
+	if ( failures != 0 )
+	{
+		printf ( "%d processes failed.\n", failures );
+		return -1;
+	}
+	return 0;
+}
+
+
+//
+// Print the results of one run.
+//
+static void printRun ( const char* title, runResults_t* run )
+{
+	double frames = run->frames != 0 ? run->frames : 1;
+	double reads  = run->reads != 0 ? run->reads : 1;
+
+	printf ( "%s:\n", title );
+	printf ( "  Frames inserted:    %'14lu (%'lu/sec)\n", run->frames,
+			 run->frames / runSeconds );
+	printf ( "  Frames stored:      %'14lu (%.1f%%)\n", run->stored,
+			 run->stored * 100.0 / frames );
+	printf ( "  Frames suppressed:  %'14lu (%.1f%%)\n",
+			 run->frames - run->stored,
+			 ( run->frames - run->stored ) * 100.0 / frames );
+	printf ( "  Reads:              %'14lu (%'lu/sec)\n", run->reads,
+			 run->reads / runSeconds );
+	printf ( "  Lines invalidated:  %'14lu (%.2f%% of reads)\n", run->newReads,
+			 run->newReads * 100.0 / reads );
+	if ( run->missesCounted )
+	{
+		printf ( "  Reader cache misses:%'14lu (%.3f per read)\n",
+				 run->cacheMisses, run->cacheMisses / reads );
+	}
+	else
+	{
+		printf ( "  Reader cache misses:%14s (no hardware counters)\n", "n/a" );
+	}
+}
+
+
+//
+// Parse a count argument.
+//
+static unsigned int countArgument ( const char* argument, unsigned int minimum,
+									unsigned int maximum, const char* name,
+									const char* executable )
+{
+	unsigned int value = atol ( argument );
+
+	if ( value < minimum || value > maximum )
+	{
+		printf ( "Invalid %s[%s] specified - must be %u to %u.\n", name,
+				 argument, minimum, maximum );
+		usage ( executable );
+		exit (255);
+	}
+	return value;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:d:hn:p:r:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'n':
+			idCount = countArgument ( optarg, 1, 0xffffffff, "ID count",
+									  argv[0] );
+			break;
+
+		  case 'p':
+			changePercent = countArgument ( optarg, 0, 100, "change percent",
+											argv[0] );
+			break;
+
+		  case 'r':
+			readers = countArgument ( optarg, 1, MAX_READERS, "reader count",
+									  argv[0] );
+			break;
+
+		  case 'd':
+			runSeconds = countArgument ( optarg, 1, 3600, "duration",
+										 argv[0] );
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( optind != argc )
+	{
+		printf ( "Invalid parameter encountered: %s\n", argv[optind] );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	changeTable_t* table = sharedMemoryGetChangeTable ( sharedMemory );
+	if ( table == 0 )
+	{
+		printf ( "The shared memory segment has no change table - Use "
+				 "\"create -C\" to define one.\n" );
+		exit (255);
+	}
+	if ( idCount > sharedMemoryGetPoolSize ( sharedMemory ) )
+	{
+		printf ( "Invalid ID count[%u] specified - the pool has %u IDs.\n",
+				 idCount, sharedMemoryGetPoolSize ( sharedMemory ) );
+		exit (255);
+	}
+	printf ( "%'u IDs with %u%% of the frames changed, 1 writer and %u "
+			 "readers for %u seconds per run.\n\n", idCount, changePercent,
+			 readers, runSeconds );
+	fflush ( stdout );
+
+	int          enabled = table->enabled;
+	runResults_t every;
+	runResults_t changes;
+	int          status  = runOnce ( sharedMemory, table, 0, &every );
+
+	if ( status == 0 )
+	{
+		status = runOnce ( sharedMemory, table, 1, &changes );
+	}
+	changeEnable ( table, enabled );
+
+	if ( status != 0 )
+	{
+		sharedMemoryClose ( sharedMemory );
+		exit (255);
+	}
+	printRun ( "Store every frame", &every );
+	printf ( "\n" );
+	printRun ( "Store changes only", &changes );
+
+	//
+	// Compare the reader side of the two runs per read and per frame
+	// inserted so the difference in the read and insert rates doesn't hide
+	// it.
+	//
+	double everyReads   = every.reads != 0 ? every.reads : 1;
+	double changesReads = changes.reads != 0 ? changes.reads : 1;
+
+	printf ( "\nSuppression ratio:    %.1f%%\n",
+			 changes.frames != 0 ?
+			 ( changes.frames - changes.stored ) * 100.0 / changes.frames : 0.0 );
+	printf ( "Lines invalidated per 1,000 reads: %.1f -> %.1f\n",
+			 every.newReads * 1000.0 / everyReads,
+			 changes.newReads * 1000.0 / changesReads );
+	printf ( "Lines invalidated per 1,000 frames inserted: %.1f -> %.1f\n",
+			 every.frames != 0 ? every.newReads * 1000.0 / every.frames : 0.0,
+			 changes.frames != 0 ?
+			 changes.newReads * 1000.0 / changes.frames : 0.0 );
+	if ( every.missesCounted && changes.missesCounted )
+	{
+		printf ( "Reader cache misses per 1,000 reads: %.1f -> %.1f\n",
+				 every.cacheMisses * 1000.0 / everyReads,
+				 changes.cacheMisses * 1000.0 / changesReads );
+	}
+	sharedMemoryClose ( sharedMemory );
+
+	return 0;
+}
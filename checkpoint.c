@@ -0,0 +1,210 @@
+//
+//	c h e c k p o i n t . c
+//
+//  Periodically write a checkpoint image of the shared memory segment to
+//  persistent storage.
+//
+//  The image written by this program can be given to the "create" program
+//  with the "--restore" option to bring the shared memory segment back with
+//  all of the messages it contained at the time of the checkpoint.  This
+//  avoids having every consumer see an empty message pool after a restart
+//  until every message ID has been transmitted again.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <locale.h>
+#include <stdbool.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the name of the checkpoint image file.  Note that this default value
+// can be overridden using the "-f" command line option.  This should normally
+// be on a persistent file system rather than the tmpfs that holds the shared
+// memory segment itself.
+//
+static const char* checkpointFileName = "CanSharedMemorySegment.checkpoint";
+
+//
+// Define the number of seconds between checkpoints when running in
+// continuous mode.  Note that this default value can be overridden using the
+// "-i" command line option.
+//
+static unsigned int checkpointInterval = 5;
+
+//
+// Define the flag that causes this function to write checkpoints continuously
+// instead of just once.
+//
+static bool continuousRun = false;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -c    Continuous       bool      false \n\
+    -f    Image File      string  CanSharedMemorySegment.checkpoint \n\
+    -i    Interval (sec)   int         5 \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:cf:hi:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  //
+		  // Get the continuous run option flag if present.
+		  //
+		  case 'c':
+			printf ( "Checkpoints will be written continuously. <ctrl-c> to "
+			         "quit...\n" );
+		    continuousRun = true;
+			break;
+
+		  //
+		  // Get the name of the checkpoint image file.
+		  //
+		  case 'f':
+			checkpointFileName = optarg;
+			break;
+
+		  //
+		  // Get the checkpoint interval and validate it.
+		  //
+		  case 'i':
+		    checkpointInterval = atol ( optarg );
+			if ( checkpointInterval <= 0 )
+			{
+				printf ( "Invalid checkpoint interval[%u] specified.\n",
+						 checkpointInterval );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+    //
+	// If the user supplied any arguments other than the ones above, they are
+	// not valid arguments so complain and quit.
+    //
+	argc -= optind;
+
+    if ( argc != 0 )
+    {
+        printf ( "Invalid parameters[s] encountered: %s\n", argv[argc] );
+        usage ( argv[0] );
+        exit (255);
+    }
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	unsigned int sharedMemorySize = sharedMemoryGetSegmentSize ( sharedMemory );
+
+	//
+	// Define the performance spec variables.
+	//
+	struct timespec startTime;
+	struct timespec stopTime;
+    unsigned long   diffTimeNs;
+
+	//
+	// Repeat the following at least once...
+	//
+	// Note that if "continuous" mode has been selected, this loop will run
+	// forever.  The user will need to kill it manually from the command line.
+	//
+	do
+	{
+		clock_gettime(CLOCK_MONOTONIC, &startTime);
+		if ( sharedMemoryCheckpoint ( sharedMemory, checkpointFileName ) != 0 )
+		{
+			printf ( "Unable to write checkpoint image[%s]\n",
+					 checkpointFileName );
+		}
+		else
+		{
+			clock_gettime(CLOCK_MONOTONIC, &stopTime);
+			diffTimeNs = ( stopTime.tv_sec - startTime.tv_sec ) * 1000000000 +
+						 stopTime.tv_nsec - startTime.tv_nsec;
+
+			printf ( "Checkpoint of %'u bytes written to %s in %'lu usec.\n",
+					 sharedMemorySize, checkpointFileName, diffTimeNs / 1000 );
+		}
+		if ( continuousRun )
+		{
+			sleep ( checkpointInterval );
+		}
+
+	}   while ( continuousRun );
+	//
+	// Close our shared memory segment and exit.
+	//
+	sharedMemoryClose ( sharedMemory );
+
+	//
+	// Return a good completion code to the caller.
+	//
+    return 0;
+}
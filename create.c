@@ -8,8 +8,10 @@
 #include <errno.h>
 #include <sys/mman.h>
 #include <locale.h>
+#include <getopt.h>
+#include <stdbool.h>
 
-#include "sharedMemory.h"
+#include "sharedMemorySegment.h"
 
 //
 // This set of files is intended to demonstrate the feasibility of using a
@@ -109,6 +111,181 @@
 //
 static unsigned int totalSharedMemoryMessages = 1000 * 1000;
 
+//
+// Define the CAN bus whose partition is being created.  If this is not
+// specified with the "-b" option, the original unpartitioned segment is
+// created.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the name of the shared memory segment being created.
+//
+static char segmentName[4096];
+
+//
+// Define the address of the shared memory segment being created and its
+// size.  The size is the size of the shared memory structure plus the size of
+// the CAN message pool plus the sizes of any optional regions.
+//
+static sharedMemory_t* sharedMemory;
+static unsigned int    sharedMemorySize;
+
+//
+// Define the name of the checkpoint image to restore the shared memory
+// segment from.  If this is not specified with the "-R" or "--restore"
+// option, a new empty segment is created.
+//
+static const char* restoreFileName = 0;
+
+//
+// Define the geometry of the optional journal region.  The journal is only
+// created if the number of chunks is specified with the "-j" option.  Both
+// values must be powers of 2.
+//
+static unsigned int journalChunkCount   = 0;
+static unsigned int journalChunkRecords = JOURNAL_DEFAULT_CHUNK_RECORDS;
+
+//
+// Define the size of the optional delivery table.  The table is only created
+// if the number of consumers is specified with the "-d" option.
+//
+static unsigned int deliveryConsumers     = 0;
+static unsigned int deliverySubscriptions = DELIVERY_DEFAULT_SUBSCRIPTIONS;
+
+//
+// Define the configuration of the optional statistics table.  The table is
+// only created if the "-s" option is given.  The payload field whose range is
+// tracked is given with the "-F" option and the timeout with the "-T" option
+// (0 selects the adaptive timeout).
+//
+static bool          statsEnabled     = false;
+static unsigned int  statsFieldOffset = 0;
+static unsigned int  statsFieldSize   = 1;
+static int           statsFieldSigned = 0;
+static unsigned long statsTimeoutMs   = 0;
+
+//
+// Define the number of subscriber slots in the optional notification table.
+// The table is only created if this is specified with the "-n" option.
+//
+static unsigned int notifySubscribers = 0;
+
+//
+// Define the configuration of the optional stream ring.  The ring is only
+// created if the number of frames is specified with the "-r" option.  The
+// number of consumer slots is given with the "-c" option and the overrun
+// policy with the "-o" option.
+//
+static unsigned int   streamFrames    = 0;
+static unsigned int   streamConsumers = 8;
+static streamPolicy_t streamPolicy    = STREAM_BLOCK;
+
+//
+// Define whether the optional mirror map is created.  The map is only
+// created if the "-M" option is given.
+//
+static bool mirrorEnabled = false;
+
+//
+// Define the signal groups of the optional group table.  The table is only
+// created if at least one group is given with the "-g" option.  The member
+// IDs of all of the groups are kept one group after another.
+//
+static unsigned int      groupCount = 0;
+static unsigned int      groupMemberCounts[GROUP_MAX_GROUPS];
+static unsigned int      groupMemberTotal = 0;
+static canMessageIndex_t groupMemberIds[GROUP_MAX_GROUPS * GROUP_MAX_MEMBERS];
+
+//
+// Define the configuration of the optional flight recorder.  The recorder is
+// only created if the number of process rings is given with the "-f"
+// option.  The samples per ring are given with "-S", the sampling rate
+// (one operation in N) with "-e" and the threshold over which every
+// operation is recorded with "-l".
+//
+static unsigned int  recorderRings       = 0;
+static unsigned int  recorderRingSamples = 4096;
+static unsigned int  recorderSampleEvery = 1024;
+static unsigned long recorderThresholdUs = 0;
+
+//
+// Define the derived signals of the optional derived signal table.  The
+// table is only created if a definition file is given with the "-x" option.
+//
+static const char*     derivedFileName   = 0;
+static int             derivedCount      = 0;
+static unsigned int    derivedInputCount = 0;
+static derivedSignal_t derivedSignalList[DERIVED_MAX_SIGNALS];
+static derivedInput_t  derivedInputList[DERIVED_MAX_SIGNALS * DERIVED_MAX_INPUTS];
+
+//
+// Define the signals and tiers of the optional rollup table.  The table is
+// only created if a definition file is given with the "-u" option, and it
+// needs the stream ring to feed it.
+//
+static const char*    rollupFileName  = 0;
+static int            rollupCount     = 0;
+static unsigned int   rollupTierCount = 0;
+static rollupSignal_t rollupSignalList[ROLLUP_MAX_SIGNALS];
+static rollupTier_t   rollupTierList[ROLLUP_MAX_TIERS];
+
+//
+// Define whether the optional change table is created.  The table is only
+// created, with change suppression turned on, if the "-C" option is given.
+//
+static bool changeEnabled = false;
+
+//
+// Define whether the optional heat map is created.  The map is only created
+// if the "-H" option is given.  It has a shard of counters for each CPU that
+// is configured on the machine.
+//
+static bool         heatEnabled = false;
+static unsigned int heatShards  = 1;
+
+//
+// Define the number of hot slots in the optional placement map.  The map is
+// only created if the "-p" option is given.
+//
+static unsigned int placementSlots = 0;
+
+//
+// Define the size of the optional trigger table.  The table is only created
+// if the "-t" option is given.  Each consumer has an event queue of
+// triggerQueueEvents events.
+//
+static unsigned int triggerSlots       = 0;
+static unsigned int triggerQueueEvents = 1024;
+
+//
+// Define the offsets of the optional regions in the segment being created.
+//
+static unsigned int journalOffset  = 0;
+static unsigned int deliveryOffset = 0;
+static unsigned int statsOffset    = 0;
+static unsigned int notifyOffset   = 0;
+static unsigned int streamOffset   = 0;
+static unsigned int mirrorOffset   = 0;
+static unsigned int groupOffset    = 0;
+static unsigned int recorderOffset = 0;
+static unsigned int derivedOffset  = 0;
+static unsigned int rollupOffset   = 0;
+static unsigned int changeOffset   = 0;
+static unsigned int heatOffset     = 0;
+static unsigned int placementOffset = 0;
+static unsigned int triggerOffset  = 0;
+
+//
+// Define the long versions of the command line options.
+//
+static struct option longOptions[] =
+{
+	{ "restore", required_argument, 0, 'R' },
+	{ "help",    no_argument,       0, 'h' },
+	{ 0,         0,                 0,  0  }
+};
+
 //
 // Define the usage message function.
 //
@@ -120,10 +297,385 @@ Usage: %s options\n\
   Option     Meaning      Type     Default \n\
   ======  =============  ======  =========== \n\
     -m    Message Count   int     1,000,000 \n\
+    -b    CAN Bus         int       None \n\
+    -j    Journal Chunks  int         0 \n\
+    -J    Chunk Records   int       16,384 \n\
+    -d    Consumers       int         0 \n\
+    -D    Subscriptions   int        256 \n\
+    -s    Statistics      bool      false \n\
+    -F    Stats Field    string      0:1 \n\
+    -T    Timeout (msec)  int     Adaptive \n\
+    -n    Notify Slots    int         0 \n\
+    -r    Stream Frames   int         0 \n\
+    -c    Stream Readers  int         8 \n\
+    -o    Overrun Policy string     block \n\
+    -M    Mirror Map      bool      false \n\
+    -g    Signal Group   string     None \n\
+    -f    Recorder Rings  int         0 \n\
+    -S    Ring Samples    int       4,096 \n\
+    -e    Sample Every    int       1,024 \n\
+    -l    Slow (usec)     int        None \n\
+    -x    Derived Signals string     None \n\
+    -u    Rollups        string     None \n\
+    -C    Change Only     bool      false \n\
+    -H    Heat Map        bool      false \n\
+    -p    Hot Slots       int         0 \n\
+    -t    Trigger Slots   int         0 \n\
+    -k    Queue Events    int       1,024 \n\
+    -R    Restore Image  string     None \n\
     -h    Help Message    N/A        N/A \n\
     -?    Help Message    N/A        N/A \n\
+\n\
+  --restore <file> is the same as -R <file>.  When restoring, the message\n\
+  count is taken from the checkpoint image and -m is ignored.\n\
+\n\
+  The statistics field is given as <byte offset>:<size>[:s] where the size\n\
+  is 1, 2, 4 or 8 bytes and :s makes it a signed field.\n\
+\n\
+  The stream ring frame count must be a power of 2.  The overrun policy is\n\
+  \"block\" (the writers wait for the slowest reader) or \"drop\" (a slow\n\
+  reader skips ahead and is flagged as lagged).\n\
+\n\
+  Each -g option defines one signal group as a list of message IDs and ID\n\
+  ranges (e.g. -g 0x100-0x103).  The groups are numbered from 0 in the\n\
+  order they are given.\n\
+\n\
+  The flight recorder has one ring per process (-f) of -S samples, which\n\
+  must be a power of 2.  It records one operation in -e (0 for none) and\n\
+  every operation that takes longer than -l microseconds.\n\
+\n\
+  -x is a file of derived signal definitions, one per line:\n\
+      <output ID> <function> <input>...\n\
+  where an input is <ID>:<offset>:<size>[:s][*<scale>] or the ID of another\n\
+  derived signal and the function is avg, sum, min, max, diff, ratio or\n\
+  lowpass=<msec>.\n\
+\n\
+  -u is a file of rollup tiers and signals, one per line:\n\
+      tier <resolution> <intervals>\n\
+      <ID>:<offset>:<size>[:s][*<scale>] or <derived signal ID>\n\
+  The rollups are fed from the stream ring so -r must also be given.\n\
+\n\
+  -C stores a frame only if it differs from the one in the pool.  The\n\
+  stream ring, journal and subscribers then only see the changes.\n\
+\n\
+  -p creates a placement map with that many hot slots, into which the\n\
+  \"placed\" program packs the busiest IDs.  It needs the heat map (-H).\n\
+\n\
+  -t creates a trigger table with that many trigger slots, shared by up to\n\
+  %u consumers, each with an event queue of -k events (a power of 2).\n\
 \n\n\
-", executable );
+", executable, TRIGGER_MAX_CONSUMERS );
+}
+
+
+//
+// Initialize the shared memory lock.
+//
+// This is done both when a new segment is created and when a segment is
+// restored from a checkpoint image since the mutex in the image may have been
+// captured in the locked state.
+//
+static void initializeLock ( sharedMemory_t* sharedMemory )
+{
+	int status;
+
+	//
+	// Initialize the mutex attributes structure.
+	//
+	status =  pthread_mutexattr_init ( &sharedMemory->mutexAttributes );
+	if ( status != 0 )
+	{
+		printf ( "Unable to initialize mutex attributes - errno: %u[%s].\n",
+				 status, strerror(status) );
+		exit (255);
+	}
+	//
+	// Set this mutex to be a process shared mutex.
+	//
+	status = pthread_mutexattr_setpshared ( &sharedMemory->mutexAttributes,
+											PTHREAD_PROCESS_SHARED );
+	if ( status != 0 )
+	{
+		printf ( "Unable to set shared mutex attributes - errno: %u[%s].\n",
+				 status, strerror(status) );
+		exit (255);
+	}
+	//
+	// Initialize the mutex itself.
+	//
+	status = pthread_mutex_init ( &sharedMemory->lock,
+								  &sharedMemory->mutexAttributes );
+	if ( status != 0 )
+	{
+		printf ( "Unable to initialize shared mutex - errno: %u[%s].\n",
+				 status, strerror(status) );
+		exit (255);
+	}
+}
+
+
+//
+// Parse a count that must be a power of 2.
+//
+static unsigned int powerOfTwoArgument ( const char* argument,
+										 const char* name,
+										 const char* executable )
+{
+	unsigned int value = atol ( argument );
+	if ( value == 0 || ( value & ( value - 1 ) ) != 0 )
+	{
+		printf ( "Invalid %s[%s] specified - must be a power of 2.\n",
+				 name, argument );
+		usage ( executable );
+		exit (255);
+	}
+	return value;
+}
+
+
+//
+// Reserve space for an optional region at the end of the shared memory
+// segment and return its offset from the start of the segment.  Regions are
+// aligned to a cache line boundary.
+//
+static unsigned int allocateRegion ( unsigned long regionSize )
+{
+	unsigned long offset = ( sharedMemorySize + 63UL ) & ~63UL;
+
+	if ( offset + regionSize > 0xffffffffUL )
+	{
+		printf ( "The requested shared memory segment is too large.\n" );
+		exit (255);
+	}
+	sharedMemorySize = offset + regionSize;
+
+	return offset;
+}
+
+
+//
+// Reset the run time state of the optional regions in a segment that has just
+// been restored from a checkpoint image.  The configuration of each region is
+// kept but anything that describes the activity of the processes that were
+// using the segment when the image was taken is discarded.
+//
+static void resetRegions ( sharedMemory_t* sharedMemory )
+{
+	if ( sharedMemory->journalOffset != 0 )
+	{
+		journal_t* journal = SHARED_MEMORY_REGION ( sharedMemory,
+													sharedMemory->journalOffset );
+
+		journalInitialize ( journal, journal->chunkCount,
+							journal->chunkRecords );
+	}
+	if ( sharedMemory->deliveryOffset != 0 )
+	{
+		deliveryTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+														sharedMemory->deliveryOffset );
+
+		deliveryInitialize ( table, table->maxConsumers,
+							 table->maxSubscriptions );
+	}
+	if ( sharedMemory->statsOffset != 0 )
+	{
+		statsTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+													 sharedMemory->statsOffset );
+
+		statsInitialize ( table, table->entryCount, table->fieldOffset,
+						  table->fieldSize, table->fieldSigned, table->timeout );
+	}
+	if ( sharedMemory->notifyOffset != 0 )
+	{
+		notifyTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+													  sharedMemory->notifyOffset );
+
+		notifyInitialize ( table, table->maxSubscribers, table->messageCount );
+	}
+	if ( sharedMemory->streamOffset != 0 )
+	{
+		streamRing_t* ring = SHARED_MEMORY_REGION ( sharedMemory,
+													sharedMemory->streamOffset );
+
+		streamInitialize ( ring, ring->capacity, ring->maxConsumers,
+						   ring->policy );
+	}
+	//
+	// Mark every message in the mirror map as changed so the mirror sends
+	// the whole restored pool.
+	//
+	if ( sharedMemory->mirrorOffset != 0 )
+	{
+		mirrorMap_t* map = SHARED_MEMORY_REGION ( sharedMemory,
+												  sharedMemory->mirrorOffset );
+
+		mirrorInitialize ( map, map->messageCount );
+		mirrorMarkAll ( map );
+	}
+	//
+	// The flight recorder keeps its settings but the samples of the processes
+	// that were running when the image was taken are discarded.
+	//
+	if ( sharedMemory->recorderOffset != 0 )
+	{
+		recorderTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+														sharedMemory->recorderOffset );
+		unsigned int  sampleEvery = table->sampleEvery;
+		unsigned long thresholdNs = table->thresholdTicks * 1e9 /
+									table->ticksPerSecond;
+
+		recorderInitialize ( table, table->ringCount, table->ringSamples,
+							 sampleEvery, thresholdNs );
+	}
+	//
+	// The derived signals keep their last values but they are all marked
+	// dirty so they are computed again from the restored inputs.  Nobody is
+	// waiting for them yet.
+	//
+	if ( sharedMemory->derivedOffset != 0 )
+	{
+		derivedTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+													   sharedMemory->derivedOffset );
+
+		table->waiting = 0;
+		for ( unsigned int i = 0; i < table->signalCount; i++ )
+		{
+			table->signals[i].dirty = 1;
+		}
+	}
+	//
+	// The rollups keep their history, which is in wall clock time, but the
+	// aggregator that was feeding them is gone.
+	//
+	if ( sharedMemory->rollupOffset != 0 )
+	{
+		rollupTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+													  sharedMemory->rollupOffset );
+
+		table->aggregator = 0;
+	}
+	//
+	// The change table keeps its setting but the arrival times in the image
+	// are from another run of the monotonic clock so they are cleared.
+	//
+	if ( sharedMemory->changeOffset != 0 )
+	{
+		changeTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+													  sharedMemory->changeOffset );
+
+		changeInitialize ( table, table->entryCount, table->enabled );
+	}
+	//
+	// The heat map is cleared since the readers in it are from before the
+	// image was taken.
+	//
+	if ( sharedMemory->heatOffset != 0 )
+	{
+		heatTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+													sharedMemory->heatOffset );
+
+		heatInitialize ( table, table->messageCount, table->shardCount );
+	}
+	//
+	// The placement map keeps the IDs that were in the hot slots, since the
+	// frames are there, but the optimizer is gone.  The image may have been
+	// taken in the middle of a move, or of a write, so the slots are checked.
+	//
+	if ( sharedMemory->placementOffset != 0 )
+	{
+		placementMap_t* map = SHARED_MEMORY_REGION ( sharedMemory,
+													 sharedMemory->placementOffset );
+
+		map->optimizer = 0;
+		map->repair    = 0;
+		placementRepair ( map, sharedMemory->messagePoolBase );
+	}
+	//
+	// The trigger table is cleared since its consumers are from before the
+	// image was taken.  They register their triggers again when they attach.
+	//
+	if ( sharedMemory->triggerOffset != 0 )
+	{
+		triggerTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+													   sharedMemory->triggerOffset );
+
+		triggerInitialize ( table, table->triggerCount, table->messageCount,
+							table->queueEvents );
+	}
+	//
+	// The group table is kept as it is.  Groups are committed with the
+	// shared memory lock held and the checkpoint copies the whole table with
+	// one acquisition of the lock, so every group in the image is a complete
+	// commit.
+	//
+}
+
+
+//
+// Restore the shared memory segment from a checkpoint image.
+//
+// The image is mapped read only, its header is validated and then the whole
+// thing is copied into the shared memory segment in one operation.  None of
+// the message pool initialization is repeated so the consumers see the last
+// known value of every message as soon as this returns.
+//
+static void restoreSegment ( int fd )
+{
+	int imageFd = open ( restoreFileName, O_RDONLY );
+	if ( imageFd < 0 )
+	{
+		printf ( "Unable to open checkpoint image[%s] errno: %u[%s].\n",
+				 restoreFileName, errno, strerror(errno) );
+		exit (255);
+	}
+	struct stat stats;
+	if ( fstat ( imageFd, &stats ) != 0 )
+	{
+		printf ( "Unable to get the size of checkpoint image[%s] errno: "
+				 "%u[%s].\n", restoreFileName, errno, strerror(errno) );
+		exit (255);
+	}
+	sharedMemory_t* image = mmap ( NULL, stats.st_size, PROT_READ,
+								   MAP_PRIVATE, imageFd, 0 );
+	(void) close ( imageFd );
+	if ( image == MAP_FAILED )
+	{
+		printf ( "Unable to map checkpoint image[%s] errno: %u[%s].\n",
+				 restoreFileName, errno, strerror(errno) );
+		exit (255);
+	}
+	if ( sharedMemoryValidate ( image, stats.st_size ) != 0 )
+	{
+		printf ( "Checkpoint image[%s] is not valid - Aborting\n",
+				 restoreFileName );
+		exit (255);
+	}
+	sharedMemorySize = image->totalSharedMemorySize;
+
+	printf ( "Restoring %'u messages from checkpoint image[%s]...\n",
+			 image->totalMessageCount, restoreFileName );
+
+	if ( ftruncate ( fd, sharedMemorySize ) != 0 )
+	{
+		printf ( "Unable to resize the shared memory segment to [%u] bytes - "
+				 "errno: %u[%s].\n", sharedMemorySize, errno, strerror(errno) );
+		exit (255);
+	}
+	sharedMemory = mmap ( NULL, sharedMemorySize, PROT_READ|PROT_WRITE,
+						  MAP_SHARED, fd, 0 );
+	if ( sharedMemory == MAP_FAILED )
+	{
+		printf ( "Unable to map shared memory segment. errno: %u[%s].\n",
+				 errno, strerror(errno) );
+		exit (255);
+	}
+	(void) memcpy ( sharedMemory, image, sharedMemorySize );
+	(void) munmap ( image, stats.st_size );
+
+	sharedMemory->busId = busId;
+
+	initializeLock ( sharedMemory );
+	resetRegions ( sharedMemory );
 }
 
 
@@ -143,7 +695,8 @@ int main ( int argc, char* const argv[] )
 	int status;
 	char ch;
 
-    while ( ( ch = getopt ( argc, argv, "hm:?" ) ) != -1 )
+    while ( ( ch = getopt_long ( argc, argv, "b:c:Cd:D:e:f:F:g:hHj:J:k:l:m:Mn:o:p:r:R:sS:t:T:u:x:?", longOptions,
+								 NULL ) ) != -1 )
     {
 		//
 		// Depending on the current command line option...
@@ -164,6 +717,251 @@ int main ( int argc, char* const argv[] )
 			}
 			break;
 
+		  //
+		  // Get the journal geometry.
+		  //
+		  case 'j':
+			journalChunkCount = powerOfTwoArgument ( optarg, "journal chunk "
+													 "count", argv[0] );
+			break;
+
+		  case 'J':
+			journalChunkRecords = powerOfTwoArgument ( optarg, "journal chunk "
+													   "record count", argv[0] );
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  //
+		  // Get the delivery table size.
+		  //
+		  case 'd':
+		    deliveryConsumers = atol ( optarg );
+			break;
+
+		  case 'D':
+		    deliverySubscriptions = atol ( optarg );
+			if ( deliverySubscriptions <= 0 )
+			{
+				printf ( "Invalid subscription count[%u] specified.\n",
+						 deliverySubscriptions );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  //
+		  // Get the statistics table configuration.
+		  //
+		  case 's':
+			statsEnabled = true;
+			break;
+
+		  case 'F':
+			if ( statsParseField ( optarg, &statsFieldOffset, &statsFieldSize,
+								   &statsFieldSigned ) != 0 )
+			{
+				printf ( "Invalid statistics field[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'T':
+		    statsTimeoutMs = atol ( optarg );
+			break;
+
+		  //
+		  // Get the number of notification subscriber slots.
+		  //
+		  case 'n':
+		    notifySubscribers = atol ( optarg );
+			if ( notifySubscribers <= 0 ||
+				 notifySubscribers > NOTIFY_MAX_SUBSCRIBERS )
+			{
+				printf ( "Invalid notification slot count[%u] specified - must "
+						 "be 1 to %u.\n", notifySubscribers,
+						 NOTIFY_MAX_SUBSCRIBERS );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  //
+		  // Get the stream ring configuration.
+		  //
+		  case 'r':
+			streamFrames = powerOfTwoArgument ( optarg, "stream ring frame "
+												"count", argv[0] );
+			break;
+
+		  case 'c':
+		    streamConsumers = atol ( optarg );
+			if ( streamConsumers <= 0 || streamConsumers > STREAM_MAX_CONSUMERS )
+			{
+				printf ( "Invalid stream reader count[%u] specified - must be "
+						 "1 to %u.\n", streamConsumers, STREAM_MAX_CONSUMERS );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'o':
+			if ( strcmp ( optarg, "block" ) == 0 )
+			{
+				streamPolicy = STREAM_BLOCK;
+			}
+			else if ( strcmp ( optarg, "drop" ) == 0 )
+			{
+				streamPolicy = STREAM_DROP;
+			}
+			else
+			{
+				printf ( "Invalid overrun policy[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  //
+		  // Get the mirror map option.
+		  //
+		  case 'M':
+			mirrorEnabled = true;
+			break;
+
+		  //
+		  // Get the change suppression option.
+		  //
+		  case 'C':
+			changeEnabled = true;
+			break;
+
+		  //
+		  // Get the heat map option.
+		  //
+		  case 'H':
+			heatEnabled = true;
+			break;
+
+		  //
+		  // Get the number of hot slots in the placement map.
+		  //
+		  case 'p':
+		    placementSlots = atol ( optarg );
+			if ( placementSlots < 1 || placementSlots > PLACEMENT_MAX_SLOTS )
+			{
+				printf ( "Invalid hot slot count[%s] specified - must be 1 to "
+						 "%'u.\n", optarg, PLACEMENT_MAX_SLOTS );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  //
+		  // Get the trigger table configuration.
+		  //
+		  case 't':
+		    triggerSlots = atol ( optarg );
+			if ( triggerSlots < 1 || triggerSlots > TRIGGER_MAX_TRIGGERS )
+			{
+				printf ( "Invalid trigger slot count[%s] specified - must be 1 "
+						 "to %'u.\n", optarg, TRIGGER_MAX_TRIGGERS );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'k':
+			triggerQueueEvents = powerOfTwoArgument ( optarg, "trigger queue "
+													  "event count", argv[0] );
+			break;
+
+		  //
+		  // Get the member IDs of a signal group.
+		  //
+		  case 'g':
+		  {
+			if ( groupCount == GROUP_MAX_GROUPS )
+			{
+				printf ( "Too many signal groups specified - the limit is "
+						 "%u.\n", GROUP_MAX_GROUPS );
+				exit (255);
+			}
+			int count = parseMessageIdList ( optarg,
+											 &groupMemberIds[groupMemberTotal],
+											 GROUP_MAX_MEMBERS );
+			if ( count <= 0 )
+			{
+				printf ( "Invalid signal group[%s] specified - it must have 1 "
+						 "to %u IDs.\n", optarg, GROUP_MAX_MEMBERS );
+				usage ( argv[0] );
+				exit (255);
+			}
+			groupMemberCounts[groupCount++] = count;
+			groupMemberTotal += count;
+			break;
+		  }
+
+		  //
+		  // Get the flight recorder configuration.
+		  //
+		  case 'f':
+		    recorderRings = atol ( optarg );
+			if ( recorderRings <= 0 )
+			{
+				printf ( "Invalid recorder ring count[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'S':
+			recorderRingSamples = powerOfTwoArgument ( optarg, "recorder ring "
+													   "sample count", argv[0] );
+			break;
+
+		  case 'e':
+		    recorderSampleEvery = atol ( optarg );
+			break;
+
+		  case 'l':
+		    recorderThresholdUs = atol ( optarg );
+			break;
+
+		  //
+		  // Get the name of the derived signal definition file.  It is read
+		  // once all of the options are known.
+		  //
+		  case 'x':
+			derivedFileName = optarg;
+			break;
+
+		  //
+		  // Get the name of the rollup definition file.
+		  //
+		  case 'u':
+			rollupFileName = optarg;
+			break;
+
+		  //
+		  // Get the name of the checkpoint image to restore from.
+		  //
+		  case 'R':
+			restoreFileName = optarg;
+			break;
+
           case 'h':
           case '?':
           default:
@@ -183,6 +981,71 @@ int main ( int argc, char* const argv[] )
         usage ( argv[0] );
         exit (255);
     }
+	//
+	// Make sure every signal group member is in the message pool.
+	//
+	for ( unsigned int i = 0; i < groupMemberTotal; i++ )
+	{
+		if ( groupMemberIds[i] >= totalSharedMemoryMessages )
+		{
+			printf ( "Signal group member 0x%x is outside the message pool.\n",
+					 groupMemberIds[i] );
+			exit (255);
+		}
+	}
+	//
+	// Read the derived signal definitions.
+	//
+	if ( derivedFileName != 0 && restoreFileName == 0 )
+	{
+		derivedCount = derivedLoad ( derivedFileName, totalSharedMemoryMessages,
+									 derivedSignalList, derivedInputList,
+									 &derivedInputCount );
+		if ( derivedCount <= 0 )
+		{
+			printf ( "No derived signals were loaded from[%s] - Aborting\n",
+					 derivedFileName );
+			exit (255);
+		}
+	}
+	//
+	// Read the rollup definitions.
+	//
+	if ( rollupFileName != 0 && restoreFileName == 0 )
+	{
+		if ( streamFrames == 0 )
+		{
+			printf ( "The rollups are fed from the stream ring - Use \"-r\" "
+					 "to create one.\n" );
+			exit (255);
+		}
+		rollupCount = rollupLoad ( rollupFileName, totalSharedMemoryMessages,
+								   rollupSignalList, rollupTierList,
+								   &rollupTierCount );
+		if ( rollupCount <= 0 )
+		{
+			printf ( "No rollup signals were loaded from[%s] - Aborting\n",
+					 rollupFileName );
+			exit (255);
+		}
+	}
+	//
+	// The placement map is only filled in from the heat map and can't hold
+	// more IDs than there are.
+	//
+	if ( placementSlots != 0 && restoreFileName == 0 )
+	{
+		if ( ! heatEnabled )
+		{
+			printf ( "The placement map is filled in from the heat map - Use "
+					 "\"-H\" to create one.\n" );
+			exit (255);
+		}
+		if ( placementSlots > totalSharedMemoryMessages )
+		{
+			placementSlots = totalSharedMemoryMessages;
+		}
+	}
 	//
 	// Compute the sizes of the buffer pool and the entire shared memory
 	// segment.
@@ -190,15 +1053,94 @@ int main ( int argc, char* const argv[] )
 	unsigned int bufferPoolSize = totalSharedMemoryMessages * sizeof(canMessage_t);
 	sharedMemorySize = sizeof(sharedMemory_t) + bufferPoolSize;
 
+	//
+	// Add the optional regions that were requested to the end of the
+	// segment.
+	//
+	if ( journalChunkCount != 0 )
+	{
+		journalOffset = allocateRegion ( journalRegionSize ( journalChunkCount,
+															 journalChunkRecords ) );
+	}
+	if ( deliveryConsumers != 0 )
+	{
+		deliveryOffset = allocateRegion ( deliveryRegionSize ( deliveryConsumers,
+															   deliverySubscriptions ) );
+	}
+	if ( statsEnabled )
+	{
+		statsOffset = allocateRegion ( statsRegionSize ( totalSharedMemoryMessages ) );
+	}
+	if ( notifySubscribers != 0 )
+	{
+		notifyOffset = allocateRegion ( notifyRegionSize ( totalSharedMemoryMessages ) );
+	}
+	if ( streamFrames != 0 )
+	{
+		streamOffset = allocateRegion ( streamRegionSize ( streamFrames ) );
+	}
+	if ( mirrorEnabled )
+	{
+		mirrorOffset = allocateRegion ( mirrorRegionSize ( totalSharedMemoryMessages ) );
+	}
+	if ( groupCount != 0 )
+	{
+		groupOffset = allocateRegion ( groupRegionSize ( groupCount,
+														 groupMemberTotal ) );
+	}
+	if ( recorderRings != 0 )
+	{
+		recorderOffset = allocateRegion ( recorderRegionSize ( recorderRings,
+															   recorderRingSamples ) );
+	}
+	if ( derivedCount != 0 )
+	{
+		derivedOffset = allocateRegion ( derivedRegionSize ( derivedCount,
+															 derivedInputCount,
+															 totalSharedMemoryMessages ) );
+	}
+	if ( rollupCount != 0 )
+	{
+		rollupOffset = allocateRegion ( rollupRegionSize ( rollupCount,
+														   rollupTierList,
+														   rollupTierCount,
+														   totalSharedMemoryMessages ) );
+	}
+
+	if ( changeEnabled )
+	{
+		changeOffset = allocateRegion ( changeRegionSize ( totalSharedMemoryMessages ) );
+	}
+	if ( heatEnabled )
+	{
+		long cpus = sysconf ( _SC_NPROCESSORS_CONF );
+
+		heatShards = cpus > 0 ? cpus : 1;
+		heatOffset = allocateRegion ( heatRegionSize ( totalSharedMemoryMessages,
+													   heatShards ) );
+	}
+	if ( placementSlots != 0 )
+	{
+		placementOffset = allocateRegion ( placementRegionSize ( placementSlots ) );
+	}
+	if ( triggerSlots != 0 )
+	{
+		triggerOffset = allocateRegion ( triggerRegionSize ( triggerSlots,
+															 totalSharedMemoryMessages,
+															 triggerQueueEvents ) );
+	}
+
 	//
 	// Open the shared memory file.
 	//
+	sharedMemoryPartitionName ( busId, segmentName, sizeof(segmentName) );
+
 	int fd = 0;
-	fd = open ( sharedMemoryName, O_RDWR|O_CREAT, 0666);
+	fd = open ( segmentName, O_RDWR|O_CREAT, 0666);
 	if (fd <= 0)
 	{
 		printf ( "Unable to open shared memory segment[%s] errno: %u[%s].\n",
-				 sharedMemoryName, errno, strerror(errno) );
+				 segmentName, errno, strerror(errno) );
 		exit (255);
 	}
     //
@@ -209,10 +1151,21 @@ int main ( int argc, char* const argv[] )
     if ( status == -1 )
     {
         printf ( "Unable to get the size of the shared memory segment[%s] "
-		         "errno: %u[%s].\n", sharedMemoryName, errno, strerror(errno) );
+		         "errno: %u[%s].\n", segmentName, errno, strerror(errno) );
         (void) close ( fd );
         exit (255);
     }
+	//
+	// If we are restoring from a checkpoint image, do that instead of
+	// initializing a new segment.
+	//
+	if ( restoreFileName != 0 )
+	{
+		restoreSegment ( fd );
+		(void) close ( fd );
+		(void) munmap ( sharedMemory, sharedMemorySize );
+		return 0;
+	}
     //
     // Initialize the shared memory segment.
     //
@@ -228,7 +1181,7 @@ int main ( int argc, char* const argv[] )
         printf ( "Shared memory segment[%s]\n"
 		         "    already exists with size %'lu\n"
 				 "    It will be destroyed and recreated with size %'u\n",
-		         sharedMemoryName, stats.st_size, sharedMemorySize );
+		         segmentName, stats.st_size, sharedMemorySize );
 	}
 	//
 	// Make the pseudo-file for the shared memory segment the size of the
@@ -260,20 +1213,42 @@ int main ( int argc, char* const argv[] )
 	//
 	// Initialize the data fields in the shared memory segment.
 	//
+	sharedMemory->magic       = SHARED_MEMORY_MAGIC;
+	sharedMemory->version     = SHARED_MEMORY_VERSION;
+	sharedMemory->headerSize  = sizeof(sharedMemory_t);
+	sharedMemory->messageSize = sizeof(canMessage_t);
+
 	sharedMemory->totalMessageCount     = totalSharedMemoryMessages;
 	sharedMemory->totalSharedMemorySize = sharedMemorySize;
+	sharedMemory->busId                 = busId;
 
 	sharedMemory->freeListCount = totalSharedMemoryMessages;
 	sharedMemory->freeListHead  = 0;
 	sharedMemory->freeListTail  = totalSharedMemoryMessages - 1;
 
+	sharedMemory->journalOffset  = journalOffset;
+	sharedMemory->deliveryOffset = deliveryOffset;
+	sharedMemory->statsOffset    = statsOffset;
+	sharedMemory->notifyOffset   = notifyOffset;
+	sharedMemory->streamOffset   = streamOffset;
+	sharedMemory->mirrorOffset   = mirrorOffset;
+	sharedMemory->groupOffset    = groupOffset;
+	sharedMemory->recorderOffset = recorderOffset;
+	sharedMemory->derivedOffset  = derivedOffset;
+	sharedMemory->rollupOffset   = rollupOffset;
+	sharedMemory->changeOffset   = changeOffset;
+	sharedMemory->heatOffset     = heatOffset;
+	sharedMemory->placementOffset = placementOffset;
+	sharedMemory->triggerOffset  = triggerOffset;
+
 	//
 	// Initialize the message buffers.
 	//
 	// Note that this should not be necessary because the mmap call above
 	// should zero all of the allocated memory but...
 	//
-	(void) memset ( sharedMemory->messagePoolBase, 0, sharedMemory->totalSharedMemorySize );
+	(void) memset ( sharedMemory->messagePoolBase, 0,
+					bufferPoolSize );
 
 	//
 	// Initialize the list of available CAN message buffers to include the
@@ -292,37 +1267,116 @@ int main ( int argc, char* const argv[] )
 	//
 	// Initialize the mutex object.
 	//
-	// Initialize the mutex attributes structure.
+	initializeLock ( sharedMemory );
+
 	//
-	status =  pthread_mutexattr_init ( &sharedMemory->mutexAttributes );
-	if ( status != 0 )
+	// Initialize the optional regions.
+	//
+	if ( journalOffset != 0 )
 	{
-		printf ( "Unable to initialize mutex attributes - errno: %u[%s].\n",
-				 status, strerror(status) );
-		exit (255);
+		journalInitialize ( SHARED_MEMORY_REGION ( sharedMemory, journalOffset ),
+							journalChunkCount, journalChunkRecords );
+		printf ( "Journal of %'u chunks of %'u records created.\n",
+				 journalChunkCount, journalChunkRecords );
 	}
-	//
-	// Set this mutex to be a process shared mutex.
-	//
-	status = pthread_mutexattr_setpshared ( &sharedMemory->mutexAttributes,
-											PTHREAD_PROCESS_SHARED );
-	if ( status != 0 )
+	if ( deliveryOffset != 0 )
 	{
-		printf ( "Unable to set shared mutex attributes - errno: %u[%s].\n",
-				 status, strerror(status) );
-		exit (255);
+		deliveryInitialize ( SHARED_MEMORY_REGION ( sharedMemory, deliveryOffset ),
+							 deliveryConsumers, deliverySubscriptions );
+		printf ( "Delivery table for %'u consumers of %'u subscriptions "
+				 "created.\n", deliveryConsumers, deliverySubscriptions );
 	}
-	//
-	// Initialize the mutex itself.
-	//
-	status = pthread_mutex_init ( &sharedMemory->lock,
-								  &sharedMemory->mutexAttributes );
-	if ( status != 0 )
+	if ( statsOffset != 0 )
 	{
-		printf ( "Unable to initialize shared mutex - errno: %u[%s].\n",
-				 status, strerror(status) );
-		exit (255);
+		statsInitialize ( SHARED_MEMORY_REGION ( sharedMemory, statsOffset ),
+						  totalSharedMemoryMessages, statsFieldOffset,
+						  statsFieldSize, statsFieldSigned,
+						  statsTimeoutMs * 1000000UL );
+		printf ( "Statistics table for %'u messages created.\n",
+				 totalSharedMemoryMessages );
+	}
+	if ( notifyOffset != 0 )
+	{
+		notifyInitialize ( SHARED_MEMORY_REGION ( sharedMemory, notifyOffset ),
+						   notifySubscribers, totalSharedMemoryMessages );
+		printf ( "Notification table for %'u subscribers created.\n",
+				 notifySubscribers );
 	}
+	if ( streamOffset != 0 )
+	{
+		streamInitialize ( SHARED_MEMORY_REGION ( sharedMemory, streamOffset ),
+						   streamFrames, streamConsumers, streamPolicy );
+		printf ( "Stream ring of %'u frames for %'u readers created (%s on "
+				 "overrun).\n", streamFrames, streamConsumers,
+				 streamPolicy == STREAM_BLOCK ? "block" : "drop" );
+	}
+	if ( mirrorOffset != 0 )
+	{
+		mirrorInitialize ( SHARED_MEMORY_REGION ( sharedMemory, mirrorOffset ),
+						   totalSharedMemoryMessages );
+		printf ( "Mirror map for %'u messages created.\n",
+				 totalSharedMemoryMessages );
+	}
+	if ( groupOffset != 0 )
+	{
+		groupInitialize ( SHARED_MEMORY_REGION ( sharedMemory, groupOffset ),
+						  groupCount, groupMemberCounts, groupMemberIds );
+		printf ( "Group table of %'u signal groups (%'u IDs) created.\n",
+				 groupCount, groupMemberTotal );
+	}
+	if ( recorderOffset != 0 )
+	{
+		recorderInitialize ( SHARED_MEMORY_REGION ( sharedMemory, recorderOffset ),
+							 recorderRings, recorderRingSamples,
+							 recorderSampleEvery, recorderThresholdUs * 1000 );
+		printf ( "Flight recorder of %'u rings of %'u samples created.\n",
+				 recorderRings, recorderRingSamples );
+	}
+	if ( derivedOffset != 0 )
+	{
+		derivedInitialize ( SHARED_MEMORY_REGION ( sharedMemory, derivedOffset ),
+							derivedSignalList, derivedCount, derivedInputList,
+							derivedInputCount, totalSharedMemoryMessages );
+		printf ( "Derived signal table of %'d signals (%'u inputs) created.\n",
+				 derivedCount, derivedInputCount );
+	}
+	if ( rollupOffset != 0 )
+	{
+		rollupInitialize ( SHARED_MEMORY_REGION ( sharedMemory, rollupOffset ),
+						   rollupSignalList, rollupCount, rollupTierList,
+						   rollupTierCount, totalSharedMemoryMessages );
+		printf ( "Rollup table of %'d signals in %u tiers created.\n",
+				 rollupCount, rollupTierCount );
+	}
+	if ( changeOffset != 0 )
+	{
+		changeInitialize ( SHARED_MEMORY_REGION ( sharedMemory, changeOffset ),
+						   totalSharedMemoryMessages, 1 );
+		printf ( "Change table for %'u messages created (suppression on).\n",
+				 totalSharedMemoryMessages );
+	}
+	if ( heatOffset != 0 )
+	{
+		heatInitialize ( SHARED_MEMORY_REGION ( sharedMemory, heatOffset ),
+						 totalSharedMemoryMessages, heatShards );
+		printf ( "Heat map for %'u messages in %u CPU shards created.\n",
+				 totalSharedMemoryMessages, heatShards );
+	}
+	if ( placementOffset != 0 )
+	{
+		placementInitialize ( SHARED_MEMORY_REGION ( sharedMemory, placementOffset ),
+							  placementSlots, totalSharedMemoryMessages );
+		printf ( "Placement map of %'u hot slots created.\n", placementSlots );
+	}
+	if ( triggerOffset != 0 )
+	{
+		triggerInitialize ( SHARED_MEMORY_REGION ( sharedMemory, triggerOffset ),
+							triggerSlots, totalSharedMemoryMessages,
+							triggerQueueEvents );
+		printf ( "Trigger table of %'u triggers created (%'u event queue).\n",
+				 triggerSlots, triggerQueueEvents );
+	}
+
 	//
 	// Initialize all of the data records in the shared memory message pool.
 	//
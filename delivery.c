@@ -0,0 +1,273 @@
+//
+//	d e l i v e r y . c
+//
+//  Per consumer rate limited and coalescing delivery of messages from the
+//  message pool.  See delivery.h for a description of the policies.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <time.h>
+
+#include "sharedMemorySegment.h"
+#include "delivery.h"
+
+//
+// Return the address of a consumer slot in the delivery table.  The slots
+// are variable length since they hold the subscriptions.
+//
+static inline deliveryConsumer_t* consumerSlot ( deliveryTable_t* table,
+												 unsigned int index )
+{
+	return (deliveryConsumer_t*)( (char*)table->consumers +
+								  (unsigned long)index * table->consumerSize );
+}
+
+
+//
+// Return the number of bytes in each consumer slot.
+//
+static unsigned int consumerSize ( unsigned int maxSubscriptions )
+{
+	unsigned long size = sizeof(deliveryConsumer_t) +
+						 maxSubscriptions * sizeof(deliverySubscription_t);
+
+	return ( size + 63 ) & ~63UL;
+}
+
+
+//
+// Return the number of bytes needed for a delivery table region.
+//
+unsigned long deliveryRegionSize ( unsigned int maxConsumers,
+								   unsigned int maxSubscriptions )
+{
+	return sizeof(deliveryTable_t) +
+		   (unsigned long)maxConsumers * consumerSize ( maxSubscriptions );
+}
+
+
+//
+// Initialize a delivery table region.  All of the consumer slots are freed.
+//
+void deliveryInitialize ( deliveryTable_t* table, unsigned int maxConsumers,
+						  unsigned int maxSubscriptions )
+{
+	(void) memset ( table, 0, deliveryRegionSize ( maxConsumers,
+												   maxSubscriptions ) );
+
+	table->maxConsumers     = maxConsumers;
+	table->maxSubscriptions = maxSubscriptions;
+	table->consumerSize     = consumerSize ( maxSubscriptions );
+}
+
+
+//
+// Return the current time in nanoseconds.
+//
+unsigned long deliveryNow ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// Sleep until the specified time.
+//
+void deliveryWait ( unsigned long until )
+{
+	struct timespec wakeup = { until / 1000000000UL, until % 1000000000UL };
+
+	while ( clock_nanosleep ( CLOCK_MONOTONIC, TIMER_ABSTIME, &wakeup,
+							  NULL ) == EINTR )
+	{
+	}
+}
+
+
+//
+// Attach the calling process to a free consumer slot.  A slot that belongs
+// to a process that no longer exists is considered free.  This function will
+// return the consumer slot or 0 if the table is full.
+//
+deliveryConsumer_t* deliveryAttach ( deliveryTable_t* table )
+{
+	pid_t self = getpid();
+
+	for ( unsigned int i = 0; i < table->maxConsumers; i++ )
+	{
+		deliveryConsumer_t* consumer = consumerSlot ( table, i );
+		pid_t               owner    = __atomic_load_n ( &consumer->pid,
+														 __ATOMIC_ACQUIRE );
+
+		if ( owner != 0 && ( kill ( owner, 0 ) == 0 || errno != ESRCH ) )
+		{
+			continue;
+		}
+		if ( __atomic_compare_exchange_n ( &consumer->pid, &owner, self, 0,
+										   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) )
+		{
+			consumer->subscriptionCount = 0;
+			consumer->polls             = 0;
+			consumer->evaluations       = 0;
+			consumer->deliveries        = 0;
+			return consumer;
+		}
+	}
+	return 0;
+}
+
+
+//
+// Give up a consumer slot.
+//
+void deliveryDetach ( deliveryConsumer_t* consumer )
+{
+	__atomic_store_n ( &consumer->pid, 0, __ATOMIC_RELEASE );
+}
+
+
+//
+// Add a subscription to a consumer.  The subscription is due immediately so
+// the current value of the message will be delivered by the next poll.  This
+// function will return 0 if the subscription was added and -1 if it was not.
+//
+int deliverySubscribe ( sharedMemory_t* sharedMemory,
+						deliveryConsumer_t* consumer, canMessageIndex_t id,
+						deliveryPolicy_t policy, unsigned long interval )
+{
+	deliveryTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+													sharedMemory->deliveryOffset );
+
+	if ( id >= sharedMemory->totalMessageCount )
+	{
+		printf ( "Message ID[%u] is outside of the message pool.\n", id );
+		return -1;
+	}
+	if ( policy < DELIVERY_COALESCE || policy > DELIVERY_PERIODIC ||
+		 interval == 0 )
+	{
+		printf ( "Invalid delivery policy[%u] or interval[%lu].\n", policy,
+				 interval );
+		return -1;
+	}
+	if ( consumer->subscriptionCount >= table->maxSubscriptions )
+	{
+		printf ( "No more subscriptions available for this consumer.\n" );
+		return -1;
+	}
+	deliverySubscription_t* subscription =
+		&consumer->subscriptions[consumer->subscriptionCount];
+
+	(void) memset ( subscription, 0, sizeof(deliverySubscription_t) );
+	subscription->id       = id;
+	subscription->policy   = policy;
+	subscription->interval = interval;
+	subscription->nextDue  = deliveryNow();
+
+	consumer->subscriptionCount++;
+
+	return 0;
+}
+
+
+//
+//	d e l i v e r y P o l l
+//
+// Evaluate the subscriptions of a consumer that are due and copy the
+// messages that should be delivered into the caller's array.
+//
+// The messages are read from the message pool without taking the shared
+// memory lock.  The time at which the next subscription becomes due is
+// returned in nextDue so the caller can sleep until then (see deliveryWait).
+// If there were more messages to deliver than would fit in the caller's
+// array, nextDue is the current time.
+//
+// This function returns the number of messages delivered.
+//
+int deliveryPoll ( sharedMemory_t* sharedMemory, deliveryConsumer_t* consumer,
+				   canMessage_t* messages, unsigned int maxMessages,
+				   unsigned long* nextDue )
+{
+	unsigned long now      = deliveryNow();
+	unsigned long earliest = ~0UL;
+	unsigned int  count    = 0;
+
+	consumer->polls++;
+
+	for ( unsigned int i = 0; i < consumer->subscriptionCount; i++ )
+	{
+		deliverySubscription_t* subscription = &consumer->subscriptions[i];
+
+		if ( subscription->nextDue > now )
+		{
+			if ( subscription->nextDue < earliest )
+			{
+				earliest = subscription->nextDue;
+			}
+			continue;
+		}
+		if ( count == maxMessages )
+		{
+			earliest = now;
+			break;
+		}
+		consumer->evaluations++;
+
+		canMessage_t* current  = &messages[count];
+		unsigned int  sequence = sharedMemoryReadMessage ( sharedMemory,
+														   subscription->id,
+														   current );
+		int deliver = ! subscription->delivered;
+
+		switch ( subscription->policy )
+		{
+		  case DELIVERY_COALESCE:
+			deliver |= sequence != subscription->lastSequence;
+			subscription->nextDue = now + subscription->interval;
+			break;
+
+		  case DELIVERY_ON_CHANGE:
+			deliver |= sequence != subscription->lastSequence &&
+					   ( current->canMessage.can_dlc != subscription->lastDlc ||
+						 memcmp ( current->canMessage.data,
+								  subscription->lastData, CAN_MAX_DLEN ) != 0 );
+			subscription->nextDue = now + subscription->interval;
+			break;
+
+		  case DELIVERY_PERIODIC:
+			deliver = 1;
+			subscription->nextDue += subscription->interval;
+			if ( subscription->nextDue <= now )
+			{
+				subscription->nextDue = now + subscription->interval;
+			}
+			break;
+		}
+		subscription->lastSequence = sequence;
+
+		if ( deliver )
+		{
+			subscription->delivered = 1;
+			subscription->lastDlc   = current->canMessage.can_dlc;
+			(void) memcpy ( subscription->lastData, current->canMessage.data,
+							CAN_MAX_DLEN );
+			count++;
+		}
+		if ( subscription->nextDue < earliest )
+		{
+			earliest = subscription->nextDue;
+		}
+	}
+	consumer->deliveries += count;
+	*nextDue = earliest;
+
+	return count;
+}
@@ -0,0 +1,125 @@
+#pragma once
+#ifndef DELIVERY_H
+#define DELIVERY_H
+
+#include <sys/types.h>
+
+#include "canMessage.h"
+
+//
+// The delivery table is an optional region of the shared memory segment that
+// holds the delivery policies of the consumers of the message pool.  Many
+// consumers (cluster displays, telemetry uploaders, etc.) only want each
+// signal at some modest rate but polling with fetchMessage forces them to
+// wake up at the bus rate to find out whether anything has changed.
+//
+// Instead, a consumer attaches to a slot in the delivery table and subscribes
+// to each message ID it is interested in with one of the following policies:
+//
+//     DELIVERY_COALESCE  - Deliver the latest value of the message at most
+//                          once per interval and only if it has been updated
+//                          since the last delivery.
+//
+//     DELIVERY_ON_CHANGE - Deliver the message only when its length or data
+//                          differs from the last value delivered, checking at
+//                          most once per interval.
+//
+//     DELIVERY_PERIODIC  - Deliver the current value of the message once per
+//                          interval whether it has changed or not.
+//
+// The policies are evaluated lazily when the consumer polls.  Nothing is
+// added to the write path other than the message sequence number that every
+// insert already maintains.  Each poll also returns the time at which the
+// next subscription becomes due so the consumer can sleep until then rather
+// than waking at the bus rate.
+//
+// All times are CLOCK_MONOTONIC nanoseconds.
+//
+
+typedef enum deliveryPolicy_t
+{
+	DELIVERY_COALESCE  = 1,
+	DELIVERY_ON_CHANGE = 2,
+	DELIVERY_PERIODIC  = 3,
+
+}   deliveryPolicy_t;
+
+//
+// Define the state of a single subscription.
+//
+typedef struct deliverySubscription_t
+{
+	canMessageIndex_t id;
+	unsigned int      policy;
+	unsigned long     interval;
+	unsigned long     nextDue;
+	unsigned int      lastSequence;
+	unsigned char     lastDlc;
+	unsigned char     delivered;            // Anything delivered yet?
+	unsigned char     pad[2];
+	unsigned char     lastData[CAN_MAX_DLEN];
+
+}   deliverySubscription_t;
+
+//
+// Define the state of a consumer.  Each consumer is on its own cache lines so
+// the consumers don't interfere with each other.
+//
+typedef struct deliveryConsumer_t
+{
+	pid_t         pid;                      // 0 if the slot is free
+	unsigned int  subscriptionCount;
+
+	unsigned long polls;
+	unsigned long evaluations;
+	unsigned long deliveries;
+
+	deliverySubscription_t subscriptions[0] __attribute__((aligned(8)));
+
+}   __attribute__((aligned(64))) deliveryConsumer_t;
+
+//
+// Define the header of the delivery table region.
+//
+typedef struct deliveryTable_t
+{
+	unsigned int maxConsumers;
+	unsigned int maxSubscriptions;
+	unsigned int consumerSize;              // Bytes per consumer slot
+
+	deliveryConsumer_t consumers[0];
+
+}   deliveryTable_t;
+
+//
+// Define the default size of the delivery table.
+//
+#define DELIVERY_DEFAULT_SUBSCRIPTIONS 256
+
+//
+// Define the delivery functions.  The ones that evaluate subscriptions need
+// the shared memory segment to find the message pool.
+//
+struct sharedMemory_t;
+
+unsigned long       deliveryRegionSize  ( unsigned int maxConsumers,
+										  unsigned int maxSubscriptions );
+void                deliveryInitialize  ( deliveryTable_t* table,
+										  unsigned int maxConsumers,
+										  unsigned int maxSubscriptions );
+deliveryConsumer_t* deliveryAttach      ( deliveryTable_t* table );
+void                deliveryDetach      ( deliveryConsumer_t* consumer );
+int                 deliverySubscribe   ( struct sharedMemory_t* sharedMemory,
+										  deliveryConsumer_t* consumer,
+										  canMessageIndex_t id,
+										  deliveryPolicy_t policy,
+										  unsigned long interval );
+int                 deliveryPoll        ( struct sharedMemory_t* sharedMemory,
+										  deliveryConsumer_t* consumer,
+										  canMessage_t* messages,
+										  unsigned int maxMessages,
+										  unsigned long* nextDue );
+void                deliveryWait        ( unsigned long until );
+unsigned long       deliveryNow         ( void );
+
+#endif		// End of DELIVERY_H
@@ -0,0 +1,832 @@
+//
+//	d e r i v e d . c
+//
+//  Derived signals that are computed from other messages and stored back in
+//  the message pool.  See derived.h for a description.
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "sharedMemorySegment.h"
+#include "derived.h"
+
+//
+// Return the address of the arrays that follow the signals in a table.
+//
+#define DERIVED_INPUTS(table) \
+	( (derivedInput_t*)( (table)->signals + (table)->signalCount ) )
+#define DERIVED_EDGES(table) \
+	( (derivedEdge_t*)( (char*)(table) + (table)->edgesOffset ) )
+#define DERIVED_OUTPUTS(table) \
+	( (derivedEdge_t*)( (char*)(table) + (table)->outputsOffset ) )
+#define DERIVED_MAP(table,offset) \
+	( (unsigned long*)( (char*)(table) + (offset) ) )
+
+//
+// Define the names of the functions.
+//
+static const char* functionNames[] =
+{
+	"?", "avg", "sum", "min", "max", "diff", "ratio", "lowpass"
+};
+
+//
+// Return the name of a function.
+//
+const char* derivedFunctionName ( unsigned int function )
+{
+	return function <= DERIVED_LOWPASS ? functionNames[function] : "?";
+}
+
+
+//
+// Return the value of a derived signal from the message that holds it.
+//
+double derivedMessageValue ( const canMessage_t* message )
+{
+	double value;
+
+	(void) memcpy ( &value, message->canMessage.data, sizeof(value) );
+
+	return value;
+}
+
+
+//
+// Return the index of the signal whose output is the given ID in a list of
+// signals or -1 if there isn't one.
+//
+static int findSignal ( const derivedSignal_t* signals, unsigned int signalCount,
+						canMessageIndex_t id )
+{
+	for ( unsigned int i = 0; i < signalCount; i++ )
+	{
+		if ( signals[i].output == id )
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+
+//
+//	d e r i v e d P a r s e I n p u t
+//
+// Parse the input of a signal, either "<ID>" for the value of a derived signal
+// or "<ID>:<offset>:<size>[:s]" for a field of a message, followed by an
+// optional "*<scale>".  The token is modified.
+//
+// This function returns 0 if the input is valid and -1 if it is not.
+//
+int derivedParseInput ( char* token, derivedInput_t* input )
+{
+	(void) memset ( input, 0, sizeof(*input) );
+	input->scale = 1.0;
+
+	char* scale = strchr ( token, '*' );
+	if ( scale != 0 )
+	{
+		char* end;
+
+		*scale++     = 0;
+		input->scale = strtod ( scale, &end );
+		if ( end == scale || *end != 0 )
+		{
+			return -1;
+		}
+	}
+	char*         end;
+	unsigned long id = strtoul ( token, &end, 0 );
+	if ( end == token || ( *end != 0 && *end != ':' ) )
+	{
+		return -1;
+	}
+	input->id = id;
+
+	if ( *end == ':' )
+	{
+		unsigned int offset;
+		unsigned int size;
+		int          isSigned;
+
+		if ( statsParseField ( end + 1, &offset, &size, &isSigned ) != 0 )
+		{
+			return -1;
+		}
+		input->offset   = offset;
+		input->size     = size;
+		input->isSigned = isSigned;
+	}
+	return 0;
+}
+
+
+//
+// Sort the signals so that every signal comes after the signals it uses.
+//
+// This function returns 0 if the signals were sorted and -1 if they depend on
+// each other in a loop.
+//
+static int sortSignals ( derivedSignal_t* signals, unsigned int signalCount,
+						 const derivedInput_t* inputs )
+{
+	derivedSignal_t sorted[DERIVED_MAX_SIGNALS];
+	unsigned char   placed[DERIVED_MAX_SIGNALS] = { 0 };
+	unsigned int    count = 0;
+
+	while ( count < signalCount )
+	{
+		unsigned int before = count;
+
+		for ( unsigned int i = 0; i < signalCount; i++ )
+		{
+			if ( placed[i] )
+			{
+				continue;
+			}
+			int ready = 1;
+			for ( unsigned int j = 0; j < signals[i].inputCount; j++ )
+			{
+				int used = findSignal ( signals, signalCount,
+										inputs[signals[i].firstInput + j].id );
+				if ( used >= 0 && ! placed[used] )
+				{
+					ready = 0;
+				}
+			}
+			if ( ready )
+			{
+				sorted[count++] = signals[i];
+				placed[i] = 1;
+			}
+		}
+		if ( count == before )
+		{
+			return -1;
+		}
+	}
+	(void) memcpy ( signals, sorted, signalCount * sizeof(derivedSignal_t) );
+
+	return 0;
+}
+
+
+//
+//	d e r i v e d L o a d
+//
+// Read the derived signal definitions from a file (see derived.h) into the
+// caller's arrays, which must have room for DERIVED_MAX_SIGNALS signals and
+// DERIVED_MAX_SIGNALS * DERIVED_MAX_INPUTS inputs.  The signals are checked
+// against the size of the message pool and sorted into dependency order.
+//
+// This function returns the number of signals or -1 if the file could not be
+// read or has an error in it.
+//
+int derivedLoad ( const char* fileName, unsigned int messageCount,
+				  derivedSignal_t* signals, derivedInput_t* inputs,
+				  unsigned int* inputCount )
+{
+	FILE* file = fopen ( fileName, "r" );
+	if ( file == 0 )
+	{
+		printf ( "Unable to open derived signal file[%s] errno: %u[%s].\n",
+				 fileName, errno, strerror(errno) );
+		return -1;
+	}
+	char         line[1024];
+	unsigned int lineNumber  = 0;
+	unsigned int signalCount = 0;
+	int          status      = 0;
+
+	*inputCount = 0;
+
+	while ( status == 0 && fgets ( line, sizeof(line), file ) != 0 )
+	{
+		lineNumber++;
+
+		char* comment = strchr ( line, '#' );
+		if ( comment != 0 )
+		{
+			*comment = 0;
+		}
+		char* save;
+		char* token = strtok_r ( line, " \t\r\n", &save );
+		if ( token == 0 )
+		{
+			continue;
+		}
+		if ( signalCount == DERIVED_MAX_SIGNALS )
+		{
+			printf ( "Too many derived signals - the limit is %u.\n",
+					 DERIVED_MAX_SIGNALS );
+			status = -1;
+			break;
+		}
+		derivedSignal_t* signal = &signals[signalCount];
+		(void) memset ( signal, 0, sizeof(*signal) );
+
+		//
+		// Get the output ID and the function.
+		//
+		char* end;
+		signal->output = strtoul ( token, &end, 0 );
+		if ( end == token || *end != 0 || signal->output >= messageCount ||
+			 findSignal ( signals, signalCount, signal->output ) >= 0 )
+		{
+			printf ( "Invalid or duplicate output ID[%s].\n", token );
+			status = -1;
+			break;
+		}
+		token = strtok_r ( 0, " \t\r\n", &save );
+		if ( token == 0 )
+		{
+			status = -1;
+			break;
+		}
+		if ( strncmp ( token, "lowpass=", 8 ) == 0 )
+		{
+			signal->function  = DERIVED_LOWPASS;
+			signal->parameter = strtod ( token + 8, &end ) * 1e6;
+			if ( *end != 0 || signal->parameter <= 0 )
+			{
+				status = -1;
+				break;
+			}
+		}
+		else
+		{
+			for ( unsigned int i = DERIVED_AVG; i < DERIVED_LOWPASS; i++ )
+			{
+				if ( strcmp ( token, functionNames[i] ) == 0 )
+				{
+					signal->function = i;
+				}
+			}
+			if ( signal->function == 0 )
+			{
+				printf ( "Unknown derived signal function[%s].\n", token );
+				status = -1;
+				break;
+			}
+		}
+		//
+		// Get the inputs.
+		//
+		signal->firstInput = *inputCount;
+
+		while ( ( token = strtok_r ( 0, " \t\r\n", &save ) ) != 0 )
+		{
+			derivedInput_t* input = &inputs[*inputCount];
+
+			if ( signal->inputCount == DERIVED_MAX_INPUTS ||
+				 derivedParseInput ( token, input ) != 0 ||
+				 input->id >= messageCount )
+			{
+				printf ( "Invalid derived signal input[%s].\n", token );
+				status = -1;
+				break;
+			}
+			signal->inputCount++;
+			(*inputCount)++;
+		}
+		if ( status != 0 )
+		{
+			break;
+		}
+		unsigned int wanted = signal->function == DERIVED_LOWPASS ? 1 :
+							  signal->function == DERIVED_DIFF ||
+							  signal->function == DERIVED_RATIO ? 2 : 0;
+		if ( signal->inputCount == 0 ||
+			 ( wanted != 0 && signal->inputCount != wanted ) )
+		{
+			printf ( "Wrong number of inputs for %s.\n",
+					 derivedFunctionName ( signal->function ) );
+			status = -1;
+			break;
+		}
+		signalCount++;
+	}
+	(void) fclose ( file );
+
+	if ( status != 0 )
+	{
+		printf ( "Derived signal file[%s] has an error on line %u.\n",
+				 fileName, lineNumber );
+		return -1;
+	}
+	//
+	// An input without a field must be another derived signal.
+	//
+	for ( unsigned int i = 0; i < *inputCount; i++ )
+	{
+		if ( inputs[i].size == 0 &&
+			 findSignal ( signals, signalCount, inputs[i].id ) < 0 )
+		{
+			printf ( "Derived signal input 0x%x has no field and is not a "
+					 "derived signal.\n", inputs[i].id );
+			return -1;
+		}
+	}
+	if ( sortSignals ( signals, signalCount, inputs ) != 0 )
+	{
+		printf ( "The derived signals in[%s] depend on each other in a "
+				 "loop.\n", fileName );
+		return -1;
+	}
+	return signalCount;
+}
+
+
+//
+// Return the offsets of the arrays of a table from its start.
+//
+static unsigned long edgesOffset ( unsigned int signalCount,
+								   unsigned int inputCount )
+{
+	return sizeof(derivedTable_t) + signalCount * sizeof(derivedSignal_t) +
+		   inputCount * sizeof(derivedInput_t);
+}
+
+static unsigned long mapOffset ( unsigned int signalCount,
+								 unsigned int inputCount )
+{
+	unsigned long offset = edgesOffset ( signalCount, inputCount ) +
+						   ( inputCount + signalCount ) * sizeof(derivedEdge_t);
+
+	return ( offset + 63UL ) & ~63UL;
+}
+
+static unsigned long mapSize ( unsigned int messageCount )
+{
+	return ( ( messageCount + 63UL ) / 64 ) * sizeof(unsigned long);
+}
+
+
+//
+// Return the number of bytes needed for a derived signal table region.
+//
+unsigned long derivedRegionSize ( unsigned int signalCount,
+								  unsigned int inputCount,
+								  unsigned int messageCount )
+{
+	return mapOffset ( signalCount, inputCount ) + 2 * mapSize ( messageCount );
+}
+
+
+//
+// Return 1 if an input read from a segment or a checkpoint image is for an
+// ID in the pool and its field is within the data of a message.
+//
+static int validInput ( const derivedInput_t* input, unsigned int messageCount )
+{
+	if ( input->id >= messageCount )
+	{
+		return 0;
+	}
+	return input->size == 0 ||
+		   ( ( input->size == 1 || input->size == 2 || input->size == 4 ||
+			   input->size == 8 ) && input->offset + input->size <= CAN_MAX_DLEN );
+}
+
+
+//
+// Check that the fields of a table read from a segment or a checkpoint image
+// describe a layout that fits in the space the region has and that every
+// index in it is in range.
+//
+// This function returns 0 if the table is valid and -1 if it is not.
+//
+int derivedValidate ( const derivedTable_t* table, unsigned long available,
+					  unsigned int messageCount )
+{
+	if ( available < sizeof(derivedTable_t) ||
+		 table->signalCount == 0 || table->signalCount > DERIVED_MAX_SIGNALS ||
+		 table->inputCount > table->signalCount * DERIVED_MAX_INPUTS ||
+		 table->edgeCount > table->inputCount ||
+		 table->messageCount != messageCount ||
+		 derivedRegionSize ( table->signalCount, table->inputCount,
+							 messageCount ) > available ||
+		 table->edgesOffset != edgesOffset ( table->signalCount,
+											 table->inputCount ) ||
+		 table->outputsOffset != table->edgesOffset +
+								 table->inputCount * sizeof(derivedEdge_t) ||
+		 table->usedMapOffset != mapOffset ( table->signalCount,
+											 table->inputCount ) ||
+		 table->outputMapOffset != table->usedMapOffset + mapSize ( messageCount ) )
+	{
+		return -1;
+	}
+	const derivedInput_t* inputs  = DERIVED_INPUTS ( table );
+	const derivedEdge_t*  edges   = DERIVED_EDGES ( table );
+	const derivedEdge_t*  outputs = DERIVED_OUTPUTS ( table );
+
+	for ( unsigned int s = 0; s < table->signalCount; s++ )
+	{
+		const derivedSignal_t* signal = &table->signals[s];
+
+		if ( signal->output >= messageCount ||
+			 signal->function < DERIVED_AVG || signal->function > DERIVED_LOWPASS ||
+			 signal->inputCount == 0 || signal->inputCount > DERIVED_MAX_INPUTS ||
+			 signal->firstInput > table->inputCount ||
+			 signal->inputCount > table->inputCount - signal->firstInput ||
+			 outputs[s].id >= messageCount || outputs[s].signal >= table->signalCount )
+		{
+			return -1;
+		}
+	}
+	for ( unsigned int i = 0; i < table->inputCount; i++ )
+	{
+		if ( ! validInput ( &inputs[i], messageCount ) )
+		{
+			return -1;
+		}
+	}
+	for ( unsigned int i = 0; i < table->edgeCount; i++ )
+	{
+		if ( edges[i].id >= messageCount || edges[i].signal >= table->signalCount )
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+//
+// Compare two dependencies by ID and then by signal for qsort.
+//
+static int compareEdges ( const void* left, const void* right )
+{
+	const derivedEdge_t* a = left;
+	const derivedEdge_t* b = right;
+
+	if ( a->id != b->id )
+	{
+		return a->id < b->id ? -1 : 1;
+	}
+	return a->signal < b->signal ? -1 : a->signal > b->signal;
+}
+
+
+//
+// Initialize a derived signal table region from the signals and inputs read
+// by derivedLoad.  Every signal starts out dirty so it is computed as soon as
+// its inputs have been received.
+//
+void derivedInitialize ( derivedTable_t* table, const derivedSignal_t* signals,
+						 unsigned int signalCount, const derivedInput_t* inputs,
+						 unsigned int inputCount, unsigned int messageCount )
+{
+	(void) memset ( table, 0, derivedRegionSize ( signalCount, inputCount,
+												  messageCount ) );
+
+	table->signalCount     = signalCount;
+	table->inputCount      = inputCount;
+	table->messageCount    = messageCount;
+	table->edgesOffset     = edgesOffset ( signalCount, inputCount );
+	table->outputsOffset   = table->edgesOffset + inputCount * sizeof(derivedEdge_t);
+	table->usedMapOffset   = mapOffset ( signalCount, inputCount );
+	table->outputMapOffset = table->usedMapOffset + mapSize ( messageCount );
+
+	(void) memcpy ( table->signals, signals, signalCount * sizeof(derivedSignal_t) );
+	(void) memcpy ( DERIVED_INPUTS ( table ), inputs,
+					inputCount * sizeof(derivedInput_t) );
+
+	//
+	// Build the list of the signals that use each ID, leaving out an ID that
+	// a signal uses more than once, and the list of the signal stored in each
+	// output ID.
+	//
+	derivedEdge_t* edges   = DERIVED_EDGES ( table );
+	derivedEdge_t* outputs = DERIVED_OUTPUTS ( table );
+	unsigned long* used    = DERIVED_MAP ( table, table->usedMapOffset );
+	unsigned long* output  = DERIVED_MAP ( table, table->outputMapOffset );
+
+	for ( unsigned int s = 0; s < signalCount; s++ )
+	{
+		derivedSignal_t* signal = &table->signals[s];
+
+		signal->dirty = 1;
+
+		for ( unsigned int i = 0; i < signal->inputCount; i++ )
+		{
+			canMessageIndex_t id   = inputs[signal->firstInput + i].id;
+			int               seen = 0;
+
+			for ( unsigned int j = 0; j < i; j++ )
+			{
+				seen |= inputs[signal->firstInput + j].id == id;
+			}
+			if ( seen )
+			{
+				continue;
+			}
+			edges[table->edgeCount].id     = id;
+			edges[table->edgeCount].signal = s;
+			table->edgeCount++;
+			used[id / 64] |= 1UL << ( id % 64 );
+		}
+		outputs[s].id     = signal->output;
+		outputs[s].signal = s;
+		output[signal->output / 64] |= 1UL << ( signal->output % 64 );
+	}
+	qsort ( edges, table->edgeCount, sizeof(derivedEdge_t), compareEdges );
+	qsort ( outputs, signalCount, sizeof(derivedEdge_t), compareEdges );
+}
+
+
+//
+// Return the inputs of a signal.
+//
+const derivedInput_t* derivedInputs ( derivedTable_t* table, unsigned int signal )
+{
+	return DERIVED_INPUTS ( table ) + table->signals[signal].firstInput;
+}
+
+
+//
+// Return the index of the first entry of a sorted list with the given ID, or
+// the number of entries if there isn't one.
+//
+static unsigned int findEdge ( const derivedEdge_t* edges, unsigned int count,
+							   canMessageIndex_t id )
+{
+	unsigned int low  = 0;
+	unsigned int high = count;
+
+	while ( low < high )
+	{
+		unsigned int middle = ( low + high ) / 2;
+
+		if ( edges[middle].id < id )
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	return low;
+}
+
+
+//
+// Return the index of the signal that is stored in an ID or -1 if the ID is
+// not a derived signal.
+//
+int derivedFindOutput ( derivedTable_t* table, canMessageIndex_t id )
+{
+	if ( id >= table->messageCount ||
+		 ( DERIVED_MAP ( table, table->outputMapOffset )[id / 64] &
+		   ( 1UL << ( id % 64 ) ) ) == 0 )
+	{
+		return -1;
+	}
+	derivedEdge_t* outputs = DERIVED_OUTPUTS ( table );
+
+	return outputs[findEdge ( outputs, table->signalCount, id )].signal;
+}
+
+
+//
+// Mark the signals that use an ID as dirty, and the signals that use those,
+// and so on.  A signal that is already dirty had the signals that use it
+// marked when it became dirty.
+//
+// This function returns 1 if any signal became dirty and 0 if none did.
+//
+static int markDependents ( derivedTable_t* table, canMessageIndex_t id )
+{
+	if ( id >= table->messageCount ||
+		 ( DERIVED_MAP ( table, table->usedMapOffset )[id / 64] &
+		   ( 1UL << ( id % 64 ) ) ) == 0 )
+	{
+		return 0;
+	}
+	derivedEdge_t* edges  = DERIVED_EDGES ( table );
+	int            marked = 0;
+
+	for ( unsigned int i = findEdge ( edges, table->edgeCount, id );
+		  i < table->edgeCount && edges[i].id == id; i++ )
+	{
+		derivedSignal_t* signal = &table->signals[edges[i].signal];
+
+		if ( __atomic_load_n ( &signal->dirty, __ATOMIC_RELAXED ) == 0 &&
+			 __atomic_exchange_n ( &signal->dirty, 1, __ATOMIC_SEQ_CST ) == 0 )
+		{
+			marked = 1;
+			(void) markDependents ( table, signal->output );
+		}
+	}
+	return marked;
+}
+
+
+//
+//	d e r i v e d M a r k D e p e n d e n t s
+//
+// Mark the signals that depend on a message that has just been inserted as
+// dirty.  This is called after every insert so an ID that no signal uses
+// costs one bit test.  If a signal that was clean became dirty, the
+// generation is bumped and any process waiting in derivedWait is woken up.
+//
+void derivedMarkDependents ( derivedTable_t* table, canMessageIndex_t id )
+{
+	if ( markDependents ( table, id ) )
+	{
+		__atomic_fetch_add ( &table->generation, 1, __ATOMIC_SEQ_CST );
+		if ( __atomic_load_n ( &table->waiting, __ATOMIC_SEQ_CST ) != 0 )
+		{
+			(void) syscall ( SYS_futex, &table->generation, FUTEX_WAKE, INT_MAX,
+							 NULL, NULL, 0 );
+		}
+	}
+}
+
+
+//
+//	d e r i v e d F i e l d V a l u e
+//
+// Extract the value of an input from the payload of a frame with the given
+// length.  An input without a field takes the whole payload as a double.
+//
+// This function returns 0 if the value was extracted and -1 if the payload
+// is too short to hold the field.
+//
+int derivedFieldValue ( const derivedInput_t* input, const unsigned char* data,
+						unsigned int length, double* value )
+{
+	if ( input->size == 0 )
+	{
+		double raw;
+
+		if ( length != sizeof(double) )
+		{
+			return -1;
+		}
+		(void) memcpy ( &raw, data, sizeof(raw) );
+		*value = raw * input->scale;
+		return 0;
+	}
+	if ( length < input->offset + input->size )
+	{
+		return -1;
+	}
+	unsigned long raw = 0;
+
+	for ( int i = input->size - 1; i >= 0; i-- )
+	{
+		raw = ( raw << 8 ) | data[input->offset + i];
+	}
+	if ( input->isSigned && input->size < 8 )
+	{
+		unsigned int shift = 64 - input->size * 8;
+
+		*value = (double)( (long)( raw << shift ) >> shift ) * input->scale;
+	}
+	else if ( input->isSigned )
+	{
+		*value = (double)(long)raw * input->scale;
+	}
+	else
+	{
+		*value = (double)raw * input->scale;
+	}
+	return 0;
+}
+
+
+//
+//	d e r i v e d E v a l u a t e
+//
+// Compute a signal from its inputs in the message pool and build the message
+// that stores it.  The inputs are found with sharedMemorySlot since they may
+// have been moved to hot slots (see placement.h).  "now" is the time in
+// nanoseconds for the low pass filter.
+// This must be called with the shared memory lock held and after any dirty
+// signals that it uses have been computed.
+//
+// This function returns 0 if the signal was computed and -1 if one of its
+// inputs has not been received yet.
+//
+int derivedEvaluate ( derivedTable_t* table, unsigned int signal,
+					  struct sharedMemory_t* sharedMemory, unsigned long now,
+					  canMessage_t* output )
+{
+	derivedSignal_t*      entry  = &table->signals[signal];
+	const derivedInput_t* inputs = DERIVED_INPUTS ( table ) + entry->firstInput;
+	double                values[DERIVED_MAX_INPUTS] = { 0 };
+
+	for ( unsigned int i = 0; i < entry->inputCount; i++ )
+	{
+		const canMessage_t* message = sharedMemorySlot ( sharedMemory,
+														 inputs[i].id );
+
+		if ( derivedFieldValue ( &inputs[i], message->canMessage.data,
+								 message->canMessage.can_dlc, &values[i] ) != 0 )
+		{
+			return -1;
+		}
+	}
+	double result = values[0];
+
+	switch ( entry->function )
+	{
+	  case DERIVED_AVG:
+	  case DERIVED_SUM:
+		for ( unsigned int i = 1; i < entry->inputCount; i++ )
+		{
+			result += values[i];
+		}
+		if ( entry->function == DERIVED_AVG )
+		{
+			result /= entry->inputCount;
+		}
+		break;
+
+	  case DERIVED_MIN:
+	  case DERIVED_MAX:
+		for ( unsigned int i = 1; i < entry->inputCount; i++ )
+		{
+			if ( entry->function == DERIVED_MIN ? values[i] < result :
+												  values[i] > result )
+			{
+				result = values[i];
+			}
+		}
+		break;
+
+	  case DERIVED_DIFF:
+		result = values[0] - values[1];
+		break;
+
+	  case DERIVED_RATIO:
+		result = values[1] != 0 ? values[0] / values[1] : 0;
+		break;
+
+	  //
+	  // The discrete form of an RC filter.  The first value goes straight
+	  // through.
+	  //
+	  case DERIVED_LOWPASS:
+		if ( entry->computations != 0 )
+		{
+			double elapsed = now > entry->updated ? now - entry->updated : 0;
+
+			result = entry->value + elapsed / ( entry->parameter + elapsed ) *
+									( values[0] - entry->value );
+		}
+		break;
+	}
+	entry->value   = result;
+	entry->updated = now;
+	entry->computations++;
+
+	(void) memset ( output, 0, sizeof(*output) );
+	output->canMessage.can_id  = entry->output;
+	output->canMessage.can_dlc = sizeof(double);
+	(void) memcpy ( output->canMessage.data, &result, sizeof(result) );
+
+	return 0;
+}
+
+
+//
+// Wait until the generation of a table is no longer the one given or the
+// timeout expires.  A process that recomputes the dirty signals reads the
+// generation before it looks for them and waits here if it finds none.
+//
+// This function returns 0 if the generation changed and -1 if it timed out.
+//
+int derivedWait ( derivedTable_t* table, unsigned int generation,
+				  unsigned long timeoutNs )
+{
+	struct timespec timeout = { timeoutNs / 1000000000UL, timeoutNs % 1000000000UL };
+
+	__atomic_fetch_add ( &table->waiting, 1, __ATOMIC_SEQ_CST );
+
+	while ( __atomic_load_n ( &table->generation, __ATOMIC_SEQ_CST ) == generation )
+	{
+		if ( syscall ( SYS_futex, &table->generation, FUTEX_WAIT, generation,
+					   &timeout, NULL, 0 ) != 0 && errno == ETIMEDOUT )
+		{
+			break;
+		}
+	}
+	__atomic_fetch_sub ( &table->waiting, 1, __ATOMIC_SEQ_CST );
+
+	return __atomic_load_n ( &table->generation, __ATOMIC_ACQUIRE ) != generation ?
+		   0 : -1;
+}
@@ -0,0 +1,178 @@
+#pragma once
+#ifndef DERIVED_H
+#define DERIVED_H
+
+#include "canMessage.h"
+
+//
+// The derived signal table is an optional region of the shared memory segment
+// that holds signals which are computed from other messages, like the average
+// of the four wheel speeds or a filtered acceleration.  Each one is stored in
+// the message pool under its own (synthetic) message ID, so it is computed
+// once for the whole system instead of by every consumer that needs it.  The
+// signals are defined in a file given to "create -x" and can't be changed
+// afterwards.
+//
+// Each line of the file defines one signal:
+//
+//     <output ID>  <function>  <input> [<input>...]
+//
+// An input is either a field of a CAN message, "<ID>:<offset>:<size>[:s]"
+// with an optional "*<scale>", or the ID of another derived signal.  The field
+// is read as for the statistics table (a little endian integer of 1, 2, 4 or
+// 8 bytes, signed with ":s").  The functions are:
+//
+//     avg, sum, min, max   - Of all of the inputs.
+//     diff, ratio          - The first input minus (or divided by) the second.
+//     lowpass=<msec>       - A first order low pass filter of one input with
+//                            the given time constant.
+//
+// A derived signal is stored as a message with a length of 8 whose data is
+// the value as a double (see derivedMessageValue).
+//
+// When a message is inserted, the signals that use it are marked dirty.  This
+// costs one bit test for a message that no signal uses.  A dirty signal is
+// recomputed, with the shared memory lock held, the first time its ID is read
+// with fetchMessage or sharedMemoryReadMessage, so a consumer always sees a
+// value that includes the latest inputs.  The "derivedd" program recomputes
+// them as soon as they are marked instead, so that the consumers that poll
+// the pool (or subscribe to the derived IDs) never pay for it.  The signals
+// are kept in dependency order so a signal that uses another one is always
+// computed after it.
+//
+// The low pass filter is updated each time the signal is computed, using the
+// time since it was last computed, so its output doesn't depend on how often
+// it is read.  A signal is not computed until every one of its inputs has
+// been received.
+//
+
+//
+// Define the limits of the derived signal definitions.
+//
+#define DERIVED_MAX_SIGNALS 256
+#define DERIVED_MAX_INPUTS  16              // Per signal
+
+//
+// Define the functions.
+//
+#define DERIVED_AVG     1
+#define DERIVED_SUM     2
+#define DERIVED_MIN     3
+#define DERIVED_MAX     4
+#define DERIVED_DIFF    5
+#define DERIVED_RATIO   6
+#define DERIVED_LOWPASS 7
+
+//
+// Define an input of a signal.  A size of zero means that the input is the
+// value of another derived signal.
+//
+typedef struct derivedInput_t
+{
+	canMessageIndex_t id;
+	unsigned char     offset;
+	unsigned char     size;
+	unsigned char     isSigned;
+	unsigned char     pad;
+	double            scale;
+
+}   derivedInput_t;
+
+//
+// Define a signal.  Its inputs are at index firstInput of the input array.
+// Each signal is on its own cache line.
+//
+typedef struct derivedSignal_t
+{
+	unsigned int      dirty;
+	canMessageIndex_t output;
+	unsigned int      function;
+	unsigned int      inputCount;
+	unsigned int      firstInput;
+	unsigned int      pad;
+	double            parameter;            // Low pass time constant (nsec)
+	double            value;                // Last value computed
+	unsigned long     updated;              // Time of the last computation
+	unsigned long     computations;
+
+}   __attribute__((aligned(64))) derivedSignal_t;
+
+//
+// Define a dependency, an ID and a signal that uses it (or that is stored in
+// it for the output list).  The lists are sorted by ID.
+//
+typedef struct derivedEdge_t
+{
+	canMessageIndex_t id;
+	unsigned int      signal;
+
+}   derivedEdge_t;
+
+//
+// Define the header of the derived signal table region.  The signals are
+// followed by the inputs, the dependency list, the output list and two
+// bitmaps with a bit for each message in the pool: one for the IDs that are
+// used by a signal and one for the IDs that are signals.
+//
+// The generation is bumped whenever a signal becomes dirty and "waiting" is
+// the number of processes waiting for that to happen (see derivedWait).
+//
+typedef struct derivedTable_t
+{
+	unsigned int    signalCount;
+	unsigned int    inputCount;
+	unsigned int    edgeCount;
+	unsigned int    messageCount;
+	unsigned int    generation;
+	unsigned int    waiting;
+	unsigned int    edgesOffset;
+	unsigned int    outputsOffset;
+	unsigned int    usedMapOffset;
+	unsigned int    outputMapOffset;
+
+	derivedSignal_t signals[0] __attribute__((aligned(64)));
+
+}   derivedTable_t;
+
+//
+// Define the derived signal functions.
+//
+int           derivedLoad         ( const char* fileName,
+									unsigned int messageCount,
+									derivedSignal_t* signals,
+									derivedInput_t* inputs,
+									unsigned int* inputCount );
+unsigned long derivedRegionSize   ( unsigned int signalCount,
+									unsigned int inputCount,
+									unsigned int messageCount );
+int           derivedValidate     ( const derivedTable_t* table,
+									unsigned long available,
+									unsigned int messageCount );
+void          derivedInitialize   ( derivedTable_t* table,
+									const derivedSignal_t* signals,
+									unsigned int signalCount,
+									const derivedInput_t* inputs,
+									unsigned int inputCount,
+									unsigned int messageCount );
+
+int           derivedParseInput   ( char* token, derivedInput_t* input );
+int           derivedFieldValue   ( const derivedInput_t* input,
+									const unsigned char* data,
+									unsigned int length, double* value );
+
+const derivedInput_t* derivedInputs ( derivedTable_t* table,
+									  unsigned int signal );
+int           derivedFindOutput   ( derivedTable_t* table, canMessageIndex_t id );
+void          derivedMarkDependents ( derivedTable_t* table,
+									  canMessageIndex_t id );
+int           derivedEvaluate     ( derivedTable_t* table, unsigned int signal,
+									struct sharedMemory_t* sharedMemory,
+									unsigned long now, canMessage_t* output );
+int           derivedWait         ( derivedTable_t* table,
+									unsigned int generation,
+									unsigned long timeoutNs );
+
+double        derivedMessageValue ( const canMessage_t* message );
+const char*   derivedFunctionName ( unsigned int function );
+
+#endif		// End of DERIVED_H
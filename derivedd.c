@@ -0,0 +1,280 @@
+//
+//	d e r i v e d d . c
+//
+//  The derived signal worker.  This program recomputes the derived signals
+//  (see derived.h) as soon as one of their inputs changes so that the
+//  consumers always find them up to date in the message pool.
+//
+//  The shared memory segment must have been created with a derived signal
+//  table (see the "-x" option of the "create" program).  Without this
+//  program the signals are still correct, but each one is computed by the
+//  first consumer that reads it after an input changes.
+//
+//  The worker sleeps on the generation of the table when there is nothing to
+//  do, so it only wakes up when a signal becomes dirty, and it reports the
+//  number of signals computed and wake ups once a second.
+//
+//  The "-l" option lists the signals with their current values and exits.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <locale.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the worker parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static unsigned int durationSeconds = 0;
+static bool         listOnly        = false;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+static volatile int stopRequested = 0;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -d    Duration (sec)   int     Forever \n\
+    -l    List Signals     bool      false \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Handle the interrupt signal by asking the main loop to stop.
+//
+static void stopHandler ( int signalNumber )
+{
+	stopRequested = 1;
+}
+
+
+//
+// Return the current monotonic time in nanoseconds.
+//
+static unsigned long nowNs ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// List the derived signals with their definitions and current values.
+//
+static void listSignals ( sharedMemory_t* sharedMemory, derivedTable_t* table )
+{
+	printf ( "%u derived signals:\n\n", table->signalCount );
+	printf ( "  %10s  %-8s  %20s  %14s  %s\n", "id", "function", "value",
+			 "computations", "inputs" );
+
+	for ( unsigned int s = 0; s < table->signalCount; s++ )
+	{
+		derivedSignal_t*      signal = &table->signals[s];
+		const derivedInput_t* inputs = derivedInputs ( table, s );
+		canMessage_t          message;
+
+		//
+		// Reading the signal computes it if it is dirty.
+		//
+		(void) sharedMemoryReadMessage ( sharedMemory, signal->output, &message );
+
+		printf ( "  %#10x  %-8s  ", signal->output,
+				 derivedFunctionName ( signal->function ) );
+		if ( message.canMessage.can_dlc == sizeof(double) )
+		{
+			printf ( "%20.6f", derivedMessageValue ( &message ) );
+		}
+		else
+		{
+			printf ( "%20s", "(no input yet)" );
+		}
+		printf ( "  %'14lu ", signal->computations );
+
+		for ( unsigned int i = 0; i < signal->inputCount; i++ )
+		{
+			if ( inputs[i].size == 0 )
+			{
+				printf ( " %#x", inputs[i].id );
+			}
+			else
+			{
+				printf ( " %#x:%u:%u%s", inputs[i].id, inputs[i].offset,
+						 inputs[i].size, inputs[i].isSigned ? ":s" : "" );
+			}
+			if ( inputs[i].scale != 1.0 )
+			{
+				printf ( "*%g", inputs[i].scale );
+			}
+		}
+		printf ( "\n" );
+	}
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:d:hl?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'd':
+		    durationSeconds = atol ( optarg );
+			break;
+
+		  case 'l':
+			listOnly = true;
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( optind != argc )
+	{
+		printf ( "Invalid parameter encountered: %s\n", argv[optind] );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	derivedTable_t* table = sharedMemoryGetDerivedTable ( sharedMemory );
+	if ( table == 0 )
+	{
+		printf ( "The shared memory segment has no derived signals - Use "
+				 "\"create -x\" to define them.\n" );
+		exit (255);
+	}
+	if ( listOnly )
+	{
+		listSignals ( sharedMemory, table );
+		sharedMemoryClose ( sharedMemory );
+		return 0;
+	}
+	signal ( SIGINT,  stopHandler );
+	signal ( SIGTERM, stopHandler );
+
+	printf ( "Computing %u derived signals...\n", table->signalCount );
+	fflush ( stdout );
+
+	unsigned long start         = nowNs();
+	unsigned long lastReport    = start;
+	unsigned long computed      = 0;
+	unsigned long wakeups       = 0;
+	unsigned long totalComputed = 0;
+	unsigned long totalWakeups  = 0;
+
+	while ( ! stopRequested )
+	{
+		//
+		// Read the generation before looking for dirty signals so a signal
+		// that is marked after we have passed it wakes us up straight away.
+		//
+		unsigned int generation = __atomic_load_n ( &table->generation,
+													__ATOMIC_ACQUIRE );
+		unsigned int count      = 0;
+
+		for ( unsigned int s = 0; s < table->signalCount; s++ )
+		{
+			int stored = sharedMemoryRefreshDerived ( sharedMemory, s );
+			if ( stored > 0 )
+			{
+				count += stored;
+			}
+		}
+		computed += count;
+
+		unsigned long now = nowNs();
+		if ( now - lastReport >= 1000000000UL )
+		{
+			printf ( "%'lu signals computed, %'lu wake ups\n", computed, wakeups );
+			fflush ( stdout );
+			totalComputed += computed;
+			totalWakeups  += wakeups;
+			computed       = 0;
+			wakeups        = 0;
+			lastReport     = now;
+		}
+		if ( durationSeconds != 0 && now - start >= durationSeconds * 1000000000UL )
+		{
+			break;
+		}
+		if ( count == 0 && derivedWait ( table, generation, 100000000UL ) == 0 )
+		{
+			wakeups++;
+		}
+	}
+	totalComputed += computed;
+	totalWakeups  += wakeups;
+
+	printf ( "Computed %'lu signals in %'lu wake ups.\n", totalComputed,
+			 totalWakeups );
+
+	sharedMemoryClose ( sharedMemory );
+
+	return 0;
+}
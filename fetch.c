@@ -18,6 +18,7 @@
 #include <stdbool.h>
 
 #include "sharedMemory.h"
+#include "realtime.h"
 
 //
 // NOTE: All references (and pointers) to data in the can message buffer is
@@ -48,6 +49,23 @@ static bool continuousRun = false;
 //
 static bool useRandom = false;
 
+//
+// Define the real time mode settings (see realtime.h).  The process is set up
+// for real time if any of "-L", "-P" or "-C" is given.  The "-p" option runs
+// the fetches in a periodic loop, "-n" at a time every period, and reports the
+// jitter of the loop instead of the throughput.
+//
+static realtimeConfig_t realtime       = { false, 0, REALTIME_NO_CPU,
+										   REALTIME_DEFAULT_STACK };
+static unsigned long    periodUs       = 0;
+static unsigned int     periodMessages = 1;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
 //
 // Define the usage message function.
 //
@@ -60,15 +78,114 @@ Usage: %s options\n\
   ======  ==============  ======  =========== \n\
     -c    Continuous       N/A        N/A \n\
     -m    Message Count    int     1,000,000 \n\
+    -b    CAN Bus          int       None \n\
+    -L    Lock Memory      bool      false \n\
+    -P    FIFO Priority    int       None \n\
+    -C    Pin to CPU    int or \"i\"   None \n\
+    -p    Period (usec)    int       None \n\
+    -n    Per Period       int           1 \n\
     -h    Help Message     N/A        N/A \n\
 	-r    Random Write     bool    1,000,000 \n\
     -?    Help Message     N/A        N/A \n\
+\n\
+  -C i pins to the first isolated CPU.  With -p, the -m fetches are done\n\
+  -n at a time every period and the loop jitter is reported.\n\
 \n\n\
 ",
              executable );
 }
 
 
+//
+// Return the current monotonic time in nanoseconds.
+//
+static unsigned long nowNs ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// Run the periodic loop.  The loop sleeps until an absolute wakeup time, does
+// the next "-n" fetches and then sleeps until the next period.  Each pass of
+// "-m" fetches is reported as histograms of the wakeup latency (how late the
+// loop woke up), the period jitter (how far the time between wakeups was from
+// the period) and the time the fetches of each period took.  A period whose
+// fetches end after the next wakeup time is counted as an overrun and the
+// periods it ran into are skipped.
+//
+static void runPeriodic ( sharedMemory_t* sharedMemory,
+						  unsigned int bufferPoolSize )
+{
+	canMessage_t       canMessage;
+	latencyHistogram_t wakeups;
+	latencyHistogram_t periods;
+	latencyHistogram_t bursts;
+	unsigned long      periodNs = periodUs * 1000;
+	unsigned long      index    = 0;
+	unsigned long      last     = 0;
+
+	(void) memset ( &canMessage, 0, sizeof(canMessage) );
+
+	printf ( "Fetching %'u messages every %'lu usec.\n", periodMessages,
+			 periodUs );
+	fflush ( stdout );
+
+	unsigned long next = nowNs() + periodNs;
+	do
+	{
+		unsigned long overruns = 0;
+
+		histogramInitialize ( &wakeups );
+		histogramInitialize ( &periods );
+		histogramInitialize ( &bursts );
+
+		for ( unsigned int done = 0; done < messagesToFetch; done += periodMessages )
+		{
+			struct timespec until = { next / 1000000000UL, next % 1000000000UL };
+			(void) clock_nanosleep ( CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL );
+
+			unsigned long woke = nowNs();
+			histogramAdd ( &wakeups, woke > next ? woke - next : 0 );
+			if ( last != 0 )
+			{
+				long jitter = woke - last - periodNs;
+				histogramAdd ( &periods, jitter < 0 ? -jitter : jitter );
+			}
+			last = woke;
+
+			for ( unsigned int i = 0; i < periodMessages; i++, index++ )
+			{
+				canMessage.canMessage.can_id = useRandom ?
+					rand() % bufferPoolSize : index % bufferPoolSize;
+				(void) fetchMessage ( sharedMemory, &canMessage );
+			}
+			unsigned long finished = nowNs();
+			histogramAdd ( &bursts, finished - woke );
+
+			next += periodNs;
+			while ( next < finished )
+			{
+				next += periodNs;
+				overruns++;
+				last = 0;
+			}
+		}
+		printf ( "\n%'u fetches in %'lu periods, %'lu overruns.\n", messagesToFetch,
+				 wakeups.count, overruns );
+		histogramPrint ( &wakeups, "Wakeup latency" );
+		histogramPrint ( &periods, "Period jitter" );
+		histogramPrint ( &bursts,  "Fetch time per period" );
+		fflush ( stdout );
+
+	}   while ( continuousRun );
+}
+
+
 //
 // M A I N
 //
@@ -84,10 +201,9 @@ int main ( int argc, char* const argv[] )
     //
     // Parse any command line options the user may have supplied.
     //
-	int status;
 	char ch;
 
-    while ( ( ch = getopt ( argc, argv, "chm:r?" ) ) != -1 )
+    while ( ( ch = getopt ( argc, argv, "b:C:chLm:n:p:P:r?" ) ) != -1 )
     {
         switch ( ch )
         {
@@ -122,6 +238,68 @@ int main ( int argc, char* const argv[] )
             useRandom = true;
             break;
 
+		  //
+		  // Get the real time mode settings.
+		  //
+		  case 'L':
+			realtime.lockMemory = true;
+			break;
+
+		  case 'P':
+		    realtime.priority = atoi ( optarg );
+			if ( realtime.priority < 1 || realtime.priority > 99 )
+			{
+				printf ( "Invalid priority[%s] specified - must be 1 to 99.\n",
+						 optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'C':
+			realtime.cpu = strcmp ( optarg, "i" ) == 0 ? REALTIME_ISOLATED_CPU
+													   : atoi ( optarg );
+			if ( realtime.cpu == REALTIME_NO_CPU )
+			{
+				printf ( "Invalid CPU[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'p':
+		    if ( atol ( optarg ) <= 0 )
+			{
+				printf ( "Invalid period[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+		    periodUs = atol ( optarg );
+			break;
+
+		  case 'n':
+		    if ( atol ( optarg ) <= 0 )
+			{
+				printf ( "Invalid count per period[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+		    periodMessages = atol ( optarg );
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
           case 'h':
           case '?':
           default:
@@ -144,18 +322,32 @@ int main ( int argc, char* const argv[] )
 	//
 	// Open the shared memory file.
 	//
-	sharedMemory = sharedMemoryOpen();
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
 	if ( sharedMemory == 0 )
 	{
 		printf ( "Unable to open the shared memory segment - Aborting\n" );
 		exit (255);
 	}
 	//
-	// Get the sizes of the buffer pool and the entire shared memory
-	// segment.
+	// Get the size of the buffer pool.
 	//
 	unsigned int bufferPoolSize = sharedMemoryGetPoolSize ( sharedMemory );
-	sharedMemorySize            = sharedMemoryGetSegmentSize ( sharedMemory );
+
+	//
+	// Set up the real time mode if it was asked for and run the periodic
+	// loop instead of the throughput loop if a period was given.
+	//
+	if ( realtime.lockMemory || realtime.priority != 0 ||
+		 realtime.cpu != REALTIME_NO_CPU )
+	{
+		(void) realtimeSetup ( sharedMemory, &realtime );
+	}
+	if ( periodUs != 0 )
+	{
+		runPeriodic ( sharedMemory, bufferPoolSize );
+		sharedMemoryClose ( sharedMemory );
+		return 0;
+	}
 
 	//
 	// Define the CAN message that we will use to fetch records from the
@@ -219,7 +411,7 @@ int main ( int argc, char* const argv[] )
 			// not a normal function for the fetch function but for this test,
 			// it's a useful thing to do.
 			//
-			messageIndex = fetchMessage ( &canMessage );
+			messageIndex = fetchMessage ( sharedMemory, &canMessage );
 		}
 		clock_gettime(CLOCK_REALTIME, &stopTime);
 
@@ -249,7 +441,7 @@ int main ( int argc, char* const argv[] )
 	//
 	// Close our shared memory segment and exit.
 	//
-	sharedMemoryClose ( sharedMemory, sharedMemorySize );
+	sharedMemoryClose ( sharedMemory );
 
 	//
 	// Return a good completion code to the caller.
@@ -0,0 +1,336 @@
+//
+//	f l i g h t d u m p . c
+//
+//  Display the samples in the flight recorder (see recorder.h).
+//
+//  The shared memory segment must have been created with a flight recorder
+//  (see the "-f" option of the "create" program).  The rings are read without
+//  taking the shared memory lock or disturbing the processes that write them,
+//  and the rings of processes that have exited are still there, so this can
+//  be run after a latency spike to see which operations were slow.
+//
+//  For each ring the program prints a summary of the samples it holds and
+//  the most recent samples.  The times are relative to the newest sample in
+//  any ring.  Samples marked with a "*" were recorded because they took
+//  longer than the threshold.
+//
+//  The "-e" and "-l" options change the sampling rate and the threshold of
+//  the recorder while it is in use.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <locale.h>
+#include <stdbool.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the display parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static unsigned int showCount     = 20;
+static bool         summaryOnly   = false;
+static long         sampleEvery   = -1;
+static long         thresholdUs   = -1;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the names of the operations.
+//
+static const char* opNames[] = { "?", "insert", "batch", "fetch", "group" };
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -n    Samples Shown    int          20 \n\
+    -a    Show All         bool      false \n\
+    -q    Summary Only     bool      false \n\
+    -e    Sample Every     int    Unchanged \n\
+    -l    Slow (usec)      int    Unchanged \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\
+  -n is the number of the most recent samples of each ring that are shown.\n\
+  -e 0 turns sampling off and -l 0 turns the threshold off.\n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Compare two tick counts for qsort.
+//
+static int compareTicks ( const void* left, const void* right )
+{
+	unsigned int a = *(const unsigned int*)left;
+	unsigned int b = *(const unsigned int*)right;
+
+	return a < b ? -1 : a > b;
+}
+
+
+//
+// Print the median, 99th percentile and maximum of a set of tick counts in
+// nanoseconds.  The counts are sorted in place.
+//
+static void printDistribution ( const char* name, unsigned int* ticks,
+								unsigned int count, double nsPerTick )
+{
+	qsort ( ticks, count, sizeof(unsigned int), compareTicks );
+
+	printf ( "    %-9s median %'9.0f  p99 %'11.0f  max %'11.0f nsec\n", name,
+			 ticks[count / 2] * nsPerTick, ticks[count * 99 / 100] * nsPerTick,
+			 ticks[count - 1] * nsPerTick );
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "ab:e:hl:n:q?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'n':
+		    showCount = atol ( optarg );
+			break;
+
+		  case 'a':
+			showCount = ~0U;
+			break;
+
+		  case 'q':
+			summaryOnly = true;
+			break;
+
+		  case 'e':
+		    sampleEvery = atol ( optarg );
+			if ( sampleEvery < 0 )
+			{
+				printf ( "Invalid sampling rate[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'l':
+		    thresholdUs = atol ( optarg );
+			if ( thresholdUs < 0 )
+			{
+				printf ( "Invalid threshold[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( optind != argc )
+	{
+		printf ( "Invalid parameter encountered: %s\n", argv[optind] );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	recorderTable_t* table = sharedMemoryGetRecorder ( sharedMemory );
+	if ( table == 0 )
+	{
+		printf ( "The shared memory segment has no flight recorder - Use "
+				 "\"create -f\" to create one.\n" );
+		exit (255);
+	}
+	double nsPerTick = 1e9 / table->ticksPerSecond;
+
+	//
+	// Change the settings if we were asked to.
+	//
+	if ( sampleEvery >= 0 || thresholdUs >= 0 )
+	{
+		recorderConfigure ( table,
+							sampleEvery >= 0 ? sampleEvery : table->sampleEvery,
+							thresholdUs >= 0 ? thresholdUs * 1000 :
+											   table->thresholdTicks * nsPerTick );
+	}
+	printf ( "Flight recorder: %u rings of %'u samples, %'.0f MHz counter.\n",
+			 table->ringCount, table->ringSamples, table->ticksPerSecond / 1e6 );
+	if ( table->sampleEvery != 0 )
+	{
+		printf ( "Sampling 1 in %'u operations.\n", table->sampleEvery );
+	}
+	else
+	{
+		printf ( "Sampling is off.\n" );
+	}
+	if ( table->thresholdTicks != 0 )
+	{
+		printf ( "Recording every operation over %'.0f usec.\n",
+				 table->thresholdTicks * nsPerTick / 1000 );
+	}
+	else
+	{
+		printf ( "The slow operation threshold is off.\n" );
+	}
+	if ( table->unrecorded != 0 )
+	{
+		printf ( "%'lu samples were not recorded because every ring was in "
+				 "use.\n", table->unrecorded );
+	}
+	//
+	// Find the newest sample in any ring to measure the times from.
+	//
+	unsigned long newest = 0;
+	for ( unsigned int r = 0; r < table->ringCount; r++ )
+	{
+		unsigned long    head = __atomic_load_n ( &table->rings[r].head,
+												  __ATOMIC_ACQUIRE );
+		recorderSample_t sample;
+
+		for ( unsigned long i = head; i > 0 && i + table->ringSamples > head; i-- )
+		{
+			if ( recorderReadSample ( table, r, i - 1, &sample ) == 0 )
+			{
+				if ( sample.timestamp > newest )
+				{
+					newest = sample.timestamp;
+				}
+				break;
+			}
+		}
+	}
+	unsigned int*     lockWaits = malloc ( table->ringSamples * sizeof(unsigned int) );
+	unsigned int*     durations = malloc ( table->ringSamples * sizeof(unsigned int) );
+	recorderSample_t* samples   = malloc ( table->ringSamples * sizeof(recorderSample_t) );
+	if ( lockWaits == 0 || durations == 0 || samples == 0 )
+	{
+		printf ( "Unable to allocate the sample buffers.\n" );
+		exit (255);
+	}
+	//
+	// Print each ring that has been used.
+	//
+	for ( unsigned int r = 0; r < table->ringCount; r++ )
+	{
+		recorderRing_t* ring = &table->rings[r];
+		pid_t           pid  = __atomic_load_n ( &ring->pid, __ATOMIC_ACQUIRE );
+		if ( pid == 0 )
+		{
+			continue;
+		}
+		unsigned long head  = __atomic_load_n ( &ring->head, __ATOMIC_ACQUIRE );
+		unsigned long first = head > table->ringSamples ? head - table->ringSamples : 0;
+		unsigned int  count = 0;
+		unsigned int  slow  = 0;
+		unsigned long ops[5] = { 0 };
+
+		for ( unsigned long i = first; i < head; i++ )
+		{
+			if ( recorderReadSample ( table, r, i, &samples[count] ) != 0 )
+			{
+				continue;
+			}
+			lockWaits[count] = samples[count].lockWait;
+			durations[count] = samples[count].duration;
+			slow            += ( samples[count].flags & RECORDER_FLAG_SLOW ) != 0;
+			ops[samples[count].op < 5 ? samples[count].op : 0]++;
+			count++;
+		}
+		bool alive = kill ( pid, 0 ) == 0 || errno != ESRCH;
+
+		printf ( "\nRing %u: pid %d (%.16s) %s, %'lu samples recorded, %'u held, "
+				 "%'u slow\n", r, pid, ring->name, alive ? "running" : "exited",
+				 head, count, slow );
+		if ( count == 0 )
+		{
+			continue;
+		}
+		printf ( "    %'lu inserts, %'lu batches, %'lu fetches, %'lu groups\n",
+				 ops[RECORDER_OP_INSERT], ops[RECORDER_OP_INSERT_BATCH],
+				 ops[RECORDER_OP_FETCH], ops[RECORDER_OP_GROUP] );
+		printDistribution ( "lock wait", lockWaits, count, nsPerTick );
+		printDistribution ( "duration", durations, count, nsPerTick );
+
+		if ( summaryOnly )
+		{
+			continue;
+		}
+		unsigned int start = count > showCount ? count - showCount : 0;
+
+		printf ( "\n    %16s  %-6s  %10s  %12s  %12s  %4s\n", "usec ago", "op",
+				 "id", "lock nsec", "total nsec", "cpu" );
+		for ( unsigned int i = start; i < count; i++ )
+		{
+			recorderSample_t* sample = &samples[i];
+			double            ago    = newest >= sample->timestamp ?
+									   ( newest - sample->timestamp ) * nsPerTick / 1000 : 0;
+
+			printf ( "    %'16.1f  %-6s  %#10x  %'12.0f  %'12.0f  %4u%s\n", ago,
+					 opNames[sample->op < 5 ? sample->op : 0], sample->id,
+					 sample->lockWait * nsPerTick, sample->duration * nsPerTick,
+					 sample->cpu, sample->flags & RECORDER_FLAG_SLOW ? " *" : "" );
+		}
+	}
+	free ( lockWaits );
+	free ( durations );
+	free ( samples );
+
+	sharedMemoryClose ( sharedMemory );
+
+    return 0;
+}
@@ -0,0 +1,588 @@
+//
+//	g e n e r a t e . c
+//
+//  Write realistic periodic CAN traffic into the shared memory message pool.
+//
+//  The traffic comes from a profile file ("-p", see workload.h for the
+//  format) or from a generated profile of "-g" IDs with a typical vehicle
+//  mix of cycle times, data lengths and bursts.  The "-l" option scales the
+//  cycle times so the traffic puts the requested load on the bus.  A
+//  generated profile is scaled to a typical 40% load unless "-l" is given.
+//
+//  By default each frame is inserted at the time it is due and the program
+//  reports how late the inserts were.  With the "-f" option the schedule is
+//  replayed as fast as possible instead, which benchmarks the message pool
+//  with a realistic mix of IDs rather than a uniform random one.  The frames
+//  are generated a block at a time outside of the timed insert loop so the
+//  cost of the generator doesn't show up in the insert rate.  The "-w"
+//  option splits the IDs over several writer processes, each with its own
+//  random number generator.
+//
+//  With the "-i" option the frames are sent to a SocketCAN interface instead
+//  of being inserted into the pool, to drive the "ingest" program.  On a
+//  virtual CAN interface "-l 100" gives the frame rate of a fully loaded bus
+//  and "-f" sends as fast as the interface will take them.  The IDs are
+//  still kept within the message pool so every frame has somewhere to go.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <locale.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <errno.h>
+#include <poll.h>
+#include <net/if.h>
+#include <linux/can/raw.h>
+
+#include "sharedMemory.h"
+#include "workload.h"
+
+//
+// Define the largest number of writer processes and the number of 1 usec
+// buckets in the lateness histogram.  The last bucket holds everything that
+// was later than that.
+//
+#define MAX_WRITERS      64
+#define LATENESS_BUCKETS 10001
+
+//
+// Define the time before a frame is due that we stop sleeping and start
+// spinning so the frame goes out on time.
+//
+#define SPIN_NS ( 50 * 1000 )
+
+//
+// Define the number of frames generated at a time for a fast replay.
+//
+#define REPLAY_BLOCK 4096
+
+//
+// Define the bus load that a generated profile is scaled to by default.
+//
+#define DEFAULT_GENERATED_LOAD 40.0
+
+//
+// Define the generator parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static const char*   profileName  = 0;
+static unsigned int  generatedIds = 256;
+static double        busLoad      = 0;
+static unsigned int  runSeconds   = 10;
+static unsigned long frameLimit   = 10000000;
+static bool          fastReplay   = false;
+static unsigned int  writerCount  = 1;
+static unsigned long seed         = 1;
+static const char*   interfaceName = 0;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the results that each writer passes back to the parent through an
+// anonymous shared mapping.
+//
+typedef struct writerResults_t
+{
+	unsigned long frames;
+	unsigned long elapsedNs;
+	unsigned long insertNs;
+	unsigned long maxLateNs;
+	unsigned long lateness[LATENESS_BUCKETS];
+
+}   writerResults_t;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -p    Profile File    string     None \n\
+    -g    Generated IDs    int         256 \n\
+    -l    Bus Load (%%)    float    See below \n\
+    -d    Duration (sec)   int          10 \n\
+    -f    Fast Replay      bool      false \n\
+    -n    Frames (fast)    int    10,000,000 \n\
+    -w    Writers          int           1 \n\
+    -s    Random Seed      int           1 \n\
+    -i    CAN Interface   string     None \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\
+  The profile is a text file with one line per message ID or ID range:\n\
+\n\
+    <id>[-<id>] <cycle ms> [dlc=<dlc>[:<weight>],...] [burst=<frames>/<gap usec>]\n\
+                           [jitter=<usec>]\n\
+\n\
+  plus an optional \"bitrate <bits/sec>\" line.  A profile file is used\n\
+  as is unless -l is given.  A generated profile is scaled to 40%% load.\n\
+\n\
+  With -i the frames are sent to the CAN interface instead of the pool.\n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Return the current monotonic time in nanoseconds.
+//
+static unsigned long nowNs ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// Open a raw CAN socket that sends to an interface.  It is given an empty
+// filter list so it never receives anything.
+//
+// This function returns the socket or -1 if it could not be opened.
+//
+static int openInterface ( const char* name )
+{
+	struct sockaddr_can address;
+
+	(void) memset ( &address, 0, sizeof(address) );
+	address.can_family  = AF_CAN;
+	address.can_ifindex = if_nametoindex ( name );
+
+	int fd = socket ( PF_CAN, SOCK_RAW, CAN_RAW );
+	if ( fd < 0 || address.can_ifindex == 0 ||
+		 setsockopt ( fd, SOL_CAN_RAW, CAN_RAW_FILTER, NULL, 0 ) != 0 ||
+		 bind ( fd, (struct sockaddr*)&address, sizeof(address) ) != 0 )
+	{
+		printf ( "Unable to open CAN interface[%s] - errno: %u[%s].\n", name,
+				 errno, strerror(errno) );
+		return -1;
+	}
+	return fd;
+}
+
+
+//
+// Send a frame to a CAN interface, waiting for room in its transmit queue
+// if it is full.
+//
+static void sendFrame ( int fd, canMessage_t* message )
+{
+	while ( write ( fd, &message->canMessage, sizeof(struct can_frame) ) < 0 )
+	{
+		struct pollfd wait = { fd, POLLOUT, 0 };
+
+		if ( errno != ENOBUFS && errno != EAGAIN && errno != EINTR )
+		{
+			printf ( "Unable to send to the CAN interface - errno: %u[%s].\n",
+					 errno, strerror(errno) );
+			_exit (255);
+		}
+		(void) poll ( &wait, 1, 10 );
+	}
+}
+
+
+//
+// Insert a frame into the pool, or send it to the CAN interface if there is
+// one.
+//
+static inline void putFrame ( sharedMemory_t* sharedMemory, int fd,
+							  canMessage_t* message )
+{
+	if ( fd >= 0 )
+	{
+		sendFrame ( fd, message );
+	}
+	else
+	{
+		(void) insertMessage ( sharedMemory, message );
+	}
+}
+
+
+//
+// Run one writer.  In real time mode each frame is inserted when it is due
+// and the lateness of every insert is recorded.  In fast mode the frames are
+// inserted back to back.
+//
+static void runWriter ( sharedMemory_t* sharedMemory, workload_t* workload,
+						writerResults_t* results )
+{
+	canMessage_t  message;
+	unsigned long durationNs = runSeconds * 1000000000UL;
+	unsigned long limit      = frameLimit / writerCount;
+	int           fd         = -1;
+
+	if ( interfaceName != 0 && ( fd = openInterface ( interfaceName ) ) < 0 )
+	{
+		_exit (255);
+	}
+	(void) memset ( &message, 0, sizeof(message) );
+	workloadStart ( workload );
+
+	unsigned long startNs = nowNs();
+
+	if ( fastReplay )
+	{
+		static canMessage_t block[REPLAY_BLOCK];
+
+		(void) memset ( block, 0, sizeof(block) );
+		for ( unsigned long done = 0; done < limit; )
+		{
+			unsigned long count = limit - done < REPLAY_BLOCK ? limit - done
+															  : REPLAY_BLOCK;
+			for ( unsigned long i = 0; i < count; i++ )
+			{
+				(void) workloadNext ( workload, &block[i] );
+			}
+			unsigned long insertStartNs = nowNs();
+			for ( unsigned long i = 0; i < count; i++ )
+			{
+				putFrame ( sharedMemory, fd, &block[i] );
+			}
+			results->insertNs += nowNs() - insertStartNs;
+			done += count;
+		}
+		results->frames = limit;
+	}
+	else
+	{
+		for ( ;; )
+		{
+			unsigned long dueNs = workloadNext ( workload, &message );
+			if ( dueNs >= durationNs )
+			{
+				break;
+			}
+			unsigned long targetNs = startNs + dueNs;
+			unsigned long now      = nowNs();
+
+			//
+			// Sleep until just before the frame is due and then spin.
+			//
+			if ( targetNs > now + SPIN_NS )
+			{
+				unsigned long   wakeNs = targetNs - SPIN_NS;
+				struct timespec until  = { wakeNs / 1000000000UL,
+										   wakeNs % 1000000000UL };
+
+				(void) clock_nanosleep ( CLOCK_MONOTONIC, TIMER_ABSTIME, &until,
+										 NULL );
+			}
+			while ( ( now = nowNs() ) < targetNs )
+			{
+			}
+			putFrame ( sharedMemory, fd, &message );
+
+			unsigned long lateNs = now - targetNs;
+			unsigned long bucket = lateNs / 1000;
+			if ( bucket >= LATENESS_BUCKETS )
+			{
+				bucket = LATENESS_BUCKETS - 1;
+			}
+			results->lateness[bucket]++;
+			if ( lateNs > results->maxLateNs )
+			{
+				results->maxLateNs = lateNs;
+			}
+			results->frames++;
+		}
+	}
+	results->elapsedNs = nowNs() - startNs;
+
+	if ( fd >= 0 )
+	{
+		(void) close ( fd );
+	}
+}
+
+
+//
+// Return a percentile of the combined lateness histograms in usec.
+//
+static unsigned long latenessPercentile ( writerResults_t* results,
+										  unsigned long frames,
+										  double percentile )
+{
+	unsigned long target = frames * percentile / 100;
+	unsigned long seen   = 0;
+
+	for ( unsigned int bucket = 0; bucket < LATENESS_BUCKETS; bucket++ )
+	{
+		for ( unsigned int i = 0; i < writerCount; i++ )
+		{
+			seen += results[i].lateness[bucket];
+		}
+		if ( seen > target )
+		{
+			return bucket;
+		}
+	}
+	return LATENESS_BUCKETS - 1;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:d:fg:hi:l:n:p:s:w:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'p':
+			profileName = optarg;
+			break;
+
+		  case 'g':
+		    generatedIds = atol ( optarg );
+			break;
+
+		  case 'l':
+		    busLoad = atof ( optarg );
+			if ( busLoad <= 0 )
+			{
+				printf ( "Invalid bus load[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'd':
+		    runSeconds = atol ( optarg );
+			break;
+
+		  case 'f':
+			fastReplay = true;
+			break;
+
+		  case 'n':
+		    frameLimit = atol ( optarg );
+			break;
+
+		  case 'w':
+		    writerCount = atol ( optarg );
+			if ( writerCount <= 0 || writerCount > MAX_WRITERS )
+			{
+				printf ( "Invalid writer count[%u] specified.\n", writerCount );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 's':
+		    seed = atol ( optarg );
+			break;
+
+		  case 'i':
+			interfaceName = optarg;
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( optind != argc )
+	{
+		printf ( "Invalid parameter encountered: %s\n", argv[optind] );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	unsigned int poolSize = sharedMemoryGetPoolSize ( sharedMemory );
+
+	//
+	// Build the traffic profile.  Generated IDs are kept within the standard
+	// 11 bit ID range when the pool is big enough, like a real bus.
+	//
+	workload_t workload;
+	(void) workloadCreate ( &workload, seed );
+
+	if ( profileName != 0 )
+	{
+		if ( workloadLoadProfile ( &workload, profileName ) != 0 )
+		{
+			exit (255);
+		}
+	}
+	else
+	{
+		unsigned int maxId = poolSize < CAN_SFF_MASK + 1 ? poolSize : CAN_SFF_MASK + 1;
+		if ( workloadGenerateProfile ( &workload, generatedIds, maxId ) != 0 )
+		{
+			exit (255);
+		}
+		if ( busLoad == 0 )
+		{
+			busLoad = DEFAULT_GENERATED_LOAD;
+		}
+	}
+	for ( unsigned int i = 0; i < workload.entryCount; i++ )
+	{
+		if ( workload.entries[i].id >= poolSize )
+		{
+			printf ( "Message ID 0x%x is outside the message pool of %'u "
+					 "messages.\n", workload.entries[i].id, poolSize );
+			exit (255);
+		}
+	}
+	if ( workload.entryCount < writerCount )
+	{
+		printf ( "There are fewer IDs than writers.\n" );
+		exit (255);
+	}
+	if ( busLoad > 0 )
+	{
+		workloadScaleLoad ( &workload, busLoad );
+	}
+	double nominalRate = 0;
+	for ( unsigned int i = 0; i < workload.entryCount; i++ )
+	{
+		nominalRate += workload.entries[i].burstCount * 1e9 /
+					   workload.entries[i].periodNs;
+	}
+	printf ( "%'u IDs, %.1f%% load at %'lu bit/sec, %'lu frames/sec nominal.\n",
+			 workload.entryCount, workloadBusLoad ( &workload ), workload.bitrate,
+			 (unsigned long)nominalRate );
+
+	writerResults_t* results = mmap ( NULL, writerCount * sizeof(writerResults_t),
+									  PROT_READ|PROT_WRITE,
+									  MAP_SHARED|MAP_ANONYMOUS, -1, 0 );
+	if ( results == MAP_FAILED )
+	{
+		printf ( "Unable to map the results area.\n" );
+		exit (255);
+	}
+	//
+	// Start the writers, each with its own share of the IDs and its own
+	// random number generator.
+	//
+	pid_t pids[MAX_WRITERS];
+
+	fflush ( stdout );
+	for ( unsigned int i = 0; i < writerCount; i++ )
+	{
+		pids[i] = fork();
+		if ( pids[i] == 0 )
+		{
+			workload_t part;
+			if ( workloadSplit ( &workload, &part, i, writerCount, seed + i ) != 0 )
+			{
+				_exit (255);
+			}
+			runWriter ( sharedMemory, &part, &results[i] );
+			_exit (0);
+		}
+	}
+	int failed = 0;
+	for ( unsigned int i = 0; i < writerCount; i++ )
+	{
+		int status = 0;
+
+		(void) waitpid ( pids[i], &status, 0 );
+		failed |= ! WIFEXITED ( status ) || WEXITSTATUS ( status ) != 0;
+	}
+	if ( failed )
+	{
+		printf ( "A writer failed - Aborting\n" );
+		exit (255);
+	}
+	//
+	// Report the results.
+	//
+	unsigned long frames    = 0;
+	unsigned long elapsedNs = 0;
+	unsigned long insertNs  = 0;
+	unsigned long maxLateNs = 0;
+
+	for ( unsigned int i = 0; i < writerCount; i++ )
+	{
+		frames   += results[i].frames;
+		insertNs += results[i].insertNs;
+		if ( results[i].elapsedNs > elapsedNs )
+		{
+			elapsedNs = results[i].elapsedNs;
+		}
+		if ( results[i].maxLateNs > maxLateNs )
+		{
+			maxLateNs = results[i].maxLateNs;
+		}
+	}
+	printf ( "%'lu frames in %'lu msec. - %'lu frames/sec from %u writers.\n",
+			 frames, elapsedNs / 1000000,
+			 (unsigned long)( frames / ( elapsedNs / 1000000000.0 ) ),
+			 writerCount );
+	if ( fastReplay && insertNs > 0 )
+	{
+		printf ( "%s time only: %'lu %s/sec per writer.\n",
+				 interfaceName != 0 ? "Send" : "Insert",
+				 (unsigned long)( frames / ( insertNs / 1000000000.0 ) ),
+				 interfaceName != 0 ? "frames" : "inserts" );
+	}
+	if ( ! fastReplay && frames > 0 )
+	{
+		printf ( "Lateness: median %'lu usec, p99 %'lu usec, p99.9 %'lu usec, "
+				 "max %'lu usec.\n",
+				 latenessPercentile ( results, frames, 50 ),
+				 latenessPercentile ( results, frames, 99 ),
+				 latenessPercentile ( results, frames, 99.9 ),
+				 maxLateNs / 1000 );
+	}
+	workloadDestroy ( &workload );
+	sharedMemoryClose ( sharedMemory );
+
+    return 0;
+}
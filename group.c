@@ -0,0 +1,215 @@
+//
+//	g r o u p . c
+//
+//  Signal groups that are committed and read as a unit.  See group.h for a
+//  description.
+//
+
+#include <stdio.h>
+#include <string.h>
+
+#include "sharedMemorySegment.h"
+#include "group.h"
+
+//
+// Return the address of the member IDs and of the frames of a table.
+//
+#define GROUP_MEMBERS(table) \
+	( (canMessageIndex_t*)( (table)->groups + (table)->groupCount ) )
+#define GROUP_FRAMES(table) \
+	( (canMessage_t*)( (char*)(table) + (table)->framesOffset ) )
+
+//
+// Return the offset of the frames from the start of a table.
+//
+static unsigned long groupFramesOffset ( unsigned int groupCount,
+										 unsigned int memberCount )
+{
+	unsigned long offset = sizeof(groupTable_t) +
+						   groupCount * sizeof(groupEntry_t) +
+						   memberCount * sizeof(canMessageIndex_t);
+
+	return ( offset + 63UL ) & ~63UL;
+}
+
+
+//
+// Return the number of bytes needed for a group table region.
+//
+unsigned long groupRegionSize ( unsigned int groupCount,
+								unsigned int memberCount )
+{
+	return groupFramesOffset ( groupCount, memberCount ) +
+		   memberCount * sizeof(canMessage_t);
+}
+
+
+//
+// Check that the fields of a table read from a segment or a checkpoint image
+// describe a layout that fits in the space the region has and that every
+// group and member is in range.
+//
+// This function returns 0 if the table is valid and -1 if it is not.
+//
+int groupValidate ( const groupTable_t* table, unsigned long available,
+					unsigned int messageCount )
+{
+	if ( available < sizeof(groupTable_t) ||
+		 table->groupCount == 0 || table->groupCount > GROUP_MAX_GROUPS ||
+		 table->memberCount > table->groupCount * GROUP_MAX_MEMBERS ||
+		 groupRegionSize ( table->groupCount, table->memberCount ) > available ||
+		 table->framesOffset != groupFramesOffset ( table->groupCount,
+													table->memberCount ) )
+	{
+		return -1;
+	}
+	for ( unsigned int group = 0; group < table->groupCount; group++ )
+	{
+		const groupEntry_t* entry = &table->groups[group];
+
+		if ( entry->memberCount == 0 || entry->memberCount > GROUP_MAX_MEMBERS ||
+			 entry->firstMember > table->memberCount ||
+			 entry->memberCount > table->memberCount - entry->firstMember )
+		{
+			return -1;
+		}
+	}
+	for ( unsigned int i = 0; i < table->memberCount; i++ )
+	{
+		if ( GROUP_MEMBERS ( table )[i] >= messageCount )
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+//
+// Initialize a group table region.  The member IDs of all of the groups are
+// given one group after another in the members array.  The frames of each
+// group start out with their IDs set and no data.
+//
+void groupInitialize ( groupTable_t* table, unsigned int groupCount,
+					   const unsigned int* memberCounts,
+					   const canMessageIndex_t* members )
+{
+	unsigned int memberCount = 0;
+
+	for ( unsigned int group = 0; group < groupCount; group++ )
+	{
+		memberCount += memberCounts[group];
+	}
+	(void) memset ( table, 0, groupRegionSize ( groupCount, memberCount ) );
+
+	table->groupCount   = groupCount;
+	table->memberCount  = memberCount;
+	table->framesOffset = groupFramesOffset ( groupCount, memberCount );
+
+	(void) memcpy ( GROUP_MEMBERS ( table ), members,
+					memberCount * sizeof(canMessageIndex_t) );
+
+	unsigned int first = 0;
+	for ( unsigned int group = 0; group < groupCount; group++ )
+	{
+		table->groups[group].memberCount = memberCounts[group];
+		table->groups[group].firstMember = first;
+		first += memberCounts[group];
+	}
+	for ( unsigned int i = 0; i < memberCount; i++ )
+	{
+		GROUP_FRAMES ( table )[i].canMessage.can_id = members[i];
+	}
+}
+
+
+//
+// Return the member IDs of a group and store the number of them in the
+// caller's variable.
+//
+// This function returns 0 if there is no such group.
+//
+const canMessageIndex_t* groupMembers ( groupTable_t* table, unsigned int group,
+										unsigned int* memberCount )
+{
+	if ( group >= table->groupCount )
+	{
+		return 0;
+	}
+	*memberCount = table->groups[group].memberCount;
+
+	return GROUP_MEMBERS ( table ) + table->groups[group].firstMember;
+}
+
+
+//
+//	g r o u p W r i t e
+//
+// Copy the frames of a commit into the group table.  The frames are given in
+// the same order as the member IDs.  Only one writer may commit a group at a
+// time so this must be called with the shared memory lock held.
+//
+void groupWrite ( groupTable_t* table, unsigned int group,
+				  const canMessage_t* messages )
+{
+	groupEntry_t* entry  = &table->groups[group];
+	canMessage_t* frames = GROUP_FRAMES ( table ) + entry->firstMember;
+
+	__atomic_store_n ( &entry->sequence, entry->sequence + 1, __ATOMIC_RELAXED );
+	__atomic_thread_fence ( __ATOMIC_RELEASE );
+
+	for ( unsigned int i = 0; i < entry->memberCount; i++ )
+	{
+		frames[i].canMessage.can_id  = messages[i].canMessage.can_id;
+		frames[i].canMessage.can_dlc = messages[i].canMessage.can_dlc;
+		(void) memcpy ( frames[i].canMessage.data, messages[i].canMessage.data,
+						CAN_MAX_DLEN );
+	}
+	__atomic_store_n ( &entry->sequence, entry->sequence + 1, __ATOMIC_RELEASE );
+}
+
+
+//
+//	g r o u p R e a d
+//
+// Read a consistent copy of the last commit of a group into the caller's
+// array, which must have room for every member.  The sequence number of each
+// frame copied is set to the group's (even) sequence number, which is twice
+// the number of commits.  This function never takes the shared memory lock.
+//
+// This function returns the number of frames copied.
+//
+unsigned int groupRead ( groupTable_t* table, unsigned int group,
+						 canMessage_t* messages )
+{
+	groupEntry_t* entry  = &table->groups[group];
+	canMessage_t* frames = GROUP_FRAMES ( table ) + entry->firstMember;
+	unsigned int  count  = entry->memberCount;
+	unsigned int  before;
+
+	while ( 1 )
+	{
+		before = __atomic_load_n ( &entry->sequence, __ATOMIC_ACQUIRE );
+		if ( ( before & 1 ) == 0 )
+		{
+			for ( unsigned int i = 0; i < count; i++ )
+			{
+				messages[i].canMessage.can_id  = frames[i].canMessage.can_id;
+				messages[i].canMessage.can_dlc = frames[i].canMessage.can_dlc;
+				(void) memcpy ( messages[i].canMessage.data,
+								frames[i].canMessage.data, CAN_MAX_DLEN );
+			}
+			__atomic_thread_fence ( __ATOMIC_ACQUIRE );
+			if ( __atomic_load_n ( &entry->sequence, __ATOMIC_RELAXED ) == before )
+			{
+				break;
+			}
+		}
+		SHARED_MEMORY_CPU_RELAX();
+	}
+	for ( unsigned int i = 0; i < count; i++ )
+	{
+		messages[i].sequence = before;
+	}
+	return count;
+}
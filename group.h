@@ -0,0 +1,85 @@
+#pragma once
+#ifndef GROUP_H
+#define GROUP_H
+
+#include "canMessage.h"
+
+//
+// The group table is an optional region of the shared memory segment that
+// holds signal groups.  A group is a set of message IDs that belong together,
+// like the four wheel speed frames of one cycle.  The groups are defined when
+// the segment is created ("create -g") and can't be changed afterwards.
+//
+// A writer commits all of the frames of a group at once with insertGroup.
+// The frames are inserted into the message pool in the usual way, with one
+// acquisition of the shared memory lock for the whole group.  A copy of the
+// group is also stored in the group table.  fetchGroup reads that copy.
+// Readers never take the lock, so they never hold off any writer.
+//
+// Each group has its own sequence number which works just like the sequence
+// number of a message.  It is odd while a commit is copying the group into
+// the table.  A reader copies the group and then checks that the sequence
+// number was even and didn't change, and tries again if it wasn't.  The
+// reader therefore always gets every frame from the same commit.
+//
+// The copy in the table only changes when the group is committed.  Inserting
+// one of its IDs with insertMessage updates the message pool but not the
+// group, so fetchGroup still returns the last complete commit.
+//
+
+//
+// Define the largest number of groups and of IDs in one group.
+//
+#define GROUP_MAX_GROUPS  256
+#define GROUP_MAX_MEMBERS 64
+
+//
+// Define a group.  Its member IDs and its frames are at index firstMember of
+// the member and frame arrays.  Each group is on its own cache line.
+//
+typedef struct groupEntry_t
+{
+	unsigned int sequence;
+	unsigned int memberCount;
+	unsigned int firstMember;
+
+}   __attribute__((aligned(64))) groupEntry_t;
+
+//
+// Define the header of the group table region.  The array of groups is
+// followed by the array of member IDs of all of the groups and then by the
+// array of frames of all of the groups, which starts at framesOffset from the
+// start of the table.
+//
+typedef struct groupTable_t
+{
+	unsigned int groupCount;
+	unsigned int memberCount;               // Members of all groups
+	unsigned int framesOffset;
+	unsigned int pad;
+
+	groupEntry_t groups[0] __attribute__((aligned(64)));
+
+}   groupTable_t;
+
+//
+// Define the group table functions.
+//
+unsigned long groupRegionSize ( unsigned int groupCount,
+								unsigned int memberCount );
+int           groupValidate   ( const groupTable_t* table,
+								unsigned long available,
+								unsigned int messageCount );
+void          groupInitialize ( groupTable_t* table, unsigned int groupCount,
+								const unsigned int* memberCounts,
+								const canMessageIndex_t* members );
+
+const canMessageIndex_t* groupMembers ( groupTable_t* table, unsigned int group,
+										unsigned int* memberCount );
+
+void          groupWrite      ( groupTable_t* table, unsigned int group,
+								const canMessage_t* messages );
+unsigned int  groupRead       ( groupTable_t* table, unsigned int group,
+								canMessage_t* messages );
+
+#endif		// End of GROUP_H
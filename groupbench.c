@@ -0,0 +1,434 @@
+//
+//	g r o u p b e n c h . c
+//
+//  Check and time signal group commits and reads (see group.h).
+//
+//  The program forks writers that commit a signal group over and over,
+//  writers that insert unrelated IDs and readers that read the group.  Each
+//  commit puts the same value (the writer and its commit count) in every
+//  frame of the group, so a reader can tell if the frames it got came from
+//  more than one commit.  The readers take turns reading the group with
+//  fetchGroup and reading its members one at a time with
+//  sharedMemoryReadMessage, and count the mixed sets each way.  fetchGroup
+//  should never return one.
+//
+//  The shared memory segment must have been created with at least one signal
+//  group ("create -g").
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <locale.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the largest number of processes of each kind.
+//
+#define MAX_PROCESSES 64
+
+//
+// Define the benchmark parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static unsigned int group          = 0;
+static unsigned int groupWriters   = 1;
+static unsigned int otherWriters   = 1;
+static unsigned int readers        = 1;
+static unsigned int runSeconds     = 3;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the counters of one process.  Each is on its own cache line.
+//
+typedef struct processCounters_t
+{
+	unsigned long operations;
+	unsigned long memberReads;
+	unsigned long groupTorn;
+	unsigned long memberTorn;
+
+}   __attribute__((aligned(64))) processCounters_t;
+
+//
+// Define the results that the children pass back to the parent through an
+// anonymous shared mapping.
+//
+typedef struct benchResults_t
+{
+	volatile int      start;
+	volatile int      stop;
+	processCounters_t groupWriters[MAX_PROCESSES];
+	processCounters_t otherWriters[MAX_PROCESSES];
+	processCounters_t readers[MAX_PROCESSES];
+
+}   benchResults_t;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -g    Signal Group     int           0 \n\
+    -w    Group Writers    int           1 \n\
+    -u    Other Writers    int           1 \n\
+    -r    Readers          int           1 \n\
+    -d    Duration (sec)   int           3 \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Return true if every frame in a set has the same data.
+//
+static int sameCommit ( canMessage_t* messages, unsigned int count )
+{
+	for ( unsigned int i = 1; i < count; i++ )
+	{
+		if ( memcmp ( messages[i].canMessage.data, messages[0].canMessage.data,
+					  CAN_MAX_DLEN ) != 0 )
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+
+//
+// Run a process that commits the group.
+//
+static void runGroupWriter ( sharedMemory_t* sharedMemory, unsigned int writer,
+							 const canMessageIndex_t* members,
+							 unsigned int memberCount, benchResults_t* results )
+{
+	processCounters_t* counters = &results->groupWriters[writer];
+	canMessage_t       messages[GROUP_MAX_MEMBERS];
+
+	(void) memset ( messages, 0, sizeof(messages) );
+	for ( unsigned int i = 0; i < memberCount; i++ )
+	{
+		messages[i].canMessage.can_id  = members[i];
+		messages[i].canMessage.can_dlc = CAN_MAX_DLEN;
+	}
+	while ( ! results->start )
+	{
+		usleep ( 1000 );
+	}
+	while ( ! results->stop )
+	{
+		unsigned long value = (unsigned long)writer << 48 | counters->operations;
+
+		for ( unsigned int i = 0; i < memberCount; i++ )
+		{
+			(void) memcpy ( messages[i].canMessage.data, &value, sizeof(value) );
+		}
+		if ( insertGroup ( sharedMemory, group, messages ) < 0 )
+		{
+			_exit (255);
+		}
+		counters->operations++;
+	}
+	_exit (0);
+}
+
+
+//
+// Run a process that inserts IDs that aren't in the group.
+//
+static void runOtherWriter ( sharedMemory_t* sharedMemory, unsigned int writer,
+							 const canMessageIndex_t* members,
+							 unsigned int memberCount, benchResults_t* results )
+{
+	processCounters_t* counters = &results->otherWriters[writer];
+	unsigned int       poolSize = sharedMemoryGetPoolSize ( sharedMemory );
+	canMessageIndex_t  id       = 0;
+	canMessage_t       message;
+
+	(void) memset ( &message, 0, sizeof(message) );
+	message.canMessage.can_dlc = CAN_MAX_DLEN;
+
+	while ( ! results->start )
+	{
+		usleep ( 1000 );
+	}
+	while ( ! results->stop )
+	{
+		id = id + 1 < poolSize ? id + 1 : 0;
+
+		unsigned int i = 0;
+		while ( i < memberCount && members[i] != id )
+		{
+			i++;
+		}
+		if ( i != memberCount )
+		{
+			continue;
+		}
+		message.canMessage.can_id = id;
+		(void) insertMessage ( sharedMemory, &message );
+		counters->operations++;
+	}
+	_exit (0);
+}
+
+
+//
+// Run a process that reads the group both ways.
+//
+static void runReader ( sharedMemory_t* sharedMemory, unsigned int reader,
+						const canMessageIndex_t* members,
+						unsigned int memberCount, benchResults_t* results )
+{
+	processCounters_t* counters = &results->readers[reader];
+	canMessage_t       messages[GROUP_MAX_MEMBERS];
+
+	while ( ! results->start )
+	{
+		usleep ( 1000 );
+	}
+	while ( ! results->stop )
+	{
+		(void) fetchGroup ( sharedMemory, group, messages );
+		counters->groupTorn += ! sameCommit ( messages, memberCount );
+		counters->operations++;
+
+		for ( unsigned int i = 0; i < memberCount; i++ )
+		{
+			(void) sharedMemoryReadMessage ( sharedMemory, members[i],
+											 &messages[i] );
+		}
+		counters->memberTorn += ! sameCommit ( messages, memberCount );
+		counters->memberReads++;
+	}
+	_exit (0);
+}
+
+
+//
+// Add up the counters of a set of processes.
+//
+static processCounters_t sumCounters ( processCounters_t* counters,
+									   unsigned int count )
+{
+	processCounters_t total;
+
+	(void) memset ( &total, 0, sizeof(total) );
+	for ( unsigned int i = 0; i < count; i++ )
+	{
+		total.operations  += counters[i].operations;
+		total.memberReads += counters[i].memberReads;
+		total.groupTorn   += counters[i].groupTorn;
+		total.memberTorn  += counters[i].memberTorn;
+	}
+	return total;
+}
+
+
+//
+// Parse a process count argument.
+//
+static unsigned int countArgument ( const char* argument, unsigned int minimum,
+									const char* executable )
+{
+	unsigned int value = atol ( argument );
+
+	if ( value < minimum || value > MAX_PROCESSES )
+	{
+		printf ( "Invalid process count[%s] specified - must be %u to %u.\n",
+				 argument, minimum, MAX_PROCESSES );
+		usage ( executable );
+		exit (255);
+	}
+	return value;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:d:g:hr:u:w:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'g':
+		    group = atol ( optarg );
+			break;
+
+		  case 'w':
+			groupWriters = countArgument ( optarg, 1, argv[0] );
+			break;
+
+		  case 'u':
+			otherWriters = countArgument ( optarg, 0, argv[0] );
+			break;
+
+		  case 'r':
+			readers = countArgument ( optarg, 1, argv[0] );
+			break;
+
+		  case 'd':
+		    runSeconds = atol ( optarg );
+			if ( runSeconds <= 0 )
+			{
+				printf ( "Invalid duration[%u] specified.\n", runSeconds );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( optind != argc )
+	{
+		printf ( "Invalid parameter encountered: %s\n", argv[optind] );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	groupTable_t* table = sharedMemoryGetGroupTable ( sharedMemory );
+	if ( table == 0 )
+	{
+		printf ( "The shared memory segment has no signal groups - Use "
+				 "\"create -g\" to define them.\n" );
+		exit (255);
+	}
+	unsigned int             memberCount = 0;
+	const canMessageIndex_t* members     = groupMembers ( table, group,
+														  &memberCount );
+	if ( members == 0 )
+	{
+		printf ( "Invalid signal group[%u] specified - the segment has %u.\n",
+				 group, table->groupCount );
+		exit (255);
+	}
+	benchResults_t* results = mmap ( NULL, sizeof(benchResults_t),
+									 PROT_READ|PROT_WRITE,
+									 MAP_SHARED|MAP_ANONYMOUS, -1, 0 );
+	if ( results == MAP_FAILED )
+	{
+		printf ( "Unable to map the results area.\n" );
+		exit (255);
+	}
+	printf ( "Group %u has %u IDs: %u group writers, %u other writers and %u "
+			 "readers for %u seconds.\n", group, memberCount, groupWriters,
+			 otherWriters, readers, runSeconds );
+	fflush ( stdout );
+
+	//
+	// Start the processes and let them run.
+	//
+	for ( unsigned int i = 0; i < groupWriters; i++ )
+	{
+		if ( fork() == 0 )
+		{
+			runGroupWriter ( sharedMemory, i, members, memberCount, results );
+		}
+	}
+	for ( unsigned int i = 0; i < otherWriters; i++ )
+	{
+		if ( fork() == 0 )
+		{
+			runOtherWriter ( sharedMemory, i, members, memberCount, results );
+		}
+	}
+	for ( unsigned int i = 0; i < readers; i++ )
+	{
+		if ( fork() == 0 )
+		{
+			runReader ( sharedMemory, i, members, memberCount, results );
+		}
+	}
+	usleep ( 100 * 1000 );
+	results->start = 1;
+	sleep ( runSeconds );
+	results->stop = 1;
+
+	int failures = 0;
+	int status;
+	while ( wait ( &status ) > 0 )
+	{
+		failures += ! WIFEXITED ( status ) || WEXITSTATUS ( status ) != 0;
+	}
+	//
+	// Report the results.
+	//
+	processCounters_t commits = sumCounters ( results->groupWriters, groupWriters );
+	processCounters_t others  = sumCounters ( results->otherWriters, otherWriters );
+	processCounters_t reads   = sumCounters ( results->readers, readers );
+
+	printf ( "Group commits:      %'12lu (%'lu/sec)\n", commits.operations,
+			 commits.operations / runSeconds );
+	printf ( "Other inserts:      %'12lu (%'lu/sec)\n", others.operations,
+			 others.operations / runSeconds );
+	printf ( "fetchGroup reads:   %'12lu (%'lu/sec), %'lu mixed\n",
+			 reads.operations, reads.operations / runSeconds, reads.groupTorn );
+	printf ( "Per member reads:   %'12lu (%'lu/sec), %'lu mixed\n",
+			 reads.memberReads, reads.memberReads / runSeconds, reads.memberTorn );
+
+	if ( failures != 0 )
+	{
+		printf ( "%d processes failed.\n", failures );
+	}
+	sharedMemoryClose ( sharedMemory );
+
+	return failures != 0 || reads.groupTorn != 0 ? 1 : 0;
+}
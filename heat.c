@@ -0,0 +1,357 @@
+//
+//	h e a t . c
+//
+//  The heat map of per ID insert and read counts.  See heat.h for a
+//  description.
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <sched.h>
+#include <pthread.h>
+#include <sys/prctl.h>
+
+#include "sharedMemorySegment.h"
+#include "heat.h"
+
+//
+// Define the size that the header and the shards are padded to.
+//
+#define HEAT_PAGE_SIZE 4096UL
+
+#define HEAT_ROUND_UP(size) \
+	( ( (size) + HEAT_PAGE_SIZE - 1 ) & ~( HEAT_PAGE_SIZE - 1 ) )
+
+//
+// Define the process local cache of the reader slot bit this process has in
+// each heat map it reads from.  An entry is filled in once, with the table
+// stored last, so the reads look it up without a lock.  A child process
+// forgets its parent's slots when it is forked and claims its own.
+//
+// If every slot was taken, the bit is 0 and the claim is tried again, at
+// most once every HEAT_CLAIM_RETRY nanoseconds, until a slot is freed.
+//
+#define HEAT_MAX_TABLES  ( SHARED_MEMORY_MAX_BUSES + 1 )
+#define HEAT_CLAIM_RETRY 1000000000UL
+
+typedef struct heatCache_t
+{
+	heatTable_t*  table;
+	unsigned long bit;
+	unsigned long retryTime;                // When a failed claim is retried
+
+}   heatCache_t;
+
+static heatCache_t     heatCaches[HEAT_MAX_TABLES];
+static pthread_mutex_t heatCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t  heatForkOnce  = PTHREAD_ONCE_INIT;
+
+
+//
+// Return the counters of a shard.
+//
+static heatCounter_t* shardCounters ( heatTable_t* table, unsigned int shard )
+{
+	return (heatCounter_t*)( (char*)table + HEAT_ROUND_UP ( sizeof(heatTable_t) ) +
+							 shard * table->shardStride );
+}
+
+
+//
+// Return the reader masks.
+//
+static unsigned long* readerMasks ( heatTable_t* table )
+{
+	return (unsigned long*)( (char*)table + table->masksOffset );
+}
+
+
+//
+// Return the number of bytes needed for a heat map region.
+//
+unsigned long heatRegionSize ( unsigned int messageCount,
+							   unsigned int shardCount )
+{
+	return HEAT_ROUND_UP ( sizeof(heatTable_t) ) +
+		   shardCount * HEAT_ROUND_UP ( messageCount * sizeof(heatCounter_t) ) +
+		   (unsigned long)messageCount * sizeof(unsigned long);
+}
+
+
+//
+// Initialize a heat map region.  All of the counters, masks and reader slots
+// are cleared.
+//
+void heatInitialize ( heatTable_t* table, unsigned int messageCount,
+					  unsigned int shardCount )
+{
+	(void) memset ( table, 0, heatRegionSize ( messageCount, shardCount ) );
+
+	table->messageCount = messageCount;
+	table->shardCount   = shardCount;
+	table->shardStride  = HEAT_ROUND_UP ( messageCount * sizeof(heatCounter_t) );
+	table->masksOffset  = HEAT_ROUND_UP ( sizeof(heatTable_t) ) +
+						  shardCount * table->shardStride;
+}
+
+
+//
+// Return the shard of the CPU the calling process is running on.
+//
+static unsigned int currentShard ( heatTable_t* table )
+{
+	int cpu = sched_getcpu();
+
+	return cpu < 0 ? 0 : (unsigned int)cpu % table->shardCount;
+}
+
+
+//
+// Add one to a counter.  See heat.h for why this isn't a locked add.
+//
+static void increment ( unsigned int* counter )
+{
+	__atomic_store_n ( counter, __atomic_load_n ( counter, __ATOMIC_RELAXED ) + 1,
+					   __ATOMIC_RELAXED );
+}
+
+
+//
+// Count an insert of a message ID.
+//
+void heatCountWrite ( heatTable_t* table, canMessageIndex_t id )
+{
+	if ( id < table->messageCount )
+	{
+		increment ( &shardCounters ( table, currentShard ( table ) )[id].writes );
+	}
+}
+
+
+//
+// Forget the reader slots of the parent in a child process.
+//
+static void forgetSlots ( void )
+{
+	(void) memset ( heatCaches, 0, sizeof(heatCaches) );
+}
+
+
+//
+// Arrange for forked children to forget the reader slots.
+//
+static void registerFork ( void )
+{
+	(void) pthread_atfork ( 0, 0, forgetSlots );
+}
+
+
+//
+// Return true if a process is still running.
+//
+static int isAlive ( pid_t pid )
+{
+	return pid != 0 && ( kill ( pid, 0 ) == 0 || errno != ESRCH );
+}
+
+
+//
+// Claim a reader slot for this process.  A slot that has never been used is
+// taken first and then one whose owner is dead, whose bit is then cleared
+// from every mask.
+//
+// This function returns the bit of the slot or 0 if every slot belongs to a
+// live process.
+//
+static unsigned long claimSlot ( heatTable_t* table, pid_t self )
+{
+	for ( int pass = 0; pass < 3; pass++ )
+	{
+		for ( unsigned int i = 0; i < HEAT_MAX_READERS; i++ )
+		{
+			heatReader_t* reader = &table->readers[i];
+			pid_t         pid    = __atomic_load_n ( &reader->pid,
+													 __ATOMIC_ACQUIRE );
+			//
+			// Find a slot we already have (after reopening the segment), then
+			// a free one and then one whose owner is dead.
+			//
+			if ( pass == 0 )
+			{
+				if ( pid == self )
+				{
+					return 1UL << i;
+				}
+				continue;
+			}
+			if ( pass == 1 ? pid != 0 : isAlive ( pid ) || pid == 0 )
+			{
+				continue;
+			}
+			if ( ! __atomic_compare_exchange_n ( &reader->pid, &pid, self, 0,
+												 __ATOMIC_ACQ_REL,
+												 __ATOMIC_RELAXED ) )
+			{
+				continue;
+			}
+			if ( pass == 2 )
+			{
+				unsigned long* masks = readerMasks ( table );
+
+				for ( unsigned int j = 0; j < table->messageCount; j++ )
+				{
+					if ( __atomic_load_n ( &masks[j], __ATOMIC_RELAXED ) &
+						 ( 1UL << i ) )
+					{
+						__atomic_fetch_and ( &masks[j], ~( 1UL << i ),
+											 __ATOMIC_RELAXED );
+					}
+				}
+			}
+			(void) memset ( reader->name, 0, sizeof(reader->name) );
+			(void) prctl ( PR_GET_NAME, reader->name, 0, 0, 0 );
+
+			return 1UL << i;
+		}
+	}
+	return 0;
+}
+
+
+//
+// Return the reader slot bit of this process in a heat map, claiming a slot
+// if this is the first read the process has counted in it.  A process that
+// finds every slot taken is counted as untracked once and tries again now
+// and then (see heatCache_t).
+//
+static unsigned long readerBit ( heatTable_t* table )
+{
+	for ( int i = 0; i < HEAT_MAX_TABLES; i++ )
+	{
+		heatTable_t* cached = __atomic_load_n ( &heatCaches[i].table,
+												__ATOMIC_ACQUIRE );
+		if ( cached == table )
+		{
+			unsigned long bit = __atomic_load_n ( &heatCaches[i].bit,
+												  __ATOMIC_RELAXED );
+			if ( bit != 0 || changeNow() < __atomic_load_n ( &heatCaches[i].retryTime,
+															 __ATOMIC_RELAXED ) )
+			{
+				return bit;
+			}
+			break;
+		}
+		if ( cached == 0 )
+		{
+			break;
+		}
+	}
+	(void) pthread_once ( &heatForkOnce, registerFork );
+
+	unsigned long bit = 0;
+	unsigned long now = changeNow();
+
+	pthread_mutex_lock ( &heatCacheLock );
+
+	for ( int i = 0; i < HEAT_MAX_TABLES; i++ )
+	{
+		heatCache_t* cache = &heatCaches[i];
+
+		if ( cache->table == table )
+		{
+			if ( cache->bit == 0 && now >= cache->retryTime )
+			{
+				__atomic_store_n ( &cache->retryTime, now + HEAT_CLAIM_RETRY,
+								   __ATOMIC_RELAXED );
+				__atomic_store_n ( &cache->bit, claimSlot ( table, getpid() ),
+								   __ATOMIC_RELAXED );
+			}
+			bit = cache->bit;
+			break;
+		}
+		if ( cache->table == 0 )
+		{
+			cache->bit       = claimSlot ( table, getpid() );
+			cache->retryTime = now + HEAT_CLAIM_RETRY;
+			if ( cache->bit == 0 )
+			{
+				__atomic_fetch_add ( &table->untracked, 1, __ATOMIC_RELAXED );
+			}
+			__atomic_store_n ( &cache->table, table, __ATOMIC_RELEASE );
+
+			bit = cache->bit;
+			break;
+		}
+	}
+	pthread_mutex_unlock ( &heatCacheLock );
+
+	return bit;
+}
+
+
+//
+// Count a read of a message ID and mark this process as one of its readers.
+//
+void heatCountRead ( heatTable_t* table, canMessageIndex_t id )
+{
+	if ( id >= table->messageCount )
+	{
+		return;
+	}
+	increment ( &shardCounters ( table, currentShard ( table ) )[id].reads );
+
+	unsigned long  bit  = readerBit ( table );
+	unsigned long* mask = &readerMasks ( table )[id];
+
+	if ( bit != 0 && ( __atomic_load_n ( mask, __ATOMIC_RELAXED ) & bit ) == 0 )
+	{
+		__atomic_fetch_or ( mask, bit, __ATOMIC_RELAXED );
+	}
+}
+
+
+//
+// Add up the counters of a message ID over all of the shards.
+//
+void heatRead ( heatTable_t* table, canMessageIndex_t id, heatTotals_t* totals )
+{
+	(void) memset ( totals, 0, sizeof(*totals) );
+
+	if ( id >= table->messageCount )
+	{
+		return;
+	}
+	for ( unsigned int shard = 0; shard < table->shardCount; shard++ )
+	{
+		heatCounter_t* counter = &shardCounters ( table, shard )[id];
+
+		totals->writes += __atomic_load_n ( &counter->writes, __ATOMIC_RELAXED );
+		totals->reads  += __atomic_load_n ( &counter->reads, __ATOMIC_RELAXED );
+	}
+	totals->readerMask = __atomic_load_n ( &readerMasks ( table )[id],
+										   __ATOMIC_RELAXED );
+}
+
+
+//
+// Return the mask of the reader slots whose processes are still running.
+//
+unsigned long heatLiveReaders ( heatTable_t* table )
+{
+	unsigned long mask = 0;
+
+	for ( unsigned int i = 0; i < HEAT_MAX_READERS; i++ )
+	{
+		if ( isAlive ( __atomic_load_n ( &table->readers[i].pid,
+										 __ATOMIC_ACQUIRE ) ) )
+		{
+			mask |= 1UL << i;
+		}
+	}
+	return mask;
+}
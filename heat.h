@@ -0,0 +1,113 @@
+#pragma once
+#ifndef HEAT_H
+#define HEAT_H
+
+#include <sys/types.h>
+
+#include "canMessage.h"
+
+//
+// The heat map is an optional region of the shared memory segment that
+// counts the inserts and reads of every message ID and remembers which
+// processes read each ID, so that "heattop" can show the IDs that dominate
+// the traffic.  This is what the layout, filtering and bus partitioning of
+// the pool should be decided from.
+//
+// The counters are sharded by CPU.  Each shard holds a pair of counters for
+// every ID in the pool and a process counts its operations in the shard of
+// the CPU it is running on, so two processes on different CPUs never write
+// the same cache line, even for the same ID.  Nobody adds the shards up
+// until a monitor asks for the totals of an ID (heatRead).
+//
+// The counters are 32 bits to keep the shards small (8 bytes per ID per
+// CPU) and they wrap.  A monitor computes rates from the difference between
+// two samples, which is correct as long as it samples more often than an ID
+// can be counted 2^32 times.  They are incremented without a locked
+// instruction: a process that is moved to another CPU between picking its
+// shard and counting can, rarely, lose a count of the process now running
+// on the shard's CPU.  That is the price of keeping the count to a plain
+// add on a line that no other CPU writes.
+//
+// A process that reads from the pool claims one of HEAT_MAX_READERS reader
+// slots (a compare and swap of its pid) the first time it reads.  Each ID has
+// a mask with a bit for each slot, which is set the first time the slot's
+// process reads the ID.  The bit is only written if it isn't already set,
+// so once a process has read an ID the mask is only ever read and it stays
+// in every CPU's cache.  The number of readers of an ID is the number of
+// bits in its mask whose process is still running.  A slot whose process has
+// died is taken over, and its bit cleared from every mask, when another
+// process needs one.  The reads of a process that finds every slot in use
+// are counted but the process is not counted as a reader until a later
+// claim, tried at most once a second, finds a free slot.
+//
+// The costs on the insert and read paths are one read of the CPU number
+// (from the vDSO or rseq) and one add, plus one read of the mask for reads.
+//
+
+//
+// Define the largest number of reader processes that are told apart.
+//
+#define HEAT_MAX_READERS 64
+
+//
+// Define the counters of a single message ID in one shard.
+//
+typedef struct heatCounter_t
+{
+	unsigned int writes;
+	unsigned int reads;
+
+}   heatCounter_t;
+
+//
+// Define a reader slot.
+//
+typedef struct heatReader_t
+{
+	pid_t pid;                              // 0 if the slot has never been used
+	char  name[16];                         // Process name
+
+}   heatReader_t;
+
+//
+// Define the header of the heat map region.  The header and each shard of
+// counters are padded to a multiple of the page size, and the reader masks
+// follow the shards.
+//
+typedef struct heatTable_t
+{
+	unsigned int  messageCount;
+	unsigned int  shardCount;
+	unsigned long shardStride;              // Bytes from one shard to the next
+	unsigned long masksOffset;              // From the start of the region
+	unsigned long untracked;                // Readers that found no free slot
+
+	heatReader_t  readers[HEAT_MAX_READERS];
+
+}   heatTable_t;
+
+//
+// Define the totals of a message ID that are returned to the monitors.
+//
+typedef struct heatTotals_t
+{
+	unsigned int  writes;
+	unsigned int  reads;
+	unsigned long readerMask;
+
+}   heatTotals_t;
+
+//
+// Define the heat map functions.
+//
+unsigned long heatRegionSize ( unsigned int messageCount,
+							   unsigned int shardCount );
+void          heatInitialize ( heatTable_t* table, unsigned int messageCount,
+							   unsigned int shardCount );
+void          heatCountWrite ( heatTable_t* table, canMessageIndex_t id );
+void          heatCountRead  ( heatTable_t* table, canMessageIndex_t id );
+void          heatRead       ( heatTable_t* table, canMessageIndex_t id,
+							   heatTotals_t* totals );
+unsigned long heatLiveReaders ( heatTable_t* table );
+
+#endif		// End of HEAT_H
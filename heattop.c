@@ -0,0 +1,376 @@
+//
+//	h e a t t o p . c
+//
+//  Display the message IDs that get the most traffic, in the manner of
+//  "top", from the heat map (see heat.h).
+//
+//  The shared memory segment must have been created with a heat map (see
+//  the "-H" option of the "create" program).  Every refresh interval the
+//  per CPU counters of every ID are added up and compared with the previous
+//  totals, and the IDs with the highest insert rates, the highest read rates
+//  and the most reader processes are shown side by side along with the
+//  totals for the whole pool and the reader processes that are running.
+//
+//  The counters are only read, so this never slows down the writers or the
+//  readers.  With "-p" the screen is not cleared between refreshes so the
+//  output can be saved in a file.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <locale.h>
+#include <stdbool.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the largest number of IDs shown in each list.
+//
+#define MAX_TOP 100
+
+//
+// Define the display parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static unsigned int refreshSeconds = 1;
+static unsigned int topCount       = 10;
+static unsigned int refreshCount   = 0;
+static bool         plainOutput    = false;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define an entry in a list of the top IDs.
+//
+typedef struct topEntry_t
+{
+	canMessageIndex_t id;
+	unsigned long     value;
+	unsigned long     order;                // Breaks ties in value
+
+}   topEntry_t;
+
+//
+// Define a list of the top IDs, kept in descending order.
+//
+typedef struct topList_t
+{
+	unsigned int count;
+	topEntry_t   entries[MAX_TOP];
+
+}   topList_t;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -n    Top IDs          int          10 \n\
+    -r    Refresh (sec)    int           1 \n\
+    -c    Refresh Count    int      Forever \n\
+    -p    Plain Output     bool      false \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Add an ID to a list of the top IDs if it belongs there.
+//
+static void addTop ( topList_t* list, canMessageIndex_t id,
+					 unsigned long value, unsigned long order )
+{
+	if ( value == 0 )
+	{
+		return;
+	}
+	unsigned int i = list->count;
+
+	if ( i == topCount )
+	{
+		topEntry_t* last = &list->entries[i - 1];
+
+		if ( value < last->value || ( value == last->value && order <= last->order ) )
+		{
+			return;
+		}
+		i--;
+	}
+	else
+	{
+		list->count++;
+	}
+	while ( i > 0 && ( list->entries[i - 1].value < value ||
+					   ( list->entries[i - 1].value == value &&
+						 list->entries[i - 1].order < order ) ) )
+	{
+		list->entries[i] = list->entries[i - 1];
+		i--;
+	}
+	list->entries[i].id    = id;
+	list->entries[i].value = value;
+	list->entries[i].order = order;
+}
+
+
+//
+// Print one column of a row of the top lists.
+//
+static void printColumn ( topList_t* list, unsigned int row )
+{
+	if ( row < list->count )
+	{
+		char id[16];
+
+		(void) snprintf ( id, sizeof(id), "0x%x", list->entries[row].id );
+		printf ( "  %10s %'13lu", id, list->entries[row].value );
+	}
+	else
+	{
+		printf ( "  %10s %13s", "", "" );
+	}
+}
+
+
+//
+// Return the current monotonic time in nanoseconds.
+//
+static unsigned long nowNs ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:c:hn:pr:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'n':
+		    topCount = atol ( optarg );
+			if ( topCount < 1 || topCount > MAX_TOP )
+			{
+				printf ( "Invalid top ID count[%s] specified - must be 1 to "
+						 "%u.\n", optarg, MAX_TOP );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'r':
+		    refreshSeconds = atol ( optarg );
+			if ( refreshSeconds < 1 )
+			{
+				printf ( "Invalid refresh interval[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'c':
+		    refreshCount = atol ( optarg );
+			break;
+
+		  case 'p':
+			plainOutput = true;
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( optind != argc )
+	{
+		printf ( "Invalid parameter encountered: %s\n", argv[optind] );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	heatTable_t* table = sharedMemoryGetHeatMap ( sharedMemory );
+	if ( table == 0 )
+	{
+		printf ( "The shared memory segment has no heat map - Use \"create "
+				 "-H\" to define one.\n" );
+		exit (255);
+	}
+	unsigned int  messageCount = table->messageCount;
+	unsigned int* lastWrites   = calloc ( messageCount, sizeof(unsigned int) );
+	unsigned int* lastReads    = calloc ( messageCount, sizeof(unsigned int) );
+
+	if ( lastWrites == 0 || lastReads == 0 )
+	{
+		printf ( "Unable to allocate the counters of %'u IDs.\n", messageCount );
+		exit (255);
+	}
+	//
+	// Take the first totals so the first refresh shows rates.
+	//
+	heatTotals_t totals;
+
+	for ( canMessageIndex_t id = 0; id < messageCount; id++ )
+	{
+		heatRead ( table, id, &totals );
+		lastWrites[id] = totals.writes;
+		lastReads[id]  = totals.reads;
+	}
+	unsigned long lastTime = nowNs();
+
+	for ( unsigned int refresh = 0; refreshCount == 0 || refresh < refreshCount;
+		  refresh++ )
+	{
+		sleep ( refreshSeconds );
+
+		unsigned long now     = nowNs();
+		double        seconds = ( now - lastTime ) / 1e9;
+		unsigned long live    = heatLiveReaders ( table );
+
+		static topList_t topWrites;
+		static topList_t topReads;
+		static topList_t topReaders;
+
+		topWrites.count  = 0;
+		topReads.count   = 0;
+		topReaders.count = 0;
+
+		unsigned long totalWrites = 0;
+		unsigned long totalReads  = 0;
+		unsigned int  writtenIds  = 0;
+		unsigned int  readIds     = 0;
+
+		for ( canMessageIndex_t id = 0; id < messageCount; id++ )
+		{
+			heatRead ( table, id, &totals );
+
+			//
+			// The counters wrap so the differences are taken in 32 bits.
+			//
+			unsigned int writes  = totals.writes - lastWrites[id];
+			unsigned int reads   = totals.reads - lastReads[id];
+			unsigned int readers = __builtin_popcountl ( totals.readerMask & live );
+
+			lastWrites[id] = totals.writes;
+			lastReads[id]  = totals.reads;
+
+			totalWrites += writes;
+			totalReads  += reads;
+			writtenIds  += writes != 0;
+			readIds     += reads != 0;
+
+			addTop ( &topWrites, id, writes / seconds, 0 );
+			addTop ( &topReads, id, reads / seconds, 0 );
+			addTop ( &topReaders, id, readers, reads );
+		}
+		lastTime = now;
+
+		//
+		// Show the lists.
+		//
+		if ( ! plainOutput )
+		{
+			printf ( "\033[H\033[2J" );
+		}
+		printf ( "heattop - %'u IDs, %u CPU shards, %d reader processes, "
+				 "every %u sec\n", messageCount, table->shardCount,
+				 __builtin_popcountl ( live ), refreshSeconds );
+		printf ( "Writes: %'lu/sec on %'u IDs   Reads: %'lu/sec on %'u IDs\n\n",
+				 (unsigned long)( totalWrites / seconds ), writtenIds,
+				 (unsigned long)( totalReads / seconds ), readIds );
+		printf ( "  %-24s  %-24s  %-24s\n", "Writes/sec", "Reads/sec",
+				 "Readers" );
+
+		for ( unsigned int row = 0; row < topCount; row++ )
+		{
+			if ( row >= topWrites.count && row >= topReads.count &&
+				 row >= topReaders.count )
+			{
+				break;
+			}
+			printColumn ( &topWrites, row );
+			printColumn ( &topReads, row );
+			printColumn ( &topReaders, row );
+			printf ( "\n" );
+		}
+		printf ( "\nReader processes:" );
+		for ( unsigned int i = 0; i < HEAT_MAX_READERS; i++ )
+		{
+			if ( live & ( 1UL << i ) )
+			{
+				printf ( " %d(%.16s)", table->readers[i].pid,
+						 table->readers[i].name );
+			}
+		}
+		if ( table->untracked != 0 )
+		{
+			printf ( " + %'lu without a slot", table->untracked );
+		}
+		printf ( "\n" );
+		if ( plainOutput )
+		{
+			printf ( "\n" );
+		}
+		fflush ( stdout );
+	}
+	free ( lastWrites );
+	free ( lastReads );
+	sharedMemoryClose ( sharedMemory );
+
+	return 0;
+}
@@ -0,0 +1,742 @@
+//
+//	i n g e s t . c
+//
+//  Read CAN frames from one or more SocketCAN interfaces and insert them
+//  into the shared memory message pool.
+//
+//  Each interface is given with "-i <name>[:<bus>]" and its frames go into
+//  the segment of that CAN bus partition (or of the "-b" bus if none is
+//  given).  The frames are read with recvmmsg, up to "-B" at a time, straight
+//  into an array of messages that is then inserted with insertMessages, so
+//  the system call and the shared memory lock are both paid once per batch.
+//
+//  The kernel only passes up the frames that the pool can hold.  A CAN_RAW
+//  filter is built from the "-I" list of IDs (every ID in the message pool
+//  by default), with consecutive IDs merged into as few ID/mask pairs as
+//  possible.  Remote frames are filtered out and extended frames are only
+//  accepted with "-e", in which case the ID without the flag is the index
+//  into the pool.
+//
+//  Every frame is time stamped by the kernel when it is received
+//  (SO_TIMESTAMPING) and the ingest latency is the time from that time stamp
+//  to the end of the insert of its batch.  The number of frames, the batch
+//  size, the latency and the frames that the kernel dropped because its
+//  receive queue was full (SO_RXQ_OVFL) are reported once a second.
+//
+//  To test against a virtual CAN interface:
+//
+//      ip link add dev vcan0 type vcan
+//      ip link set vcan0 up
+//      ./ingest -i vcan0 &
+//      ./generate -i vcan0 -l 100
+//
+//  "generate -i" sends its traffic to the interface instead of the pool,
+//  paced to the requested bus load (100% of a 500 kbit/sec bus here), or as
+//  fast as the interface will take it with "-f".
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <locale.h>
+#include <stdbool.h>
+#include <time.h>
+#include <poll.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/can.h>
+#include <linux/can/raw.h>
+#include <linux/net_tstamp.h>
+
+#include "sharedMemory.h"
+#include "realtime.h"
+
+//
+// Define the largest number of interfaces, of frames read at once and of IDs
+// in the "-I" list.
+//
+#define MAX_INTERFACES 16
+#define MAX_BATCH      1024
+#define MAX_IDS        ( ( CAN_SFF_MASK + 1 ) * 16 )
+
+//
+// Define the largest number of CAN_RAW filters the kernel accepts.
+//
+#ifndef CAN_RAW_FILTER_MAX
+#define CAN_RAW_FILTER_MAX 512
+#endif
+
+//
+// Define the receive buffer requested for each socket.  A burst of frames at
+// full load must fit in it while the ingest thread is busy inserting.
+//
+#define RECEIVE_BUFFER ( 4 * 1024 * 1024 )
+
+//
+// Define the state of an interface.
+//
+typedef struct interface_t
+{
+	const char*     name;
+	int             bus;
+	int             fd;
+	sharedMemory_t* sharedMemory;
+	unsigned int    poolSize;
+	unsigned int    kernelDropped;          // Last SO_RXQ_OVFL count
+	unsigned long   frames;
+	unsigned long   batches;
+	unsigned long   dropped;
+	unsigned long   rejected;
+
+}   interface_t;
+
+//
+// Define the ingest parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static unsigned int durationSeconds = 0;
+static unsigned int batchSize       = 64;
+static bool         extendedFrames  = false;
+static bool         quiet           = false;
+static const char*  idList          = 0;
+
+//
+// Define the CAN bus partition used for the interfaces that don't name one.
+// If this is not specified with the "-b" option, the original unpartitioned
+// segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the interfaces.
+//
+static interface_t  interfaces[MAX_INTERFACES];
+static unsigned int interfaceCount = 0;
+
+static volatile int stopRequested = 0;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -i    Interface       string     None \n\
+    -I    Message IDs     string   Whole Pool \n\
+    -e    Extended IDs     bool      false \n\
+    -B    Batch Frames     int          64 \n\
+    -d    Duration (sec)   int     Forever \n\
+    -q    Quiet            bool      false \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\
+  Each -i option is <interface>[:<bus>] and the frames from the interface\n\
+  go into the segment of that bus (or of the -b bus).  Up to %u interfaces\n\
+  can be given.  The IDs are a list of IDs and ID ranges like 0-0x7ff,0x18db.\n\
+\n\n\
+",
+             executable, MAX_INTERFACES );
+}
+
+
+//
+// Handle the interrupt signal by asking the main loop to stop.
+//
+static void stopHandler ( int signalNumber )
+{
+	stopRequested = 1;
+}
+
+
+//
+// Return the current time in nanoseconds from a clock.
+//
+static unsigned long clockNs ( clockid_t clock )
+{
+	struct timespec now;
+
+	clock_gettime ( clock, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// Compare two message IDs for qsort.
+//
+static int compareIds ( const void* left, const void* right )
+{
+	canMessageIndex_t a = *(const canMessageIndex_t*)left;
+	canMessageIndex_t b = *(const canMessageIndex_t*)right;
+
+	return a < b ? -1 : a > b;
+}
+
+
+//
+// Add the filters that accept a range of IDs of one frame format (standard
+// or extended) to a filter list.  The range is split into aligned power of 2
+// blocks, each of which is one ID and mask.  Remote frames never match.
+//
+// This function returns the new number of filters or -1 if there are too
+// many.
+//
+static int addRangeFilters ( struct can_filter* filters, int count,
+							 unsigned long first, unsigned long last,
+							 canid_t format )
+{
+	canid_t idMask = format == CAN_EFF_FLAG ? CAN_EFF_MASK : CAN_SFF_MASK;
+
+	while ( count >= 0 && first <= last )
+	{
+		//
+		// Find the largest aligned block that starts at the first ID and
+		// doesn't go past the last one.
+		//
+		unsigned long size = first == 0 ? idMask + 1UL : first & -first;
+		while ( first + size - 1 > last )
+		{
+			size >>= 1;
+		}
+		if ( count == CAN_RAW_FILTER_MAX )
+		{
+			return -1;
+		}
+		filters[count].can_id   = first | format;
+		filters[count].can_mask = ( ~( size - 1 ) & idMask ) | CAN_EFF_FLAG |
+								  CAN_RTR_FLAG;
+		count++;
+		first += size;
+	}
+	return count;
+}
+
+
+//
+// Add the filters for a range of IDs, as standard frames for the part of it
+// in the 11 bit range and as extended frames if they are accepted.
+//
+static int addFilters ( struct can_filter* filters, int count,
+						unsigned long first, unsigned long last )
+{
+	if ( count >= 0 && first <= CAN_SFF_MASK )
+	{
+		count = addRangeFilters ( filters, count, first,
+								  last < CAN_SFF_MASK ? last : CAN_SFF_MASK, 0 );
+	}
+	if ( count >= 0 && extendedFrames )
+	{
+		count = addRangeFilters ( filters, count, first, last, CAN_EFF_FLAG );
+	}
+	return count;
+}
+
+
+//
+// Build the CAN_RAW filters for the IDs that an interface passes up to us.
+// These are the IDs in the "-I" list, or every ID in the message pool, that
+// can be stored in the pool.
+//
+// This function returns the number of filters or -1 if the IDs need more
+// filters than the kernel allows.
+//
+static int buildFilters ( struct can_filter* filters, unsigned int poolSize,
+						  canMessageIndex_t* ids, int idCount )
+{
+	unsigned long limit = extendedFrames ? CAN_EFF_MASK : CAN_SFF_MASK;
+	int           count = 0;
+
+	if ( limit > poolSize - 1 )
+	{
+		limit = poolSize - 1;
+	}
+	if ( idCount == 0 )
+	{
+		return addFilters ( filters, 0, 0, limit );
+	}
+	for ( int i = 0; i < idCount && count >= 0; )
+	{
+		unsigned long first = ids[i];
+		unsigned long last  = ids[i];
+
+		while ( ++i < idCount && ids[i] <= last + 1 )
+		{
+			last = ids[i];
+		}
+		if ( first > limit )
+		{
+			break;
+		}
+		if ( last > limit )
+		{
+			last = limit;
+		}
+		count = addFilters ( filters, count, first, last );
+	}
+	return count;
+}
+
+
+//
+// Open the raw CAN socket of an interface with its filters, kernel time
+// stamps and drop counter.
+//
+// This function returns 0 if the socket is ready and -1 if it is not.
+//
+static int openInterface ( interface_t* interface, canMessageIndex_t* ids,
+						   int idCount )
+{
+	struct can_filter filters[CAN_RAW_FILTER_MAX];
+	int               filterCount = buildFilters ( filters, interface->poolSize,
+												   ids, idCount );
+	if ( filterCount < 0 )
+	{
+		printf ( "The message IDs for %s need more than %u CAN filters - Use "
+				 "ranges of IDs.\n", interface->name, CAN_RAW_FILTER_MAX );
+		return -1;
+	}
+	interface->fd = socket ( PF_CAN, SOCK_RAW, CAN_RAW );
+	if ( interface->fd < 0 )
+	{
+		printf ( "Unable to open a CAN socket - errno: %u[%s].\n", errno,
+				 strerror(errno) );
+		return -1;
+	}
+	struct sockaddr_can address;
+	(void) memset ( &address, 0, sizeof(address) );
+	address.can_family  = AF_CAN;
+	address.can_ifindex = if_nametoindex ( interface->name );
+	if ( address.can_ifindex == 0 )
+	{
+		printf ( "Unknown CAN interface[%s].\n", interface->name );
+		return -1;
+	}
+	if ( setsockopt ( interface->fd, SOL_CAN_RAW, CAN_RAW_FILTER, filters,
+					  filterCount * sizeof(struct can_filter) ) != 0 )
+	{
+		printf ( "Unable to set the CAN filters of %s - errno: %u[%s].\n",
+				 interface->name, errno, strerror(errno) );
+		return -1;
+	}
+	int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+	int on    = 1;
+	int size  = RECEIVE_BUFFER;
+
+	if ( setsockopt ( interface->fd, SOL_SOCKET, SO_TIMESTAMPING, &flags,
+					  sizeof(flags) ) != 0 ||
+		 setsockopt ( interface->fd, SOL_SOCKET, SO_RXQ_OVFL, &on,
+					  sizeof(on) ) != 0 )
+	{
+		printf ( "Unable to enable time stamps on %s - errno: %u[%s].\n",
+				 interface->name, errno, strerror(errno) );
+		return -1;
+	}
+	//
+	// Only root can go over the system limit on the receive buffer size so
+	// fall back to asking for it normally.
+	//
+	if ( setsockopt ( interface->fd, SOL_SOCKET, SO_RCVBUFFORCE, &size,
+					  sizeof(size) ) != 0 )
+	{
+		(void) setsockopt ( interface->fd, SOL_SOCKET, SO_RCVBUF, &size,
+							sizeof(size) );
+	}
+	if ( bind ( interface->fd, (struct sockaddr*)&address, sizeof(address) ) != 0 )
+	{
+		printf ( "Unable to bind to CAN interface[%s] - errno: %u[%s].\n",
+				 interface->name, errno, strerror(errno) );
+		return -1;
+	}
+	printf ( "Reading %s into bus %d with %d CAN filters.\n", interface->name,
+			 interface->bus, filterCount );
+	return 0;
+}
+
+
+//
+// Define the buffers for one batch of frames.  The frames are received
+// straight into the messages that are inserted.
+//
+static canMessage_t   messages[MAX_BATCH];
+static struct mmsghdr headers[MAX_BATCH];
+static struct iovec   vectors[MAX_BATCH];
+static char           controls[MAX_BATCH][CMSG_SPACE(sizeof(struct timespec) * 3) +
+										  CMSG_SPACE(sizeof(unsigned int))];
+static bool           inserted[MAX_BATCH];
+
+//
+// Read a batch of frames from an interface and insert them into its message
+// pool.  The ingest latency of each frame that was inserted is added to the
+// histogram.
+//
+// This function returns the number of frames read.
+//
+static int ingestBatch ( interface_t* interface, latencyHistogram_t* latency )
+{
+	for ( unsigned int i = 0; i < batchSize; i++ )
+	{
+		headers[i].msg_hdr.msg_controllen = sizeof(controls[i]);
+		headers[i].msg_hdr.msg_flags      = 0;
+	}
+	int count = recvmmsg ( interface->fd, headers, batchSize, MSG_DONTWAIT, NULL );
+	if ( count <= 0 )
+	{
+		return 0;
+	}
+	//
+	// Strip the flags from the IDs and drop anything the pool can't hold,
+	// which the filters should have stopped already.
+	//
+	int kept = 0;
+	for ( int i = 0; i < count; i++ )
+	{
+		canid_t id = messages[i].canMessage.can_id;
+
+		id = id & CAN_EFF_FLAG ? id & CAN_EFF_MASK : id & CAN_SFF_MASK;
+		inserted[i] = id < interface->poolSize &&
+					  headers[i].msg_len == sizeof(struct can_frame);
+		if ( ! inserted[i] )
+		{
+			interface->rejected++;
+			continue;
+		}
+		messages[i].canMessage.can_id = id;
+		if ( kept != i )
+		{
+			messages[kept] = messages[i];
+		}
+		kept++;
+	}
+	(void) insertMessages ( interface->sharedMemory, messages, kept );
+
+	unsigned long now = clockNs ( CLOCK_REALTIME );
+
+	//
+	// Get the kernel time stamp of each frame that was inserted and the drop
+	// counter, which every frame carries.
+	//
+	for ( int i = 0; i < count; i++ )
+	{
+		struct msghdr* header = &headers[i].msg_hdr;
+
+		for ( struct cmsghdr* control = CMSG_FIRSTHDR ( header ); control != 0;
+			  control = CMSG_NXTHDR ( header, control ) )
+		{
+			if ( control->cmsg_level != SOL_SOCKET )
+			{
+				continue;
+			}
+			if ( control->cmsg_type == SO_TIMESTAMPING && inserted[i] )
+			{
+				struct timespec stamps[3];
+
+				(void) memcpy ( stamps, CMSG_DATA ( control ), sizeof(stamps) );
+				unsigned long received = stamps[0].tv_sec * 1000000000UL +
+										 stamps[0].tv_nsec;
+				if ( received != 0 && now > received )
+				{
+					histogramAdd ( latency, now - received );
+				}
+			}
+			else if ( control->cmsg_type == SO_RXQ_OVFL )
+			{
+				unsigned int dropped;
+
+				(void) memcpy ( &dropped, CMSG_DATA ( control ), sizeof(dropped) );
+				interface->dropped      += dropped - interface->kernelDropped;
+				interface->kernelDropped = dropped;
+			}
+		}
+	}
+	interface->frames += kept;
+	interface->batches++;
+
+	return count;
+}
+
+
+//
+// Print the activity of the last reporting period.
+//
+static void report ( unsigned long elapsedNs, unsigned long frames,
+					 unsigned long batches, unsigned long dropped,
+					 latencyHistogram_t* latency )
+{
+	double seconds = elapsedNs / 1e9;
+
+	printf ( "%'10lu frames/sec  %6.1f frames/batch  latency mean %'7lu "
+			 "p50 < %'7lu p99 < %'7lu max %'8lu nsec  %'lu dropped\n",
+			 (unsigned long)( frames / seconds ),
+			 batches != 0 ? (double)frames / batches : 0.0,
+			 latency->count != 0 ? latency->total / latency->count : 0,
+			 histogramPercentile ( latency, 50 ),
+			 histogramPercentile ( latency, 99 ), latency->maximum, dropped );
+	fflush ( stdout );
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:B:d:ehi:I:q?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  //
+		  // Get an interface and the bus it feeds.
+		  //
+		  case 'i':
+		  {
+			if ( interfaceCount == MAX_INTERFACES )
+			{
+				printf ( "Too many interfaces specified - the limit is %u.\n",
+						 MAX_INTERFACES );
+				exit (255);
+			}
+			interface_t* interface = &interfaces[interfaceCount++];
+			char*        bus       = strchr ( optarg, ':' );
+
+			interface->name = optarg;
+			interface->bus  = SHARED_MEMORY_MAX_BUSES;
+			if ( bus != 0 )
+			{
+				*bus++ = 0;
+				interface->bus = atoi ( bus );
+				if ( interface->bus < 0 ||
+					 interface->bus >= SHARED_MEMORY_MAX_BUSES )
+				{
+					printf ( "Invalid CAN bus[%s] specified.\n", bus );
+					usage ( argv[0] );
+					exit (255);
+				}
+			}
+			break;
+		  }
+
+		  case 'I':
+			idList = optarg;
+			break;
+
+		  case 'e':
+			extendedFrames = true;
+			break;
+
+		  case 'B':
+		    batchSize = atol ( optarg );
+			if ( batchSize <= 0 || batchSize > MAX_BATCH )
+			{
+				printf ( "Invalid batch size[%s] specified - must be 1 to "
+						 "%u.\n", optarg, MAX_BATCH );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'd':
+		    durationSeconds = atol ( optarg );
+			break;
+
+		  case 'q':
+			quiet = true;
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( optind != argc || interfaceCount == 0 )
+	{
+		printf ( "No CAN interface or an invalid parameter was given.\n" );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Get the IDs to accept, in order.
+	//
+	static canMessageIndex_t ids[MAX_IDS];
+	int                      idCount = 0;
+
+	if ( idList != 0 )
+	{
+		idCount = parseMessageIdList ( idList, ids, MAX_IDS );
+		if ( idCount <= 0 )
+		{
+			printf ( "Invalid message ID list[%s] specified.\n", idList );
+			usage ( argv[0] );
+			exit (255);
+		}
+		qsort ( ids, idCount, sizeof(canMessageIndex_t), compareIds );
+	}
+	//
+	// Open the segment of each interface's bus and its socket.  Interfaces
+	// that feed the same bus share the segment.
+	//
+	sharedMemory_t* segments[SHARED_MEMORY_MAX_BUSES + 1] = { 0 };
+
+	for ( unsigned int i = 0; i < interfaceCount; i++ )
+	{
+		interface_t* interface = &interfaces[i];
+
+		if ( interface->bus == SHARED_MEMORY_MAX_BUSES )
+		{
+			interface->bus = busId;
+		}
+		unsigned int slot = interface->bus == SHARED_MEMORY_NO_BUS ?
+							SHARED_MEMORY_MAX_BUSES : interface->bus;
+		if ( segments[slot] == 0 )
+		{
+			segments[slot] = sharedMemoryOpenBus ( interface->bus );
+			if ( segments[slot] == 0 )
+			{
+				printf ( "Unable to open the shared memory segment of bus %d - "
+						 "Aborting\n", interface->bus );
+				exit (255);
+			}
+		}
+		interface->sharedMemory = segments[slot];
+		interface->poolSize     = sharedMemoryGetPoolSize ( segments[slot] );
+
+		if ( openInterface ( interface, ids, idCount ) != 0 )
+		{
+			exit (255);
+		}
+	}
+	//
+	// Set up the receive buffers.
+	//
+	for ( unsigned int i = 0; i < MAX_BATCH; i++ )
+	{
+		vectors[i].iov_base                = &messages[i].canMessage;
+		vectors[i].iov_len                 = sizeof(struct can_frame);
+		headers[i].msg_hdr.msg_iov         = &vectors[i];
+		headers[i].msg_hdr.msg_iovlen      = 1;
+		headers[i].msg_hdr.msg_control     = controls[i];
+	}
+	signal ( SIGINT,  stopHandler );
+	signal ( SIGTERM, stopHandler );
+
+	struct pollfd polls[MAX_INTERFACES];
+	for ( unsigned int i = 0; i < interfaceCount; i++ )
+	{
+		polls[i].fd     = interfaces[i].fd;
+		polls[i].events = POLLIN;
+	}
+	latencyHistogram_t latency;
+	latencyHistogram_t totalLatency;
+	histogramInitialize ( &latency );
+	histogramInitialize ( &totalLatency );
+
+	unsigned long start       = clockNs ( CLOCK_MONOTONIC );
+	unsigned long lastReport  = start;
+	unsigned long lastFrames  = 0;
+	unsigned long lastBatches = 0;
+	unsigned long lastDropped = 0;
+
+	while ( ! stopRequested )
+	{
+		if ( poll ( polls, interfaceCount, 100 ) > 0 )
+		{
+			for ( unsigned int i = 0; i < interfaceCount; i++ )
+			{
+				if ( polls[i].revents & POLLIN )
+				{
+					(void) ingestBatch ( &interfaces[i], &latency );
+				}
+			}
+		}
+		unsigned long now = clockNs ( CLOCK_MONOTONIC );
+		if ( now - lastReport >= 1000000000UL )
+		{
+			unsigned long frames  = 0;
+			unsigned long batches = 0;
+			unsigned long dropped = 0;
+
+			for ( unsigned int i = 0; i < interfaceCount; i++ )
+			{
+				frames  += interfaces[i].frames;
+				batches += interfaces[i].batches;
+				dropped += interfaces[i].dropped;
+			}
+			if ( ! quiet )
+			{
+				report ( now - lastReport, frames - lastFrames,
+						 batches - lastBatches, dropped - lastDropped, &latency );
+			}
+			histogramMerge ( &totalLatency, &latency );
+			histogramInitialize ( &latency );
+			lastFrames  = frames;
+			lastBatches = batches;
+			lastDropped = dropped;
+			lastReport  = now;
+		}
+		if ( durationSeconds != 0 && now - start >= durationSeconds * 1000000000UL )
+		{
+			break;
+		}
+	}
+	histogramMerge ( &totalLatency, &latency );
+
+	//
+	// Report the totals for each interface and the overall latency.
+	//
+	double seconds = ( clockNs ( CLOCK_MONOTONIC ) - start ) / 1e9;
+
+	for ( unsigned int i = 0; i < interfaceCount; i++ )
+	{
+		interface_t* interface = &interfaces[i];
+
+		printf ( "%s: %'lu frames (%'lu/sec) in %'lu batches, %'lu dropped by "
+				 "the kernel, %'lu rejected.\n", interface->name,
+				 interface->frames, (unsigned long)( interface->frames / seconds ),
+				 interface->batches, interface->dropped, interface->rejected );
+		(void) close ( interface->fd );
+	}
+	histogramPrint ( &totalLatency, "Ingest latency" );
+
+	for ( unsigned int i = 0; i <= SHARED_MEMORY_MAX_BUSES; i++ )
+	{
+		if ( segments[i] != 0 )
+		{
+			sharedMemoryClose ( segments[i] );
+		}
+	}
+	return 0;
+}
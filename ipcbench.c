@@ -0,0 +1,838 @@
+//
+//	i p c b e n c h . c
+//
+//  Compare the shared memory segment with the usual Linux IPC mechanisms by
+//  moving the same CAN message workload through each of them.
+//
+//  Each transport is run with the same number of producer and consumer
+//  processes.  Every consumer receives every message, which is what the CAN
+//  consumers need: a signal decoder, a logger and a gateway all want the
+//  whole bus.  The transports are:
+//
+//      pipe      - One pipe per consumer.  Each producer writes every message
+//                  to every pipe.
+//      unix      - One Unix domain stream socket pair per consumer.
+//      seqpacket - One Unix domain SOCK_SEQPACKET socket pair per consumer.
+//      mqueue    - One POSIX message queue per consumer.
+//      shm       - The shared memory segment.  The producers use
+//                  insertMessage and the consumers read the stream ring (see
+//                  stream.h), which gives each of them every frame.
+//
+//  The messages are whole canMessage_t records for the kernel transports and
+//  16 byte stream frames for the segment.  They are sent one per call.  The
+//  consumers of the kernel transports block in the kernel.  The stream ring
+//  consumers poll the ring and yield the processor when it is empty.
+//
+//  Each message carries the CLOCK_MONOTONIC time at which it was sent.  The
+//  consumer subtracts that from the time it received it and adds the result
+//  to a latency histogram.  The throughput is the number of messages sent
+//  divided by the time from the start until the last consumer has received
+//  every message.
+//
+//  By default the producers send as fast as they can, which measures the
+//  throughput, but the latency then includes the time each message waits
+//  behind the ones in front of it.  With "-r" each producer sends at a fixed
+//  rate instead, so the queues stay empty and the latency is that of the
+//  transport itself.
+//
+//  The shm transport creates its own segment with a stream ring on a spare
+//  bus partition (15 unless "-b" is given) with the "create" program that
+//  sits next to this one.
+//
+//  "make bench-ipc" runs the standard comparison and writes the results to
+//  ipcResults.csv.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sched.h>
+#include <locale.h>
+#include <libgen.h>
+#include <mqueue.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#include "sharedMemory.h"
+#include "realtime.h"
+
+//
+// Define the limits of the benchmark.
+//
+#define MAX_PRODUCERS 16
+#define MAX_CONSUMERS 16
+#define MAX_BATCH     256
+
+//
+// Define the transports.
+//
+#define TRANSPORT_PIPE      0
+#define TRANSPORT_UNIX      1
+#define TRANSPORT_SEQPACKET 2
+#define TRANSPORT_MQUEUE    3
+#define TRANSPORT_SHM       4
+#define TRANSPORT_COUNT     5
+
+static const char* transportNames[TRANSPORT_COUNT] =
+{
+	"pipe", "unix", "seqpacket", "mqueue", "shm"
+};
+
+//
+// Define the benchmark parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static unsigned int  producerCount = 1;
+static unsigned int  consumerCount = 1;
+static unsigned long messageCount  = 200000;
+static unsigned int  queueDepth    = 64;
+static unsigned long sendRate      = 0;
+static const char*   csvName       = 0;
+static int           selected[TRANSPORT_COUNT] = { 1, 1, 1, 1, 1 };
+
+//
+// Define the CAN bus partition used for the shm transport.
+//
+static int busId = 15;
+
+//
+// Define the channels of the kernel transports, one per consumer.  Each has a
+// file descriptor (or message queue) that the producers write to and one
+// that the consumer reads from.
+//
+static int   writeFds[MAX_CONSUMERS];
+static int   readFds[MAX_CONSUMERS];
+static mqd_t queues[MAX_CONSUMERS];
+
+//
+// Define the results that each consumer passes back to the parent through an
+// anonymous shared mapping.
+//
+typedef struct consumerResults_t
+{
+	volatile int       ready;
+	unsigned long      received;
+	unsigned long      dropped;
+	unsigned long      finishNs;
+	latencyHistogram_t latency;
+
+}   __attribute__((aligned(128))) consumerResults_t;
+
+typedef struct benchResults_t
+{
+	volatile int      ready[MAX_PRODUCERS];
+	volatile int      go;
+	unsigned long     startNs;
+	consumerResults_t consumers[MAX_CONSUMERS];
+
+}   benchResults_t;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -t    Transports     string       all \n\
+    -p    Producers        int           1 \n\
+    -c    Consumers        int           1 \n\
+    -n    Messages         int        200,000 \n\
+    -q    Queue Depth      int          64 \n\
+    -r    Rate (msg/sec)   int      Unlimited \n\
+    -o    CSV File       string      None \n\
+    -b    CAN Bus          int          15 \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\
+  -t is a comma separated list of pipe, unix, seqpacket, mqueue and shm.\n\
+  -n is the number of messages each producer sends.  Every consumer\n\
+  receives every message.  -r is the rate at which each producer sends.\n\
+  -q is the depth of the message queues, which may be capped by\n\
+  /proc/sys/fs/mqueue/msg_max.  -o appends one line per transport to a CSV\n\
+  file.  -b is the bus partition that is (re)created for the shm transport.\n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Return the current monotonic time in nanoseconds.
+//
+static unsigned long nowNs ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// Read a whole message from a stream.  A stream socket may hand back part of
+// a message.
+//
+// This function returns 0 if the message was read and -1 if the stream was
+// closed or failed.
+//
+static int readAll ( int fd, void* buffer, size_t length )
+{
+	char* next = buffer;
+
+	while ( length > 0 )
+	{
+		ssize_t count = read ( fd, next, length );
+		if ( count <= 0 )
+		{
+			if ( count < 0 && errno == EINTR )
+			{
+				continue;
+			}
+			return -1;
+		}
+		next   += count;
+		length -= count;
+	}
+	return 0;
+}
+
+
+//
+// Create the channels of a kernel transport.
+//
+// This function returns 0 if the channels were created and -1 if they
+// weren't.
+//
+static int openChannels ( int transport )
+{
+	for ( unsigned int c = 0; c < consumerCount; c++ )
+	{
+		int fds[2];
+		int status = 0;
+
+		switch ( transport )
+		{
+		  case TRANSPORT_PIPE:
+			status = pipe ( fds );
+			break;
+
+		  case TRANSPORT_UNIX:
+			status = socketpair ( AF_UNIX, SOCK_STREAM, 0, fds );
+			break;
+
+		  case TRANSPORT_SEQPACKET:
+			status = socketpair ( AF_UNIX, SOCK_SEQPACKET, 0, fds );
+			break;
+
+		  //
+		  // The queue is unlinked as soon as it is open.  The consumer
+		  // inherits the descriptor.  If the system limit doesn't allow the
+		  // depth asked for, the default depth is used.
+		  //
+		  case TRANSPORT_MQUEUE:
+		  {
+			char           name[64];
+			struct mq_attr attributes = { 0 };
+
+			attributes.mq_maxmsg  = queueDepth;
+			attributes.mq_msgsize = sizeof(canMessage_t);
+
+			(void) snprintf ( name, sizeof(name), "/ipcbench.%d.%u", getpid(), c );
+			queues[c] = mq_open ( name, O_RDWR|O_CREAT|O_EXCL, 0600, &attributes );
+			if ( queues[c] == (mqd_t)-1 && errno == EINVAL )
+			{
+				attributes.mq_maxmsg = 10;
+				queues[c] = mq_open ( name, O_RDWR|O_CREAT|O_EXCL, 0600,
+									  &attributes );
+				if ( c == 0 && queues[c] != (mqd_t)-1 )
+				{
+					printf ( "The message queue depth is limited to 10 (see "
+							 "/proc/sys/fs/mqueue/msg_max).\n" );
+				}
+			}
+			if ( queues[c] == (mqd_t)-1 )
+			{
+				status = -1;
+				break;
+			}
+			(void) mq_unlink ( name );
+			continue;
+		  }
+		}
+		if ( status != 0 )
+		{
+			printf ( "Unable to create a %s channel errno: %u[%s].\n",
+					 transportNames[transport], errno, strerror(errno) );
+			return -1;
+		}
+		readFds[c]  = fds[0];
+		writeFds[c] = fds[1];
+	}
+	return 0;
+}
+
+
+//
+// Close the channels of a kernel transport.  The consumers close their ends
+// when they exit.
+//
+static void closeChannels ( int transport )
+{
+	for ( unsigned int c = 0; c < consumerCount; c++ )
+	{
+		if ( transport == TRANSPORT_MQUEUE )
+		{
+			(void) mq_close ( queues[c] );
+		}
+		else
+		{
+			(void) close ( readFds[c] );
+			(void) close ( writeFds[c] );
+		}
+	}
+}
+
+
+//
+// Run a producer process.  It waits for the start signal and then sends its
+// messages to every consumer.
+//
+static void runProducer ( int transport, unsigned int producer,
+						  sharedMemory_t* sharedMemory, benchResults_t* bench )
+{
+	canMessage_t message;
+
+	(void) memset ( &message, 0, sizeof(message) );
+	message.canMessage.can_dlc = CAN_MAX_DLEN;
+
+	bench->ready[producer] = 1;
+	while ( ! __atomic_load_n ( &bench->go, __ATOMIC_ACQUIRE ) )
+	{
+		(void) sched_yield();
+	}
+	unsigned long startNs = nowNs();
+
+	for ( unsigned long i = 0; i < messageCount; i++ )
+	{
+		//
+		// Wait for the time to send this message if a rate was given.
+		//
+		if ( sendRate != 0 )
+		{
+			unsigned long   dueNs = startNs + i * 1000000000UL / sendRate;
+			struct timespec due   = { dueNs / 1000000000UL, dueNs % 1000000000UL };
+
+			while ( clock_nanosleep ( CLOCK_MONOTONIC, TIMER_ABSTIME, &due,
+									  NULL ) == EINTR );
+		}
+		unsigned long sent = nowNs();
+
+		message.canMessage.can_id = producer * 256 + ( i & 0xff );
+		(void) memcpy ( message.canMessage.data, &sent, sizeof(sent) );
+
+		if ( transport == TRANSPORT_SHM )
+		{
+			(void) insertMessage ( sharedMemory, &message );
+			continue;
+		}
+		for ( unsigned int c = 0; c < consumerCount; c++ )
+		{
+			int status;
+
+			if ( transport == TRANSPORT_MQUEUE )
+			{
+				status = mq_send ( queues[c], (const char*)&message,
+								   sizeof(message), 0 );
+			}
+			else
+			{
+				status = write ( writeFds[c], &message, sizeof(message) ) ==
+						 sizeof(message) ? 0 : -1;
+			}
+			if ( status != 0 )
+			{
+				printf ( "Producer %u failed to send errno: %u[%s].\n", producer,
+						 errno, strerror(errno) );
+				_exit (255);
+			}
+		}
+	}
+	_exit (0);
+}
+
+
+//
+// Run a consumer process.  It receives every message sent by every producer
+// and records the latency of each one.
+//
+static void runConsumer ( int transport, unsigned int consumer,
+						  sharedMemory_t* sharedMemory, benchResults_t* bench )
+{
+	consumerResults_t* results  = &bench->consumers[consumer];
+	unsigned long      expected = messageCount * producerCount;
+
+	histogramInitialize ( &results->latency );
+
+	//
+	// Close the ends of the channels that this consumer doesn't read so that
+	// it doesn't hold them open.
+	//
+	if ( transport != TRANSPORT_SHM && transport != TRANSPORT_MQUEUE )
+	{
+		for ( unsigned int c = 0; c < consumerCount; c++ )
+		{
+			(void) close ( writeFds[c] );
+			if ( c != consumer )
+			{
+				(void) close ( readFds[c] );
+			}
+		}
+	}
+	if ( transport == TRANSPORT_SHM )
+	{
+		streamRing_t*     ring   = sharedMemoryGetStreamRing ( sharedMemory );
+		streamConsumer_t* reader = streamAttach ( ring );
+		streamFrame_t     frames[MAX_BATCH];
+
+		if ( reader == 0 )
+		{
+			printf ( "No free stream ring reader slot.\n" );
+			_exit (255);
+		}
+		results->ready = 1;
+
+		while ( results->received + reader->dropped < expected )
+		{
+			unsigned long count = streamRead ( ring, reader, frames, MAX_BATCH );
+			if ( count == 0 )
+			{
+				(void) sched_yield();
+				continue;
+			}
+			unsigned long now = nowNs();
+
+			for ( unsigned long i = 0; i < count; i++ )
+			{
+				unsigned long sent;
+
+				(void) memcpy ( &sent, frames[i].data, sizeof(sent) );
+				histogramAdd ( &results->latency, now - sent );
+			}
+			results->received += count;
+		}
+		results->dropped = reader->dropped;
+		streamDetach ( reader );
+	}
+	else
+	{
+		results->ready = 1;
+
+		while ( results->received < expected )
+		{
+			canMessage_t message;
+			int          status;
+
+			if ( transport == TRANSPORT_MQUEUE )
+			{
+				status = mq_receive ( queues[consumer], (char*)&message,
+									  sizeof(message), 0 ) == sizeof(message) ?
+						 0 : -1;
+			}
+			else
+			{
+				status = readAll ( readFds[consumer], &message, sizeof(message) );
+			}
+			if ( status != 0 )
+			{
+				printf ( "Consumer %u failed to receive errno: %u[%s].\n",
+						 consumer, errno, strerror(errno) );
+				_exit (255);
+			}
+			unsigned long sent;
+
+			(void) memcpy ( &sent, message.canMessage.data, sizeof(sent) );
+			histogramAdd ( &results->latency, nowNs() - sent );
+			results->received++;
+		}
+	}
+	results->finishNs = nowNs();
+	_exit (0);
+}
+
+
+//
+// Create a fresh segment with a stream ring for the shm transport and open
+// it.
+//
+static sharedMemory_t* createSegment ( const char* createPath )
+{
+	char command[8192];
+
+	(void) snprintf ( command, sizeof(command), "%s -b %d -m 4096 -r 65536 "
+					  "-c %u > /dev/null", createPath, busId, consumerCount );
+	if ( system ( command ) != 0 )
+	{
+		printf ( "Unable to create the segment with [%s].\n", command );
+		return 0;
+	}
+	return sharedMemoryOpenBus ( busId );
+}
+
+
+//
+// Run one transport and print (and optionally store) its results.
+//
+// This function returns 0 if the run completed and -1 if it didn't.
+//
+static int runTransport ( int transport, const char* createPath,
+						  benchResults_t* bench, FILE* csv )
+{
+	sharedMemory_t* sharedMemory = 0;
+
+	if ( transport == TRANSPORT_SHM )
+	{
+		sharedMemory = createSegment ( createPath );
+		if ( sharedMemory == 0 )
+		{
+			return -1;
+		}
+	}
+	else if ( openChannels ( transport ) != 0 )
+	{
+		return -1;
+	}
+	(void) memset ( bench, 0, sizeof(*bench) );
+
+	//
+	// Start the consumers, then the producers, and wait for all of them to
+	// be ready before starting the clock.
+	//
+	pid_t        pids[MAX_PRODUCERS + MAX_CONSUMERS];
+	unsigned int processCount = 0;
+	int          status       = 0;
+
+	fflush ( stdout );
+	for ( unsigned int c = 0; c < consumerCount; c++ )
+	{
+		pids[processCount] = fork();
+		if ( pids[processCount] == 0 )
+		{
+			runConsumer ( transport, c, sharedMemory, bench );
+		}
+		processCount++;
+	}
+	for ( unsigned int p = 0; p < producerCount; p++ )
+	{
+		pids[processCount] = fork();
+		if ( pids[processCount] == 0 )
+		{
+			runProducer ( transport, p, sharedMemory, bench );
+		}
+		processCount++;
+	}
+	for ( unsigned int c = 0; c < consumerCount; c++ )
+	{
+		while ( ! bench->consumers[c].ready )
+		{
+			usleep ( 1000 );
+		}
+	}
+	for ( unsigned int p = 0; p < producerCount; p++ )
+	{
+		while ( ! bench->ready[p] )
+		{
+			usleep ( 1000 );
+		}
+	}
+	bench->startNs = nowNs();
+	__atomic_store_n ( &bench->go, 1, __ATOMIC_RELEASE );
+
+	for ( unsigned int i = 0; i < processCount; i++ )
+	{
+		int exitStatus;
+
+		if ( waitpid ( pids[i], &exitStatus, 0 ) != pids[i] ||
+			 ! WIFEXITED ( exitStatus ) || WEXITSTATUS ( exitStatus ) != 0 )
+		{
+			status = -1;
+		}
+	}
+	if ( transport == TRANSPORT_SHM )
+	{
+		sharedMemoryClose ( sharedMemory );
+	}
+	else
+	{
+		closeChannels ( transport );
+	}
+	if ( status != 0 )
+	{
+		printf ( "%-10s failed\n", transportNames[transport] );
+		return -1;
+	}
+	//
+	// Combine the results of the consumers.
+	//
+	latencyHistogram_t latency;
+	unsigned long      received = 0;
+	unsigned long      dropped  = 0;
+	unsigned long      finishNs = bench->startNs;
+
+	histogramInitialize ( &latency );
+	for ( unsigned int c = 0; c < consumerCount; c++ )
+	{
+		consumerResults_t* results = &bench->consumers[c];
+
+		histogramMerge ( &latency, &results->latency );
+		received += results->received;
+		dropped  += results->dropped;
+		if ( results->finishNs > finishNs )
+		{
+			finishNs = results->finishNs;
+		}
+	}
+	double        seconds   = ( finishNs - bench->startNs ) / 1e9;
+	unsigned long sent      = messageCount * producerCount;
+	double        sentRate  = sent / seconds;
+	double        delivered = received / seconds;
+	unsigned long mean      = latency.count ? latency.total / latency.count : 0;
+
+	printf ( "%-10s %'12.0f %'12.0f %'10lu %'10lu %'10lu %'10lu %'12lu",
+			 transportNames[transport], sentRate, delivered, mean,
+			 histogramPercentile ( &latency, 50 ),
+			 histogramPercentile ( &latency, 99 ),
+			 histogramPercentile ( &latency, 99.9 ), latency.maximum );
+	if ( dropped != 0 )
+	{
+		printf ( "  (%'lu dropped)", dropped );
+	}
+	printf ( "\n" );
+
+	if ( csv != 0 )
+	{
+		fprintf ( csv, "%s,%u,%u,%lu,%lu,%.0f,%.0f,%lu,%lu,%lu,%lu,%lu,%lu\n",
+				  transportNames[transport], producerCount, consumerCount,
+				  messageCount, sendRate, sentRate, delivered, mean,
+				  histogramPercentile ( &latency, 50 ),
+				  histogramPercentile ( &latency, 99 ),
+				  histogramPercentile ( &latency, 99.9 ), latency.maximum,
+				  dropped );
+		fflush ( csv );
+	}
+	return 0;
+}
+
+
+//
+// Parse the list of transports to run.
+//
+// This function returns 0 if the list is valid and -1 if it is not.
+//
+static int parseTransports ( char* list )
+{
+	char* save;
+
+	(void) memset ( selected, 0, sizeof(selected) );
+
+	for ( char* name = strtok_r ( list, ",", &save ); name != 0;
+		  name = strtok_r ( 0, ",", &save ) )
+	{
+		int found = 0;
+
+		for ( int t = 0; t < TRANSPORT_COUNT; t++ )
+		{
+			if ( strcmp ( name, transportNames[t] ) == 0 ||
+				 strcmp ( name, "all" ) == 0 )
+			{
+				selected[t] = 1;
+				found       = 1;
+			}
+		}
+		if ( ! found )
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:c:hn:o:p:q:r:t:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 't':
+			if ( parseTransports ( optarg ) != 0 )
+			{
+				printf ( "Invalid transport list specified.\n" );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'p':
+		    producerCount = atol ( optarg );
+			if ( producerCount <= 0 || producerCount > MAX_PRODUCERS )
+			{
+				printf ( "Invalid producer count[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'c':
+		    consumerCount = atol ( optarg );
+			if ( consumerCount <= 0 || consumerCount > MAX_CONSUMERS )
+			{
+				printf ( "Invalid consumer count[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'n':
+		    messageCount = atol ( optarg );
+			if ( messageCount <= 0 )
+			{
+				printf ( "Invalid message count[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'q':
+		    queueDepth = atol ( optarg );
+			if ( queueDepth <= 0 )
+			{
+				printf ( "Invalid queue depth[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'r':
+		    sendRate = atol ( optarg );
+			break;
+
+		  case 'o':
+			csvName = optarg;
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( optind != argc )
+	{
+		printf ( "Invalid parameter encountered: %s\n", argv[optind] );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// The segment for the shm transport is built with the "create" program
+	// that sits next to this one.
+	//
+	char executable[4096];
+	char createPath[4096];
+
+	(void) strncpy ( executable, argv[0], sizeof(executable) - 1 );
+	executable[sizeof(executable) - 1] = 0;
+	(void) snprintf ( createPath, sizeof(createPath), "%s/create",
+					  dirname ( executable ) );
+
+	//
+	// Open the CSV file and write the header if it is new.
+	//
+	FILE* csv = 0;
+	if ( csvName != 0 )
+	{
+		csv = fopen ( csvName, "a" );
+		if ( csv == 0 )
+		{
+			printf ( "Unable to open the CSV file[%s] errno: %u[%s].\n", csvName,
+					 errno, strerror(errno) );
+			exit (255);
+		}
+		if ( ftell ( csv ) == 0 )
+		{
+			fprintf ( csv, "transport,producers,consumers,messages,rate,sent_per_sec,"
+					  "delivered_per_sec,mean_ns,p50_ns,p99_ns,p999_ns,max_ns,"
+					  "dropped\n" );
+		}
+	}
+	benchResults_t* bench = mmap ( NULL, sizeof(benchResults_t),
+								   PROT_READ|PROT_WRITE,
+								   MAP_SHARED|MAP_ANONYMOUS, -1, 0 );
+	if ( bench == MAP_FAILED )
+	{
+		printf ( "Unable to map the results area.\n" );
+		exit (255);
+	}
+	printf ( "%u producers, %u consumers, %'lu messages per producer, every "
+			 "consumer receives every message.\n", producerCount, consumerCount,
+			 messageCount );
+	if ( sendRate != 0 )
+	{
+		printf ( "Each producer sends %'lu messages/sec.\n", sendRate );
+	}
+	printf ( "The latency percentiles are upper bounds (power of 2 buckets).\n\n" );
+	printf ( "%-10s %12s %12s %10s %10s %10s %10s %12s\n", "transport",
+			 "sent/sec", "deliv/sec", "mean nsec", "p50 <", "p99 <", "p99.9 <",
+			 "max nsec" );
+
+	int failures = 0;
+	for ( int t = 0; t < TRANSPORT_COUNT; t++ )
+	{
+		if ( selected[t] && runTransport ( t, createPath, bench, csv ) != 0 )
+		{
+			failures++;
+		}
+	}
+	if ( csv != 0 )
+	{
+		(void) fclose ( csv );
+	}
+	return failures == 0 ? 0 : 1;
+}
@@ -0,0 +1,207 @@
+//
+//	j o u r n a l . c
+//
+//  Append only journal of every message inserted into the message pool.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+
+#include "journal.h"
+
+//
+// Return the number of bytes needed for a journal region with the specified
+// geometry.  Both values must be powers of 2.
+//
+unsigned long journalRegionSize ( unsigned int chunkCount,
+								  unsigned int chunkRecords )
+{
+	return sizeof(journal_t) +
+		   (unsigned long)chunkCount * chunkRecords * sizeof(journalRecord_t);
+}
+
+
+//
+// Initialize a journal region.  This clears all of the records so that no
+// stale sequence numbers from a previous run (or a checkpoint image) can be
+// mistaken for new records.
+//
+void journalInitialize ( journal_t* journal, unsigned int chunkCount,
+						 unsigned int chunkRecords )
+{
+	(void) memset ( journal, 0, journalRegionSize ( chunkCount, chunkRecords ) );
+
+	journal->chunkRecords = chunkRecords;
+	journal->chunkCount   = chunkCount;
+	journal->recordMask   = (unsigned long)chunkCount * chunkRecords - 1;
+}
+
+
+//
+// Define the number of times the flusher will yield the processor waiting for
+// a writer to finish a record it has reserved before it gives up and treats
+// the record as dropped (presumably because the writer died).
+//
+#define JOURNAL_WRITER_WAIT_LIMIT ( 1000 * 1000 )
+
+//
+// Return the current time in nanoseconds to be used as a journal timestamp.
+//
+unsigned long journalTimestamp ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_REALTIME, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+//	j o u r n a l A p p e n d
+//
+// Append a copy of a message to the journal.
+//
+// The record is reserved with a single atomic increment of the journal head
+// so any number of writers may call this at the same time without a lock.
+// The record's sequence field is cleared before the record is filled in and
+// set to the record's sequence number plus one when it is complete so that
+// readers can tell when the record is ready.
+//
+void journalAppend ( journal_t* journal, canMessage_t* message )
+{
+	unsigned long sequence = __atomic_fetch_add ( &journal->head, 1,
+												  __ATOMIC_RELAXED );
+
+	journalRecord_t* record = &journal->records[sequence & journal->recordMask];
+
+	__atomic_store_n ( &record->sequence, 0, __ATOMIC_RELAXED );
+	__atomic_thread_fence ( __ATOMIC_RELEASE );
+
+	record->timestamp = journalTimestamp();
+	record->id        = message->canMessage.can_id;
+	record->dlc       = message->canMessage.can_dlc;
+	(void) memcpy ( record->data, message->canMessage.data, CAN_MAX_DLEN );
+
+	__atomic_store_n ( &record->sequence, sequence + 1, __ATOMIC_RELEASE );
+}
+
+
+//
+//	j o u r n a l R e a d
+//
+// Read the journal record at the specified cursor position.
+//
+// This function will return 1 and advance the cursor if the record was read,
+// 0 if the record has not been written yet, and -1 if the reader has fallen
+// so far behind that the record has already been overwritten.  In the last
+// case the cursor is moved up to the oldest record still in the journal.
+//
+int journalRead ( journal_t* journal, unsigned long* cursor,
+				  journalRecord_t* record )
+{
+	unsigned long    expected = *cursor + 1;
+	journalRecord_t* source   = &journal->records[*cursor & journal->recordMask];
+
+	unsigned long before = __atomic_load_n ( &source->sequence,
+											 __ATOMIC_ACQUIRE );
+	if ( before == expected )
+	{
+		*record = *source;
+		__atomic_thread_fence ( __ATOMIC_ACQUIRE );
+		if ( __atomic_load_n ( &source->sequence, __ATOMIC_RELAXED ) == expected )
+		{
+			*cursor += 1;
+			return 1;
+		}
+	}
+	//
+	// Either the record isn't there yet or it has been overwritten.  If the
+	// head has moved more than a full ring past us, we've been lapped.
+	//
+	unsigned long head = __atomic_load_n ( &journal->head, __ATOMIC_ACQUIRE );
+	if ( head > *cursor + journal->recordMask + 1 )
+	{
+		*cursor = head - ( journal->recordMask + 1 );
+		return -1;
+	}
+	return 0;
+}
+
+
+//
+//	j o u r n a l C o p y
+//
+// Copy a range of records that have all been reserved by writers out of the
+// journal into the caller's buffer.  This is used by the flusher to take a
+// stable copy of a chunk before writing it to disk.
+//
+// Any record that a writer has reserved but not finished is waited for.  If
+// a record is never finished, it is left in the buffer with a sequence of
+// zero and counted as a dropped record.
+//
+// This function will return the number of records copied or -1 if any of the
+// records were overwritten by writers that have lapped the journal before the
+// copy was complete.
+//
+long journalCopy ( journal_t* journal, unsigned long first,
+				   unsigned long count, journalRecord_t* buffer )
+{
+	unsigned long capacity = journal->recordMask + 1;
+
+	//
+	// Wait for every record in the range to be finished by its writer.
+	//
+	for ( unsigned long i = 0; i < count; i++ )
+	{
+		journalRecord_t* record = &journal->records[( first + i ) &
+													journal->recordMask];
+		unsigned long    expected = first + i + 1;
+		unsigned long    sequence;
+
+		for ( unsigned int wait = 0; ; wait++ )
+		{
+			sequence = __atomic_load_n ( &record->sequence, __ATOMIC_ACQUIRE );
+			if ( sequence >= expected || wait == JOURNAL_WRITER_WAIT_LIMIT )
+			{
+				break;
+			}
+			sched_yield();
+		}
+		if ( sequence > expected )
+		{
+			return -1;
+		}
+		if ( sequence != expected )
+		{
+			++journal->droppedRecords;
+		}
+	}
+	//
+	// Copy the records.  The range may wrap around the end of the ring.
+	//
+	unsigned long start = first & journal->recordMask;
+	unsigned long part  = count;
+	if ( start + part > capacity )
+	{
+		part = capacity - start;
+	}
+	(void) memcpy ( buffer, &journal->records[start],
+					part * sizeof(journalRecord_t) );
+	(void) memcpy ( buffer + part, &journal->records[0],
+					( count - part ) * sizeof(journalRecord_t) );
+
+	//
+	// If a writer has reserved a record that maps onto the range we just
+	// copied, our copy may contain some of its data so it can't be trusted.
+	//
+	__atomic_thread_fence ( __ATOMIC_ACQUIRE );
+	if ( __atomic_load_n ( &journal->head, __ATOMIC_RELAXED ) >
+		 first + capacity )
+	{
+		return -1;
+	}
+	return count;
+}
@@ -0,0 +1,112 @@
+#pragma once
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "canMessage.h"
+
+//
+// The journal is an optional region of the shared memory segment that holds
+// a copy of every message that is inserted into the message pool, in the
+// order in which they were inserted.  The message pool only keeps the latest
+// value of each message ID so any burst of messages between two reader polls
+// is lost.  The journal fixes that by giving us a lossless recording of the
+// bus that can be flushed to disk by the "record" program.
+//
+// The journal is a ring of fixed size records that is divided into a power
+// of two number of chunks, each holding a power of two number of records.
+// Writers reserve a record with a single atomic increment of the journal
+// head and then fill it in.  The flusher waits for a chunk to be completely
+// filled and then writes the whole chunk to disk with one large sequential
+// write.  Writers never wait for the flusher.  If the flusher falls so far
+// behind that a chunk is overwritten before it was flushed, the flusher will
+// detect this, skip the chunk and count it as an overrun.
+//
+// Note: All references to data in the journal are offsets or sequence
+// numbers so this will work in multiple processes that have their shared
+// memory segments mapped to different base addresses.
+//
+
+//
+// Define the structure of a single journal record.  The sequence field is
+// written last by the writer and holds the journal sequence number of the
+// record plus one.  Readers use it to decide whether the record they are
+// looking at is complete and is the one they expected.  A value of zero means
+// that the record is being written.
+//
+typedef struct journalRecord_t
+{
+	unsigned long timestamp;                // nsec, CLOCK_REALTIME
+	unsigned long sequence;
+	canid_t       id;
+	unsigned char dlc;
+	unsigned char pad[3];
+	unsigned char data[CAN_MAX_DLEN];
+
+}   journalRecord_t;                        // 32 bytes
+
+//
+// Define the journal header that sits at the start of the journal region.
+// The fields that are modified by the writers and the flusher are kept on
+// their own cache lines so they don't interfere with each other.
+//
+typedef struct journal_t
+{
+	unsigned int  chunkRecords;             // Records per chunk (power of 2)
+	unsigned int  chunkCount;               // Chunks in the ring (power of 2)
+	unsigned long recordMask;               // Total records - 1
+
+	//
+	// The sequence number of the next record to be reserved by a writer.
+	//
+	unsigned long head __attribute__((aligned(64)));
+
+	//
+	// The flusher statistics.  These are only written by the flusher.
+	//
+	unsigned long flushedChunks __attribute__((aligned(64)));
+	unsigned long overrunChunks;
+	unsigned long droppedRecords;
+
+	//
+	// The start of the ring of journal records.
+	//
+	journalRecord_t records[0] __attribute__((aligned(64)));
+
+}   journal_t;
+
+//
+// Define the header that is written at the start of every journal file
+// written by the flusher.  The file is followed by nothing but records.
+//
+#define JOURNAL_FILE_MAGIC   0x4a495356         // "VSIJ"
+#define JOURNAL_FILE_VERSION 1
+
+typedef struct journalFileHeader_t
+{
+	unsigned int magic;
+	unsigned int version;
+	unsigned int recordSize;
+	unsigned int reserved;
+
+}   journalFileHeader_t;
+
+//
+// Define the default journal geometry.
+//
+#define JOURNAL_DEFAULT_CHUNK_RECORDS ( 16 * 1024 )
+
+//
+// Define the journal functions.
+//
+unsigned long journalRegionSize ( unsigned int chunkCount,
+								  unsigned int chunkRecords );
+void          journalInitialize ( journal_t* journal, unsigned int chunkCount,
+								  unsigned int chunkRecords );
+void          journalAppend     ( journal_t* journal, canMessage_t* message );
+int           journalRead       ( journal_t* journal, unsigned long* cursor,
+								  journalRecord_t* record );
+long          journalCopy       ( journal_t* journal, unsigned long first,
+								  unsigned long count, journalRecord_t* buffer );
+unsigned long journalTimestamp  ( void );
+
+#endif		// End of JOURNAL_H
@@ -0,0 +1,171 @@
+//
+//	m e r g e . c
+//
+//  Read a single timestamp ordered stream of the messages inserted into
+//  several CAN bus partitions.
+//
+//  Each bus partition must have been created with a journal (see the "-b"
+//  and "-j" options of the "create" program).  The merged stream is checked
+//  to make sure it really is in timestamp order and the throughput, the
+//  number of records from each bus and any journal overruns are reported at
+//  the end of the run.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <locale.h>
+#include <stdbool.h>
+
+#include "sharedMemory.h"
+#include "busMerge.h"
+#include "traceFile.h"
+
+//
+// Define the merge parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static const char*   busList    = "0-3";
+static unsigned long maxLagUs   = BUS_MERGE_DEFAULT_LAG / 1000;
+static unsigned int  runSeconds = 10;
+static bool          verbose    = false;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -b    CAN Buses        list       0-3 \n\
+    -l    Max Lag (usec)   int       1,000 \n\
+    -d    Duration (sec)   int          10 \n\
+    -v    Verbose          bool      false \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:d:hl:v?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'b':
+			busList = optarg;
+			break;
+
+		  case 'd':
+		    runSeconds = atol ( optarg );
+			break;
+
+		  case 'l':
+		    maxLagUs = atol ( optarg );
+			break;
+
+		  case 'v':
+			verbose = true;
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	canMessageIndex_t busIds[SHARED_MEMORY_MAX_BUSES];
+	int               busCount = parseMessageIdList ( busList, busIds,
+													  SHARED_MEMORY_MAX_BUSES );
+	if ( busCount <= 0 || optind != argc )
+	{
+		printf ( "Invalid bus list[%s] specified.\n", busList );
+		usage ( argv[0] );
+		exit (255);
+	}
+	int buses[SHARED_MEMORY_MAX_BUSES];
+	for ( int i = 0; i < busCount; i++ )
+	{
+		buses[i] = busIds[i];
+	}
+	busMergeReader_t reader;
+	if ( busMergeOpen ( &reader, buses, busCount, maxLagUs * 1000 ) != 0 )
+	{
+		printf ( "Unable to open the bus partitions - Aborting\n" );
+		exit (255);
+	}
+	printf ( "Merging %d buses for %u seconds...\n", busCount, runSeconds );
+
+	unsigned long   perBus[SHARED_MEMORY_MAX_BUSES] = { 0 };
+	unsigned long   startNs    = journalTimestamp();
+	unsigned long   stopNs     = startNs + runSeconds * 1000000000UL;
+	unsigned long   merged     = 0;
+	unsigned long   outOfOrder = 0;
+	unsigned long   lastTime   = 0;
+	journalRecord_t record;
+	int             bus;
+	char            interface[16];
+
+	while ( journalTimestamp() < stopNs )
+	{
+		//
+		// Drain everything that is ready and then take a short nap.
+		//
+		while ( busMergeNext ( &reader, &record, &bus ) > 0 )
+		{
+			if ( record.timestamp < lastTime )
+			{
+				outOfOrder++;
+			}
+			lastTime = record.timestamp;
+			merged++;
+			perBus[bus]++;
+
+			if ( verbose )
+			{
+				(void) snprintf ( interface, sizeof(interface), "can%d", bus );
+				traceWriteCandump ( stdout, interface, &record );
+			}
+		}
+		struct timespec delay = { 0, 100 * 1000 };
+		(void) nanosleep ( &delay, NULL );
+	}
+	//
+	// Report the results.
+	//
+	double seconds = ( journalTimestamp() - startNs ) / 1000000000.0;
+
+	printf ( "%'lu records merged (%'lu/sec), %'lu out of order\n", merged,
+			 (unsigned long)( merged / seconds ), outOfOrder );
+	for ( unsigned int i = 0; i < reader.partitionCount; i++ )
+	{
+		printf ( "  bus %d: %'lu records, %'lu journal overruns\n",
+				 reader.partitions[i].bus, perBus[reader.partitions[i].bus],
+				 reader.partitions[i].overruns );
+	}
+	busMergeClose ( &reader );
+
+    return 0;
+}
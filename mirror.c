@@ -0,0 +1,260 @@
+//
+//	m i r r o r . c
+//
+//  Dirty tracking and batched delta encoding for mirroring the message pool
+//  to another machine.  See mirror.h for a description.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "mirror.h"
+
+//
+// Return the address of the summary words and of the map words.
+//
+#define MIRROR_SUMMARY(map) ( (map)->bits )
+#define MIRROR_WORDS(map)   ( (map)->bits + (map)->summaryCount )
+
+//
+// Return the number of bytes needed for a mirror map region.
+//
+unsigned long mirrorRegionSize ( unsigned int messageCount )
+{
+	unsigned long wordCount    = ( messageCount + 63UL ) / 64;
+	unsigned long summaryCount = ( wordCount + 63UL ) / 64;
+
+	return sizeof(mirrorMap_t) + ( wordCount + summaryCount ) * sizeof(unsigned long);
+}
+
+
+//
+// Initialize a mirror map region with every message clean.
+//
+void mirrorInitialize ( mirrorMap_t* map, unsigned int messageCount )
+{
+	(void) memset ( map, 0, mirrorRegionSize ( messageCount ) );
+
+	map->messageCount = messageCount;
+	map->wordCount    = ( messageCount + 63UL ) / 64;
+	map->summaryCount = ( map->wordCount + 63UL ) / 64;
+}
+
+
+//
+//	m i r r o r M a r k D i r t y
+//
+// Mark a message as changed since the last flush.  This is called by
+// insertMessage after the message has been updated.
+//
+void mirrorMarkDirty ( mirrorMap_t* map, canMessageIndex_t id )
+{
+	if ( id >= map->messageCount )
+	{
+		return;
+	}
+	unsigned long* word = &MIRROR_WORDS ( map )[id / 64];
+	unsigned long  bit  = 1UL << ( id % 64 );
+
+	//
+	// A message that is already dirty costs us one read.
+	//
+	if ( __atomic_load_n ( word, __ATOMIC_RELAXED ) & bit )
+	{
+		return;
+	}
+	unsigned long old = __atomic_fetch_or ( word, bit, __ATOMIC_SEQ_CST );
+
+	//
+	// If this word was clean, set its summary bit too.  The summary bit is
+	// set after the map bit so the sender never finds a summary bit without
+	// the map bit that goes with it, except for one it is about to clear.
+	//
+	if ( old == 0 )
+	{
+		unsigned long  index   = id / 64;
+		unsigned long* summary = &MIRROR_SUMMARY ( map )[index / 64];
+
+		__atomic_fetch_or ( summary, 1UL << ( index % 64 ), __ATOMIC_SEQ_CST );
+	}
+}
+
+
+//
+// Mark every message as changed.  This is used to force a full refresh of
+// the mirror.
+//
+void mirrorMarkAll ( mirrorMap_t* map )
+{
+	for ( unsigned int id = 0; id < map->messageCount; id += 64 )
+	{
+		unsigned int   count = map->messageCount - id < 64 ? map->messageCount - id : 64;
+		unsigned long  bits  = count == 64 ? ~0UL : ( 1UL << count ) - 1;
+
+		__atomic_fetch_or ( &MIRROR_WORDS ( map )[id / 64], bits, __ATOMIC_SEQ_CST );
+	}
+	for ( unsigned int i = 0; i < map->wordCount; i += 64 )
+	{
+		unsigned int  count = map->wordCount - i < 64 ? map->wordCount - i : 64;
+		unsigned long bits  = count == 64 ? ~0UL : ( 1UL << count ) - 1;
+
+		__atomic_fetch_or ( &MIRROR_SUMMARY ( map )[i / 64], bits, __ATOMIC_SEQ_CST );
+	}
+}
+
+
+//
+//	m i r r o r C o l l e c t
+//
+// Collect and clear the IDs of the messages that have changed since the
+// last collection.  The IDs are stored in increasing order in the caller's
+// array, which must have room for every message in the map.  The messages
+// must be read after this call so the values sent are at least as new as
+// the changes that were collected.
+//
+// This function returns the number of IDs collected.
+//
+unsigned int mirrorCollect ( mirrorMap_t* map, canMessageIndex_t* ids )
+{
+	unsigned long* summary = MIRROR_SUMMARY ( map );
+	unsigned long* words   = MIRROR_WORDS ( map );
+	unsigned int   count   = 0;
+
+	for ( unsigned int s = 0; s < map->summaryCount; s++ )
+	{
+		if ( __atomic_load_n ( &summary[s], __ATOMIC_RELAXED ) == 0 )
+		{
+			continue;
+		}
+		unsigned long dirtyWords = __atomic_exchange_n ( &summary[s], 0,
+														 __ATOMIC_SEQ_CST );
+		while ( dirtyWords != 0 )
+		{
+			unsigned int index = s * 64 + __builtin_ctzl ( dirtyWords );
+			dirtyWords &= dirtyWords - 1;
+
+			unsigned long bits = __atomic_exchange_n ( &words[index], 0,
+													   __ATOMIC_SEQ_CST );
+			while ( bits != 0 )
+			{
+				ids[count++] = index * 64 + __builtin_ctzl ( bits );
+				bits &= bits - 1;
+			}
+		}
+	}
+	return count;
+}
+
+
+//
+//	m i r r o r E n c o d e
+//
+// Encode as many of the messages as will fit into a batch in the caller's
+// buffer.  The messages must be in increasing ID order.  The header is
+// filled in with the batch sequence number, the flags and the current time.
+//
+// This function returns the number of messages encoded.  The length of the
+// batch is in its header.
+//
+unsigned int mirrorEncode ( unsigned char* buffer, unsigned int bufferSize,
+							canMessage_t* messages, unsigned int count,
+							unsigned long sequence, unsigned short flags )
+{
+	mirrorBatch_t*  batch    = (mirrorBatch_t*)buffer;
+	unsigned char*  next     = buffer + sizeof(mirrorBatch_t);
+	unsigned char*  end      = buffer + bufferSize;
+	long            previous = -1;
+	unsigned int    encoded  = 0;
+	struct timespec now;
+
+	for ( ; encoded < count && next + MIRROR_MAX_RECORD <= end; encoded++ )
+	{
+		canMessage_t* message = &messages[encoded];
+		unsigned long gap     = message->canMessage.can_id - previous - 1;
+		unsigned int  dlc     = message->canMessage.can_dlc;
+
+		previous = message->canMessage.can_id;
+		if ( dlc > CAN_MAX_DLEN )
+		{
+			dlc = CAN_MAX_DLEN;
+		}
+		while ( gap >= 0x80 )
+		{
+			*next++ = gap | 0x80;
+			gap   >>= 7;
+		}
+		*next++ = gap;
+		*next++ = dlc;
+		(void) memcpy ( next, message->canMessage.data, dlc );
+		next += dlc;
+	}
+	clock_gettime ( CLOCK_REALTIME, &now );
+
+	batch->magic       = MIRROR_MAGIC;
+	batch->version     = MIRROR_VERSION;
+	batch->flags       = flags;
+	batch->recordCount = encoded;
+	batch->length      = next - buffer;
+	batch->sequence    = sequence;
+	batch->sendTime    = now.tv_sec * 1000000000UL + now.tv_nsec;
+
+	return encoded;
+}
+
+
+//
+//	m i r r o r D e c o d e
+//
+// Decode a batch of deltas into the caller's array of messages.
+//
+// This function returns the number of messages decoded or -1 if the batch is
+// not valid.
+//
+int mirrorDecode ( const unsigned char* buffer, unsigned int length,
+				   canMessage_t* messages, unsigned int maxMessages )
+{
+	const mirrorBatch_t* batch = (const mirrorBatch_t*)buffer;
+
+	if ( length < sizeof(mirrorBatch_t) || batch->magic != MIRROR_MAGIC ||
+		 batch->version != MIRROR_VERSION || batch->length != length ||
+		 batch->recordCount > maxMessages )
+	{
+		return -1;
+	}
+	const unsigned char* next = buffer + sizeof(mirrorBatch_t);
+	const unsigned char* end  = buffer + length;
+	long                 id   = -1;
+
+	for ( unsigned int i = 0; i < batch->recordCount; i++ )
+	{
+		unsigned long gap   = 0;
+		unsigned int  shift = 0;
+
+		do
+		{
+			if ( next == end || shift > 28 )
+			{
+				return -1;
+			}
+			gap   |= (unsigned long)( *next & 0x7f ) << shift;
+			shift += 7;
+		}
+		while ( *next++ & 0x80 );
+
+		if ( next == end || *next > CAN_MAX_DLEN || next + 1 + *next > end )
+		{
+			return -1;
+		}
+		id += gap + 1;
+
+		canMessage_t* message = &messages[i];
+		message->canMessage.can_id  = id;
+		message->canMessage.can_dlc = *next++;
+		(void) memset ( message->canMessage.data, 0, CAN_MAX_DLEN );
+		(void) memcpy ( message->canMessage.data, next,
+						message->canMessage.can_dlc );
+		next += message->canMessage.can_dlc;
+	}
+	return next == end ? batch->recordCount : -1;
+}
@@ -0,0 +1,94 @@
+#pragma once
+#ifndef MIRROR_H
+#define MIRROR_H
+
+#include "canMessage.h"
+
+//
+// The mirror map is an optional region of the shared memory segment that
+// lets the "mirrord" program keep a copy of the message pool up to date on
+// another machine without forwarding every insert.
+//
+// The map is a bitmap with one bit per message ID.  insertMessage sets the
+// bit of every ID it updates (after the update, and only if it isn't set
+// already, so a busy ID costs one read of a cache line per insert).  A
+// summary bitmap with one bit per 64 bit word of the map lets the sender
+// skip the clean parts of a large pool without reading them.  At each flush
+// the sender collects and clears the dirty bits and sends the current value
+// of each dirty message.  However many times a message changed between two
+// flushes, only its latest value is sent.
+//
+// The deltas are sent in batches.  Each batch is a mirrorBatch_t header
+// followed by one record per message:
+//
+//     id gap  - The difference from the previous ID in the batch, minus 1,
+//               as a varint.  The IDs in a batch are in increasing order so
+//               runs of neighbouring IDs cost one byte each.
+//     dlc     - One byte.
+//     data    - dlc bytes.
+//
+// There is only one sender per map since collecting the dirty bits clears
+// them.
+//
+
+//
+// Define the header of the mirror map region.  The summary words are
+// followed by the map words in the bits array.
+//
+typedef struct mirrorMap_t
+{
+	unsigned int  messageCount;
+	unsigned int  wordCount;                // Map words
+	unsigned int  summaryCount;             // Summary words
+	unsigned int  pad;
+
+	unsigned long bits[0] __attribute__((aligned(64)));
+
+}   mirrorMap_t;
+
+//
+// Define the header of a batch of deltas on the wire.  All fields are in the
+// byte order of the sender, which is checked with the magic number.
+//
+#define MIRROR_MAGIC   0x4d495356               // "VSIM"
+#define MIRROR_VERSION 1
+
+//
+// Set in a batch that is part of a full refresh of the pool.
+//
+#define MIRROR_FULL_REFRESH 0x0001
+
+typedef struct mirrorBatch_t
+{
+	unsigned int   magic;
+	unsigned short version;
+	unsigned short flags;
+	unsigned int   recordCount;
+	unsigned int   length;                  // Bytes including this header
+	unsigned long  sequence;                // Batch number
+	unsigned long  sendTime;                // CLOCK_REALTIME nsec
+
+}   mirrorBatch_t;
+
+//
+// Define the largest encoded record: a 5 byte varint, the dlc and the data.
+//
+#define MIRROR_MAX_RECORD ( 5 + 1 + CAN_MAX_DLEN )
+
+//
+// Define the mirror functions.
+//
+unsigned long mirrorRegionSize ( unsigned int messageCount );
+void          mirrorInitialize ( mirrorMap_t* map, unsigned int messageCount );
+void          mirrorMarkDirty  ( mirrorMap_t* map, canMessageIndex_t id );
+void          mirrorMarkAll    ( mirrorMap_t* map );
+unsigned int  mirrorCollect    ( mirrorMap_t* map, canMessageIndex_t* ids );
+
+unsigned int  mirrorEncode     ( unsigned char* buffer, unsigned int bufferSize,
+								 canMessage_t* messages, unsigned int count,
+								 unsigned long sequence, unsigned short flags );
+int           mirrorDecode     ( const unsigned char* buffer,
+								 unsigned int length, canMessage_t* messages,
+								 unsigned int maxMessages );
+
+#endif		// End of MIRROR_H
@@ -0,0 +1,794 @@
+//
+//	m i r r o r d . c
+//
+//  Keep a copy of the message pool up to date on another machine.
+//
+//  The sender ("-s <host>:<port>") runs next to a segment that was created
+//  with a mirror map ("create -M").  At every flush interval it collects the
+//  messages that have changed since the last flush and sends their latest
+//  values in compact batches (see mirror.h for the format).  A message that
+//  changed many times between flushes is only sent once.  When the sender
+//  starts, and at every "-R" refresh interval, it sends the whole pool so
+//  the receiver can't stay out of date.
+//
+//  The receiver ("-l <port>") applies the batches to its own segment with
+//  insertMessages, so its readers, journal, statistics and so on work just
+//  as they do for local writers.  The receiving segment can be any size;
+//  IDs outside its pool are counted and dropped.
+//
+//  Batches go over TCP by default or over UDP with "-u".  Both ends report
+//  their throughput every second and the receiver also reports the time
+//  from the send of each batch to its application, using CLOCK_REALTIME, so
+//  the clocks of the two machines need to be synchronized.  Over 127.0.0.1
+//  they are the same clock.
+//
+//  The "-c <bus>" option compares the local segment with another partition
+//  on the same machine and reports the messages that differ.  It is the way
+//  to check a mirror that runs over the loopback interface.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <signal.h>
+#include <locale.h>
+#include <stdbool.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the largest batch and the number of messages read from the pool at
+// a time by the sender.
+//
+#define MAX_BATCH_BYTES 65507
+#define READ_CHUNK      4096
+
+//
+// Define the largest number of latency samples kept for one report.
+//
+#define MAX_SAMPLES 65536
+
+//
+// Define the mirror parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static const char*   sendTo          = 0;
+static int           listenPort      = 0;
+static bool          useUdp          = false;
+static unsigned long flushIntervalUs = 10000;
+static unsigned int  batchBytes      = 0;
+static unsigned int  refreshSeconds  = 0;
+static unsigned int  runSeconds      = 0;
+static int           compareBus      = SHARED_MEMORY_NO_BUS - 1;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+static volatile int stopRequested = 0;
+
+//
+// Define the counters that are reported every second.
+//
+typedef struct mirrorCounters_t
+{
+	unsigned long flushes;
+	unsigned long batches;
+	unsigned long messages;
+	unsigned long bytes;
+	unsigned long busyNs;
+	unsigned long lost;
+	unsigned long ignored;
+	unsigned long sampleCount;
+	unsigned long samples[MAX_SAMPLES];
+
+}   mirrorCounters_t;
+
+static mirrorCounters_t counters;
+static mirrorCounters_t totals;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -s    Send To        host:port    None \n\
+    -l    Listen Port      int        None \n\
+    -u    Use UDP          bool      false \n\
+    -i    Flush (usec)     int      10,000 \n\
+    -m    Batch Bytes      int   1400 UDP/65507 TCP \n\
+    -R    Refresh (sec)    int     Never \n\
+    -d    Duration (sec)   int     Forever \n\
+    -c    Compare Bus      int        None \n\
+    -b    CAN Bus          int        None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\
+  Use -s to run the sender or -l to run the receiver.  -c <bus> compares the\n\
+  local segment with another partition and exits (-1 for the default one).\n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Handle the interrupt signal by asking the main loop to stop.
+//
+static void stopHandler ( int signalNumber )
+{
+	stopRequested = 1;
+}
+
+
+//
+// Return the current time of a clock in nanoseconds.
+//
+static unsigned long clockNs ( clockid_t clock )
+{
+	struct timespec now;
+
+	clock_gettime ( clock, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// Compare two latency samples for qsort.
+//
+static int compareSamples ( const void* left, const void* right )
+{
+	unsigned long a = *(const unsigned long*)left;
+	unsigned long b = *(const unsigned long*)right;
+
+	return a < b ? -1 : a > b;
+}
+
+
+//
+// Print the counters for the last report interval, add them to the totals
+// and clear them.
+//
+static void report ( const char* role, unsigned long intervalNs )
+{
+	double seconds = intervalNs / 1e9;
+
+	if ( counters.flushes == 0 && counters.batches == 0 )
+	{
+		return;
+	}
+	printf ( "%s: %'8lu msgs/sec  %'6lu batches/sec  %'10lu bytes/sec",
+			 role, (unsigned long)( counters.messages / seconds ),
+			 (unsigned long)( counters.batches / seconds ),
+			 (unsigned long)( counters.bytes / seconds ) );
+
+	if ( counters.flushes != 0 )
+	{
+		printf ( "  flush %'lu usec avg", counters.busyNs / counters.flushes / 1000 );
+	}
+	if ( counters.sampleCount != 0 )
+	{
+		qsort ( counters.samples, counters.sampleCount, sizeof(unsigned long),
+				compareSamples );
+		printf ( "  latency median %'lu p99 %'lu max %'lu usec",
+				 counters.samples[counters.sampleCount / 2] / 1000,
+				 counters.samples[counters.sampleCount * 99 / 100] / 1000,
+				 counters.samples[counters.sampleCount - 1] / 1000 );
+	}
+	if ( counters.lost != 0 || counters.ignored != 0 )
+	{
+		printf ( "  lost %'lu batches, ignored %'lu msgs", counters.lost,
+				 counters.ignored );
+	}
+	printf ( "\n" );
+	fflush ( stdout );
+
+	totals.flushes  += counters.flushes;
+	totals.batches  += counters.batches;
+	totals.messages += counters.messages;
+	totals.bytes    += counters.bytes;
+	totals.lost     += counters.lost;
+	totals.ignored  += counters.ignored;
+	(void) memset ( &counters, 0, sizeof(counters) );
+}
+
+
+//
+// Resolve "host:port" into a socket address.
+//
+// This function returns 0 if the address was resolved and -1 if it was not.
+//
+static int resolve ( const char* hostPort, struct sockaddr_storage* address,
+					 socklen_t* length )
+{
+	char host[256];
+	const char* colon = strrchr ( hostPort, ':' );
+
+	if ( colon == 0 || colon - hostPort >= sizeof(host) )
+	{
+		return -1;
+	}
+	(void) memcpy ( host, hostPort, colon - hostPort );
+	host[colon - hostPort] = 0;
+
+	struct addrinfo  hints;
+	struct addrinfo* result;
+
+	(void) memset ( &hints, 0, sizeof(hints) );
+	hints.ai_family   = AF_UNSPEC;
+	hints.ai_socktype = useUdp ? SOCK_DGRAM : SOCK_STREAM;
+
+	if ( getaddrinfo ( host, colon + 1, &hints, &result ) != 0 )
+	{
+		return -1;
+	}
+	(void) memcpy ( address, result->ai_addr, result->ai_addrlen );
+	*length = result->ai_addrlen;
+	freeaddrinfo ( result );
+
+	return 0;
+}
+
+
+//
+// Send all of a buffer, waiting for room in the socket if need be.
+//
+// This function returns 0 if it was sent and -1 if the connection failed.
+//
+static int sendAll ( int fd, const unsigned char* buffer, unsigned int length )
+{
+	while ( length > 0 )
+	{
+		ssize_t sent = send ( fd, buffer, length, MSG_NOSIGNAL );
+		if ( sent < 0 )
+		{
+			if ( errno == EINTR )
+			{
+				continue;
+			}
+			//
+			// A UDP receiver that isn't running yet is not an error.
+			//
+			return useUdp && errno == ECONNREFUSED ? 0 : -1;
+		}
+		buffer += sent;
+		length -= sent;
+	}
+	return 0;
+}
+
+
+//
+// Run the sender.
+//
+static int runSender ( sharedMemory_t* sharedMemory )
+{
+	mirrorMap_t* map = sharedMemoryGetMirrorMap ( sharedMemory );
+	if ( map == 0 )
+	{
+		printf ( "The shared memory segment has no mirror map - Use \"create "
+				 "-M\" to create one.\n" );
+		return -1;
+	}
+	struct sockaddr_storage address;
+	socklen_t               addressLength;
+	if ( resolve ( sendTo, &address, &addressLength ) != 0 )
+	{
+		printf ( "Unable to resolve the address[%s].\n", sendTo );
+		return -1;
+	}
+	int fd = socket ( address.ss_family, useUdp ? SOCK_DGRAM : SOCK_STREAM, 0 );
+	if ( fd < 0 || connect ( fd, (struct sockaddr*)&address, addressLength ) != 0 )
+	{
+		printf ( "Unable to connect to [%s] errno: %u[%s].\n", sendTo, errno,
+				 strerror(errno) );
+		return -1;
+	}
+	if ( ! useUdp )
+	{
+		int one = 1;
+		(void) setsockopt ( fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one) );
+	}
+	canMessageIndex_t* ids      = malloc ( map->messageCount * sizeof(canMessageIndex_t) );
+	canMessage_t*      messages = malloc ( READ_CHUNK * sizeof(canMessage_t) );
+	unsigned char*     buffer   = malloc ( batchBytes );
+	if ( ids == 0 || messages == 0 || buffer == 0 )
+	{
+		printf ( "Unable to allocate the sender buffers.\n" );
+		return -1;
+	}
+	printf ( "Mirroring %'u messages to %s over %s every %'lu usec in batches "
+			 "of up to %'u bytes.\n", map->messageCount, sendTo,
+			 useUdp ? "UDP" : "TCP", flushIntervalUs, batchBytes );
+	fflush ( stdout );
+
+	//
+	// Start with a full refresh so the receiver gets the whole pool.
+	//
+	unsigned long sequence   = 0;
+	unsigned long startNs    = clockNs ( CLOCK_MONOTONIC );
+	unsigned long nextFlush  = startNs;
+	unsigned long nextReport = startNs + 1000000000UL;
+	unsigned long nextRefresh = startNs;
+	unsigned long lastReport = startNs;
+	unsigned long stopNs     = runSeconds ? startNs + runSeconds * 1000000000UL : ~0UL;
+
+	while ( ! stopRequested && nextFlush < stopNs )
+	{
+		struct timespec until = { nextFlush / 1000000000UL, nextFlush % 1000000000UL };
+		(void) clock_nanosleep ( CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL );
+
+		unsigned long  flushStart = clockNs ( CLOCK_MONOTONIC );
+		unsigned short flags      = 0;
+
+		if ( flushStart >= nextRefresh )
+		{
+			mirrorMarkAll ( map );
+			flags       = MIRROR_FULL_REFRESH;
+			nextRefresh = refreshSeconds ? flushStart + refreshSeconds * 1000000000UL
+										 : ~0UL;
+		}
+		//
+		// Collect the changed messages, read their current values a chunk at
+		// a time and send them in as many batches as it takes.
+		//
+		unsigned int count = mirrorCollect ( map, ids );
+
+		for ( unsigned int first = 0; first < count; first += READ_CHUNK )
+		{
+			unsigned int chunk = count - first < READ_CHUNK ? count - first : READ_CHUNK;
+
+			for ( unsigned int i = 0; i < chunk; i++ )
+			{
+				(void) sharedMemoryReadMessage ( sharedMemory, ids[first + i],
+												 &messages[i] );
+			}
+			for ( unsigned int done = 0; done < chunk; )
+			{
+				done += mirrorEncode ( buffer, batchBytes, &messages[done],
+									   chunk - done, sequence++, flags );
+
+				unsigned int length = ((mirrorBatch_t*)buffer)->length;
+				if ( sendAll ( fd, buffer, length ) != 0 )
+				{
+					printf ( "The connection to [%s] failed errno: %u[%s].\n",
+							 sendTo, errno, strerror(errno) );
+					return -1;
+				}
+				counters.batches++;
+				counters.bytes += length;
+			}
+		}
+		counters.messages += count;
+		counters.flushes++;
+
+		unsigned long now = clockNs ( CLOCK_MONOTONIC );
+		counters.busyNs += now - flushStart;
+
+		if ( now >= nextReport )
+		{
+			report ( "send", now - lastReport );
+			lastReport  = now;
+			nextReport += 1000000000UL;
+		}
+		//
+		// Skip any flushes we missed rather than trying to catch up.
+		//
+		nextFlush += flushIntervalUs * 1000;
+		if ( nextFlush < now )
+		{
+			nextFlush = now;
+		}
+	}
+	report ( "send", clockNs ( CLOCK_MONOTONIC ) - lastReport );
+	printf ( "Sent %'lu messages in %'lu batches (%'lu bytes, %.1f bytes per "
+			 "message).\n", totals.messages, totals.batches, totals.bytes,
+			 totals.messages ? (double)totals.bytes / totals.messages : 0 );
+
+	(void) close ( fd );
+	return 0;
+}
+
+
+//
+// Read exactly "length" bytes from a stream socket.
+//
+// This function returns 0 if they were read, 1 if the connection was closed
+// and -1 if the read failed.
+//
+static int readAll ( int fd, unsigned char* buffer, unsigned int length )
+{
+	while ( length > 0 )
+	{
+		ssize_t received = recv ( fd, buffer, length, 0 );
+		if ( received == 0 )
+		{
+			return 1;
+		}
+		if ( received < 0 )
+		{
+			return errno == EINTR && ! stopRequested ? 0 : -1;
+		}
+		buffer += received;
+		length -= received;
+	}
+	return 0;
+}
+
+
+//
+// Apply a batch to the local segment.
+//
+static void applyBatch ( sharedMemory_t* sharedMemory, unsigned char* buffer,
+						 unsigned int length, canMessage_t* messages,
+						 unsigned long* expected )
+{
+	mirrorBatch_t* batch = (mirrorBatch_t*)buffer;
+	int            count = mirrorDecode ( buffer, length, messages,
+										  MAX_BATCH_BYTES );
+	if ( count < 0 )
+	{
+		printf ( "Invalid batch of %u bytes received.\n", length );
+		return;
+	}
+	//
+	// Drop the messages that don't fit in our pool.
+	//
+	unsigned int poolSize = sharedMemoryGetPoolSize ( sharedMemory );
+	unsigned int kept     = 0;
+	for ( int i = 0; i < count; i++ )
+	{
+		if ( messages[i].canMessage.can_id < poolSize )
+		{
+			messages[kept++] = messages[i];
+		}
+	}
+	(void) insertMessages ( sharedMemory, messages, kept );
+
+	unsigned long now = clockNs ( CLOCK_REALTIME );
+	if ( counters.sampleCount < MAX_SAMPLES && now >= batch->sendTime )
+	{
+		counters.samples[counters.sampleCount++] = now - batch->sendTime;
+	}
+	//
+	// A gap in the batch sequence means batches were lost.  A sequence that
+	// goes backwards means the sender was restarted.
+	//
+	if ( batch->sequence > *expected )
+	{
+		counters.lost += batch->sequence - *expected;
+	}
+	*expected = batch->sequence + 1;
+
+	counters.batches++;
+	counters.messages += kept;
+	counters.ignored  += count - kept;
+	counters.bytes    += length;
+}
+
+
+//
+// Run the receiver.
+//
+static int runReceiver ( sharedMemory_t* sharedMemory )
+{
+	struct sockaddr_in6 address;
+
+	(void) memset ( &address, 0, sizeof(address) );
+	address.sin6_family = AF_INET6;
+	address.sin6_addr   = in6addr_any;
+	address.sin6_port   = htons ( listenPort );
+
+	int fd  = socket ( AF_INET6, useUdp ? SOCK_DGRAM : SOCK_STREAM, 0 );
+	int one = 1;
+	int off = 0;
+	(void) setsockopt ( fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one) );
+	(void) setsockopt ( fd, IPPROTO_IPV6, IPV6_V6ONLY, &off, sizeof(off) );
+
+	if ( fd < 0 || bind ( fd, (struct sockaddr*)&address, sizeof(address) ) != 0 ||
+		 ( ! useUdp && listen ( fd, 1 ) != 0 ) )
+	{
+		printf ( "Unable to listen on port %d errno: %u[%s].\n", listenPort,
+				 errno, strerror(errno) );
+		return -1;
+	}
+	if ( useUdp )
+	{
+		int size = 4 * 1024 * 1024;
+		(void) setsockopt ( fd, SOL_SOCKET, SO_RCVBUF, &size, sizeof(size) );
+	}
+	//
+	// Wake up once a second to report even if nothing arrives.
+	//
+	struct timeval timeout = { 1, 0 };
+
+	unsigned char* buffer   = malloc ( MAX_BATCH_BYTES );
+	canMessage_t*  messages = malloc ( MAX_BATCH_BYTES * sizeof(canMessage_t) );
+	if ( buffer == 0 || messages == 0 )
+	{
+		printf ( "Unable to allocate the receiver buffers.\n" );
+		return -1;
+	}
+	printf ( "Receiving mirror batches on %s port %d into a pool of %'u "
+			 "messages.\n", useUdp ? "UDP" : "TCP", listenPort,
+			 sharedMemoryGetPoolSize ( sharedMemory ) );
+	fflush ( stdout );
+
+	unsigned long startNs    = clockNs ( CLOCK_MONOTONIC );
+	unsigned long lastReport = startNs;
+	unsigned long stopNs     = runSeconds ? startNs + runSeconds * 1000000000UL : ~0UL;
+	unsigned long expected   = 0;
+	int           connection = -1;
+
+	while ( ! stopRequested && clockNs ( CLOCK_MONOTONIC ) < stopNs )
+	{
+		unsigned long now = clockNs ( CLOCK_MONOTONIC );
+		if ( now - lastReport >= 1000000000UL )
+		{
+			report ( "receive", now - lastReport );
+			lastReport = now;
+		}
+		if ( useUdp )
+		{
+			(void) setsockopt ( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+			ssize_t length = recv ( fd, buffer, MAX_BATCH_BYTES, 0 );
+			if ( length > 0 )
+			{
+				applyBatch ( sharedMemory, buffer, length, messages, &expected );
+			}
+			continue;
+		}
+		//
+		// Accept a sender if we don't have one.
+		//
+		if ( connection < 0 )
+		{
+			(void) setsockopt ( fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout) );
+			connection = accept ( fd, 0, 0 );
+			if ( connection >= 0 )
+			{
+				(void) setsockopt ( connection, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+									sizeof(timeout) );
+				expected = 0;
+				printf ( "Sender connected.\n" );
+				fflush ( stdout );
+			}
+			continue;
+		}
+		//
+		// Read the batch header to get the length and then the rest of it.
+		//
+		int status = readAll ( connection, buffer, sizeof(mirrorBatch_t) );
+		if ( status == 0 )
+		{
+			unsigned int length = ((mirrorBatch_t*)buffer)->length;
+			if ( length < sizeof(mirrorBatch_t) || length > MAX_BATCH_BYTES )
+			{
+				printf ( "Invalid batch length %u - dropping the sender.\n", length );
+				status = -1;
+			}
+			else
+			{
+				status = readAll ( connection, buffer + sizeof(mirrorBatch_t),
+								   length - sizeof(mirrorBatch_t) );
+				if ( status == 0 )
+				{
+					applyBatch ( sharedMemory, buffer, length, messages, &expected );
+				}
+			}
+		}
+		if ( status < 0 && errno == EAGAIN )
+		{
+			continue;
+		}
+		if ( status != 0 )
+		{
+			printf ( "Sender disconnected.\n" );
+			fflush ( stdout );
+			(void) close ( connection );
+			connection = -1;
+		}
+	}
+	report ( "receive", clockNs ( CLOCK_MONOTONIC ) - lastReport );
+	printf ( "Received %'lu messages in %'lu batches (%'lu bytes), %'lu "
+			 "batches lost, %'lu messages ignored.\n", totals.messages,
+			 totals.batches, totals.bytes, totals.lost, totals.ignored );
+
+	(void) close ( fd );
+	return 0;
+}
+
+
+//
+// Compare the local segment with another partition.
+//
+// This function returns the number of messages that differ.
+//
+static unsigned long compareSegments ( sharedMemory_t* sharedMemory )
+{
+	sharedMemory_t* other = sharedMemoryOpenBus ( compareBus );
+	if ( other == 0 )
+	{
+		printf ( "Unable to open the segment of bus %d.\n", compareBus );
+		exit (255);
+	}
+	unsigned int  count      = sharedMemoryGetPoolSize ( sharedMemory );
+	unsigned long mismatches = 0;
+
+	if ( sharedMemoryGetPoolSize ( other ) < count )
+	{
+		count = sharedMemoryGetPoolSize ( other );
+	}
+	for ( unsigned int id = 0; id < count; id++ )
+	{
+		canMessage_t local;
+		canMessage_t remote;
+
+		(void) sharedMemoryReadMessage ( sharedMemory, id, &local );
+		(void) sharedMemoryReadMessage ( other, id, &remote );
+
+		if ( local.canMessage.can_dlc != remote.canMessage.can_dlc ||
+			 memcmp ( local.canMessage.data, remote.canMessage.data,
+					  local.canMessage.can_dlc ) != 0 )
+		{
+			if ( mismatches++ < 10 )
+			{
+				printf ( "Message 0x%x differs.\n", id );
+			}
+		}
+	}
+	printf ( "Compared %'u messages: %'lu differ.\n", count, mismatches );
+	sharedMemoryClose ( other );
+
+	return mismatches;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:c:d:hi:l:m:R:s:u?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 's':
+			sendTo = optarg;
+			break;
+
+		  case 'l':
+		    listenPort = atoi ( optarg );
+			if ( listenPort <= 0 || listenPort > 65535 )
+			{
+				printf ( "Invalid port[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'u':
+			useUdp = true;
+			break;
+
+		  case 'i':
+		    flushIntervalUs = atol ( optarg );
+			if ( flushIntervalUs <= 0 )
+			{
+				printf ( "Invalid flush interval[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'm':
+		    batchBytes = atol ( optarg );
+			if ( batchBytes < sizeof(mirrorBatch_t) + MIRROR_MAX_RECORD ||
+				 batchBytes > MAX_BATCH_BYTES )
+			{
+				printf ( "Invalid batch size[%s] specified - must be %zu to "
+						 "%u.\n", optarg, sizeof(mirrorBatch_t) + MIRROR_MAX_RECORD,
+						 MAX_BATCH_BYTES );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'R':
+		    refreshSeconds = atol ( optarg );
+			break;
+
+		  case 'd':
+		    runSeconds = atol ( optarg );
+			break;
+
+		  case 'c':
+		    compareBus = atoi ( optarg );
+			if ( compareBus < SHARED_MEMORY_NO_BUS ||
+				 compareBus >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", compareBus );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	bool compare = compareBus >= SHARED_MEMORY_NO_BUS;
+	if ( optind != argc || ( sendTo != 0 ) + ( listenPort != 0 ) + compare != 1 )
+	{
+		printf ( "Specify exactly one of -s, -l and -c.\n" );
+		usage ( argv[0] );
+		exit (255);
+	}
+	if ( batchBytes == 0 )
+	{
+		batchBytes = useUdp ? 1400 : MAX_BATCH_BYTES;
+	}
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	if ( compare )
+	{
+		return compareSegments ( sharedMemory ) == 0 ? 0 : 1;
+	}
+	signal ( SIGINT,  stopHandler );
+	signal ( SIGTERM, stopHandler );
+
+	int status = sendTo != 0 ? runSender ( sharedMemory )
+							 : runReceiver ( sharedMemory );
+
+	sharedMemoryClose ( sharedMemory );
+
+    return status == 0 ? 0 : 255;
+}
@@ -0,0 +1,449 @@
+//
+//	n o t i f y . c
+//
+//  Coalesced eventfd notification of message updates.  See notify.h for a
+//  description.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "sharedMemorySegment.h"
+#include "notify.h"
+
+//
+// Define the cache of the subscriber eventfds that a writer thread uses to
+// signal the subscribers of each notification table it writes to.  Each
+// thread has its own, so a writer never takes a lock to signal and no other
+// thread can close an eventfd while it is being written.  The cache of a
+// table is refreshed from the broker once for each new generation of the
+// table and its eventfds are closed when the thread exits.
+//
+#define NOTIFY_MAX_TABLES ( SHARED_MEMORY_MAX_BUSES + 1 )
+
+typedef struct notifyWriterCache_t
+{
+	notifyTable_t* table;
+	unsigned long  generation;
+	int            fds[NOTIFY_MAX_SUBSCRIBERS];
+
+}   notifyWriterCache_t;
+
+static __thread notifyWriterCache_t writerCaches[NOTIFY_MAX_TABLES];
+static pthread_key_t               writerCacheKey;
+static pthread_once_t              writerCacheOnce = PTHREAD_ONCE_INIT;
+
+//
+// Return the number of bytes needed for a notification table region.
+//
+unsigned long notifyRegionSize ( unsigned int messageCount )
+{
+	return sizeof(notifyTable_t) + (unsigned long)messageCount * sizeof(unsigned long);
+}
+
+
+//
+// Initialize a notification table region.  All of the subscriber slots are
+// freed and all of the interest masks are cleared.
+//
+void notifyInitialize ( notifyTable_t* table, unsigned int maxSubscribers,
+						unsigned int messageCount )
+{
+	(void) memset ( table, 0, notifyRegionSize ( messageCount ) );
+
+	table->maxSubscribers = maxSubscribers;
+	table->messageCount   = messageCount;
+}
+
+
+//
+// Send a reply to a broker request with the specified file descriptors
+// attached.
+//
+// This function returns 0 if the reply was sent and -1 if it was not.
+//
+int notifySendFds ( int socket, notifyReply_t* reply, const int* fds,
+					unsigned int fdCount )
+{
+	char           control[CMSG_SPACE ( sizeof(int) * NOTIFY_MAX_SUBSCRIBERS )];
+	struct iovec   iov = { reply, sizeof(notifyReply_t) };
+	struct msghdr  header;
+
+	(void) memset ( &header, 0, sizeof(header) );
+	header.msg_iov    = &iov;
+	header.msg_iovlen = 1;
+
+	if ( fdCount > 0 )
+	{
+		(void) memset ( control, 0, sizeof(control) );
+		header.msg_control    = control;
+		header.msg_controllen = CMSG_SPACE ( sizeof(int) * fdCount );
+
+		struct cmsghdr* message = CMSG_FIRSTHDR ( &header );
+		message->cmsg_level = SOL_SOCKET;
+		message->cmsg_type  = SCM_RIGHTS;
+		message->cmsg_len   = CMSG_LEN ( sizeof(int) * fdCount );
+		(void) memcpy ( CMSG_DATA ( message ), fds, sizeof(int) * fdCount );
+	}
+	if ( sendmsg ( socket, &header, MSG_NOSIGNAL ) != sizeof(notifyReply_t) )
+	{
+		return -1;
+	}
+	return 0;
+}
+
+
+//
+// Receive a reply to a broker request and the file descriptors attached to
+// it.
+//
+// This function returns the number of file descriptors received or -1 if
+// the reply could not be received.
+//
+int notifyReceiveFds ( int socket, notifyReply_t* reply, int* fds,
+					   unsigned int maxFds )
+{
+	char           control[CMSG_SPACE ( sizeof(int) * NOTIFY_MAX_SUBSCRIBERS )];
+	struct iovec   iov = { reply, sizeof(notifyReply_t) };
+	struct msghdr  header;
+
+	(void) memset ( &header, 0, sizeof(header) );
+	header.msg_iov        = &iov;
+	header.msg_iovlen     = 1;
+	header.msg_control    = control;
+	header.msg_controllen = sizeof(control);
+
+	if ( recvmsg ( socket, &header, MSG_CMSG_CLOEXEC ) != sizeof(notifyReply_t) )
+	{
+		return -1;
+	}
+	int count = 0;
+	for ( struct cmsghdr* message = CMSG_FIRSTHDR ( &header ); message != 0;
+		  message = CMSG_NXTHDR ( &header, message ) )
+	{
+		if ( message->cmsg_level != SOL_SOCKET ||
+			 message->cmsg_type  != SCM_RIGHTS )
+		{
+			continue;
+		}
+		int  received = ( message->cmsg_len - CMSG_LEN ( 0 ) ) / sizeof(int);
+		int* source   = (int*)CMSG_DATA ( message );
+
+		for ( int i = 0; i < received; i++ )
+		{
+			if ( count < maxFds )
+			{
+				fds[count++] = source[i];
+			}
+			else
+			{
+				(void) close ( source[i] );
+			}
+		}
+	}
+	return count;
+}
+
+
+//
+// Connect to the broker of a notification table and send it a request.
+//
+// This function returns the connected socket or -1 if the broker could not
+// be reached.
+//
+static int brokerRequest ( notifyTable_t* table, unsigned int request )
+{
+	struct sockaddr_un address;
+
+	if ( table->socketName[0] == 0 )
+	{
+		return -1;
+	}
+	int fd = socket ( AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0 );
+	if ( fd < 0 )
+	{
+		return -1;
+	}
+	(void) memset ( &address, 0, sizeof(address) );
+	address.sun_family = AF_UNIX;
+	(void) strncpy ( address.sun_path, table->socketName,
+					 sizeof(address.sun_path) - 1 );
+
+	if ( connect ( fd, (struct sockaddr*)&address, sizeof(address) ) != 0 ||
+		 write ( fd, &request, sizeof(request) ) != sizeof(request) )
+	{
+		(void) close ( fd );
+		return -1;
+	}
+	return fd;
+}
+
+
+//
+// Subscribe to notifications from a shared memory segment.  The subscriber
+// gets a slot in the notification table and an eventfd from the broker.  The
+// connection to the broker is kept open so the broker frees the slot when
+// the subscriber goes away.
+//
+// The subscriber is not armed until it calls notifyRearm.
+//
+// This function returns 0 if the subscription was made and -1 if it was not.
+//
+int notifySubscribe ( sharedMemory_t* sharedMemory,
+					  notifySubscription_t* subscription )
+{
+	notifyReply_t reply = { EPROTO };
+
+	if ( sharedMemory->notifyOffset == 0 )
+	{
+		printf ( "The shared memory segment has no notification table.\n" );
+		return -1;
+	}
+	notifyTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+												  sharedMemory->notifyOffset );
+
+	subscription->socket = brokerRequest ( table, NOTIFY_REQUEST_SUBSCRIBE );
+	if ( subscription->socket < 0 )
+	{
+		printf ( "Unable to reach the notification broker - is notifyd "
+				 "running?\n" );
+		return -1;
+	}
+	if ( notifyReceiveFds ( subscription->socket, &reply, &subscription->fd,
+							1 ) != 1 || reply.status != 0 )
+	{
+		printf ( "The notification broker refused the subscription[%s].\n",
+				 strerror ( reply.status ) );
+		(void) close ( subscription->socket );
+		return -1;
+	}
+	subscription->slot = reply.slot;
+
+	return 0;
+}
+
+
+//
+// Add a message ID to the set of messages a subscriber is notified about.
+//
+// This function returns 0 if the ID was added and -1 if it is out of range.
+//
+int notifyAddInterest ( sharedMemory_t* sharedMemory,
+						notifySubscription_t* subscription,
+						canMessageIndex_t id )
+{
+	notifyTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+												  sharedMemory->notifyOffset );
+	if ( id >= table->messageCount )
+	{
+		return -1;
+	}
+	__atomic_fetch_or ( &table->interest[id], 1UL << subscription->slot,
+						__ATOMIC_SEQ_CST );
+
+	return 0;
+}
+
+
+//
+// Re-arm a subscriber so that the next update of a message it is interested
+// in signals its eventfd.  The subscriber must look for changed messages
+// after calling this, not before.
+//
+void notifyRearm ( sharedMemory_t* sharedMemory,
+				   notifySubscription_t* subscription )
+{
+	notifyTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+												  sharedMemory->notifyOffset );
+
+	__atomic_store_n ( &table->subscribers[subscription->slot].armed, 1,
+					   __ATOMIC_SEQ_CST );
+	__atomic_thread_fence ( __ATOMIC_SEQ_CST );
+}
+
+
+//
+// Cancel a subscription.  The broker frees the slot when it sees the
+// connection close.
+//
+void notifyUnsubscribe ( notifySubscription_t* subscription )
+{
+	(void) close ( subscription->fd );
+	(void) close ( subscription->socket );
+}
+
+
+//
+// Close the cached eventfds of a table.
+//
+static void closeWriterFds ( notifyWriterCache_t* cache )
+{
+	for ( int i = 0; i < NOTIFY_MAX_SUBSCRIBERS; i++ )
+	{
+		if ( cache->fds[i] >= 0 )
+		{
+			(void) close ( cache->fds[i] );
+			cache->fds[i] = -1;
+		}
+	}
+}
+
+
+//
+// Close the cached eventfds of a writer thread that is exiting.
+//
+static void releaseWriterCaches ( void* caches )
+{
+	notifyWriterCache_t* cache = caches;
+
+	for ( int i = 0; i < NOTIFY_MAX_TABLES && cache[i].table != 0; i++ )
+	{
+		closeWriterFds ( &cache[i] );
+	}
+}
+
+
+//
+// Create the key that closes the cached eventfds when a thread exits.
+//
+static void createWriterCacheKey ( void )
+{
+	(void) pthread_key_create ( &writerCacheKey, releaseWriterCaches );
+}
+
+
+//
+// Return the eventfd of a subscriber for the calling writer thread.
+//
+// If the subscribers have changed, the thread's cache is refreshed from the
+// broker first.  This is tried once for each generation of the table.  If
+// the broker can't be reached, the cache is left empty until the next
+// generation, so the subscribers stay armed for the other writers rather
+// than have this thread connect to the broker on every insert.
+//
+// This function returns -1 if the subscriber's eventfd isn't known.
+//
+static int writerFd ( notifyTable_t* table, unsigned int slot )
+{
+	notifyWriterCache_t* cache = 0;
+
+	for ( int i = 0; i < NOTIFY_MAX_TABLES; i++ )
+	{
+		if ( writerCaches[i].table == table )
+		{
+			cache = &writerCaches[i];
+			break;
+		}
+		if ( writerCaches[i].table == 0 )
+		{
+			(void) pthread_once ( &writerCacheOnce, createWriterCacheKey );
+			(void) pthread_setspecific ( writerCacheKey, writerCaches );
+
+			cache = &writerCaches[i];
+			cache->table      = table;
+			cache->generation = 0;
+			for ( int j = 0; j < NOTIFY_MAX_SUBSCRIBERS; j++ )
+			{
+				cache->fds[j] = -1;
+			}
+			break;
+		}
+	}
+	if ( cache == 0 )
+	{
+		return -1;
+	}
+	unsigned long generation = __atomic_load_n ( &table->generation,
+												 __ATOMIC_ACQUIRE );
+	if ( cache->generation != generation )
+	{
+		notifyReply_t reply = { EPROTO };
+		int           fds[NOTIFY_MAX_SUBSCRIBERS];
+		int           fd    = brokerRequest ( table, NOTIFY_REQUEST_WRITER );
+		int           count = -1;
+
+		if ( fd >= 0 )
+		{
+			count = notifyReceiveFds ( fd, &reply, fds, NOTIFY_MAX_SUBSCRIBERS );
+			(void) close ( fd );
+		}
+		closeWriterFds ( cache );
+
+		if ( count < 0 || reply.status != 0 )
+		{
+			for ( int i = 0; i < count; i++ )
+			{
+				(void) close ( fds[i] );
+			}
+			cache->generation = generation;
+			return -1;
+		}
+		int next = 0;
+		for ( int i = 0; i < NOTIFY_MAX_SUBSCRIBERS && next < count; i++ )
+		{
+			if ( reply.activeMask & ( 1UL << i ) )
+			{
+				cache->fds[i] = fds[next++];
+			}
+		}
+		while ( next < count )
+		{
+			(void) close ( fds[next++] );
+		}
+		cache->generation = reply.generation;
+	}
+	return cache->fds[slot];
+}
+
+
+//
+//	n o t i f y S i g n a l
+//
+// Signal the armed subscribers in the interest mask of a message that has
+// just been updated.  This is called by insertMessage after the update is
+// complete and the shared memory lock has been released.
+//
+void notifySignal ( notifyTable_t* table, unsigned long mask )
+{
+	while ( mask != 0 )
+	{
+		unsigned int        slot       = __builtin_ctzl ( mask );
+		notifySubscriber_t* subscriber = &table->subscribers[slot];
+
+		mask &= mask - 1;
+
+		//
+		// Only the writer that disarms the subscriber signals it.  The flag
+		// is read first so the updates of a burst after the first one only
+		// read the subscriber's line rather than take it exclusively.  A
+		// writer that has no eventfd for the subscriber leaves it armed.
+		//
+		if ( __atomic_load_n ( &subscriber->armed, __ATOMIC_RELAXED ) == 0 )
+		{
+			continue;
+		}
+		int fd = writerFd ( table, slot );
+
+		if ( fd < 0 ||
+			 __atomic_exchange_n ( &subscriber->armed, 0, __ATOMIC_SEQ_CST ) == 0 )
+		{
+			continue;
+		}
+		unsigned long one = 1;
+
+		if ( write ( fd, &one, sizeof(one) ) != sizeof(one) )
+		{
+			//
+			// We couldn't signal it so leave it armed for the next writer.
+			//
+			__atomic_store_n ( &subscriber->armed, 1, __ATOMIC_SEQ_CST );
+			continue;
+		}
+		__atomic_fetch_add ( &subscriber->signals, 1, __ATOMIC_RELAXED );
+	}
+}
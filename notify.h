@@ -0,0 +1,121 @@
+#pragma once
+#ifndef NOTIFY_H
+#define NOTIFY_H
+
+#include <sys/types.h>
+
+#include "canMessage.h"
+
+//
+// The notification table is an optional region of the shared memory segment
+// that lets event loop based consumers wait for message updates with epoll
+// instead of polling or blocking in a custom wait call.
+//
+// Each subscriber gets an eventfd from the notification broker ("notifyd")
+// over a Unix domain socket and adds it to its own epoll set.  The subscriber
+// then sets its bit in the interest mask of each message ID it cares about.
+// When insertMessage updates a message whose interest mask is not zero, it
+// signals the eventfd of every interested subscriber that is armed.
+//
+// Signalling is edge triggered and coalesced on the writer side.  A writer
+// clears the subscriber's armed flag with an atomic exchange and only the
+// writer that actually cleared it writes to the eventfd.  Every other update
+// until the subscriber re-arms costs nothing but a read of the flag, so a
+// burst of updates produces a single wakeup.  After a wakeup the subscriber drains the
+// eventfd, re-arms and then looks for the messages that changed (using their
+// sequence numbers).  Re-arming before looking means that an update made
+// while the subscriber is looking will produce another wakeup rather than be
+// missed.
+//
+// Writers get the eventfds of the subscribers from the broker as well.  The
+// broker bumps the table generation whenever a subscriber comes or goes and
+// a writer that sees a new generation asks the broker for the current set of
+// eventfds before signalling.  Each writer thread keeps its own set, so
+// signalling takes no lock, and asks the broker once per generation.
+//
+// The interest masks are 64 bits so there can be at most 64 subscribers.
+//
+#define NOTIFY_MAX_SUBSCRIBERS 64
+
+//
+// Define the state of a subscriber slot.  Each slot is on its own cache line.
+//
+typedef struct notifySubscriber_t
+{
+	pid_t         pid;                      // 0 if the slot is free
+	unsigned int  armed;
+	unsigned long signals;                  // eventfd writes by writers
+
+}   __attribute__((aligned(64))) notifySubscriber_t;
+
+//
+// Define the header of the notification table region.  The interest masks of
+// the message IDs follow the header.
+//
+typedef struct notifyTable_t
+{
+	unsigned int       maxSubscribers;
+	unsigned int       messageCount;
+	unsigned long      generation;
+	char               socketName[108];     // Broker's Unix socket
+
+	notifySubscriber_t subscribers[NOTIFY_MAX_SUBSCRIBERS];
+
+	unsigned long      interest[0] __attribute__((aligned(64)));
+
+}   notifyTable_t;
+
+//
+// Define the messages exchanged with the broker.  The request is a single
+// type code.  The reply carries the eventfds as SCM_RIGHTS ancillary data:
+// one eventfd for a subscriber or one for each bit of the active mask (in
+// slot order) for a writer.
+//
+#define NOTIFY_REQUEST_SUBSCRIBE 1
+#define NOTIFY_REQUEST_WRITER    2
+
+typedef struct notifyReply_t
+{
+	int           status;                   // 0 or an errno value
+	unsigned int  slot;
+	unsigned long generation;
+	unsigned long activeMask;
+
+}   notifyReply_t;
+
+//
+// Define the process local state of a subscription.  The eventfd is the file
+// descriptor that the subscriber adds to its epoll set.
+//
+typedef struct notifySubscription_t
+{
+	int          fd;
+	int          socket;
+	unsigned int slot;
+
+}   notifySubscription_t;
+
+//
+// Define the notification functions.
+//
+struct sharedMemory_t;
+
+unsigned long notifyRegionSize  ( unsigned int messageCount );
+void          notifyInitialize  ( notifyTable_t* table,
+								  unsigned int maxSubscribers,
+								  unsigned int messageCount );
+int           notifySubscribe   ( struct sharedMemory_t* sharedMemory,
+								  notifySubscription_t* subscription );
+int           notifyAddInterest ( struct sharedMemory_t* sharedMemory,
+								  notifySubscription_t* subscription,
+								  canMessageIndex_t id );
+void          notifyRearm       ( struct sharedMemory_t* sharedMemory,
+								  notifySubscription_t* subscription );
+void          notifyUnsubscribe ( notifySubscription_t* subscription );
+void          notifySignal      ( notifyTable_t* table, unsigned long mask );
+int           notifySendFds     ( int socket, notifyReply_t* reply,
+								  const int* fds, unsigned int fdCount );
+int           notifyReceiveFds  ( int socket, notifyReply_t* reply, int* fds,
+								  unsigned int maxFds );
+
+#endif		// End of NOTIFY_H
@@ -0,0 +1,437 @@
+//
+//	n o t i f y b e n c h . c
+//
+//  Compare an epoll based consumer woken by the notification table (see
+//  notify.h) with a busy polling consumer.
+//
+//  The program forks a consumer process that watches a set of message IDs
+//  and then writes updates to those IDs at a fixed rate.  Each update carries
+//  the time it was written so the consumer can measure the wake latency of
+//  every frame it sees.  At the end of the run the program reports the
+//  frames seen, the wakeups, the system calls per frame (the consumer's
+//  epoll_wait and eventfd reads plus the writers' eventfd writes), the
+//  latency distribution and the CPU time used by the consumer.
+//
+//  The shared memory segment must have been created with a notification
+//  table ("create -n") and the notification broker ("notifyd") must be
+//  running unless the "-p" busy poll option is used.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <locale.h>
+#include <stdbool.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the largest number of message IDs and latency samples.
+//
+#define MAX_IDS     4096
+#define MAX_SAMPLES ( 4 * 1024 * 1024 )
+
+//
+// Define the benchmark parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static const char*   idList      = "0-99";
+static unsigned long frameRate   = 10000;
+static unsigned int  burstSize   = 1;
+static unsigned int  runSeconds  = 5;
+static bool          busyPoll    = false;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the results that the consumer passes back to the parent through an
+// anonymous shared mapping.
+//
+typedef struct benchResults_t
+{
+	volatile int  ready;
+	volatile int  stop;
+	unsigned int  slot;
+	unsigned long frames;
+	unsigned long wakeups;
+	unsigned long syscalls;
+	unsigned long cpuUs;
+	unsigned long sampleCount;
+	unsigned long samples[MAX_SAMPLES];
+
+}   benchResults_t;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -i    Message IDs      list       0-99 \n\
+    -r    Frames/sec       int      10,000 \n\
+    -n    Burst Size       int           1 \n\
+    -d    Duration (sec)   int           5 \n\
+    -p    Busy Poll        bool      false \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Return the current monotonic time in nanoseconds.
+//
+static unsigned long nowNs ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// Return the CPU time used by this process in microseconds.
+//
+static unsigned long cpuTimeUs ( void )
+{
+	struct rusage usage;
+
+	(void) getrusage ( RUSAGE_SELF, &usage );
+
+	return usage.ru_utime.tv_sec * 1000000UL + usage.ru_utime.tv_usec +
+		   usage.ru_stime.tv_sec * 1000000UL + usage.ru_stime.tv_usec;
+}
+
+
+//
+// Look at each of the watched messages and record the latency of the ones
+// that have changed since the last look.
+//
+static void scan ( sharedMemory_t* sharedMemory, canMessageIndex_t* ids,
+				   int idCount, unsigned int* sequences,
+				   benchResults_t* results )
+{
+	canMessage_t message;
+
+	for ( int i = 0; i < idCount; i++ )
+	{
+		unsigned int sequence = sharedMemoryReadMessage ( sharedMemory, ids[i],
+														  &message );
+		if ( sequence == sequences[i] )
+		{
+			continue;
+		}
+		sequences[i] = sequence;
+
+		unsigned long written;
+		(void) memcpy ( &written, message.canMessage.data, sizeof(written) );
+
+		unsigned long now = nowNs();
+		if ( results->sampleCount < MAX_SAMPLES && now >= written )
+		{
+			results->samples[results->sampleCount++] = now - written;
+		}
+		results->frames++;
+	}
+}
+
+
+//
+// Run the consumer process.
+//
+static void runConsumer ( sharedMemory_t* sharedMemory, canMessageIndex_t* ids,
+						  int idCount, benchResults_t* results )
+{
+	notifySubscription_t subscription;
+	unsigned int         sequences[MAX_IDS];
+	canMessage_t         message;
+	int                  epollFd = -1;
+
+	if ( ! busyPoll )
+	{
+		if ( notifySubscribe ( sharedMemory, &subscription ) != 0 )
+		{
+			_exit (255);
+		}
+		for ( int i = 0; i < idCount; i++ )
+		{
+			(void) notifyAddInterest ( sharedMemory, &subscription, ids[i] );
+		}
+		results->slot = subscription.slot;
+
+		epollFd = epoll_create1 ( 0 );
+		struct epoll_event event = { EPOLLIN, { .u32 = 0 } };
+		(void) epoll_ctl ( epollFd, EPOLL_CTL_ADD, subscription.fd, &event );
+
+		notifyRearm ( sharedMemory, &subscription );
+	}
+	for ( int i = 0; i < idCount; i++ )
+	{
+		sequences[i] = sharedMemoryReadMessage ( sharedMemory, ids[i], &message );
+	}
+	unsigned long startCpu = cpuTimeUs();
+	results->ready = 1;
+
+	while ( ! results->stop )
+	{
+		if ( busyPoll )
+		{
+			results->wakeups++;
+			scan ( sharedMemory, ids, idCount, sequences, results );
+			continue;
+		}
+		struct epoll_event event;
+		int count = epoll_wait ( epollFd, &event, 1, 100 );
+		results->syscalls++;
+		if ( count <= 0 )
+		{
+			continue;
+		}
+		unsigned long value;
+		(void) read ( subscription.fd, &value, sizeof(value) );
+		results->syscalls++;
+		results->wakeups++;
+
+		notifyRearm ( sharedMemory, &subscription );
+		scan ( sharedMemory, ids, idCount, sequences, results );
+	}
+	results->cpuUs = cpuTimeUs() - startCpu;
+
+	if ( ! busyPoll )
+	{
+		notifyUnsubscribe ( &subscription );
+	}
+	_exit (0);
+}
+
+
+//
+// Compare two latency samples for qsort.
+//
+static int compareSamples ( const void* left, const void* right )
+{
+	unsigned long a = *(const unsigned long*)left;
+	unsigned long b = *(const unsigned long*)right;
+
+	return a < b ? -1 : a > b;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:d:hi:n:pr:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'd':
+		    runSeconds = atol ( optarg );
+			break;
+
+		  case 'i':
+			idList = optarg;
+			break;
+
+		  case 'n':
+		    burstSize = atol ( optarg );
+			if ( burstSize <= 0 )
+			{
+				printf ( "Invalid burst size[%u] specified.\n", burstSize );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'p':
+			busyPoll = true;
+			break;
+
+		  case 'r':
+		    frameRate = atol ( optarg );
+			if ( frameRate <= 0 )
+			{
+				printf ( "Invalid frame rate[%lu] specified.\n", frameRate );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	canMessageIndex_t ids[MAX_IDS];
+	int               idCount = parseMessageIdList ( idList, ids, MAX_IDS );
+	if ( idCount <= 0 || optind != argc )
+	{
+		printf ( "Invalid message ID list[%s] specified.\n", idList );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	if ( ! busyPoll && sharedMemoryGetNotifyTable ( sharedMemory ) == 0 )
+	{
+		printf ( "The shared memory segment has no notification table - Use "
+				 "\"create -n\" to create one.\n" );
+		exit (255);
+	}
+	benchResults_t* results = mmap ( NULL, sizeof(benchResults_t),
+									 PROT_READ|PROT_WRITE,
+									 MAP_SHARED|MAP_ANONYMOUS, -1, 0 );
+	if ( results == MAP_FAILED )
+	{
+		printf ( "Unable to map the results area.\n" );
+		exit (255);
+	}
+	//
+	// Start the consumer and wait for it to be ready.
+	//
+	fflush ( stdout );
+	pid_t consumer = fork();
+	if ( consumer == 0 )
+	{
+		runConsumer ( sharedMemory, ids, idCount, results );
+	}
+	while ( ! results->ready )
+	{
+		int status;
+		if ( waitpid ( consumer, &status, WNOHANG ) == consumer )
+		{
+			printf ( "The consumer failed to start - Aborting\n" );
+			exit (255);
+		}
+		usleep ( 1000 );
+	}
+	//
+	// Write the frames.  Each tick writes a burst of frames to consecutive
+	// IDs from the list and then sleeps until the next tick.
+	//
+	canMessage_t    message;
+	unsigned long   tickNs  = 1000000000UL * burstSize / frameRate;
+	unsigned long   startNs = nowNs();
+	unsigned long   stopNs  = startNs + runSeconds * 1000000000UL;
+	unsigned long   nextNs  = startNs;
+	unsigned long   written = 0;
+	int             next    = 0;
+
+	(void) memset ( &message, 0, sizeof(message) );
+	message.canMessage.can_dlc = CAN_MAX_DLEN;
+
+	while ( nextNs < stopNs )
+	{
+		for ( unsigned int i = 0; i < burstSize; i++ )
+		{
+			unsigned long now = nowNs();
+
+			message.canMessage.can_id = ids[next];
+			(void) memcpy ( message.canMessage.data, &now, sizeof(now) );
+			(void) insertMessage ( sharedMemory, &message );
+
+			next = ( next + 1 ) % idCount;
+			written++;
+		}
+		nextNs += tickNs;
+
+		struct timespec until = { nextNs / 1000000000UL, nextNs % 1000000000UL };
+		(void) clock_nanosleep ( CLOCK_MONOTONIC, TIMER_ABSTIME, &until, NULL );
+	}
+	//
+	// Let the consumer catch up and then stop it.
+	//
+	usleep ( 100 * 1000 );
+	results->stop = 1;
+	(void) waitpid ( consumer, 0, 0 );
+
+	//
+	// Report the results.
+	//
+	unsigned long signals = 0;
+	if ( ! busyPoll )
+	{
+		signals = sharedMemoryGetNotifyTable ( sharedMemory )->
+					  subscribers[results->slot].signals;
+	}
+	unsigned long syscalls = results->syscalls + signals;
+
+	qsort ( results->samples, results->sampleCount, sizeof(unsigned long),
+			compareSamples );
+
+	printf ( "%s consumer, %'lu frames/sec in bursts of %u:\n",
+			 busyPoll ? "Busy poll" : "Epoll", frameRate, burstSize );
+	printf ( "  %'lu frames written, %'lu seen, %'lu wakeups (%.2f frames/"
+			 "wakeup)\n", written, results->frames, results->wakeups,
+			 results->wakeups ? (double)results->frames / results->wakeups : 0.0 );
+	printf ( "  %'lu syscalls (%'lu eventfd signals) - %.2f syscalls/frame\n",
+			 syscalls, signals,
+			 results->frames ? (double)syscalls / results->frames : 0.0 );
+	if ( results->sampleCount > 0 )
+	{
+		unsigned long count = results->sampleCount;
+
+		printf ( "  latency usec: median %'.1f, p99 %'.1f, max %'.1f\n",
+				 results->samples[count / 2] / 1000.0,
+				 results->samples[count * 99 / 100] / 1000.0,
+				 results->samples[count - 1] / 1000.0 );
+	}
+	printf ( "  consumer CPU %.1f%%\n",
+			 results->cpuUs / 10000.0 / runSeconds );
+
+	sharedMemoryClose ( sharedMemory );
+
+    return 0;
+}
@@ -0,0 +1,373 @@
+//
+//	n o t i f y d . c
+//
+//  The notification broker.  This program hands out the eventfds that are
+//  used to wake up the subscribers of the notification table (see notify.h)
+//  over a Unix domain socket.
+//
+//  The shared memory segment must have been created with a notification
+//  table (see the "-n" option of the "create" program).  The broker listens
+//  on a socket named after the segment with ".notify" appended and stores
+//  that name in the table so the library can find it.  It handles two kinds
+//  of requests:
+//
+//      subscribe - Allocate a subscriber slot, create an eventfd for it and
+//                  pass it back.  The connection stays open and the slot is
+//                  freed (and its interest bits cleared) when it closes.
+//
+//      writer    - Pass back the eventfds of all of the active subscribers
+//                  so that a writer can signal them.
+//
+//  Every change to the set of subscribers bumps the table generation so the
+//  writers know to come back for the new set of eventfds.
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <locale.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the broker state.
+//
+static notifyTable_t* table;
+static int            eventFds[NOTIFY_MAX_SUBSCRIBERS];
+static int            connections[NOTIFY_MAX_SUBSCRIBERS];
+static char           socketName[108];
+static volatile int   stopRequested = 0;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Handle the interrupt signal by asking the main loop to stop.
+//
+static void stopHandler ( int signalNumber )
+{
+	stopRequested = 1;
+}
+
+
+//
+// Tell the writers that the set of subscribers has changed.
+//
+static void bumpGeneration ( void )
+{
+	__atomic_fetch_add ( &table->generation, 1, __ATOMIC_RELEASE );
+}
+
+
+//
+// Allocate a subscriber slot for a new connection and pass the subscriber
+// its eventfd.
+//
+static void subscribe ( int epollFd, int connection )
+{
+	notifyReply_t reply;
+	struct ucred  credentials;
+	socklen_t     length = sizeof(credentials);
+
+	(void) memset ( &reply, 0, sizeof(reply) );
+
+	int slot = -1;
+	for ( unsigned int i = 0; i < table->maxSubscribers; i++ )
+	{
+		if ( connections[i] < 0 )
+		{
+			slot = i;
+			break;
+		}
+	}
+	if ( slot < 0 )
+	{
+		reply.status = ENOSPC;
+		(void) notifySendFds ( connection, &reply, 0, 0 );
+		(void) close ( connection );
+		return;
+	}
+	int eventFd = eventfd ( 0, EFD_NONBLOCK|EFD_CLOEXEC );
+	if ( eventFd < 0 )
+	{
+		reply.status = errno;
+		(void) notifySendFds ( connection, &reply, 0, 0 );
+		(void) close ( connection );
+		return;
+	}
+	if ( getsockopt ( connection, SOL_SOCKET, SO_PEERCRED, &credentials,
+					  &length ) != 0 )
+	{
+		credentials.pid = 0;
+	}
+	eventFds[slot]    = eventFd;
+	connections[slot] = connection;
+
+	table->subscribers[slot].armed   = 0;
+	table->subscribers[slot].signals = 0;
+	table->subscribers[slot].pid     = credentials.pid;
+	bumpGeneration();
+
+	reply.slot       = slot;
+	reply.generation = table->generation;
+	if ( notifySendFds ( connection, &reply, &eventFd, 1 ) != 0 )
+	{
+		printf ( "Unable to send the eventfd to subscriber %d.\n", slot );
+	}
+	struct epoll_event event = { EPOLLIN|EPOLLRDHUP, { .u32 = slot + 1 } };
+	(void) epoll_ctl ( epollFd, EPOLL_CTL_ADD, connection, &event );
+
+	printf ( "Subscriber %d (pid %d) connected.\n", slot, credentials.pid );
+}
+
+
+//
+// Free the slot of a subscriber whose connection has closed.
+//
+static void unsubscribe ( int epollFd, unsigned int slot )
+{
+	unsigned long mask = ~( 1UL << slot );
+
+	(void) epoll_ctl ( epollFd, EPOLL_CTL_DEL, connections[slot], 0 );
+	(void) close ( connections[slot] );
+	connections[slot] = -1;
+
+	for ( unsigned int id = 0; id < table->messageCount; id++ )
+	{
+		if ( table->interest[id] & ~mask )
+		{
+			__atomic_fetch_and ( &table->interest[id], mask, __ATOMIC_SEQ_CST );
+		}
+	}
+	printf ( "Subscriber %u (pid %d) disconnected after %'lu signals.\n", slot,
+			 table->subscribers[slot].pid, table->subscribers[slot].signals );
+
+	table->subscribers[slot].armed = 0;
+	table->subscribers[slot].pid   = 0;
+	bumpGeneration();
+
+	(void) close ( eventFds[slot] );
+	eventFds[slot] = -1;
+}
+
+
+//
+// Pass a writer the eventfds of all of the active subscribers.
+//
+static void writer ( int connection )
+{
+	notifyReply_t reply;
+	int           fds[NOTIFY_MAX_SUBSCRIBERS];
+	unsigned int  count = 0;
+
+	(void) memset ( &reply, 0, sizeof(reply) );
+	reply.generation = __atomic_load_n ( &table->generation, __ATOMIC_ACQUIRE );
+
+	for ( unsigned int i = 0; i < table->maxSubscribers; i++ )
+	{
+		if ( eventFds[i] >= 0 )
+		{
+			reply.activeMask |= 1UL << i;
+			fds[count++] = eventFds[i];
+		}
+	}
+	(void) notifySendFds ( connection, &reply, fds, count );
+	(void) close ( connection );
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:h?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	//
+	// Open the shared memory file and find the notification table.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	table = sharedMemoryGetNotifyTable ( sharedMemory );
+	if ( table == 0 )
+	{
+		printf ( "The shared memory segment has no notification table - Use "
+				 "\"create -n\" to create one.\n" );
+		exit (255);
+	}
+	//
+	// Any subscribers left over from a previous broker can't be signalled
+	// any more so start with a clean table.  The generation carries on from
+	// where it was so that no writer mistakes the new set of subscribers for
+	// the one it has cached.
+	//
+	unsigned long generation = table->generation;
+	notifyInitialize ( table, table->maxSubscribers, table->messageCount );
+	table->generation = generation;
+	for ( int i = 0; i < NOTIFY_MAX_SUBSCRIBERS; i++ )
+	{
+		eventFds[i]    = -1;
+		connections[i] = -1;
+	}
+	//
+	// Create the listening socket.
+	//
+	char segmentName[4096];
+	sharedMemoryPartitionName ( busId, segmentName, sizeof(segmentName) );
+	if ( snprintf ( socketName, sizeof(socketName), "%s.notify",
+					segmentName ) >= sizeof(socketName) )
+	{
+		printf ( "The socket name for segment[%s] is too long.\n", segmentName );
+		exit (255);
+	}
+	struct sockaddr_un address;
+	(void) memset ( &address, 0, sizeof(address) );
+	address.sun_family = AF_UNIX;
+	(void) strncpy ( address.sun_path, socketName, sizeof(address.sun_path) - 1 );
+
+	int listenFd = socket ( AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0 );
+	(void) unlink ( socketName );
+	if ( listenFd < 0 ||
+		 bind ( listenFd, (struct sockaddr*)&address, sizeof(address) ) != 0 ||
+		 listen ( listenFd, 64 ) != 0 )
+	{
+		printf ( "Unable to listen on socket[%s] errno: %u[%s].\n", socketName,
+				 errno, strerror(errno) );
+		exit (255);
+	}
+	(void) strncpy ( table->socketName, socketName,
+					 sizeof(table->socketName) - 1 );
+	bumpGeneration();
+
+	int epollFd = epoll_create1 ( EPOLL_CLOEXEC );
+	struct epoll_event event = { EPOLLIN, { .u32 = 0 } };
+	(void) epoll_ctl ( epollFd, EPOLL_CTL_ADD, listenFd, &event );
+
+	signal ( SIGINT,  stopHandler );
+	signal ( SIGTERM, stopHandler );
+
+	printf ( "Notification broker listening on %s for %u subscribers. "
+			 "<ctrl-c> to quit...\n", socketName, table->maxSubscribers );
+	fflush ( stdout );
+
+	//
+	// Handle requests until we are told to stop.
+	//
+	while ( ! stopRequested )
+	{
+		struct epoll_event events[16];
+		int count = epoll_wait ( epollFd, events, 16, -1 );
+
+		for ( int i = 0; i < count; i++ )
+		{
+			if ( events[i].data.u32 != 0 )
+			{
+				//
+				// A subscriber connection only becomes readable when it
+				// closes.
+				//
+				unsubscribe ( epollFd, events[i].data.u32 - 1 );
+				continue;
+			}
+			int connection = accept4 ( listenFd, 0, 0, SOCK_CLOEXEC );
+			if ( connection < 0 )
+			{
+				continue;
+			}
+			unsigned int request = 0;
+			if ( read ( connection, &request, sizeof(request) ) != sizeof(request) )
+			{
+				(void) close ( connection );
+			}
+			else if ( request == NOTIFY_REQUEST_SUBSCRIBE )
+			{
+				subscribe ( epollFd, connection );
+			}
+			else if ( request == NOTIFY_REQUEST_WRITER )
+			{
+				writer ( connection );
+			}
+			else
+			{
+				(void) close ( connection );
+			}
+		}
+		fflush ( stdout );
+	}
+	//
+	// Remove the socket so nobody tries to reach us any more.
+	//
+	table->socketName[0] = 0;
+	bumpGeneration();
+	(void) unlink ( socketName );
+	sharedMemoryClose ( sharedMemory );
+
+    return 0;
+}
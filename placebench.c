@@ -0,0 +1,790 @@
+//
+//	p l a c e b e n c h . c
+//
+//  Measure what the placement map (see placement.h) saves the readers of a
+//  realistic traffic mix and check that the IDs can be moved while they are
+//  being read.
+//
+//  The traffic is a generated profile (see workload.h) of a few hundred IDs
+//  spread over the whole pool, as on a real bus.  A writer replays the
+//  profile as fast as it can and the readers follow the same schedule, so
+//  each ID is read as often as it is sent.  Every so often a reader runs
+//  through a buffer much larger than its caches and TLB, as any other work
+//  it does would, and then times one pass over the IDs from cold.  The rest
+//  of the passes are timed as warm.
+//
+//  The load is run three times:
+//
+//    Home slots  Every ID in its home slot.  The traffic of this run is taken
+//                from the heat map to choose the IDs for the hot slots.
+//    Moving      The chosen IDs are promoted and demoted over and over while
+//                the writer and readers run.
+//    Hot slots   The chosen IDs in the hot slots.
+//
+//  Each reader checks every frame it reads: it must have the right ID, a
+//  payload that isn't torn (the writer puts the same 32 bit count in both
+//  halves) and a sequence number that isn't older than the last one it saw
+//  for that ID.  Any frame that fails is reported as an error.
+//
+//  For each run the pages and cache lines that hold the IDs are reported,
+//  with the time per read from cold and warm and, if the processor's
+//  counters can be read (perf_event_open), the first level cache and TLB
+//  misses per cold read.
+//
+//  The shared memory segment must have been created with a heat map and a
+//  placement map ("create -H -p") and the placement optimizer ("placed")
+//  must not be running.  The placement is put back the way it was when the
+//  program is done.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <locale.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#include "sharedMemory.h"
+#include "workload.h"
+
+//
+// Define the largest number of readers.
+//
+#define MAX_READERS 64
+
+//
+// Define the size of the buffer a reader runs through to evict its caches
+// and TLB, and the number of warm passes after each cold pass.
+//
+#define EVICT_BYTES  ( 64UL * 1024 * 1024 )
+#define WARM_PASSES  50
+
+//
+// Define the time between placement changes in the "Moving" run.
+//
+#define MOVE_INTERVAL_USEC 20000
+
+//
+// Define the page and cache line sizes used to count the footprint.
+//
+#define PAGE_BYTES 4096UL
+#define LINE_BYTES 64UL
+
+//
+// Define the benchmark parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static unsigned int idCount    = 256;
+static unsigned int readers    = 1;
+static unsigned int runSeconds = 3;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the counters of one process.  Each is on its own cache line.
+//
+typedef struct processCounters_t
+{
+	unsigned long operations;
+	unsigned long errors;
+	unsigned long coldReads;
+	unsigned long coldNs;
+	unsigned long warmReads;
+	unsigned long warmNs;
+	unsigned long cacheMisses;
+	unsigned long tlbMisses;
+	int           missesCounted;
+
+}   __attribute__((aligned(64))) processCounters_t;
+
+//
+// Define the results that the children pass back to the parent through an
+// anonymous shared mapping.
+//
+typedef struct benchResults_t
+{
+	volatile int      start;
+	volatile int      stop;
+	processCounters_t writer;
+	processCounters_t readers[MAX_READERS];
+
+}   benchResults_t;
+
+//
+// Define the results of one run.
+//
+typedef struct runResults_t
+{
+	unsigned long frames;
+	unsigned long reads;
+	unsigned long errors;
+	unsigned long coldReads;
+	unsigned long coldNs;
+	unsigned long warmReads;
+	unsigned long warmNs;
+	unsigned long cacheMisses;
+	unsigned long tlbMisses;
+	int           missesCounted;
+	unsigned long moves;
+	unsigned long pages;
+	unsigned long lines;
+
+}   runResults_t;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -n    ID Count         int          256 \n\
+    -r    Readers          int           1 \n\
+    -d    Duration (sec)   int           3 \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\
+  The -n IDs are spread evenly over the pool and each run lasts -d\n\
+  seconds.\n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Return the current monotonic time in nanoseconds.
+//
+static unsigned long nowNs ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// Open a processor cache counter for read misses of the calling process.
+// This returns the counter's file descriptor or -1 if the processor's
+// counters can't be read (in a virtual machine, for instance).
+//
+static int openMissCounter ( unsigned long cache )
+{
+	struct perf_event_attr attributes;
+
+	(void) memset ( &attributes, 0, sizeof(attributes) );
+	attributes.type           = PERF_TYPE_HW_CACHE;
+	attributes.size           = sizeof(attributes);
+	attributes.config         = cache |
+								( PERF_COUNT_HW_CACHE_OP_READ << 8 ) |
+								( PERF_COUNT_HW_CACHE_RESULT_MISS << 16 );
+	attributes.disabled       = 1;
+	attributes.exclude_kernel = 1;
+	attributes.exclude_hv     = 1;
+
+	return syscall ( __NR_perf_event_open, &attributes, 0, -1, -1, 0 );
+}
+
+
+//
+// Read a counter and close it.  This returns 0 if the counter was read.
+//
+static int closeCounter ( int fd, unsigned long* value )
+{
+	int status = read ( fd, value, sizeof(*value) ) == sizeof(*value) ? 0 : -1;
+
+	(void) close ( fd );
+
+	return status;
+}
+
+
+//
+// Set up the generator of the profile.  The writer and the readers use the
+// same seed so they all get the same IDs and cycle times.
+//
+static int createWorkload ( workload_t* workload, unsigned int poolSize )
+{
+	if ( workloadCreate ( workload, 0x9e3779b97f4a7c15UL ) != 0 ||
+		 workloadGenerateProfile ( workload, idCount, poolSize ) != 0 )
+	{
+		return -1;
+	}
+	workloadStart ( workload );
+
+	return 0;
+}
+
+
+//
+// Run the process that replays the profile.  The payload of every frame is
+// a count, stored twice, so the readers can tell a torn copy.
+//
+static void runWriter ( sharedMemory_t* sharedMemory, benchResults_t* results )
+{
+	processCounters_t* counters = &results->writer;
+	workload_t         workload;
+	canMessage_t       message;
+	unsigned int       count    = 0;
+
+	if ( createWorkload ( &workload, sharedMemoryGetPoolSize ( sharedMemory ) ) != 0 )
+	{
+		_exit (255);
+	}
+	while ( ! results->start )
+	{
+		usleep ( 1000 );
+	}
+	while ( ! results->stop )
+	{
+		for ( unsigned int i = 0; i < idCount; i++ )
+		{
+			(void) workloadNext ( &workload, &message );
+
+			count++;
+			message.canMessage.can_dlc = CAN_MAX_DLEN;
+			(void) memcpy ( &message.canMessage.data[0], &count, sizeof(count) );
+			(void) memcpy ( &message.canMessage.data[4], &count, sizeof(count) );
+			(void) insertMessage ( sharedMemory, &message );
+		}
+		counters->operations += idCount;
+	}
+	workloadDestroy ( &workload );
+	_exit (0);
+}
+
+
+//
+// Read one frame and check it.  This returns true if the frame is wrong.
+//
+static int readAndCheck ( sharedMemory_t* sharedMemory, canMessageIndex_t id,
+						  unsigned int* lastSequence )
+{
+	canMessage_t message;
+	unsigned int sequence = sharedMemoryReadMessage ( sharedMemory, id, &message );
+	unsigned int low;
+	unsigned int high;
+
+	(void) memcpy ( &low, &message.canMessage.data[0], sizeof(low) );
+	(void) memcpy ( &high, &message.canMessage.data[4], sizeof(high) );
+
+	int wrong = message.canMessage.can_id != id || low != high ||
+				(int)( sequence - *lastSequence ) < 0;
+
+	*lastSequence = sequence;
+
+	return wrong;
+}
+
+
+//
+// Run a process that reads the IDs in the order they are sent and times
+// the cold and warm passes.
+//
+static void runReader ( sharedMemory_t* sharedMemory, unsigned int reader,
+						benchResults_t* results )
+{
+	processCounters_t* counters  = &results->readers[reader];
+	unsigned int       poolSize  = sharedMemoryGetPoolSize ( sharedMemory );
+	unsigned int*      sequences = calloc ( poolSize, sizeof(unsigned int) );
+	canMessageIndex_t* schedule  = calloc ( idCount, sizeof(canMessageIndex_t) );
+	char*              evict     = malloc ( EVICT_BYTES );
+	workload_t         workload;
+	canMessage_t       message;
+
+	if ( sequences == 0 || schedule == 0 || evict == 0 ||
+		 createWorkload ( &workload, poolSize ) != 0 )
+	{
+		_exit (255);
+	}
+	(void) memset ( evict, 1, EVICT_BYTES );
+
+	int cacheCounter = openMissCounter ( PERF_COUNT_HW_CACHE_L1D );
+	int tlbCounter   = openMissCounter ( PERF_COUNT_HW_CACHE_DTLB );
+
+	while ( ! results->start )
+	{
+		usleep ( 1000 );
+	}
+	unsigned long sum = 0;
+
+	while ( ! results->stop )
+	{
+		//
+		// Take the next pass of the schedule before anything is timed.
+		//
+		for ( unsigned int i = 0; i < idCount; i++ )
+		{
+			(void) workloadNext ( &workload, &message );
+			schedule[i] = message.canMessage.can_id;
+		}
+		for ( unsigned long i = 0; i < EVICT_BYTES; i += LINE_BYTES )
+		{
+			sum += evict[i];
+		}
+		if ( cacheCounter >= 0 )
+		{
+			(void) ioctl ( cacheCounter, PERF_EVENT_IOC_ENABLE, 0 );
+		}
+		if ( tlbCounter >= 0 )
+		{
+			(void) ioctl ( tlbCounter, PERF_EVENT_IOC_ENABLE, 0 );
+		}
+		unsigned long start = nowNs();
+
+		for ( unsigned int i = 0; i < idCount; i++ )
+		{
+			counters->errors += readAndCheck ( sharedMemory, schedule[i],
+											   &sequences[schedule[i]] );
+		}
+		counters->coldNs += nowNs() - start;
+		counters->coldReads += idCount;
+
+		if ( cacheCounter >= 0 )
+		{
+			(void) ioctl ( cacheCounter, PERF_EVENT_IOC_DISABLE, 0 );
+		}
+		if ( tlbCounter >= 0 )
+		{
+			(void) ioctl ( tlbCounter, PERF_EVENT_IOC_DISABLE, 0 );
+		}
+		start = nowNs();
+
+		for ( unsigned int pass = 0; pass < WARM_PASSES && ! results->stop; pass++ )
+		{
+			for ( unsigned int i = 0; i < idCount; i++ )
+			{
+				counters->errors += readAndCheck ( sharedMemory, schedule[i],
+												   &sequences[schedule[i]] );
+			}
+			counters->warmReads += idCount;
+		}
+		counters->warmNs += nowNs() - start;
+	}
+	counters->operations = counters->coldReads + counters->warmReads;
+	counters->missesCounted = cacheCounter >= 0 && tlbCounter >= 0 && sum != 0 &&
+							  closeCounter ( cacheCounter, &counters->cacheMisses ) == 0 &&
+							  closeCounter ( tlbCounter, &counters->tlbMisses ) == 0;
+
+	workloadDestroy ( &workload );
+	free ( sequences );
+	free ( schedule );
+	free ( evict );
+	_exit (0);
+}
+
+
+//
+// Count the pages and cache lines that hold the IDs of the profile, and the
+// index of the placement map if any ID is in a hot slot.
+//
+static void countFootprint ( sharedMemory_t* sharedMemory, placementMap_t* map,
+							 const canMessageIndex_t* ids, runResults_t* run )
+{
+	unsigned long* pages = calloc ( 2 * idCount, sizeof(unsigned long) );
+	unsigned long* lines = calloc ( 2 * idCount, sizeof(unsigned long) );
+
+	run->pages = 0;
+	run->lines = 0;
+	if ( pages == 0 || lines == 0 )
+	{
+		free ( pages );
+		free ( lines );
+		return;
+	}
+	for ( unsigned int i = 0; i < idCount; i++ )
+	{
+		unsigned long start = (unsigned long)sharedMemoryMessageAddress ( sharedMemory,
+																		  ids[i] );
+		unsigned long ends[2] = { start, start + sizeof(canMessage_t) - 1 };
+
+		for ( int end = 0; end < 2; end++ )
+		{
+			unsigned long address = ends[end];
+			unsigned long j;
+
+			for ( j = 0; j < run->pages && pages[j] != address / PAGE_BYTES; j++ )
+			{
+			}
+			if ( j == run->pages )
+			{
+				pages[run->pages++] = address / PAGE_BYTES;
+			}
+			for ( j = 0; j < run->lines && lines[j] != address / LINE_BYTES; j++ )
+			{
+			}
+			if ( j == run->lines )
+			{
+				lines[run->lines++] = address / LINE_BYTES;
+			}
+		}
+	}
+	if ( map->usedSlots != 0 )
+	{
+		unsigned long indexBytes = map->indexSize * sizeof(unsigned long);
+
+		run->lines += indexBytes / LINE_BYTES;
+		run->pages += ( indexBytes + PAGE_BYTES - 1 ) / PAGE_BYTES;
+	}
+	free ( pages );
+	free ( lines );
+}
+
+
+//
+// Run the load once and return the results.  If "moving" is set, the
+// chosen IDs are placed and removed from the hot slots until the run ends.
+//
+static int runOnce ( sharedMemory_t* sharedMemory, const canMessageIndex_t* chosen,
+					 unsigned int chosenCount, int moving, runResults_t* run )
+{
+	benchResults_t* results = mmap ( NULL, sizeof(benchResults_t),
+									 PROT_READ|PROT_WRITE,
+									 MAP_SHARED|MAP_ANONYMOUS, -1, 0 );
+	if ( results == MAP_FAILED )
+	{
+		printf ( "Unable to map the results area.\n" );
+		return -1;
+	}
+	(void) memset ( run, 0, sizeof(*run) );
+
+	if ( fork() == 0 )
+	{
+		runWriter ( sharedMemory, results );
+	}
+	for ( unsigned int i = 0; i < readers; i++ )
+	{
+		if ( fork() == 0 )
+		{
+			runReader ( sharedMemory, i, results );
+		}
+	}
+	usleep ( 100 * 1000 );
+	results->start = 1;
+
+	if ( moving )
+	{
+		unsigned long end = nowNs() + runSeconds * 1000000000UL;
+
+		for ( int placed = 0; nowNs() < end; placed = ! placed )
+		{
+			int moves = sharedMemoryPlace ( sharedMemory, chosen,
+											placed ? 0 : chosenCount );
+			run->moves += moves > 0 ? moves : 0;
+			usleep ( MOVE_INTERVAL_USEC );
+		}
+	}
+	else
+	{
+		sleep ( runSeconds );
+	}
+	results->stop = 1;
+
+	int failures = 0;
+	int status;
+	while ( wait ( &status ) > 0 )
+	{
+		failures += ! WIFEXITED ( status ) || WEXITSTATUS ( status ) != 0;
+	}
+	run->frames        = results->writer.operations;
+	run->missesCounted = 1;
+	for ( unsigned int i = 0; i < readers; i++ )
+	{
+		processCounters_t* counters = &results->readers[i];
+
+		run->reads         += counters->operations;
+		run->errors        += counters->errors;
+		run->coldReads     += counters->coldReads;
+		run->coldNs        += counters->coldNs;
+		run->warmReads     += counters->warmReads;
+		run->warmNs        += counters->warmNs;
+		run->cacheMisses   += counters->cacheMisses;
+		run->tlbMisses     += counters->tlbMisses;
+		run->missesCounted &= counters->missesCounted;
+	}
+	(void) munmap ( results, sizeof(benchResults_t) );
+
+	if ( failures != 0 )
+	{
+		printf ( "%d processes failed.\n", failures );
+		return -1;
+	}
+	return 0;
+}
+
+
+//
+// Print the results of one run.
+//
+static void printRun ( const char* title, runResults_t* run )
+{
+	double coldReads = run->coldReads != 0 ? run->coldReads : 1;
+	double warmReads = run->warmReads != 0 ? run->warmReads : 1;
+
+	printf ( "%s:\n", title );
+	printf ( "  Frames inserted:    %'14lu (%'lu/sec)\n", run->frames,
+			 run->frames / runSeconds );
+	printf ( "  Reads:              %'14lu (%'lu/sec)\n", run->reads,
+			 run->reads / runSeconds );
+	printf ( "  Read errors:        %'14lu\n", run->errors );
+	if ( run->moves != 0 )
+	{
+		printf ( "  IDs moved:          %'14lu\n", run->moves );
+	}
+	else
+	{
+		printf ( "  Pages / lines:      %'8lu / %'lu\n", run->pages, run->lines );
+	}
+	printf ( "  Cold read:          %14.1f ns\n", run->coldNs / coldReads );
+	printf ( "  Warm read:          %14.1f ns\n", run->warmNs / warmReads );
+	if ( run->missesCounted )
+	{
+		printf ( "  Cold L1D misses:    %14.3f per read\n",
+				 run->cacheMisses / coldReads );
+		printf ( "  Cold TLB misses:    %14.3f per read\n",
+				 run->tlbMisses / coldReads );
+	}
+	else
+	{
+		printf ( "  Cold L1D/TLB misses:%14s (no hardware counters)\n", "n/a" );
+	}
+}
+
+
+//
+// Parse a count argument.
+//
+static unsigned int countArgument ( const char* argument, unsigned int minimum,
+									unsigned int maximum, const char* name,
+									const char* executable )
+{
+	unsigned int value = atol ( argument );
+
+	if ( value < minimum || value > maximum )
+	{
+		printf ( "Invalid %s[%s] specified - must be %u to %u.\n", name,
+				 argument, minimum, maximum );
+		usage ( executable );
+		exit (255);
+	}
+	return value;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:d:hn:r:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'n':
+			idCount = countArgument ( optarg, 1, PLACEMENT_MAX_SLOTS, "ID count",
+									  argv[0] );
+			break;
+
+		  case 'r':
+			readers = countArgument ( optarg, 1, MAX_READERS, "reader count",
+									  argv[0] );
+			break;
+
+		  case 'd':
+			runSeconds = countArgument ( optarg, 1, 3600, "duration",
+										 argv[0] );
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( optind != argc )
+	{
+		printf ( "Invalid parameter encountered: %s\n", argv[optind] );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	heatTable_t*    table    = sharedMemoryGetHeatMap ( sharedMemory );
+	placementMap_t* map      = sharedMemoryGetPlacementMap ( sharedMemory );
+	unsigned int    poolSize = sharedMemoryGetPoolSize ( sharedMemory );
+
+	if ( table == 0 || map == 0 )
+	{
+		printf ( "The shared memory segment has no heat map or no placement "
+				 "map - Use \"create -H -p\" to define them.\n" );
+		exit (255);
+	}
+	if ( idCount > poolSize )
+	{
+		printf ( "Invalid ID count[%u] specified - the pool has %u IDs.\n",
+				 idCount, poolSize );
+		exit (255);
+	}
+	if ( placementAttach ( map ) != 0 )
+	{
+		printf ( "The placement optimizer (pid %d) is running - Stop it "
+				 "first.\n", map->optimizer );
+		exit (255);
+	}
+	//
+	// Remember the placement so it can be put back, and the IDs of the
+	// profile for the footprint.
+	//
+	canMessageIndex_t* saved      = calloc ( map->slotCount, sizeof(canMessageIndex_t) );
+	canMessageIndex_t* chosen     = calloc ( map->slotCount, sizeof(canMessageIndex_t) );
+	canMessageIndex_t* profileIds = calloc ( idCount, sizeof(canMessageIndex_t) );
+	unsigned int*      lastTotals = calloc ( poolSize, sizeof(unsigned int) );
+	unsigned long*     frequency  = calloc ( poolSize, sizeof(unsigned long) );
+	unsigned int       savedCount = 0;
+	workload_t         workload;
+
+	if ( saved == 0 || chosen == 0 || profileIds == 0 || lastTotals == 0 ||
+		 frequency == 0 || createWorkload ( &workload, poolSize ) != 0 )
+	{
+		printf ( "Unable to allocate the benchmark tables.\n" );
+		placementDetach ( map );
+		exit (255);
+	}
+	for ( unsigned int i = 0; i < idCount; i++ )
+	{
+		profileIds[i] = workload.entries[i].id;
+	}
+	workloadDestroy ( &workload );
+
+	for ( unsigned int slot = 0; slot < map->slotCount; slot++ )
+	{
+		if ( map->slots[slot].canMessage.can_id != PLACEMENT_FREE_SLOT )
+		{
+			saved[savedCount++] = map->slots[slot].canMessage.can_id;
+		}
+	}
+	printf ( "%'u IDs over %'u slots, %'u hot slots, 1 writer and %u readers "
+			 "for %u seconds per run.\n\n", idCount, poolSize, map->slotCount,
+			 readers, runSeconds );
+	fflush ( stdout );
+
+	//
+	// Run with every ID in its home slot and take the traffic of the run from
+	// the heat map.
+	//
+	runResults_t home;
+	runResults_t moving;
+	runResults_t hot;
+	heatTotals_t totals;
+	int          status;
+
+	(void) sharedMemoryPlace ( sharedMemory, 0, 0 );
+	for ( canMessageIndex_t id = 0; id < poolSize; id++ )
+	{
+		heatRead ( table, id, &totals );
+		lastTotals[id] = totals.writes + totals.reads;
+	}
+	status = runOnce ( sharedMemory, 0, 0, 0, &home );
+	countFootprint ( sharedMemory, map, profileIds, &home );
+
+	for ( canMessageIndex_t id = 0; id < poolSize; id++ )
+	{
+		heatRead ( table, id, &totals );
+		frequency[id] = (unsigned int)( totals.writes + totals.reads -
+										lastTotals[id] );
+	}
+	unsigned int chosenCount = placementSelect ( map, frequency, chosen );
+
+	if ( status == 0 )
+	{
+		status = runOnce ( sharedMemory, chosen, chosenCount, 1, &moving );
+	}
+	if ( status == 0 )
+	{
+		(void) sharedMemoryPlace ( sharedMemory, chosen, chosenCount );
+		status = runOnce ( sharedMemory, 0, 0, 0, &hot );
+		countFootprint ( sharedMemory, map, profileIds, &hot );
+	}
+	(void) sharedMemoryPlace ( sharedMemory, saved, savedCount );
+	placementDetach ( map );
+
+	if ( status != 0 )
+	{
+		exit (255);
+	}
+	printRun ( "Home slots", &home );
+	printf ( "\n" );
+	printRun ( "Moving", &moving );
+	printf ( "\n" );
+	printRun ( "Hot slots", &hot );
+
+	double homeCold = home.coldReads != 0 ? (double)home.coldNs / home.coldReads : 0;
+	double hotCold  = hot.coldReads != 0 ? (double)hot.coldNs / hot.coldReads : 0;
+	double homeWarm = home.warmReads != 0 ? (double)home.warmNs / home.warmReads : 0;
+	double hotWarm  = hot.warmReads != 0 ? (double)hot.warmNs / hot.warmReads : 0;
+
+	printf ( "\n%'u IDs placed: %'lu pages and %'lu lines instead of %'lu and "
+			 "%'lu, cold reads %.2fx and warm reads %.2fx as fast.\n",
+			 chosenCount, hot.pages, hot.lines, home.pages, home.lines,
+			 hotCold != 0 ? homeCold / hotCold : 0,
+			 hotWarm != 0 ? homeWarm / hotWarm : 0 );
+	if ( home.errors + moving.errors + hot.errors != 0 )
+	{
+		printf ( "%'lu reads returned a wrong frame.\n",
+				 home.errors + moving.errors + hot.errors );
+	}
+	free ( saved );
+	free ( chosen );
+	free ( profileIds );
+	free ( lastTotals );
+	free ( frequency );
+	sharedMemoryClose ( sharedMemory );
+
+	return home.errors + moving.errors + hot.errors != 0 ? 1 : 0;
+}
@@ -0,0 +1,270 @@
+//
+//	p l a c e d . c
+//
+//  The placement optimizer.  This program packs the message IDs that get
+//  the most traffic into the hot slots of the placement map (see
+//  placement.h) so the readers and writers of those IDs touch a few pages
+//  and cache lines instead of one of each per ID.
+//
+//  The shared memory segment must have been created with a heat map and a
+//  placement map (see the "-H" and "-p" options of the "create" program).
+//  Every period the per ID insert and read counts are taken from the heat
+//  map, the IDs with the most traffic since the last period are chosen and
+//  the placement is changed to match (a period without any traffic leaves
+//  it alone).  The readers keep reading while IDs are moved and the writers
+//  are held off for a few dozen moves at a time.
+//
+//  Only one optimizer can run at a time.  The placement is left as it is
+//  when the optimizer stops, so it can be run only while the traffic mix is
+//  settling down, or once with "-c 1" after a representative period.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <locale.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the optimizer parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static unsigned int periodSeconds = 10;
+static unsigned int passCount     = 0;
+static bool         quiet         = false;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+static volatile int stopRequested = 0;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -r    Period (sec)     int          10 \n\
+    -c    Pass Count       int      Forever \n\
+    -q    Quiet            bool      false \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Handle the interrupt signal by asking the main loop to stop.
+//
+static void stopHandler ( int signalNumber )
+{
+	stopRequested = 1;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:c:hqr:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'r':
+		    periodSeconds = atol ( optarg );
+			if ( periodSeconds < 1 )
+			{
+				printf ( "Invalid period[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'c':
+		    passCount = atol ( optarg );
+			break;
+
+		  case 'q':
+			quiet = true;
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( optind != argc )
+	{
+		printf ( "Invalid parameter encountered: %s\n", argv[optind] );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	heatTable_t*    table = sharedMemoryGetHeatMap ( sharedMemory );
+	placementMap_t* map   = sharedMemoryGetPlacementMap ( sharedMemory );
+	if ( table == 0 || map == 0 )
+	{
+		printf ( "The shared memory segment has no heat map or no placement "
+				 "map - Use \"create -H -p\" to define them.\n" );
+		exit (255);
+	}
+	if ( placementAttach ( map ) != 0 )
+	{
+		printf ( "Another placement optimizer (pid %d) is running - Aborting\n",
+				 map->optimizer );
+		exit (255);
+	}
+	unsigned int       messageCount = table->messageCount;
+	unsigned int*      lastWrites   = calloc ( messageCount, sizeof(unsigned int) );
+	unsigned int*      lastReads    = calloc ( messageCount, sizeof(unsigned int) );
+	unsigned long*     frequency    = calloc ( messageCount, sizeof(unsigned long) );
+	canMessageIndex_t* ids          = calloc ( map->slotCount,
+											   sizeof(canMessageIndex_t) );
+
+	if ( lastWrites == 0 || lastReads == 0 || frequency == 0 || ids == 0 )
+	{
+		printf ( "Unable to allocate the counters of %'u IDs.\n", messageCount );
+		placementDetach ( map );
+		exit (255);
+	}
+	signal ( SIGINT,  stopHandler );
+	signal ( SIGTERM, stopHandler );
+
+	printf ( "Placing the busiest of %'u IDs in %'u hot slots every %u sec...\n",
+			 messageCount, map->slotCount, periodSeconds );
+	fflush ( stdout );
+
+	//
+	// Take the first totals so the first pass only counts the traffic of
+	// its own period.
+	//
+	heatTotals_t totals;
+
+	for ( canMessageIndex_t id = 0; id < messageCount; id++ )
+	{
+		heatRead ( table, id, &totals );
+		lastWrites[id] = totals.writes;
+		lastReads[id]  = totals.reads;
+	}
+	unsigned long totalMoves = 0;
+	unsigned int  pass;
+
+	for ( pass = 0; ! stopRequested && ( passCount == 0 || pass < passCount );
+		  pass++ )
+	{
+		sleep ( periodSeconds );
+		if ( stopRequested )
+		{
+			break;
+		}
+		//
+		// The counters wrap so the differences are taken in 32 bits.
+		//
+		unsigned long traffic = 0;
+
+		for ( canMessageIndex_t id = 0; id < messageCount; id++ )
+		{
+			heatRead ( table, id, &totals );
+			frequency[id] = (unsigned int)( totals.writes - lastWrites[id] ) +
+							(unsigned int)( totals.reads - lastReads[id] );
+			lastWrites[id] = totals.writes;
+			lastReads[id]  = totals.reads;
+			traffic       += frequency[id];
+		}
+		//
+		// A period without any traffic says nothing about which IDs are
+		// busy, so the placement is left alone.
+		//
+		if ( traffic == 0 )
+		{
+			if ( ! quiet )
+			{
+				printf ( "No traffic - the placement is unchanged\n" );
+				fflush ( stdout );
+			}
+			continue;
+		}
+		unsigned int count = placementSelect ( map, frequency, ids );
+		int          moves = sharedMemoryPlace ( sharedMemory, ids, count );
+
+		if ( moves < 0 )
+		{
+			break;
+		}
+		totalMoves += moves;
+
+		if ( ! quiet )
+		{
+			unsigned long hotTraffic = 0;
+
+			for ( unsigned int i = 0; i < count; i++ )
+			{
+				hotTraffic += frequency[ids[i]];
+			}
+			printf ( "%'u hot IDs, %'d moved, %.1f%% of %'lu operations on "
+					 "the hot slots\n", count, moves,
+					 traffic != 0 ? 100.0 * hotTraffic / traffic : 0.0,
+					 traffic );
+			fflush ( stdout );
+		}
+	}
+	printf ( "Made %'lu moves in %u passes.\n", totalMoves, pass );
+
+	free ( lastWrites );
+	free ( lastReads );
+	free ( frequency );
+	free ( ids );
+	placementDetach ( map );
+	sharedMemoryClose ( sharedMemory );
+
+	return 0;
+}
@@ -0,0 +1,561 @@
+//
+//	p l a c e m e n t . c
+//
+//  The placement map that packs the busiest message IDs into a few hot
+//  slots.  See placement.h for a description.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+
+#include "sharedMemorySegment.h"
+#include "placement.h"
+
+//
+// Define the multiplier of the index hash (the golden ratio in 32 bits).
+//
+#define PLACEMENT_HASH 0x9e3779b1U
+
+//
+// Define a candidate for a hot slot.
+//
+typedef struct placementCandidate_t
+{
+	canMessageIndex_t id;
+	unsigned long     score;
+
+}   placementCandidate_t;
+
+
+//
+// Return the number of index entries used for a number of hot slots.
+//
+static unsigned int indexEntries ( unsigned int slotCount )
+{
+	unsigned int size = PLACEMENT_MIN_INDEX;
+
+	while ( size < 2 * slotCount )
+	{
+		size *= 2;
+	}
+	return size;
+}
+
+
+//
+// Return the byte offset of the index from the start of the region.
+//
+static unsigned long indexStart ( unsigned int slotCount )
+{
+	return ( sizeof(placementMap_t) + slotCount * sizeof(canMessage_t) + 63 ) &
+		   ~63UL;
+}
+
+
+//
+// Return the index of a placement map.
+//
+static unsigned long* placementIndex ( placementMap_t* map )
+{
+	return (unsigned long*)( (char*)map + map->indexOffset );
+}
+
+
+//
+// Return the index entry where the search for an ID starts.
+//
+static unsigned int indexHome ( placementMap_t* map, canMessageIndex_t id )
+{
+	return ( id * PLACEMENT_HASH ) >> map->indexShift;
+}
+
+
+//
+// Return the key of an ID in the upper half of an index entry.
+//
+static unsigned long indexKey ( canMessageIndex_t id )
+{
+	return ( (unsigned long)id + 1 ) << 32;
+}
+
+
+//
+// Return the later of two sequence numbers, allowing for them wrapping.
+//
+static unsigned int laterSequence ( unsigned int a, unsigned int b )
+{
+	return (int)( b - a ) > 0 ? b : a;
+}
+
+
+//
+// Return the number of bytes needed for a placement map region.
+//
+unsigned long placementRegionSize ( unsigned int slotCount )
+{
+	return indexStart ( slotCount ) +
+		   indexEntries ( slotCount ) * sizeof(unsigned long);
+}
+
+
+//
+// Check that the fields of a map read from a segment or a checkpoint image
+// describe a layout that fits in the space the region has.  The contents of
+// the index and the hot slots are checked by placementRepair.
+//
+// This function returns 0 if the map is valid and -1 if it is not.
+//
+int placementValidate ( const placementMap_t* map, unsigned long available,
+						unsigned int messageCount )
+{
+	if ( available < sizeof(placementMap_t) ||
+		 map->slotCount == 0 || map->slotCount > PLACEMENT_MAX_SLOTS ||
+		 map->slotCount > messageCount || map->messageCount != messageCount ||
+		 placementRegionSize ( map->slotCount ) > available ||
+		 map->indexSize != indexEntries ( map->slotCount ) ||
+		 map->indexShift != 32 - (unsigned int)__builtin_ctz ( map->indexSize ) ||
+		 map->indexOffset != indexStart ( map->slotCount ) )
+	{
+		return -1;
+	}
+	return 0;
+}
+
+
+//
+// Initialize a placement map region.  Every hot slot is free, with an odd
+// sequence number so that no reader ever accepts a copy of it, and every ID
+// is in its home slot.
+//
+void placementInitialize ( placementMap_t* map, unsigned int slotCount,
+						   unsigned int messageCount )
+{
+	(void) memset ( map, 0, placementRegionSize ( slotCount ) );
+
+	map->slotCount    = slotCount;
+	map->indexSize    = indexEntries ( slotCount );
+	map->indexShift   = 32 - __builtin_ctz ( map->indexSize );
+	map->messageCount = messageCount;
+	map->indexOffset  = indexStart ( slotCount );
+
+	for ( unsigned int i = 0; i < slotCount; i++ )
+	{
+		map->slots[i].canMessage.can_id = PLACEMENT_FREE_SLOT;
+		map->slots[i].nextMessageIndex  = CAN_END_OF_LIST;
+		map->slots[i].sequence          = 1;
+	}
+}
+
+
+//
+// Return the hot slot of a message ID or 0 if the ID is in its home slot.
+// This doesn't need the shared memory lock.  A reader that races with a move
+// may be told the ID is in a slot that it has just left, whose sequence
+// number will then be odd, so the reader has to look the ID up again when it
+// retries.
+//
+canMessage_t* placementFind ( placementMap_t* map, canMessageIndex_t id )
+{
+	if ( __atomic_load_n ( &map->usedSlots, __ATOMIC_ACQUIRE ) == 0 )
+	{
+		return 0;
+	}
+	unsigned long* index = placementIndex ( map );
+	unsigned long  key   = indexKey ( id );
+	unsigned int   mask  = map->indexSize - 1;
+	unsigned int   i     = indexHome ( map, id );
+
+	for ( unsigned int probes = 0; probes < map->indexSize; probes++ )
+	{
+		unsigned long entry = __atomic_load_n ( &index[i], __ATOMIC_ACQUIRE );
+
+		if ( entry == 0 )
+		{
+			break;
+		}
+		if ( ( entry & 0xffffffff00000000UL ) == key )
+		{
+			return &map->slots[(unsigned int)entry];
+		}
+		i = ( i + 1 ) & mask;
+	}
+	return 0;
+}
+
+
+//
+// Add an ID to the index.  The index always has a free entry since it is at
+// least twice the number of hot slots.
+//
+static void indexInsert ( placementMap_t* map, canMessageIndex_t id,
+						  unsigned int slot )
+{
+	unsigned long* index = placementIndex ( map );
+	unsigned int   mask  = map->indexSize - 1;
+	unsigned int   i     = indexHome ( map, id );
+
+	while ( index[i] != 0 )
+	{
+		i = ( i + 1 ) & mask;
+	}
+	__atomic_store_n ( &index[i], indexKey ( id ) | slot, __ATOMIC_RELEASE );
+}
+
+
+//
+// Remove an ID from the index.  The entries after it are shifted back into
+// the hole so that no search has to skip deleted entries.  Each entry that
+// is moved is stored in its new place before its old place is overwritten,
+// so a reader may miss it for a moment (and retry) but never finds the
+// wrong slot.
+//
+static void indexRemove ( placementMap_t* map, canMessageIndex_t id )
+{
+	unsigned long* index = placementIndex ( map );
+	unsigned long  key   = indexKey ( id );
+	unsigned int   mask  = map->indexSize - 1;
+	unsigned int   i     = indexHome ( map, id );
+
+	while ( ( index[i] & 0xffffffff00000000UL ) != key )
+	{
+		if ( index[i] == 0 )
+		{
+			return;
+		}
+		i = ( i + 1 ) & mask;
+	}
+	for ( unsigned int j = ( i + 1 ) & mask; index[j] != 0; j = ( j + 1 ) & mask )
+	{
+		unsigned int home = indexHome ( map, ( index[j] >> 32 ) - 1 );
+
+		//
+		// An entry whose search starts after the hole, up to and including
+		// its own place, stays where it is.
+		//
+		if ( i <= j ? ( i < home && home <= j ) : ( i < home || home <= j ) )
+		{
+			continue;
+		}
+		__atomic_store_n ( &index[i], index[j], __ATOMIC_RELEASE );
+		i = j;
+	}
+	__atomic_store_n ( &index[i], 0, __ATOMIC_RELEASE );
+}
+
+
+//
+// Copy a frame into the slot an ID is moving to and make it valid.  The
+// slot's sequence number is odd (it is free or retired) and the frame gets a
+// sequence number past both its own and the slot's, so neither the ID's nor
+// the slot's sequence number ever goes back to a value a reader may have
+// seen before.
+//
+static void moveFrame ( canMessage_t* from, canMessage_t* to )
+{
+	unsigned int sequence = laterSequence ( from->sequence, to->sequence + 1 );
+
+	to->canMessage.can_id  = from->canMessage.can_id;
+	to->canMessage.can_dlc = from->canMessage.can_dlc;
+	(void) memcpy ( to->canMessage.data, from->canMessage.data, CAN_MAX_DLEN );
+
+	__atomic_store_n ( &to->sequence, sequence, __ATOMIC_RELEASE );
+}
+
+
+//
+// Move a message ID from its home slot to a free hot slot.  This must be
+// called with the shared memory lock held.  The lowest free slot is used so
+// the IDs promoted first are packed together at the start of the slots.
+//
+// This function returns 0 if the ID was moved and -1 if it is already in a
+// hot slot, is out of range or there is no free slot.
+//
+int placementPromote ( placementMap_t* map, canMessage_t* pool,
+					   canMessageIndex_t id )
+{
+	if ( id >= map->messageCount || map->usedSlots == map->slotCount ||
+		 placementFind ( map, id ) != 0 )
+	{
+		return -1;
+	}
+	unsigned int slot = map->firstFree;
+
+	while ( map->slots[slot].canMessage.can_id != PLACEMENT_FREE_SLOT )
+	{
+		slot++;
+	}
+	map->firstFree = slot + 1;
+
+	canMessage_t* home = &pool[id];
+
+	moveFrame ( home, &map->slots[slot] );
+	__atomic_store_n ( &map->usedSlots, map->usedSlots + 1, __ATOMIC_RELEASE );
+	indexInsert ( map, id, slot );
+	__atomic_store_n ( &home->sequence, home->sequence + 1, __ATOMIC_RELEASE );
+
+	map->moves++;
+
+	return 0;
+}
+
+
+//
+// Move a message ID from its hot slot back to its home slot.  This must be
+// called with the shared memory lock held.
+//
+void placementDemote ( placementMap_t* map, canMessage_t* pool,
+					   canMessageIndex_t id )
+{
+	canMessage_t* hot = placementFind ( map, id );
+
+	if ( hot == 0 )
+	{
+		return;
+	}
+	unsigned int slot = hot - map->slots;
+
+	moveFrame ( hot, &pool[id] );
+	indexRemove ( map, id );
+	__atomic_store_n ( &map->usedSlots, map->usedSlots - 1, __ATOMIC_RELEASE );
+	__atomic_store_n ( &hot->sequence, hot->sequence + 1, __ATOMIC_RELEASE );
+
+	hot->canMessage.can_id = PLACEMENT_FREE_SLOT;
+	if ( slot < map->firstFree )
+	{
+		map->firstFree = slot;
+	}
+	map->moves++;
+}
+
+
+//
+// Make the placement map consistent again after an optimizer died in the
+// middle of a move or a checkpoint image of the segment was restored.  This
+// must be called with the shared memory lock held (or before anyone else is
+// using the segment).
+//
+// The index decides where an ID is: an ID whose index entry points at a hot
+// slot holding it is in that slot and every other hot slot is freed.  Any
+// home slot left with an odd sequence number by a move (or a writer) that
+// was cut short is made valid again unless its ID is in a hot slot.
+//
+void placementRepair ( placementMap_t* map, canMessage_t* pool )
+{
+	unsigned long* index  = placementIndex ( map );
+	unsigned long* placed = calloc ( map->slotCount + 1, sizeof(unsigned long) );
+	unsigned int   count  = 0;
+
+	if ( placed == 0 )
+	{
+		printf ( "Unable to allocate the placement map repair list.\n" );
+		return;
+	}
+	for ( unsigned int i = 0; i < map->indexSize; i++ )
+	{
+		unsigned long     entry = index[i];
+		canMessageIndex_t id    = ( entry >> 32 ) - 1;
+		unsigned int      slot  = (unsigned int)entry;
+
+		if ( entry == 0 || id >= map->messageCount || slot >= map->slotCount ||
+			 map->slots[slot].canMessage.can_id != id )
+		{
+			continue;
+		}
+		unsigned int j;
+		for ( j = 0; j < count && (unsigned int)placed[j] != slot; j++ )
+		{
+		}
+		if ( j == count )
+		{
+			placed[count++] = entry;
+		}
+	}
+	//
+	// Rebuild the index from the IDs that are placed.
+	//
+	__atomic_store_n ( &map->usedSlots, 0, __ATOMIC_RELEASE );
+	for ( unsigned int i = 0; i < map->indexSize; i++ )
+	{
+		__atomic_store_n ( &index[i], 0, __ATOMIC_RELEASE );
+	}
+	for ( unsigned int i = 0; i < count; i++ )
+	{
+		indexInsert ( map, ( placed[i] >> 32 ) - 1, (unsigned int)placed[i] );
+	}
+	__atomic_store_n ( &map->usedSlots, count, __ATOMIC_RELEASE );
+	free ( placed );
+
+	//
+	// Free the hot slots that aren't in the index and make sure the ones
+	// that are hold a valid frame and their home slots don't.
+	//
+	map->firstFree = map->slotCount;
+	for ( unsigned int slot = 0; slot < map->slotCount; slot++ )
+	{
+		canMessage_t*     hot = &map->slots[slot];
+		canMessageIndex_t id  = hot->canMessage.can_id;
+
+		if ( id != PLACEMENT_FREE_SLOT && id < map->messageCount &&
+			 placementFind ( map, id ) == hot )
+		{
+			if ( hot->sequence & 1 )
+			{
+				__atomic_store_n ( &hot->sequence, hot->sequence + 1,
+								   __ATOMIC_RELEASE );
+			}
+			if ( ( pool[id].sequence & 1 ) == 0 )
+			{
+				__atomic_store_n ( &pool[id].sequence, pool[id].sequence + 1,
+								   __ATOMIC_RELEASE );
+			}
+			continue;
+		}
+		if ( ( hot->sequence & 1 ) == 0 )
+		{
+			__atomic_store_n ( &hot->sequence, hot->sequence + 1,
+							   __ATOMIC_RELEASE );
+		}
+		hot->canMessage.can_id = PLACEMENT_FREE_SLOT;
+		if ( slot < map->firstFree )
+		{
+			map->firstFree = slot;
+		}
+	}
+	for ( canMessageIndex_t id = 0; id < map->messageCount; id++ )
+	{
+		if ( ( pool[id].sequence & 1 ) != 0 && placementFind ( map, id ) == 0 )
+		{
+			__atomic_store_n ( &pool[id].sequence, pool[id].sequence + 1,
+							   __ATOMIC_RELEASE );
+		}
+	}
+}
+
+
+//
+// Compare two candidates for qsort so the highest scores come first and
+// equal scores are in ID order.
+//
+static int compareCandidates ( const void* a, const void* b )
+{
+	const placementCandidate_t* left  = a;
+	const placementCandidate_t* right = b;
+
+	if ( left->score != right->score )
+	{
+		return left->score > right->score ? -1 : 1;
+	}
+	return left->id < right->id ? -1 : left->id > right->id;
+}
+
+
+//
+// Choose the IDs that should be in the hot slots from the number of times
+// each ID was used (inserted plus read) since the last time the placement
+// was changed.  The frequency array has an entry for every ID in the pool.
+//
+// An ID that is already in a hot slot counts double, so an ID has to get
+// twice as much traffic as one that is already hot to displace it.  That
+// keeps two IDs with about the same traffic from trading places every time
+// the optimizer runs.  IDs that weren't used at all are never chosen.
+//
+// The chosen IDs are returned in the caller's array, which must have room
+// for slotCount IDs, busiest first.  This function returns the number of IDs
+// chosen.
+//
+unsigned int placementSelect ( placementMap_t* map,
+							   const unsigned long* frequency,
+							   canMessageIndex_t* ids )
+{
+	unsigned int used = 0;
+
+	for ( canMessageIndex_t id = 0; id < map->messageCount; id++ )
+	{
+		used += frequency[id] != 0;
+	}
+	placementCandidate_t* candidates = malloc ( ( used + 1 ) *
+												sizeof(placementCandidate_t) );
+	if ( candidates == 0 )
+	{
+		printf ( "Unable to allocate %'u placement candidates.\n", used );
+		return 0;
+	}
+	unsigned int count = 0;
+
+	for ( canMessageIndex_t id = 0; id < map->messageCount; id++ )
+	{
+		if ( frequency[id] != 0 )
+		{
+			candidates[count].id    = id;
+			candidates[count].score = frequency[id];
+			if ( placementFind ( map, id ) != 0 )
+			{
+				candidates[count].score *= 2;
+			}
+			count++;
+		}
+	}
+	qsort ( candidates, count, sizeof(placementCandidate_t), compareCandidates );
+
+	if ( count > map->slotCount )
+	{
+		count = map->slotCount;
+	}
+	for ( unsigned int i = 0; i < count; i++ )
+	{
+		ids[i] = candidates[i].id;
+	}
+	free ( candidates );
+
+	return count;
+}
+
+
+//
+//	p l a c e m e n t A t t a c h
+//
+// Claim the map for the calling process as its optimizer.  The map is taken
+// over from an optimizer that has exited without detaching.  Such an
+// optimizer may have been killed in the middle of a move, so the map is
+// marked to be repaired the next time the placement is changed.
+//
+// This function returns 0 if the map was claimed and -1 if another
+// optimizer is running.
+//
+int placementAttach ( placementMap_t* map )
+{
+	pid_t self = getpid();
+	pid_t pid  = __atomic_load_n ( &map->optimizer, __ATOMIC_ACQUIRE );
+
+	do
+	{
+		if ( pid != 0 && ( kill ( pid, 0 ) == 0 || errno != ESRCH ) )
+		{
+			return -1;
+		}
+	}
+	while ( ! __atomic_compare_exchange_n ( &map->optimizer, &pid, self, 0,
+											__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) );
+
+	if ( pid != 0 )
+	{
+		__atomic_store_n ( &map->repair, 1, __ATOMIC_RELEASE );
+	}
+	return 0;
+}
+
+
+//
+// Give up the map so another optimizer can claim it.
+//
+void placementDetach ( placementMap_t* map )
+{
+	pid_t self = getpid();
+
+	(void) __atomic_compare_exchange_n ( &map->optimizer, &self, 0, 0,
+										 __ATOMIC_RELEASE, __ATOMIC_RELAXED );
+}
@@ -0,0 +1,122 @@
+#pragma once
+#ifndef PLACEMENT_H
+#define PLACEMENT_H
+
+#include <sys/types.h>
+
+#include "canMessage.h"
+
+//
+// The placement map is an optional region of the shared memory segment that
+// moves the most frequently used message IDs out of the message pool and
+// packs them together into a small array of hot slots.
+//
+// Every ID normally lives in its home slot, messagePoolBase[id].  A real bus
+// uses a few hundred IDs spread over the whole ID space, so a reader that
+// follows them all touches a different cache line, and usually a different
+// page, for every ID: with 1,000,000 slots and a 256 ID profile, the IDs are
+// 4,096 slots (96KB) apart.  Packed into the hot slots the same IDs fit in a
+// couple of pages, so they need a couple of TLB entries instead of 256 and
+// about a third as many cache lines.
+//
+// The hot slots are found through a small open addressing hash table (the
+// index) that maps an ID to its hot slot.  It has at least twice as many
+// entries as there are hot slots, so a lookup nearly always reads a single
+// 8 byte entry, and it is small enough to stay in the cache.  An ID that
+// isn't in the index is in its home slot.  The lookup is skipped entirely
+// when nothing has been placed.
+//
+// The placement is changed by a single optimizer (the "placed" program) that
+// claims the map with a compare and swap of its pid.  It takes the insert
+// and read counts of every ID from the heat map (see heat.h), picks the IDs
+// that get the most traffic and moves them with sharedMemoryPlace, which
+// holds the shared memory lock for a few dozen moves at a time so the
+// writers are held off for no longer than a short batch insert.
+//
+// The readers don't take the lock, so a move must never let a reader return
+// a frame that is torn, belongs to another ID or is older than one it has
+// already seen.  Every slot has its own sequence number (as in the pool):
+//
+//   - To promote an ID, its frame and sequence number are copied from the
+//     home slot to a free hot slot, the index entry is published and only
+//     then is the home slot's sequence number made odd.
+//
+//   - To demote an ID, its frame and sequence number are copied back to the
+//     home slot, the index entry is removed and then the hot slot's sequence
+//     number is made odd.
+//
+// The slot an ID isn't using any more is left with an odd sequence number
+// and a reader that found it treats it like an update in progress: it looks
+// the ID up again and retries.  A reader that copied the old slot before it
+// was retired sees its sequence number change and also retries.  A free hot
+// slot that is reused for another ID is caught by checking the ID in the
+// frame that was copied.  Since the sequence number moves with the frame,
+// the sequence numbers a reader sees for an ID only ever go forward.
+//
+// The writers find the slot of an ID the same way while they hold the lock,
+// so they always update the slot that the index points to.
+//
+
+//
+// Define the largest number of hot slots and the smallest index.
+//
+#define PLACEMENT_MAX_SLOTS 65536
+#define PLACEMENT_MIN_INDEX 64
+
+//
+// Define the number of moves made with each acquisition of the shared memory
+// lock.
+//
+#define PLACEMENT_BATCH_MOVES 32
+
+//
+// Define the ID stored in a hot slot that isn't in use.
+//
+#define PLACEMENT_FREE_SLOT CAN_END_OF_LIST
+
+//
+// Define the header of the placement map region.  The hot slots start on a
+// cache line boundary and the index follows them.  An index entry is 0 if
+// it is empty or else the ID plus 1 in the upper 32 bits and the number of
+// its hot slot in the lower 32 bits.
+//
+typedef struct placementMap_t
+{
+	unsigned int  slotCount;
+	unsigned int  indexSize;                // A power of 2
+	unsigned int  indexShift;               // 32 - log2 ( indexSize )
+	unsigned int  messageCount;
+	unsigned int  usedSlots;
+	unsigned int  firstFree;                // No free hot slot below this
+	pid_t         optimizer;                // 0 if no optimizer is running
+	unsigned int  repair;                   // Set when an optimizer died
+	unsigned long indexOffset;              // From the start of the region
+	unsigned long moves;                    // Promotions and demotions
+	unsigned long passes;                   // Calls to sharedMemoryPlace
+
+	canMessage_t  slots[0] __attribute__ ((aligned (64)));
+
+}   placementMap_t;
+
+//
+// Define the placement map functions.
+//
+unsigned long placementRegionSize ( unsigned int slotCount );
+int           placementValidate   ( const placementMap_t* map,
+									unsigned long available,
+									unsigned int messageCount );
+void          placementInitialize ( placementMap_t* map, unsigned int slotCount,
+									unsigned int messageCount );
+canMessage_t* placementFind       ( placementMap_t* map, canMessageIndex_t id );
+int           placementPromote    ( placementMap_t* map, canMessage_t* pool,
+									canMessageIndex_t id );
+void          placementDemote     ( placementMap_t* map, canMessage_t* pool,
+									canMessageIndex_t id );
+void          placementRepair     ( placementMap_t* map, canMessage_t* pool );
+unsigned int  placementSelect     ( placementMap_t* map,
+									const unsigned long* frequency,
+									canMessageIndex_t* ids );
+int           placementAttach     ( placementMap_t* map );
+void          placementDetach     ( placementMap_t* map );
+
+#endif		// End of PLACEMENT_H
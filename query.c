@@ -0,0 +1,309 @@
+//
+//	q u e r y . c
+//
+//  Extract the frames of one message ID over a time window from a trace file
+//  written by the "trace" program.
+//
+//  Only the block index and the blocks of the requested ID that overlap the
+//  time window are mapped into memory.  The query is repeated the requested
+//  number of times and the latency is reported.  If a candump log of the
+//  same traffic is given with the "-l" option, the same query is also run by
+//  scanning the log so the two can be compared.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <locale.h>
+#include <stdbool.h>
+
+#include "traceFile.h"
+
+//
+// Define the largest number of frames that will be returned by a query.
+//
+#define MAX_FRAMES ( 1024 * 1024 )
+
+//
+// Define the query parameters.  The times are given on the command line in
+// seconds (with a fraction) and kept in nanoseconds.
+//
+static const char*   traceFileName   = "trace.vsit";
+static const char*   candumpFileName = 0;
+static canid_t       queryId         = 0;
+static bool          haveId          = false;
+static unsigned long startTime       = 0;
+static unsigned long endTime         = ~0UL;
+static unsigned int  repeatCount     = 10;
+static bool          printFrames     = false;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -f    Trace File      string   trace.vsit \n\
+    -i    Message ID       hex      Required \n\
+    -s    Start (sec)     double    Beginning \n\
+    -e    End (sec)       double      End \n\
+    -l    Candump Log     string     None \n\
+    -r    Repeat Count     int         10 \n\
+    -p    Print Frames     bool      false \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Return the current monotonic time in nanoseconds.
+//
+static unsigned long nowNs ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// Convert a time in seconds with a fraction to nanoseconds.
+//
+static unsigned long parseTime ( const char* argument )
+{
+	char*         fraction;
+	unsigned long seconds = strtoul ( argument, &fraction, 10 );
+	unsigned long nsec    = 0;
+
+	if ( *fraction == '.' )
+	{
+		unsigned long scale = 100000000;
+		for ( fraction++; *fraction >= '0' && *fraction <= '9' && scale > 0;
+			  fraction++, scale /= 10 )
+		{
+			nsec += ( *fraction - '0' ) * scale;
+		}
+	}
+	return seconds * 1000000000UL + nsec;
+}
+
+
+//
+// Run the query against a candump log by scanning every line of it.  This
+// returns the number of matching frames or -1 if the log can't be read.
+//
+static long scanCandump ( const char* fileName )
+{
+	FILE* log = fopen ( fileName, "r" );
+	if ( log == 0 )
+	{
+		printf ( "Unable to open candump log[%s] errno: %u[%s].\n",
+				 fileName, errno, strerror(errno) );
+		return -1;
+	}
+	char line[256];
+	long matched = 0;
+
+	while ( fgets ( line, sizeof(line), log ) != 0 )
+	{
+		//
+		// Each line looks like "(1436509052.249713) can0 123#DEADBEEF".
+		//
+		if ( line[0] != '(' )
+		{
+			continue;
+		}
+		unsigned long timestamp = parseTime ( line + 1 );
+		char*         field     = strchr ( line, ' ' );
+		if ( field == 0 || ( field = strchr ( field + 1, ' ' ) ) == 0 )
+		{
+			continue;
+		}
+		canid_t id = strtoul ( field + 1, 0, 16 );
+
+		if ( id == ( queryId & CAN_EFF_MASK ) && timestamp >= startTime &&
+			 timestamp <= endTime )
+		{
+			matched++;
+		}
+	}
+	(void) fclose ( log );
+
+	return matched;
+}
+
+
+//
+// Order latencies for the median calculation.
+//
+static int compareLatency ( const void* left, const void* right )
+{
+	unsigned long a = *(const unsigned long*)left;
+	unsigned long b = *(const unsigned long*)right;
+
+	return a < b ? -1 : a > b;
+}
+
+
+//
+// Report the minimum, median and maximum of a set of latencies.
+//
+static void reportLatency ( const char* name, unsigned long* latencies,
+							unsigned int count, long matched )
+{
+	qsort ( latencies, count, sizeof(unsigned long), compareLatency );
+
+	printf ( "%-8s %'ld frames - latency min %'lu usec, median %'lu usec, "
+			 "max %'lu usec\n", name, matched, latencies[0] / 1000,
+			 latencies[count / 2] / 1000, latencies[count - 1] / 1000 );
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "e:f:hi:l:pr:s:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'e':
+			endTime = parseTime ( optarg );
+			break;
+
+		  case 'f':
+			traceFileName = optarg;
+			break;
+
+		  case 'i':
+			queryId = strtoul ( optarg, 0, 16 );
+			haveId  = true;
+			break;
+
+		  case 'l':
+			candumpFileName = optarg;
+			break;
+
+		  case 'p':
+			printFrames = true;
+			break;
+
+		  case 'r':
+		    repeatCount = atol ( optarg );
+			if ( repeatCount <= 0 )
+			{
+				printf ( "Invalid repeat count[%u] specified.\n", repeatCount );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 's':
+			startTime = parseTime ( optarg );
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( ! haveId || optind != argc )
+	{
+		printf ( "A message ID (and nothing else) must be specified.\n" );
+		usage ( argv[0] );
+		exit (255);
+	}
+	traceFrame_t*  frames    = malloc ( MAX_FRAMES * sizeof(traceFrame_t) );
+	unsigned long* latencies = malloc ( repeatCount * sizeof(unsigned long) );
+	if ( frames == 0 || latencies == 0 )
+	{
+		printf ( "Unable to allocate the query buffers.\n" );
+		exit (255);
+	}
+	//
+	// Run the trace query the requested number of times.  The file is opened
+	// each time so the cost of mapping the index is included.
+	//
+	long matched = 0;
+	for ( unsigned int i = 0; i < repeatCount; i++ )
+	{
+		traceReader_t reader;
+		unsigned long startNs = nowNs();
+
+		if ( traceReaderOpen ( &reader, traceFileName ) != 0 )
+		{
+			exit (255);
+		}
+		matched = traceQuery ( &reader, queryId, startTime, endTime, frames,
+							   MAX_FRAMES );
+		traceReaderClose ( &reader );
+
+		latencies[i] = nowNs() - startNs;
+		if ( matched < 0 )
+		{
+			printf ( "Trace file[%s] is corrupt.\n", traceFileName );
+			exit (255);
+		}
+	}
+	reportLatency ( "trace:", latencies, repeatCount, matched );
+
+	if ( printFrames )
+	{
+		for ( long i = 0; i < matched && i < MAX_FRAMES; i++ )
+		{
+			journalRecord_t record = { .timestamp = frames[i].timestamp,
+									   .id        = frames[i].id,
+									   .dlc       = frames[i].dlc };
+
+			(void) memcpy ( record.data, frames[i].data, CAN_MAX_DLEN );
+			traceWriteCandump ( stdout, "trace", &record );
+		}
+	}
+	//
+	// Run the same query against the candump log.
+	//
+	if ( candumpFileName != 0 )
+	{
+		for ( unsigned int i = 0; i < repeatCount; i++ )
+		{
+			unsigned long startNs = nowNs();
+
+			matched = scanCandump ( candumpFileName );
+			latencies[i] = nowNs() - startNs;
+			if ( matched < 0 )
+			{
+				exit (255);
+			}
+		}
+		reportLatency ( "candump:", latencies, repeatCount, matched );
+	}
+	free ( frames );
+	free ( latencies );
+
+    return 0;
+}
@@ -0,0 +1,288 @@
+//
+//	r e a l t i m e . c
+//
+//  The real time mode setup and the latency histogram.  See realtime.h for a
+//  description.
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+
+#include "realtime.h"
+
+//
+// Return the first CPU in the kernel's isolated set or -1 if no CPUs are
+// isolated.
+//
+int realtimeIsolatedCpu ( void )
+{
+	FILE* file = fopen ( "/sys/devices/system/cpu/isolated", "r" );
+	int   cpu  = -1;
+
+	if ( file != 0 )
+	{
+		if ( fscanf ( file, "%d", &cpu ) != 1 )
+		{
+			cpu = -1;
+		}
+		(void) fclose ( file );
+	}
+	return cpu;
+}
+
+
+//
+// Fault in every page of the segment for writing.  MADV_POPULATE_WRITE does
+// this in one call on kernels that have it.  Otherwise each page is touched
+// with an atomic add of zero, which makes the page writable without changing
+// anything another process may be writing to it.
+//
+static void prefaultSegment ( sharedMemory_t* sharedMemory )
+{
+	char*         base = (char*)sharedMemory;
+	unsigned long size = sharedMemoryGetSegmentSize ( sharedMemory );
+
+#ifdef MADV_POPULATE_WRITE
+	if ( madvise ( base, size, MADV_POPULATE_WRITE ) == 0 )
+	{
+		return;
+	}
+#endif
+	for ( unsigned long offset = 0; offset < size; offset += 4096 )
+	{
+		__atomic_fetch_add ( (int*)( base + offset ), 0, __ATOMIC_RELAXED );
+	}
+}
+
+
+//
+// Fault in the pages of the stack that the loop will use.  This is a
+// separate function that isn't inlined so the array is really on the stack
+// below the caller's frame.
+//
+static void __attribute__((noinline)) prefaultStack ( unsigned long bytes )
+{
+	volatile char* stack = alloca ( bytes );
+
+	for ( unsigned long offset = 0; offset < bytes; offset += 4096 )
+	{
+		stack[offset] = 0;
+	}
+}
+
+
+//
+//	r e a l t i m e S e t u p
+//
+// Prepare this process to run a real time loop on the segment.
+//
+// This function returns 0 if every step that was asked for worked and -1 if
+// any of them failed.  The failures are reported but don't stop the rest of
+// the setup.
+//
+int realtimeSetup ( sharedMemory_t* sharedMemory, const realtimeConfig_t* config )
+{
+	int status = 0;
+
+	//
+	// Pin the process first so the pages it faults in below are local to
+	// the CPU it is going to run on.
+	//
+	int cpu = config->cpu;
+	if ( cpu == REALTIME_ISOLATED_CPU )
+	{
+		cpu = realtimeIsolatedCpu();
+		if ( cpu < 0 )
+		{
+			printf ( "No CPUs are isolated (see the isolcpus= kernel option) - "
+					 "not pinning.\n" );
+			status = -1;
+		}
+	}
+	if ( cpu >= 0 )
+	{
+		cpu_set_t cpus;
+
+		CPU_ZERO ( &cpus );
+		CPU_SET ( cpu, &cpus );
+		if ( sched_setaffinity ( 0, sizeof(cpus), &cpus ) != 0 )
+		{
+			printf ( "Unable to pin to CPU %d errno: %u[%s].\n", cpu, errno,
+					 strerror(errno) );
+			status = -1;
+		}
+		else
+		{
+			printf ( "Pinned to CPU %d.\n", cpu );
+		}
+	}
+	if ( config->lockMemory )
+	{
+		if ( mlockall ( MCL_CURRENT | MCL_FUTURE ) != 0 )
+		{
+			printf ( "Unable to lock memory errno: %u[%s].\n", errno,
+					 strerror(errno) );
+			status = -1;
+		}
+		prefaultSegment ( sharedMemory );
+		prefaultStack ( config->stackBytes );
+		printf ( "Memory locked, %'u byte segment and %'lu byte stack "
+				 "prefaulted.\n", sharedMemoryGetSegmentSize ( sharedMemory ),
+				 config->stackBytes );
+	}
+	if ( config->priority > 0 )
+	{
+		struct sched_param parameters = { .sched_priority = config->priority };
+
+		if ( sched_setscheduler ( 0, SCHED_FIFO, &parameters ) != 0 )
+		{
+			printf ( "Unable to set SCHED_FIFO priority %d errno: %u[%s].\n",
+					 config->priority, errno, strerror(errno) );
+			status = -1;
+		}
+		else
+		{
+			printf ( "Running SCHED_FIFO at priority %d.\n", config->priority );
+		}
+	}
+	//
+	// Ask for the smallest timer slack so the periodic sleeps end on time.
+	//
+	(void) prctl ( PR_SET_TIMERSLACK, 1, 0, 0, 0 );
+
+	return status;
+}
+
+
+//
+// Clear a histogram.
+//
+void histogramInitialize ( latencyHistogram_t* histogram )
+{
+	(void) memset ( histogram, 0, sizeof(*histogram) );
+
+	histogram->minimum = ~0UL;
+}
+
+
+//
+// Add a time to a histogram.  Bucket N holds the times from 2^(N-1) up to
+// 2^N - 1 nanoseconds.
+//
+void histogramAdd ( latencyHistogram_t* histogram, unsigned long ns )
+{
+	unsigned int bucket = ns == 0 ? 0 : 64 - __builtin_clzl ( ns );
+
+	if ( bucket >= REALTIME_BUCKETS )
+	{
+		bucket = REALTIME_BUCKETS - 1;
+	}
+	histogram->buckets[bucket]++;
+	histogram->count++;
+	histogram->total += ns;
+
+	if ( ns < histogram->minimum )
+	{
+		histogram->minimum = ns;
+	}
+	if ( ns > histogram->maximum )
+	{
+		histogram->maximum = ns;
+	}
+}
+
+
+//
+// Add the times in one histogram to another.
+//
+void histogramMerge ( latencyHistogram_t* histogram,
+					  const latencyHistogram_t* other )
+{
+	for ( unsigned int bucket = 0; bucket < REALTIME_BUCKETS; bucket++ )
+	{
+		histogram->buckets[bucket] += other->buckets[bucket];
+	}
+	histogram->count += other->count;
+	histogram->total += other->total;
+
+	if ( other->minimum < histogram->minimum )
+	{
+		histogram->minimum = other->minimum;
+	}
+	if ( other->maximum > histogram->maximum )
+	{
+		histogram->maximum = other->maximum;
+	}
+}
+
+
+//
+// Return an upper bound on a percentile of the times in a histogram.  This
+// is the top of the bucket the percentile falls in, or the maximum if that
+// is smaller.
+//
+unsigned long histogramPercentile ( latencyHistogram_t* histogram,
+									double percentile )
+{
+	unsigned long rank = histogram->count * percentile / 100;
+	unsigned long seen = 0;
+
+	for ( unsigned int bucket = 0; bucket < REALTIME_BUCKETS; bucket++ )
+	{
+		seen += histogram->buckets[bucket];
+		if ( seen > rank )
+		{
+			unsigned long top = bucket == 0 ? 0 : ( 1UL << bucket ) - 1;
+			return top < histogram->maximum ? top : histogram->maximum;
+		}
+	}
+	return histogram->maximum;
+}
+
+
+//
+// Print a histogram with its summary and one line per bucket that isn't
+// empty.
+//
+void histogramPrint ( latencyHistogram_t* histogram, const char* title )
+{
+	if ( histogram->count == 0 )
+	{
+		printf ( "%s: no samples\n", title );
+		return;
+	}
+	printf ( "%s: %'lu samples, min %'lu mean %'lu max %'lu nsec\n", title,
+			 histogram->count, histogram->minimum,
+			 histogram->total / histogram->count, histogram->maximum );
+	printf ( "    p50 < %'lu  p99 < %'lu  p99.9 < %'lu  p99.99 < %'lu nsec\n",
+			 histogramPercentile ( histogram, 50 ),
+			 histogramPercentile ( histogram, 99 ),
+			 histogramPercentile ( histogram, 99.9 ),
+			 histogramPercentile ( histogram, 99.99 ) );
+
+	for ( unsigned int bucket = 0; bucket < REALTIME_BUCKETS; bucket++ )
+	{
+		unsigned long count = histogram->buckets[bucket];
+		if ( count == 0 )
+		{
+			continue;
+		}
+		unsigned long top   = ( 1UL << bucket ) - 1;
+		double        share = 100.0 * count / histogram->count;
+		char          bar[51];
+		int           width = share / 2 + ( count != 0 && share < 2 );
+
+		(void) memset ( bar, '#', width );
+		bar[width] = 0;
+
+		printf ( "    < %'14lu nsec %'12lu %6.2f%% %s\n", top + 1, count, share,
+				 bar );
+	}
+}
@@ -0,0 +1,78 @@
+#pragma once
+#ifndef REALTIME_H
+#define REALTIME_H
+
+#include <stdbool.h>
+
+#include "sharedMemory.h"
+
+//
+// The real time mode prepares a writer or reader process so that its worst
+// case latency is set by the copy it does rather than by the scheduler or the
+// memory manager.  On a loaded target the jitter of a normal process is
+// many times the cost of an insert or fetch.
+//
+// The setup is done once, before the process enters its loop:
+//
+//     lockMemory - mlockall the current and future pages of the process so
+//                  that none of them are ever paged out, and fault in every
+//                  page of the segment (for writing) and stackBytes of stack
+//                  so the loop never takes a page fault.
+//     priority   - Run the process under SCHED_FIFO at this priority (1 to
+//                  99).  0 leaves the scheduling policy alone.
+//     cpu        - Pin the process to this CPU.  REALTIME_NO_CPU leaves the
+//                  affinity alone and REALTIME_ISOLATED_CPU picks the first
+//                  CPU in the kernel's isolated set (isolcpus=).
+//
+// Most of these need CAP_IPC_LOCK and CAP_SYS_NICE (or root).  A step that
+// fails is reported and the setup carries on with the rest so a test can
+// still be run without privileges.
+//
+#define REALTIME_NO_CPU       ( -1 )
+#define REALTIME_ISOLATED_CPU ( -2 )
+
+#define REALTIME_DEFAULT_STACK ( 512 * 1024 )
+
+typedef struct realtimeConfig_t
+{
+	bool          lockMemory;
+	int           priority;
+	int           cpu;
+	unsigned long stackBytes;
+
+}   realtimeConfig_t;
+
+//
+// The latency histogram collects the loop periods (or any other times) of a
+// real time loop.  The buckets are powers of 2 nanoseconds, which is enough
+// to show the shape of the tail, and the minimum, maximum and mean are kept
+// exactly.
+//
+#define REALTIME_BUCKETS 40
+
+typedef struct latencyHistogram_t
+{
+	unsigned long count;
+	unsigned long total;
+	unsigned long minimum;
+	unsigned long maximum;
+	unsigned long buckets[REALTIME_BUCKETS];
+
+}   latencyHistogram_t;
+
+//
+// Define the real time functions.
+//
+int  realtimeSetup       ( sharedMemory_t* sharedMemory,
+						   const realtimeConfig_t* config );
+int  realtimeIsolatedCpu ( void );
+
+void histogramInitialize ( latencyHistogram_t* histogram );
+void histogramAdd        ( latencyHistogram_t* histogram, unsigned long ns );
+void histogramMerge      ( latencyHistogram_t* histogram,
+						   const latencyHistogram_t* other );
+unsigned long histogramPercentile ( latencyHistogram_t* histogram,
+									double percentile );
+void histogramPrint      ( latencyHistogram_t* histogram, const char* title );
+
+#endif		// End of REALTIME_H
@@ -0,0 +1,388 @@
+//
+//	r e c o r d . c
+//
+//  Flush the shared memory journal to disk files to make a lossless
+//  recording of every message inserted into the message pool.
+//
+//  The shared memory segment must have been created with a journal (see the
+//  "-j" option of the "create" program).  This program waits for each chunk
+//  of the journal to be filled by the writers and then writes the entire
+//  chunk to the current output file with a single large sequential write.
+//  A new output file is started every time the requested number of chunks
+//  has been written to the current one.
+//
+//  The writers never wait for this program.  If it falls so far behind that
+//  the writers overwrite a chunk before it has been written, that chunk is
+//  skipped and counted as an overrun.  These counts are reported along with
+//  the throughput at the requested interval.
+//
+//  When the program is stopped with <ctrl-c> any complete records in the
+//  chunk currently being filled are written before the program exits.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <locale.h>
+#include <stdbool.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the prefix of the names of the journal files that will be written.
+// The file sequence number and ".vsij" are appended to this.  Note that this
+// default value can be overridden using the "-o" command line option.
+//
+static const char* outputPrefix = "journal";
+
+//
+// Define the number of journal chunks that will be written to each file
+// before a new file is started.  Note that this default value can be
+// overridden using the "-n" command line option.
+//
+static unsigned int chunksPerFile = 64;
+
+//
+// Define the number of seconds between status reports.  Note that this
+// default value can be overridden using the "-i" command line option.
+//
+static unsigned int reportInterval = 1;
+
+//
+// Define the flag that is set by the signal handler to stop the program.
+//
+static volatile sig_atomic_t stopRequested = 0;
+
+//
+// Define the current output file and the counts that go with it.
+//
+static int           outputFd        = -1;
+static unsigned long outputFileCount = 0;
+static unsigned int  outputChunks    = 0;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -o    File Prefix     string    journal \n\
+    -n    Chunks/File      int         64 \n\
+    -i    Report (sec)     int          1 \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Stop the recording when the user hits <ctrl-c>.
+//
+static void stopHandler ( int signalNumber )
+{
+	stopRequested = 1;
+}
+
+
+//
+// Write a buffer to the current output file, starting a new file if needed.
+//
+static void writeRecords ( journalRecord_t* records, unsigned long count )
+{
+	//
+	// If we don't have an output file open, start a new one.
+	//
+	if ( outputFd < 0 )
+	{
+		char fileName[4096];
+		(void) snprintf ( fileName, sizeof(fileName), "%s-%06lu.vsij",
+						  outputPrefix, outputFileCount++ );
+
+		outputFd = open ( fileName, O_WRONLY|O_CREAT|O_TRUNC, 0666 );
+		if ( outputFd < 0 )
+		{
+			printf ( "Unable to open journal file[%s] errno: %u[%s].\n",
+					 fileName, errno, strerror(errno) );
+			exit (255);
+		}
+		journalFileHeader_t header = { JOURNAL_FILE_MAGIC, JOURNAL_FILE_VERSION,
+									   sizeof(journalRecord_t), 0 };
+		if ( write ( outputFd, &header, sizeof(header) ) != sizeof(header) )
+		{
+			printf ( "Unable to write journal file[%s] errno: %u[%s].\n",
+					 fileName, errno, strerror(errno) );
+			exit (255);
+		}
+		outputChunks = 0;
+	}
+	//
+	// Write the records with as few write calls as possible.
+	//
+	char*         buffer = (char*)records;
+	unsigned long length = count * sizeof(journalRecord_t);
+
+	while ( length > 0 )
+	{
+		ssize_t written = write ( outputFd, buffer, length );
+		if ( written < 0 )
+		{
+			if ( errno == EINTR )
+			{
+				continue;
+			}
+			printf ( "Unable to write journal file errno: %u[%s].\n",
+					 errno, strerror(errno) );
+			exit (255);
+		}
+		buffer += written;
+		length -= written;
+	}
+	//
+	// If this file is full, close it so the next chunk starts a new one.
+	//
+	if ( ++outputChunks >= chunksPerFile )
+	{
+		(void) close ( outputFd );
+		outputFd = -1;
+	}
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:hi:n:o:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  //
+		  // Get the report interval and validate it.
+		  //
+		  case 'i':
+		    reportInterval = atol ( optarg );
+			if ( reportInterval <= 0 )
+			{
+				printf ( "Invalid report interval[%u] specified.\n",
+						 reportInterval );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  //
+		  // Get the number of chunks per file and validate it.
+		  //
+		  case 'n':
+		    chunksPerFile = atol ( optarg );
+			if ( chunksPerFile <= 0 )
+			{
+				printf ( "Invalid chunks per file[%u] specified.\n",
+						 chunksPerFile );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  //
+		  // Get the output file prefix.
+		  //
+		  case 'o':
+			outputPrefix = optarg;
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	argc -= optind;
+
+    if ( argc != 0 )
+    {
+        printf ( "Invalid parameters[s] encountered: %s\n", argv[argc] );
+        usage ( argv[0] );
+        exit (255);
+    }
+	//
+	// Open the shared memory file and find the journal.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	journal_t* journal = sharedMemoryGetJournal ( sharedMemory );
+	if ( journal == 0 )
+	{
+		printf ( "The shared memory segment has no journal - Use \"create "
+				 "-j\" to create one.\n" );
+		exit (255);
+	}
+
+	unsigned long chunkRecords = journal->chunkRecords;
+	unsigned long capacity     = journal->recordMask + 1;
+
+	journalRecord_t* buffer = malloc ( chunkRecords * sizeof(journalRecord_t) );
+	if ( buffer == 0 )
+	{
+		printf ( "Unable to allocate the chunk buffer.\n" );
+		exit (255);
+	}
+	signal ( SIGINT,  stopHandler );
+	signal ( SIGTERM, stopHandler );
+
+	//
+	// Start with the chunk that the writers are currently filling.  Anything
+	// before that was written before we started and is not ours to record.
+	//
+	unsigned long chunk = __atomic_load_n ( &journal->head, __ATOMIC_ACQUIRE ) /
+						  chunkRecords;
+	journal->flushedChunks = chunk;
+
+	//
+	// Define the performance spec variables.
+	//
+	unsigned long lastReportNs      = journalTimestamp();
+	unsigned long recordsThisReport = 0;
+	unsigned long totalRecords      = 0;
+
+	printf ( "Recording journal chunks of %'lu records to %s-*.vsij. "
+			 "<ctrl-c> to quit...\n", chunkRecords, outputPrefix );
+
+	while ( ! stopRequested )
+	{
+		unsigned long head  = __atomic_load_n ( &journal->head, __ATOMIC_ACQUIRE );
+		unsigned long first = chunk * chunkRecords;
+
+		//
+		// If the writers have lapped us, skip ahead to the oldest chunk that
+		// is still intact and count everything we skipped as overrun.
+		//
+		if ( head > first + capacity )
+		{
+			unsigned long oldest = ( head - capacity ) / chunkRecords + 1;
+			journal->overrunChunks  += oldest - chunk;
+			journal->droppedRecords += ( oldest - chunk ) * chunkRecords;
+			chunk = oldest;
+		}
+		//
+		// If the current chunk is full, copy it and write it out.
+		//
+		else if ( head >= first + chunkRecords )
+		{
+			if ( journalCopy ( journal, first, chunkRecords, buffer ) < 0 )
+			{
+				++journal->overrunChunks;
+				journal->droppedRecords += chunkRecords;
+			}
+			else
+			{
+				writeRecords ( buffer, chunkRecords );
+				recordsThisReport += chunkRecords;
+			}
+			++chunk;
+			__atomic_store_n ( &journal->flushedChunks, chunk, __ATOMIC_RELEASE );
+		}
+		//
+		// Nothing to do yet, so wait a little while for the writers.
+		//
+		else
+		{
+			struct timespec delay = { 0, 1000 * 1000 };
+			(void) nanosleep ( &delay, NULL );
+		}
+		//
+		// Display the status report if it is time.  This is checked after
+		// every pass, including the ones that write a chunk, so the report
+		// still comes out when the writers always have a full chunk ready.
+		//
+		unsigned long nowNs = journalTimestamp();
+		if ( nowNs - lastReportNs >= reportInterval * 1000000000UL )
+		{
+			double seconds = ( nowNs - lastReportNs ) / 1000000000.0;
+
+			totalRecords += recordsThisReport;
+			printf ( "%'lu records/sec - %'lu KB/sec - lag %'lu records - "
+					 "Total: %'lu Overrun chunks: %'lu Dropped: %'lu\n",
+					 (unsigned long)( recordsThisReport / seconds ),
+					 (unsigned long)( recordsThisReport *
+									  sizeof(journalRecord_t) / seconds / 1024 ),
+					 head - chunk * chunkRecords, totalRecords,
+					 journal->overrunChunks, journal->droppedRecords );
+
+			recordsThisReport = 0;
+			lastReportNs      = nowNs;
+		}
+	}
+	//
+	// Write whatever complete records are in the partial chunk.
+	//
+	unsigned long head  = __atomic_load_n ( &journal->head, __ATOMIC_ACQUIRE );
+	unsigned long first = chunk * chunkRecords;
+	if ( head > first && head - first < chunkRecords )
+	{
+		long count = journalCopy ( journal, first, head - first, buffer );
+		if ( count > 0 )
+		{
+			writeRecords ( buffer, count );
+			totalRecords += count;
+		}
+	}
+	if ( outputFd >= 0 )
+	{
+		(void) close ( outputFd );
+	}
+	printf ( "\nRecorded %'lu records in %'lu files - Overrun chunks: %'lu "
+			 "Dropped records: %'lu\n", totalRecords + recordsThisReport,
+			 outputFileCount, journal->overrunChunks, journal->droppedRecords );
+
+	sharedMemoryClose ( sharedMemory );
+
+    return 0;
+}
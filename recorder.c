@@ -0,0 +1,371 @@
+//
+//	r e c o r d e r . c
+//
+//  The flight recorder of sampled operation latencies.  See recorder.h for a
+//  description.
+//
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <sched.h>
+#include <sys/prctl.h>
+
+#include "sharedMemorySegment.h"
+#include "recorder.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+//
+// Define the process local cache of the ring this process writes to in each
+// flight recorder it uses.  An entry is filled in once a ring has been
+// claimed, with the table stored last, so the samples look it up without a
+// lock.  A child process forgets its parent's rings when it is forked and
+// claims its own rather than writing to its parent's.
+//
+#define RECORDER_MAX_TABLES ( SHARED_MEMORY_MAX_BUSES + 1 )
+
+typedef struct recorderCache_t
+{
+	recorderTable_t* table;
+	recorderRing_t*  ring;
+
+}   recorderCache_t;
+
+static recorderCache_t recorderCaches[RECORDER_MAX_TABLES];
+static pthread_mutex_t recorderCacheLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t  recorderForkOnce  = PTHREAD_ONCE_INIT;
+
+//
+// Define the number of operations since the last sample in this thread.
+//
+static __thread unsigned int operationCount;
+
+//
+// Return the current value of the time stamp counter.
+//
+unsigned long recorderNow ( void )
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __rdtsc();
+#else
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+#endif
+}
+
+
+//
+// Measure the rate of the time stamp counter against CLOCK_MONOTONIC.
+//
+static unsigned long measureTicksPerSecond ( void )
+{
+	struct timespec start;
+	struct timespec end;
+	struct timespec wait = { 0, 20 * 1000 * 1000 };
+
+	clock_gettime ( CLOCK_MONOTONIC, &start );
+	unsigned long startTicks = recorderNow();
+
+	(void) nanosleep ( &wait, NULL );
+
+	clock_gettime ( CLOCK_MONOTONIC, &end );
+	unsigned long endTicks = recorderNow();
+
+	unsigned long elapsedNs = ( end.tv_sec - start.tv_sec ) * 1000000000UL +
+							  end.tv_nsec - start.tv_nsec;
+
+	return (unsigned long)( ( endTicks - startTicks ) * 1e9 / elapsedNs );
+}
+
+
+//
+// Return the number of bytes needed for a flight recorder region.
+//
+unsigned long recorderRegionSize ( unsigned int ringCount,
+								   unsigned int ringSamples )
+{
+	return sizeof(recorderTable_t) + ringCount * sizeof(recorderRing_t) +
+		   (unsigned long)ringCount * ringSamples * sizeof(recorderSample_t);
+}
+
+
+//
+// Initialize a flight recorder region.  The sampling rate and threshold are
+// given as for recorderConfigure.
+//
+void recorderInitialize ( recorderTable_t* table, unsigned int ringCount,
+						  unsigned int ringSamples, unsigned int sampleEvery,
+						  unsigned long thresholdNs )
+{
+	(void) memset ( table, 0, recorderRegionSize ( ringCount, ringSamples ) );
+
+	table->ringCount      = ringCount;
+	table->ringSamples    = ringSamples;
+	table->ticksPerSecond = measureTicksPerSecond();
+
+	recorderConfigure ( table, sampleEvery, thresholdNs );
+}
+
+
+//
+// Set the sampling rate (one operation in sampleEvery, 0 for none) and the
+// threshold over which every operation is recorded (0 for none).
+//
+void recorderConfigure ( recorderTable_t* table, unsigned int sampleEvery,
+						 unsigned long thresholdNs )
+{
+	unsigned long ticks = (unsigned long)( thresholdNs * 1e-9 *
+										   table->ticksPerSecond );
+	if ( thresholdNs != 0 && ticks == 0 )
+	{
+		ticks = 1;
+	}
+	__atomic_store_n ( &table->sampleEvery, sampleEvery, __ATOMIC_RELAXED );
+	__atomic_store_n ( &table->thresholdTicks, ticks, __ATOMIC_RELAXED );
+}
+
+
+//
+// Return the address of the samples of a ring.
+//
+recorderSample_t* recorderSamples ( recorderTable_t* table, unsigned int ring )
+{
+	recorderSample_t* samples = (recorderSample_t*)( table->rings + table->ringCount );
+
+	return samples + (unsigned long)ring * table->ringSamples;
+}
+
+
+//
+// Claim a ring for this process.  A ring that has never been used is taken
+// first so the rings of processes that have exited are kept for as long as
+// possible.
+//
+// This function returns 0 if every ring belongs to a live process.
+//
+static recorderRing_t* claimRing ( recorderTable_t* table, pid_t self )
+{
+	for ( int pass = 0; pass < 3; pass++ )
+	{
+		for ( unsigned int i = 0; i < table->ringCount; i++ )
+		{
+			recorderRing_t* ring = &table->rings[i];
+			pid_t           pid  = __atomic_load_n ( &ring->pid, __ATOMIC_ACQUIRE );
+
+			//
+			// Find a ring we already have (after reopening the segment), then
+			// a free one and then one whose owner is dead.
+			//
+			if ( pass == 0 )
+			{
+				if ( pid == self )
+				{
+					return ring;
+				}
+				continue;
+			}
+			if ( pass == 1 ? pid != 0 :
+				 pid == 0 || kill ( pid, 0 ) == 0 || errno != ESRCH )
+			{
+				continue;
+			}
+			if ( ! __atomic_compare_exchange_n ( &ring->pid, &pid, self, 0,
+												 __ATOMIC_ACQ_REL,
+												 __ATOMIC_RELAXED ) )
+			{
+				continue;
+			}
+			recorderSample_t* samples = recorderSamples ( table, i );
+			for ( unsigned int j = 0; j < table->ringSamples; j++ )
+			{
+				__atomic_store_n ( &samples[j].sequence, 0, __ATOMIC_RELAXED );
+			}
+			__atomic_store_n ( &ring->head, 0, __ATOMIC_RELEASE );
+			(void) memset ( ring->name, 0, sizeof(ring->name) );
+			(void) prctl ( PR_GET_NAME, ring->name, 0, 0, 0 );
+
+			return ring;
+		}
+	}
+	return 0;
+}
+
+
+//
+// Forget the rings of the parent in a child process.
+//
+static void forgetRings ( void )
+{
+	(void) memset ( recorderCaches, 0, sizeof(recorderCaches) );
+}
+
+
+//
+// Arrange for forked children to forget the rings.
+//
+static void registerFork ( void )
+{
+	(void) pthread_atfork ( 0, 0, forgetRings );
+}
+
+
+//
+// Return the ring of this process in a flight recorder, claiming one if this
+// is the first sample the process has recorded in it.
+//
+// A claim that fails because every ring belongs to a live process is not
+// cached, so the next sample tries again once a ring has been freed.
+//
+static recorderRing_t* processRing ( recorderTable_t* table )
+{
+	for ( int i = 0; i < RECORDER_MAX_TABLES; i++ )
+	{
+		recorderTable_t* cached = __atomic_load_n ( &recorderCaches[i].table,
+													__ATOMIC_ACQUIRE );
+		if ( cached == table )
+		{
+			return recorderCaches[i].ring;
+		}
+		if ( cached == 0 )
+		{
+			break;
+		}
+	}
+	(void) pthread_once ( &recorderForkOnce, registerFork );
+
+	recorderRing_t* ring = 0;
+
+	pthread_mutex_lock ( &recorderCacheLock );
+
+	for ( int i = 0; i < RECORDER_MAX_TABLES; i++ )
+	{
+		recorderCache_t* cache = &recorderCaches[i];
+
+		if ( cache->table == table )
+		{
+			ring = cache->ring;
+			break;
+		}
+		if ( cache->table == 0 )
+		{
+			ring = claimRing ( table, getpid() );
+			if ( ring != 0 )
+			{
+				cache->ring = ring;
+				__atomic_store_n ( &cache->table, table, __ATOMIC_RELEASE );
+			}
+			break;
+		}
+	}
+	pthread_mutex_unlock ( &recorderCacheLock );
+
+	return ring;
+}
+
+
+//
+//	r e c o r d e r B e g i n
+//
+// Decide how an operation is to be recorded.  This is called at the start of
+// every insert and fetch so it must stay cheap.
+//
+// This function returns RECORDER_SAMPLED if the operation is to be recorded,
+// RECORDER_TIMED if it is to be timed and recorded only if it is slow and
+// RECORDER_OFF if it is not to be timed at all.
+//
+unsigned int recorderBegin ( recorderTable_t* table )
+{
+	unsigned int every = __atomic_load_n ( &table->sampleEvery, __ATOMIC_RELAXED );
+
+	if ( every != 0 && ++operationCount >= every )
+	{
+		operationCount = 0;
+		return RECORDER_SAMPLED;
+	}
+	return __atomic_load_n ( &table->thresholdTicks, __ATOMIC_RELAXED ) != 0 ?
+		   RECORDER_TIMED : RECORDER_OFF;
+}
+
+
+//
+//	r e c o r d e r E n d
+//
+// Finish timing an operation that recorderBegin said was to be timed and
+// record it if it was sampled or was slower than the threshold.  "start" is
+// the counter at the start of the operation and "locked" is the counter when
+// it got the shared memory lock.
+//
+void recorderEnd ( recorderTable_t* table, unsigned int mode, unsigned int op,
+				   canMessageIndex_t id, unsigned long start,
+				   unsigned long locked )
+{
+	unsigned long end       = recorderNow();
+	unsigned long duration  = end - start;
+	unsigned long threshold = __atomic_load_n ( &table->thresholdTicks,
+												__ATOMIC_RELAXED );
+	bool          slow      = threshold != 0 && duration >= threshold;
+
+	if ( mode != RECORDER_SAMPLED && ! slow )
+	{
+		return;
+	}
+	recorderRing_t* ring = processRing ( table );
+	if ( ring == 0 )
+	{
+		__atomic_fetch_add ( &table->unrecorded, 1, __ATOMIC_RELAXED );
+		return;
+	}
+	unsigned long     index  = __atomic_fetch_add ( &ring->head, 1, __ATOMIC_RELAXED );
+	recorderSample_t* sample = recorderSamples ( table, ring - table->rings ) +
+							   ( index & ( table->ringSamples - 1 ) );
+
+	__atomic_store_n ( &sample->sequence, 0, __ATOMIC_RELAXED );
+	__atomic_thread_fence ( __ATOMIC_RELEASE );
+
+	sample->timestamp = start;
+	sample->lockWait  = locked - start < 0xffffffffUL ? locked - start : 0xffffffffUL;
+	sample->duration  = duration < 0xffffffffUL ? duration : 0xffffffffUL;
+	sample->id        = id;
+	sample->op        = op;
+	sample->flags     = slow ? RECORDER_FLAG_SLOW : 0;
+	sample->cpu       = sched_getcpu();
+
+	__atomic_store_n ( &sample->sequence, index + 1, __ATOMIC_RELEASE );
+}
+
+
+//
+// Read a consistent copy of a sample from a ring given its index (the number
+// of samples reserved in the ring before it).
+//
+// This function returns 0 if the sample was copied and -1 if it is being
+// written or has been overwritten.
+//
+int recorderReadSample ( recorderTable_t* table, unsigned int ring,
+						 unsigned long index, recorderSample_t* sample )
+{
+	recorderSample_t* source = recorderSamples ( table, ring ) +
+							   ( index & ( table->ringSamples - 1 ) );
+
+	if ( __atomic_load_n ( &source->sequence, __ATOMIC_ACQUIRE ) != index + 1 )
+	{
+		return -1;
+	}
+	*sample = *source;
+	__atomic_thread_fence ( __ATOMIC_ACQUIRE );
+
+	return __atomic_load_n ( &source->sequence, __ATOMIC_RELAXED ) == index + 1 ?
+		   0 : -1;
+}
@@ -0,0 +1,135 @@
+#pragma once
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <sys/types.h>
+
+#include "canMessage.h"
+
+//
+// The flight recorder is an optional region of the shared memory segment
+// that keeps a record of recent insert and fetch operations and how long they
+// took, so that a latency spike seen in the field can be traced back to the
+// operation that was slow.  It is read with "flightdump", even after the
+// processes that wrote it have gone.
+//
+// Each process that uses the segment gets its own ring of samples the first
+// time it records one.  The ring is claimed with a compare and swap of its
+// pid and is kept after the process exits so it can be read post mortem.  It
+// is only taken over by another process when every ring is in use and its
+// owner is dead.  A process with several threads shares one ring; the
+// threads reserve samples in it with an atomic add.
+//
+// One operation in every "sampleEvery" is recorded.  An operation that takes
+// longer than the threshold is always recorded.  Each sample holds:
+//
+//     timestamp - The time stamp counter at the start of the operation.
+//     lockWait  - The ticks spent waiting for the shared memory lock.
+//     duration  - The ticks from the start to the end of the operation.
+//     id        - The message ID (the first one for a batch).
+//     op        - The operation (RECORDER_OP_*).
+//     cpu       - The CPU the operation finished on.
+//
+// The ticks are those of the time stamp counter (CLOCK_MONOTONIC nsec on
+// machines that don't have one).  Its rate is measured when the region is
+// initialized and kept in the header for the readers.
+//
+// When neither sampling nor the threshold is enabled, an operation costs one
+// read of the header.  With sampling alone, only the sampled operations read
+// the counter.  The threshold needs every operation to be timed so it costs
+// two reads of the counter per operation, plus a third to time the lock wait
+// when the lock is contended.  The rate and the threshold can be changed at
+// any time ("flightdump -e/-l").
+//
+
+//
+// Define the operations that are recorded.
+//
+#define RECORDER_OP_INSERT       1
+#define RECORDER_OP_INSERT_BATCH 2
+#define RECORDER_OP_FETCH        3
+#define RECORDER_OP_GROUP        4
+
+//
+// Define the flags of a sample.
+//
+#define RECORDER_FLAG_SLOW       0x01       // Over the threshold
+
+//
+// Define the values that recorderBegin returns to say how an operation is
+// to be recorded.
+//
+#define RECORDER_OFF     0
+#define RECORDER_TIMED   1                  // Record it if it's slow
+#define RECORDER_SAMPLED 2                  // Record it
+
+//
+// Define a sample.  The sequence number is zero while the sample is being
+// written and the index of the sample in the ring plus one after that.
+//
+typedef struct recorderSample_t
+{
+	unsigned long     sequence;
+	unsigned long     timestamp;
+	unsigned int      lockWait;
+	unsigned int      duration;
+	canMessageIndex_t id;
+	unsigned char     op;
+	unsigned char     flags;
+	unsigned short    cpu;
+
+}   recorderSample_t;
+
+//
+// Define the header of a ring.  The samples of each ring follow the ring
+// headers in the region.
+//
+typedef struct recorderRing_t
+{
+	pid_t         pid;                      // 0 if the ring has never been used
+	char          name[16];                 // Process name
+	unsigned long head;                     // Samples ever reserved
+
+}   __attribute__((aligned(64))) recorderRing_t;
+
+//
+// Define the header of the flight recorder region.
+//
+typedef struct recorderTable_t
+{
+	unsigned int   ringCount;
+	unsigned int   ringSamples;             // Power of 2
+	unsigned int   sampleEvery;             // 0 for no sampling
+	unsigned int   pad;
+	unsigned long  thresholdTicks;          // 0 for no threshold
+	unsigned long  ticksPerSecond;
+	unsigned long  unrecorded;              // Samples with no ring to go in
+
+	recorderRing_t rings[0] __attribute__((aligned(64)));
+
+}   recorderTable_t;
+
+//
+// Define the flight recorder functions.
+//
+unsigned long recorderRegionSize ( unsigned int ringCount,
+								   unsigned int ringSamples );
+void          recorderInitialize ( recorderTable_t* table, unsigned int ringCount,
+								   unsigned int ringSamples,
+								   unsigned int sampleEvery,
+								   unsigned long thresholdNs );
+void          recorderConfigure  ( recorderTable_t* table,
+								   unsigned int sampleEvery,
+								   unsigned long thresholdNs );
+
+unsigned long recorderNow        ( void );
+unsigned int  recorderBegin      ( recorderTable_t* table );
+void          recorderEnd        ( recorderTable_t* table, unsigned int mode,
+								   unsigned int op, canMessageIndex_t id,
+								   unsigned long start, unsigned long locked );
+
+recorderSample_t* recorderSamples ( recorderTable_t* table, unsigned int ring );
+int           recorderReadSample ( recorderTable_t* table, unsigned int ring,
+								   unsigned long index, recorderSample_t* sample );
+
+#endif		// End of RECORDER_H
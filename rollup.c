@@ -0,0 +1,708 @@
+//
+//	r o l l u p . c
+//
+//  Multi-resolution rollups of signal values kept in the shared memory
+//  segment.  See rollup.h for a description.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sharedMemorySegment.h"
+#include "rollup.h"
+
+//
+// Return the address of the bitmap of the IDs that are used by a signal and
+// of the ring of intervals of a signal in a tier.
+//
+#define ROLLUP_MAP(table) \
+	( (unsigned long*)( (char*)(table) + (table)->usedMapOffset ) )
+#define ROLLUP_RING(table,tier,signal) \
+	( (rollupInterval_t*)( (char*)(table) + (table)->tiers[tier].intervalsOffset ) + \
+	  (unsigned long)(signal) * (table)->tiers[tier].intervalCount )
+
+//
+// Define the default tiers, one second intervals for an hour and one minute
+// intervals for a day.
+//
+static const rollupTier_t defaultTiers[] =
+{
+	{ .resolution = 1000000000UL,  .intervalCount = 3600 },
+	{ .resolution = 60000000000UL, .intervalCount = 1440 },
+};
+
+
+//
+// Return the current wall clock time in nanoseconds since the epoch.
+//
+unsigned long rollupNow ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_REALTIME, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// Parse a duration given as a number of seconds with an optional "ms", "s",
+// "m", "h" or "d" suffix.
+//
+// This function returns 0 if the duration is valid and -1 if it is not.
+//
+int rollupParseDuration ( const char* text, unsigned long* duration )
+{
+	char*  end;
+	double value = strtod ( text, &end );
+	double unit  = 1e9;
+
+	if ( end == text || value <= 0 )
+	{
+		return -1;
+	}
+	if ( strcmp ( end, "ms" ) == 0 )
+	{
+		unit = 1e6;
+	}
+	else if ( strcmp ( end, "m" ) == 0 )
+	{
+		unit = 60e9;
+	}
+	else if ( strcmp ( end, "h" ) == 0 )
+	{
+		unit = 3600e9;
+	}
+	else if ( strcmp ( end, "d" ) == 0 )
+	{
+		unit = 86400e9;
+	}
+	else if ( *end != 0 && strcmp ( end, "s" ) != 0 )
+	{
+		return -1;
+	}
+	*duration = value * unit;
+
+	return *duration != 0 ? 0 : -1;
+}
+
+
+//
+// Compare two signals by message ID and then by field offset for qsort.
+//
+static int compareSignals ( const void* left, const void* right )
+{
+	const rollupSignal_t* a = left;
+	const rollupSignal_t* b = right;
+
+	if ( a->input.id != b->input.id )
+	{
+		return a->input.id < b->input.id ? -1 : 1;
+	}
+	return a->input.offset < b->input.offset ? -1 :
+		   a->input.offset > b->input.offset;
+}
+
+
+//
+//	r o l l u p L o a d
+//
+// Read the rollup definitions from a file (see rollup.h) into the caller's
+// arrays, which must have room for ROLLUP_MAX_SIGNALS signals and
+// ROLLUP_MAX_TIERS tiers.  The signals are checked against the size of the
+// message pool and sorted by ID.  The tiers must be given from the finest
+// resolution to the coarsest.
+//
+// This function returns the number of signals or -1 if the file could not be
+// read or has an error in it.
+//
+int rollupLoad ( const char* fileName, unsigned int messageCount,
+				 rollupSignal_t* signals, rollupTier_t* tiers,
+				 unsigned int* tierCount )
+{
+	FILE* file = fopen ( fileName, "r" );
+	if ( file == 0 )
+	{
+		printf ( "Unable to open rollup file[%s] errno: %u[%s].\n",
+				 fileName, errno, strerror(errno) );
+		return -1;
+	}
+	char         line[1024];
+	unsigned int lineNumber  = 0;
+	unsigned int signalCount = 0;
+	int          status      = 0;
+
+	*tierCount = 0;
+
+	while ( status == 0 && fgets ( line, sizeof(line), file ) != 0 )
+	{
+		lineNumber++;
+
+		char* comment = strchr ( line, '#' );
+		if ( comment != 0 )
+		{
+			*comment = 0;
+		}
+		char* save;
+		char* token = strtok_r ( line, " \t\r\n", &save );
+		if ( token == 0 )
+		{
+			continue;
+		}
+		//
+		// Get a tier.
+		//
+		if ( strcmp ( token, "tier" ) == 0 )
+		{
+			char*         resolution = strtok_r ( 0, " \t\r\n", &save );
+			char*         count      = strtok_r ( 0, " \t\r\n", &save );
+			rollupTier_t* tier       = &tiers[*tierCount];
+
+			if ( *tierCount == ROLLUP_MAX_TIERS )
+			{
+				printf ( "Too many rollup tiers - the limit is %u.\n",
+						 ROLLUP_MAX_TIERS );
+				status = -1;
+				break;
+			}
+			(void) memset ( tier, 0, sizeof(*tier) );
+
+			if ( resolution == 0 || count == 0 ||
+				 rollupParseDuration ( resolution, &tier->resolution ) != 0 ||
+				 ( tier->intervalCount = atol ( count ) ) == 0 )
+			{
+				printf ( "Invalid rollup tier.\n" );
+				status = -1;
+				break;
+			}
+			if ( *tierCount != 0 &&
+				 tier->resolution <= tiers[*tierCount - 1].resolution )
+			{
+				printf ( "The rollup tiers must be given from the finest "
+						 "resolution to the coarsest.\n" );
+				status = -1;
+				break;
+			}
+			(*tierCount)++;
+			continue;
+		}
+		//
+		// Get a signal.
+		//
+		if ( signalCount == ROLLUP_MAX_SIGNALS )
+		{
+			printf ( "Too many rollup signals - the limit is %u.\n",
+					 ROLLUP_MAX_SIGNALS );
+			status = -1;
+			break;
+		}
+		rollupSignal_t* signal = &signals[signalCount];
+		(void) memset ( signal, 0, sizeof(*signal) );
+
+		if ( derivedParseInput ( token, &signal->input ) != 0 ||
+			 signal->input.id >= messageCount ||
+			 strtok_r ( 0, " \t\r\n", &save ) != 0 )
+		{
+			printf ( "Invalid rollup signal[%s].\n", token );
+			status = -1;
+			break;
+		}
+		signalCount++;
+	}
+	(void) fclose ( file );
+
+	if ( status != 0 )
+	{
+		printf ( "Rollup file[%s] has an error on line %u.\n", fileName,
+				 lineNumber );
+		return -1;
+	}
+	if ( *tierCount == 0 )
+	{
+		*tierCount = sizeof(defaultTiers) / sizeof(defaultTiers[0]);
+		(void) memcpy ( tiers, defaultTiers, sizeof(defaultTiers) );
+	}
+	qsort ( signals, signalCount, sizeof(rollupSignal_t), compareSignals );
+
+	return signalCount;
+}
+
+
+//
+// Return the offset of the bitmap from the start of a table and its size.
+//
+static unsigned long mapOffset ( unsigned int signalCount )
+{
+	return sizeof(rollupTable_t) + signalCount * sizeof(rollupSignal_t);
+}
+
+static unsigned long mapSize ( unsigned int messageCount )
+{
+	return ( ( messageCount + 63UL ) / 64 ) * sizeof(unsigned long);
+}
+
+
+//
+// Return the number of bytes needed for a rollup table region.  The rings of
+// each tier start on a cache line boundary.
+//
+unsigned long rollupRegionSize ( unsigned int signalCount,
+								 const rollupTier_t* tiers,
+								 unsigned int tierCount,
+								 unsigned int messageCount )
+{
+	unsigned long size = mapOffset ( signalCount ) + mapSize ( messageCount );
+
+	for ( unsigned int t = 0; t < tierCount; t++ )
+	{
+		size  = ( size + 63UL ) & ~63UL;
+		size += (unsigned long)signalCount * tiers[t].intervalCount *
+				sizeof(rollupInterval_t);
+	}
+	return size;
+}
+
+
+//
+// Check that the fields of a table read from a segment or a checkpoint image
+// describe a layout that fits in the space the region has and that every
+// index in it is in range.
+//
+// This function returns 0 if the table is valid and -1 if it is not.
+//
+int rollupValidate ( const rollupTable_t* table, unsigned long available,
+					 unsigned int messageCount )
+{
+	if ( available < sizeof(rollupTable_t) ||
+		 table->signalCount == 0 || table->signalCount > ROLLUP_MAX_SIGNALS ||
+		 table->tierCount == 0 || table->tierCount > ROLLUP_MAX_TIERS ||
+		 table->messageCount != messageCount ||
+		 table->usedMapOffset != mapOffset ( table->signalCount ) )
+	{
+		return -1;
+	}
+	unsigned long offset = table->usedMapOffset + mapSize ( messageCount );
+
+	for ( unsigned int t = 0; t < table->tierCount; t++ )
+	{
+		const rollupTier_t* tier = &table->tiers[t];
+
+		if ( tier->resolution == 0 || tier->intervalCount == 0 ||
+			 tier->intervalCount > available / sizeof(rollupInterval_t) ||
+			 tier->intervalsOffset != ( ( offset + 63UL ) & ~63UL ) )
+		{
+			return -1;
+		}
+		offset = tier->intervalsOffset +
+				 (unsigned long)table->signalCount * tier->intervalCount *
+				 sizeof(rollupInterval_t);
+	}
+	if ( offset > available )
+	{
+		return -1;
+	}
+	for ( unsigned int s = 0; s < table->signalCount; s++ )
+	{
+		const derivedInput_t* input = &table->signals[s].input;
+
+		if ( input->id >= messageCount ||
+			 ( input->size != 0 && input->offset + input->size > CAN_MAX_DLEN ) )
+		{
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+//
+// Initialize a rollup table region from the signals and tiers read by
+// rollupLoad.  Every interval starts out empty.
+//
+void rollupInitialize ( rollupTable_t* table, const rollupSignal_t* signals,
+						unsigned int signalCount, const rollupTier_t* tiers,
+						unsigned int tierCount, unsigned int messageCount )
+{
+	(void) memset ( table, 0, rollupRegionSize ( signalCount, tiers, tierCount,
+												 messageCount ) );
+
+	table->signalCount   = signalCount;
+	table->tierCount     = tierCount;
+	table->messageCount  = messageCount;
+	table->usedMapOffset = mapOffset ( signalCount );
+
+	(void) memcpy ( table->signals, signals, signalCount * sizeof(rollupSignal_t) );
+
+	unsigned long  offset = table->usedMapOffset + mapSize ( messageCount );
+	unsigned long* used   = ROLLUP_MAP ( table );
+
+	for ( unsigned int t = 0; t < tierCount; t++ )
+	{
+		table->tiers[t]                 = tiers[t];
+		table->tiers[t].intervalsOffset = ( offset + 63UL ) & ~63UL;
+
+		offset = table->tiers[t].intervalsOffset +
+				 (unsigned long)signalCount * tiers[t].intervalCount *
+				 sizeof(rollupInterval_t);
+	}
+	for ( unsigned int s = 0; s < signalCount; s++ )
+	{
+		canMessageIndex_t id = signals[s].input.id;
+
+		used[id / 64] |= 1UL << ( id % 64 );
+	}
+}
+
+
+//
+//	r o l l u p A t t a c h
+//
+// Claim the table for the calling process as its aggregator.  The table is
+// taken over from an aggregator that has exited without detaching.  Such an
+// aggregator may have been killed in the middle of updating an interval, so
+// any interval that was left with an odd sequence number is released.
+//
+// This function returns 0 if the table was claimed and -1 if another
+// aggregator is running.
+//
+int rollupAttach ( rollupTable_t* table )
+{
+	pid_t self = getpid();
+	pid_t pid  = __atomic_load_n ( &table->aggregator, __ATOMIC_ACQUIRE );
+
+	do
+	{
+		if ( pid != 0 && ( kill ( pid, 0 ) == 0 || errno != ESRCH ) )
+		{
+			return -1;
+		}
+	}
+	while ( ! __atomic_compare_exchange_n ( &table->aggregator, &pid, self, 0,
+											__ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE ) );
+
+	for ( unsigned int t = 0; t < table->tierCount; t++ )
+	{
+		rollupInterval_t* ring  = ROLLUP_RING ( table, t, 0 );
+		unsigned long     count = (unsigned long)table->signalCount *
+									table->tiers[t].intervalCount;
+
+		for ( unsigned long i = 0; i < count; i++ )
+		{
+			if ( ring[i].sequence & 1 )
+			{
+				__atomic_store_n ( &ring[i].sequence, ring[i].sequence + 1,
+								   __ATOMIC_RELEASE );
+			}
+		}
+	}
+	return 0;
+}
+
+
+//
+// Give up the table so another aggregator can claim it.
+//
+void rollupDetach ( rollupTable_t* table )
+{
+	pid_t self = getpid();
+
+	(void) __atomic_compare_exchange_n ( &table->aggregator, &self, 0, 0,
+										 __ATOMIC_RELEASE, __ATOMIC_RELAXED );
+}
+
+
+//
+// Return the index of the first signal with a message ID, or the number of
+// signals if there isn't one.
+//
+static unsigned int firstSignal ( rollupTable_t* table, canMessageIndex_t id )
+{
+	unsigned int low  = 0;
+	unsigned int high = table->signalCount;
+
+	while ( low < high )
+	{
+		unsigned int middle = ( low + high ) / 2;
+
+		if ( table->signals[middle].input.id < id )
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	return low;
+}
+
+
+//
+// Add a value to the interval of a signal in a tier that the given time
+// falls in, starting a new interval if the slot holds an older one.
+//
+static void addInterval ( rollupTable_t* table, unsigned int tier,
+						  unsigned int signal, unsigned long now, double value )
+{
+	unsigned long     number = now / table->tiers[tier].resolution;
+	rollupInterval_t* slot   = ROLLUP_RING ( table, tier, signal ) +
+							   number % table->tiers[tier].intervalCount;
+
+	__atomic_store_n ( &slot->sequence, slot->sequence + 1, __ATOMIC_RELAXED );
+	__atomic_thread_fence ( __ATOMIC_RELEASE );
+
+	if ( slot->interval != number )
+	{
+		slot->interval = number;
+		slot->count    = 1;
+		slot->minimum  = value;
+		slot->maximum  = value;
+		slot->sum      = value;
+	}
+	else
+	{
+		slot->count++;
+		slot->sum += value;
+		if ( value < slot->minimum )
+		{
+			slot->minimum = value;
+		}
+		if ( value > slot->maximum )
+		{
+			slot->maximum = value;
+		}
+	}
+	__atomic_store_n ( &slot->sequence, slot->sequence + 1, __ATOMIC_RELEASE );
+}
+
+
+//
+//	r o l l u p A d d
+//
+// Add the values of the signals that are carried by a frame to their
+// current intervals in every tier.  This must only be called by the
+// aggregator that has attached to the table.  A frame whose ID no signal
+// uses costs one bit test.
+//
+// This function returns the number of signal values that were added.
+//
+unsigned int rollupAdd ( rollupTable_t* table, canMessageIndex_t id,
+						 const unsigned char* data, unsigned int length,
+						 unsigned long now )
+{
+	if ( id >= table->messageCount ||
+		 ( ROLLUP_MAP ( table )[id / 64] & ( 1UL << ( id % 64 ) ) ) == 0 )
+	{
+		return 0;
+	}
+	unsigned int added = 0;
+
+	for ( unsigned int s = firstSignal ( table, id );
+		  s < table->signalCount && table->signals[s].input.id == id; s++ )
+	{
+		rollupSignal_t* signal = &table->signals[s];
+		double          value;
+
+		if ( derivedFieldValue ( &signal->input, data, length, &value ) != 0 )
+		{
+			continue;
+		}
+		for ( unsigned int t = 0; t < table->tierCount; t++ )
+		{
+			addInterval ( table, t, s, now, value );
+		}
+		signal->lastValue  = value;
+		signal->lastSample = now;
+		signal->samples++;
+		added++;
+	}
+	return added;
+}
+
+
+//
+// Return the index of the signal for a field of a message, or -1 if there
+// isn't one.  A derived signal is found with an offset of 0.
+//
+int rollupFindSignal ( rollupTable_t* table, canMessageIndex_t id,
+					   unsigned int offset )
+{
+	for ( unsigned int s = firstSignal ( table, id );
+		  s < table->signalCount && table->signals[s].input.id == id; s++ )
+	{
+		if ( table->signals[s].input.offset == offset )
+		{
+			return s;
+		}
+	}
+	return -1;
+}
+
+
+//
+//	r o l l u p S e l e c t T i e r
+//
+// Choose the tier to answer a query that starts at the given time with the
+// given resolution.  This is the coarsest tier whose resolution is no
+// coarser than the one requested and that still holds the start time.  If
+// none of those tiers goes back far enough, the one that goes back the
+// furthest is used, and if the requested resolution is finer than every
+// tier, the finest tier is used.
+//
+// This function returns the index of the tier.
+//
+int rollupSelectTier ( rollupTable_t* table, unsigned long start,
+					   unsigned long resolution, unsigned long now )
+{
+	int          selected = 0;
+	unsigned int reach    = 0;
+
+	for ( unsigned int t = 0; t < table->tierCount; t++ )
+	{
+		rollupTier_t* tier = &table->tiers[t];
+
+		if ( tier->resolution > resolution )
+		{
+			break;
+		}
+		//
+		// The oldest interval that the tier still holds.
+		//
+		unsigned long current = now / tier->resolution;
+		unsigned long oldest  = current >= tier->intervalCount ?
+								current - tier->intervalCount + 1 : 0;
+
+		if ( oldest * tier->resolution <= start )
+		{
+			selected = t;
+			reach    = 1;
+		}
+		else if ( ! reach )
+		{
+			selected = t;
+		}
+	}
+	return selected;
+}
+
+
+//
+// Copy an interval without a lock.
+//
+// This function returns 1 if the slot holds the given interval number and 0
+// if it doesn't.
+//
+static int readInterval ( rollupInterval_t* slot, unsigned long number,
+						  rollupInterval_t* copy )
+{
+	while ( 1 )
+	{
+		unsigned int before = __atomic_load_n ( &slot->sequence,
+												__ATOMIC_ACQUIRE );
+		if ( ( before & 1 ) == 0 )
+		{
+			*copy = *slot;
+			__atomic_thread_fence ( __ATOMIC_ACQUIRE );
+			if ( __atomic_load_n ( &slot->sequence, __ATOMIC_RELAXED ) == before )
+			{
+				break;
+			}
+		}
+		SHARED_MEMORY_CPU_RELAX();
+	}
+	return copy->count != 0 && copy->interval == number;
+}
+
+
+//
+//	r o l l u p Q u e r y
+//
+// Return the history of a signal from "start" to "end" (in nanoseconds
+// since the epoch) at the requested resolution.  The tier is chosen with
+// rollupSelectTier and its index is returned in "tier".  When the requested
+// resolution is coarser than that of the tier, each sample returned merges
+// as many whole intervals of the tier as fit in it.  Only the samples that
+// have any values in them are returned, oldest first.
+//
+// This function returns the number of samples or -1 if there is no such
+// signal.
+//
+int rollupQuery ( rollupTable_t* table, unsigned int signal,
+				  unsigned long start, unsigned long end,
+				  unsigned long resolution, rollupSample_t* samples,
+				  unsigned int maxSamples, unsigned int* tier )
+{
+	if ( signal >= table->signalCount || table->tierCount == 0 )
+	{
+		return -1;
+	}
+	unsigned long now = rollupNow();
+	int           t   = rollupSelectTier ( table, start, resolution, now );
+
+	*tier = t;
+
+	//
+	// Work out how many intervals of the tier go into each sample and limit
+	// the range to the intervals that the tier can still hold.
+	//
+	unsigned long width   = table->tiers[t].resolution;
+	unsigned long count   = table->tiers[t].intervalCount;
+	unsigned long step    = resolution > width ? resolution / width : 1;
+	unsigned long current = now / width;
+	unsigned long first   = start / width;
+	unsigned long last    = ( end + width - 1 ) / width;
+
+	if ( current >= count && first < current - count + 1 )
+	{
+		first = current - count + 1;
+	}
+	if ( last > current + 1 )
+	{
+		last = current + 1;
+	}
+	first -= first % step;
+
+	rollupInterval_t* ring        = ROLLUP_RING ( table, t, signal );
+	unsigned int      sampleCount = 0;
+
+	for ( unsigned long number = first; number < last &&
+		  sampleCount < maxSamples; number += step )
+	{
+		rollupSample_t* sample = &samples[sampleCount];
+		double          sum    = 0;
+
+		(void) memset ( sample, 0, sizeof(*sample) );
+		sample->start = number * width;
+
+		for ( unsigned long n = number; n < number + step && n < last; n++ )
+		{
+			rollupInterval_t interval;
+
+			if ( ! readInterval ( &ring[n % count], n, &interval ) )
+			{
+				continue;
+			}
+			if ( sample->count == 0 || interval.minimum < sample->minimum )
+			{
+				sample->minimum = interval.minimum;
+			}
+			if ( sample->count == 0 || interval.maximum > sample->maximum )
+			{
+				sample->maximum = interval.maximum;
+			}
+			sample->count += interval.count;
+			sum           += interval.sum;
+		}
+		if ( sample->count != 0 )
+		{
+			sample->average = sum / sample->count;
+			sampleCount++;
+		}
+	}
+	return sampleCount;
+}
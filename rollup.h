@@ -0,0 +1,180 @@
+#pragma once
+#ifndef ROLLUP_H
+#define ROLLUP_H
+
+#include <sys/types.h>
+
+#include "canMessage.h"
+#include "derived.h"
+
+//
+// The rollup table is an optional region of the shared memory segment that
+// keeps the minimum, maximum and average of selected signals over fixed time
+// intervals, at several resolutions, for hours or days.  Keeping that much
+// raw history in the message pool (or the stream ring) is out of the
+// question, so the history is summarized as it arrives instead.
+//
+// The table is defined by a file given to "create -u" and can't be changed
+// afterwards.  Each line of the file is either a tier or a signal:
+//
+//     tier <resolution> <intervals>
+//     <ID>:<offset>:<size>[:s][*<scale>]
+//     <ID>[*<scale>]
+//
+// The resolution of a tier is a number of seconds with an optional "s", "m",
+// "h" or "d" suffix and the tier keeps the given number of intervals, so
+// "tier 1s 3600" keeps an hour of one second intervals.  If no tiers are
+// given, the table has one second intervals for an hour and one minute
+// intervals for a day.  A signal is a field of a message, read as for the
+// derived signals (see derived.h), or a derived signal by itself.
+//
+// Each signal has a ring of intervals in every tier.  The interval that a
+// sample falls in is the wall clock time (CLOCK_REALTIME) divided by the
+// resolution, so the intervals of every tier line up with the clock and the
+// history is still meaningful after a checkpoint is restored.  The slot of
+// an interval in its ring is its number modulo the size of the ring, and the
+// interval number is stored with it so an interval that has been overwritten
+// (or was never written) is recognized.
+//
+// The rollups are maintained by a single aggregator, the "rollupd" program,
+// that reads every frame from the stream ring, so nothing is added to the
+// insert path.  The table is claimed by the aggregator with a compare and
+// swap of its pid and can only be taken over once that process has exited.
+// Every sample updates one interval in each tier.  Each interval has a
+// sequence number that is odd while it is being updated so any number of
+// readers can copy it without a lock, as for the messages in the pool.
+//
+// rollupQuery returns the intervals of a signal over a time range at a
+// requested resolution.  It uses the coarsest tier whose resolution is at
+// least as fine as the one requested and that still holds the start of the
+// range, and merges its intervals into the requested resolution.
+//
+
+//
+// Define the limits of the rollup definitions.
+//
+#define ROLLUP_MAX_SIGNALS 256
+#define ROLLUP_MAX_TIERS   4
+
+//
+// Define one interval of a signal in a tier.  The interval number is the
+// start time of the interval divided by the resolution of the tier and is 0
+// if the slot has never been written.
+//
+typedef struct rollupInterval_t
+{
+	unsigned int  sequence;
+	unsigned int  count;
+	unsigned long interval;
+	double        minimum;
+	double        maximum;
+	double        sum;
+
+}   rollupInterval_t;                       // 40 bytes
+
+//
+// Define a tier.  The rings of all of the signals of a tier are stored one
+// after another starting at intervalsOffset from the start of the table.
+//
+typedef struct rollupTier_t
+{
+	unsigned long resolution;               // nsec
+	unsigned int  intervalCount;            // Per signal
+	unsigned int  pad;
+	unsigned long intervalsOffset;
+
+}   rollupTier_t;
+
+//
+// Define a signal.  The signals are sorted by message ID.
+//
+typedef struct rollupSignal_t
+{
+	derivedInput_t input;
+	unsigned long  samples;
+	unsigned long  lastSample;              // nsec since the epoch
+	double         lastValue;
+
+}   rollupSignal_t;
+
+//
+// Define the header of the rollup table region.  The signals are followed by
+// a bitmap with a bit for each message in the pool that is used by a signal
+// and then the interval rings of each tier.
+//
+// The aggregator counts the frames it has read, and the frames it missed
+// because it fell behind a stream ring with the drop policy.
+//
+typedef struct rollupTable_t
+{
+	unsigned int   signalCount;
+	unsigned int   tierCount;
+	unsigned int   messageCount;
+	pid_t          aggregator;              // 0 if there isn't one
+	unsigned long  usedMapOffset;
+	unsigned long  frames;
+	unsigned long  dropped;
+
+	rollupTier_t   tiers[ROLLUP_MAX_TIERS];
+
+	rollupSignal_t signals[0] __attribute__((aligned(64)));
+
+}   rollupTable_t;
+
+//
+// Define an interval returned by rollupQuery.
+//
+typedef struct rollupSample_t
+{
+	unsigned long start;                    // nsec since the epoch
+	unsigned long count;
+	double        minimum;
+	double        maximum;
+	double        average;
+
+}   rollupSample_t;
+
+//
+// Define the rollup functions.
+//
+int           rollupLoad         ( const char* fileName,
+								   unsigned int messageCount,
+								   rollupSignal_t* signals,
+								   rollupTier_t* tiers,
+								   unsigned int* tierCount );
+unsigned long rollupRegionSize   ( unsigned int signalCount,
+								   const rollupTier_t* tiers,
+								   unsigned int tierCount,
+								   unsigned int messageCount );
+int           rollupValidate     ( const rollupTable_t* table,
+								   unsigned long available,
+								   unsigned int messageCount );
+void          rollupInitialize   ( rollupTable_t* table,
+								   const rollupSignal_t* signals,
+								   unsigned int signalCount,
+								   const rollupTier_t* tiers,
+								   unsigned int tierCount,
+								   unsigned int messageCount );
+
+int           rollupAttach       ( rollupTable_t* table );
+void          rollupDetach       ( rollupTable_t* table );
+unsigned int  rollupAdd          ( rollupTable_t* table, canMessageIndex_t id,
+								   const unsigned char* data,
+								   unsigned int length, unsigned long now );
+
+int           rollupFindSignal   ( rollupTable_t* table, canMessageIndex_t id,
+								   unsigned int offset );
+int           rollupSelectTier   ( rollupTable_t* table, unsigned long start,
+								   unsigned long resolution,
+								   unsigned long now );
+int           rollupQuery        ( rollupTable_t* table, unsigned int signal,
+								   unsigned long start, unsigned long end,
+								   unsigned long resolution,
+								   rollupSample_t* samples,
+								   unsigned int maxSamples,
+								   unsigned int* tier );
+unsigned long rollupNow          ( void );
+int           rollupParseDuration ( const char* text,
+									unsigned long* duration );
+
+#endif		// End of ROLLUP_H
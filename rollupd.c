@@ -0,0 +1,258 @@
+//
+//	r o l l u p d . c
+//
+//  The rollup aggregator.  This program reads every frame from the stream
+//  ring and adds the values of the signals in the rollup table (see
+//  rollup.h) to their current intervals in every tier.
+//
+//  The shared memory segment must have been created with a rollup table and
+//  a stream ring (see the "-u" and "-r" options of the "create" program).
+//  Only one aggregator can run at a time.  The rollups are kept in the
+//  segment so the aggregator can be stopped and restarted, or run only while
+//  the history is wanted, and "rollupdump" reads them whether it is running
+//  or not.
+//
+//  The aggregator uses the wall clock time at which it reads a batch of
+//  frames from the ring as the time of the samples in it.  The ring only
+//  holds a fraction of a second of frames at full speed, so this is always
+//  well within the finest resolution that makes sense for a rollup.
+//
+//  The number of frames and signal values processed is reported once a
+//  second, with the frames that were missed if the stream ring uses the drop
+//  policy and the aggregator fell behind.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <locale.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the number of frames read from the stream ring at once.
+//
+#define BATCH_FRAMES 1024
+
+//
+// Define the aggregator parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static unsigned int durationSeconds = 0;
+static bool         quiet           = false;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+static volatile int stopRequested = 0;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -d    Duration (sec)   int     Forever \n\
+    -q    Quiet            bool      false \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Handle the interrupt signal by asking the main loop to stop.
+//
+static void stopHandler ( int signalNumber )
+{
+	stopRequested = 1;
+}
+
+
+//
+// Return the current monotonic time in nanoseconds.
+//
+static unsigned long nowNs ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:d:hq?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'd':
+		    durationSeconds = atol ( optarg );
+			break;
+
+		  case 'q':
+			quiet = true;
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( optind != argc )
+	{
+		printf ( "Invalid parameter encountered: %s\n", argv[optind] );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	rollupTable_t* table = sharedMemoryGetRollupTable ( sharedMemory );
+	streamRing_t*  ring  = sharedMemoryGetStreamRing ( sharedMemory );
+	if ( table == 0 || ring == 0 )
+	{
+		printf ( "The shared memory segment has no rollup table or no stream "
+				 "ring - Use \"create -u -r\" to define them.\n" );
+		exit (255);
+	}
+	if ( rollupAttach ( table ) != 0 )
+	{
+		printf ( "Another rollup aggregator (pid %d) is running - Aborting\n",
+				 table->aggregator );
+		exit (255);
+	}
+	streamConsumer_t* consumer = streamAttach ( ring );
+	if ( consumer == 0 )
+	{
+		printf ( "Every stream ring reader slot is in use - Aborting\n" );
+		rollupDetach ( table );
+		exit (255);
+	}
+	signal ( SIGINT,  stopHandler );
+	signal ( SIGTERM, stopHandler );
+
+	printf ( "Rolling up %u signals in %u tiers...\n", table->signalCount,
+			 table->tierCount );
+	fflush ( stdout );
+
+	static streamFrame_t frames[BATCH_FRAMES];
+
+	unsigned long start        = nowNs();
+	unsigned long lastReport   = start;
+	unsigned long frameCount   = 0;
+	unsigned long valueCount   = 0;
+	unsigned long totalFrames  = 0;
+	unsigned long totalValues  = 0;
+	unsigned long lastDropped  = 0;
+
+	while ( ! stopRequested )
+	{
+		unsigned long count = streamRead ( ring, consumer, frames, BATCH_FRAMES );
+
+		if ( count != 0 )
+		{
+			unsigned long now = rollupNow();
+
+			for ( unsigned long i = 0; i < count; i++ )
+			{
+				valueCount += rollupAdd ( table, frames[i].id, frames[i].data,
+										  frames[i].dlc, now );
+			}
+			frameCount += count;
+		}
+		else
+		{
+			usleep ( 1000 );
+		}
+		unsigned long now = nowNs();
+		if ( now - lastReport >= 1000000000UL )
+		{
+			unsigned long dropped = consumer->dropped;
+
+			table->frames  += frameCount;
+			table->dropped  = dropped;
+
+			if ( ! quiet )
+			{
+				printf ( "%'lu frames, %'lu values, %'lu dropped\n", frameCount,
+						 valueCount, dropped - lastDropped );
+				fflush ( stdout );
+			}
+			totalFrames += frameCount;
+			totalValues += valueCount;
+			frameCount   = 0;
+			valueCount   = 0;
+			lastDropped  = dropped;
+			lastReport   = now;
+		}
+		if ( durationSeconds != 0 && now - start >= durationSeconds * 1000000000UL )
+		{
+			break;
+		}
+	}
+	table->frames  += frameCount;
+	table->dropped  = consumer->dropped;
+	totalFrames    += frameCount;
+	totalValues    += valueCount;
+
+	printf ( "Rolled up %'lu values from %'lu frames.\n", totalValues,
+			 totalFrames );
+
+	streamDetach ( consumer );
+	rollupDetach ( table );
+	sharedMemoryClose ( sharedMemory );
+
+	return 0;
+}
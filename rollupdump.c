@@ -0,0 +1,353 @@
+//
+//	r o l l u p d u m p . c
+//
+//  Display the rollups of signal values (see rollup.h).
+//
+//  The shared memory segment must have been created with a rollup table (see
+//  the "-u" option of the "create" program).  The rollups are read without a
+//  lock so this never disturbs the aggregator ("rollupd").
+//
+//  Without the "-i" option the program lists the tiers and the signals with
+//  their latest values.  With "-i <ID>[:<offset>]" it prints the minimum,
+//  maximum and average of that signal over the last "-w" (an hour by
+//  default) at the "-r" resolution (a minute by default), using the
+//  coarsest tier that can answer the question.  The durations are given in
+//  seconds with an optional "ms", "s", "m", "h" or "d" suffix.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include <locale.h>
+#include <stdbool.h>
+#include <time.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the largest number of samples that a query prints.
+//
+#define MAX_SAMPLES 100000
+
+//
+// Define the query parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static const char*   signalName = 0;
+static unsigned long window     = 3600000000000UL;
+static unsigned long resolution = 60000000000UL;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -i    Signal          string     None \n\
+    -w    Window          string      1h \n\
+    -r    Resolution      string      1m \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\
+  The signal is given as <ID>:<offset>, or just <ID> for a derived signal.\n\
+  The window and resolution are seconds with an optional ms, s, m, h or d\n\
+  suffix.  Without -i the tiers and signals are listed.\n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Format a duration in nanoseconds with the largest unit that divides it.
+//
+static const char* formatDuration ( unsigned long duration, char* text,
+									unsigned int size )
+{
+	static const struct { unsigned long unit; const char* name; } units[] =
+	{
+		{ 86400000000000UL, "d" }, { 3600000000000UL, "h" },
+		{ 60000000000UL,    "m" }, { 1000000000UL,    "s" },
+		{ 1000000UL,       "ms" },
+	};
+	for ( unsigned int i = 0; i < sizeof(units) / sizeof(units[0]); i++ )
+	{
+		if ( duration % units[i].unit == 0 )
+		{
+			(void) snprintf ( text, size, "%lu%s", duration / units[i].unit,
+							  units[i].name );
+			return text;
+		}
+	}
+	(void) snprintf ( text, size, "%luns", duration );
+	return text;
+}
+
+
+//
+// Format a time in nanoseconds since the epoch as the local time.
+//
+static const char* formatTime ( unsigned long time, char* text,
+								unsigned int size )
+{
+	time_t    seconds = time / 1000000000UL;
+	struct tm local;
+
+	(void) localtime_r ( &seconds, &local );
+	(void) strftime ( text, size, "%Y-%m-%d %H:%M:%S", &local );
+
+	return text;
+}
+
+
+//
+// Format the field of a signal.
+//
+static const char* formatSignal ( const rollupSignal_t* signal, char* text,
+								  unsigned int size )
+{
+	const derivedInput_t* input = &signal->input;
+	int                   used;
+
+	if ( input->size == 0 )
+	{
+		used = snprintf ( text, size, "%#x", input->id );
+	}
+	else
+	{
+		used = snprintf ( text, size, "%#x:%u:%u%s", input->id, input->offset,
+						  input->size, input->isSigned ? ":s" : "" );
+	}
+	if ( input->scale != 1.0 && used < size )
+	{
+		(void) snprintf ( text + used, size - used, "*%g", input->scale );
+	}
+	return text;
+}
+
+
+//
+// List the tiers and the signals with their latest values.
+//
+static void listRollups ( rollupTable_t* table )
+{
+	unsigned long now = rollupNow();
+	char          text[64];
+	char          span[64];
+
+	printf ( "Aggregator: " );
+	if ( table->aggregator != 0 )
+	{
+		printf ( "pid %d", table->aggregator );
+	}
+	else
+	{
+		printf ( "not running" );
+	}
+	printf ( ", %'lu frames, %'lu dropped\n\n", table->frames, table->dropped );
+
+	printf ( "%u tiers:\n\n", table->tierCount );
+	for ( unsigned int t = 0; t < table->tierCount; t++ )
+	{
+		rollupTier_t* tier = &table->tiers[t];
+
+		printf ( "  %u: %6s x %'7u intervals = %s\n", t,
+				 formatDuration ( tier->resolution, text, sizeof(text) ),
+				 tier->intervalCount,
+				 formatDuration ( tier->resolution * tier->intervalCount, span,
+								  sizeof(span) ) );
+	}
+	printf ( "\n%u signals:\n\n", table->signalCount );
+	printf ( "  %-24s  %14s  %20s  %10s\n", "signal", "samples", "last value",
+			 "age (sec)" );
+
+	for ( unsigned int s = 0; s < table->signalCount; s++ )
+	{
+		rollupSignal_t* signal = &table->signals[s];
+
+		printf ( "  %-24s  %'14lu  ", formatSignal ( signal, text, sizeof(text) ),
+				 signal->samples );
+		if ( signal->samples != 0 )
+		{
+			printf ( "%20.6f  %10.3f\n", signal->lastValue,
+					 now > signal->lastSample ?
+					 ( now - signal->lastSample ) / 1e9 : 0.0 );
+		}
+		else
+		{
+			printf ( "%20s  %10s\n", "-", "-" );
+		}
+	}
+}
+
+
+//
+// Print the history of a signal.
+//
+static int querySignal ( rollupTable_t* table, const char* name )
+{
+	char*         end;
+	unsigned long id     = strtoul ( name, &end, 0 );
+	unsigned long offset = 0;
+
+	if ( end == name || ( *end != 0 && *end != ':' ) )
+	{
+		printf ( "Invalid signal[%s] specified.\n", name );
+		return -1;
+	}
+	if ( *end == ':' )
+	{
+		offset = strtoul ( end + 1, &end, 0 );
+	}
+	int signal = rollupFindSignal ( table, id, offset );
+	if ( signal < 0 || *end != 0 )
+	{
+		printf ( "There is no rollup of signal[%s].\n", name );
+		return -1;
+	}
+	static rollupSample_t samples[MAX_SAMPLES];
+
+	unsigned long now   = rollupNow();
+	unsigned int  tier  = 0;
+	int           count = rollupQuery ( table, signal, now - window, now,
+										resolution, samples, MAX_SAMPLES,
+										&tier );
+	char          text[64];
+	char          span[64];
+	char          width[64];
+	char          tierWidth[64];
+
+	printf ( "Signal %s over the last %s at %s from tier %u (%s):\n\n",
+			 formatSignal ( &table->signals[signal], text, sizeof(text) ),
+			 formatDuration ( window, span, sizeof(span) ),
+			 formatDuration ( resolution, width, sizeof(width) ), tier,
+			 formatDuration ( table->tiers[tier].resolution, tierWidth,
+							  sizeof(tierWidth) ) );
+	printf ( "  %-19s  %12s  %16s  %16s  %16s\n", "start", "count", "minimum",
+			 "maximum", "average" );
+
+	for ( int i = 0; i < count; i++ )
+	{
+		printf ( "  %-19s  %'12lu  %16.6f  %16.6f  %16.6f\n",
+				 formatTime ( samples[i].start, text, sizeof(text) ),
+				 samples[i].count, samples[i].minimum, samples[i].maximum,
+				 samples[i].average );
+	}
+	if ( count == 0 )
+	{
+		printf ( "  (no samples)\n" );
+	}
+	return 0;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:hi:r:w:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'i':
+			signalName = optarg;
+			break;
+
+		  case 'w':
+			if ( rollupParseDuration ( optarg, &window ) != 0 )
+			{
+				printf ( "Invalid window[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'r':
+			if ( rollupParseDuration ( optarg, &resolution ) != 0 )
+			{
+				printf ( "Invalid resolution[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( optind != argc )
+	{
+		printf ( "Invalid parameter encountered: %s\n", argv[optind] );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	rollupTable_t* table = sharedMemoryGetRollupTable ( sharedMemory );
+	if ( table == 0 )
+	{
+		printf ( "The shared memory segment has no rollup table - Use "
+				 "\"create -u\" to define one.\n" );
+		exit (255);
+	}
+	int status = 0;
+
+	if ( signalName == 0 )
+	{
+		listRollups ( table );
+	}
+	else
+	{
+		status = querySignal ( table, signalName );
+	}
+	sharedMemoryClose ( sharedMemory );
+
+	return status == 0 ? 0 : 255;
+}
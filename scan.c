@@ -0,0 +1,583 @@
+//
+//	s c a n . c
+//
+//  The predicate scan of the message pool.  See scan.h for a description.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <limits.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+#include "scan.h"
+#include "stats.h"
+
+//
+// The kernels load the slots as 8 byte words.  Each slot is 3 words: the
+// next index and the sequence number, the CAN ID and the length, and the
+// data.
+//
+_Static_assert ( sizeof(canMessage_t) == 24, "A slot must be 3 words" );
+_Static_assert ( offsetof(canMessage_t, sequence) == 4,
+				 "The sequence number must be in the upper half of word 0" );
+_Static_assert ( offsetof(canMessage_t, canMessage.can_dlc) == 12,
+				 "The length must be in the upper half of word 1" );
+_Static_assert ( offsetof(canMessage_t, canMessage.data) == 16,
+				 "The data must be word 2" );
+
+//
+// Define the kernel used by scanBlock.  It is chosen the first time it is
+// needed.
+//
+static int activeKernel = SCAN_KERNEL_AUTO;
+
+//
+// Define how far ahead of the slots being checked the vector kernels
+// prefetch.  The hardware prefetcher alone leaves them waiting for memory
+// about a fifth of the time.
+//
+#define SCAN_PREFETCH_BYTES 1024
+
+
+//
+// Return the mask of the bits of a field of the given size.
+//
+static unsigned long fieldMask ( unsigned int size )
+{
+	return size == 8 ? ~0UL : ( 1UL << ( size * 8 ) ) - 1;
+}
+
+
+//
+// Parse a term of the form "<offset>:<size>[:s]&<mask>=<value>" or
+// "<offset>:<size>[:s]=<low>[..<high>]".
+//
+// This function returns 0 if the term is valid and -1 if it is not.
+//
+int scanParseTerm ( const char* spec, scanTerm_t* term )
+{
+	char field[32];
+	const char* test = strpbrk ( spec, "&=" );
+
+	if ( test == 0 || test - spec >= (long)sizeof(field) )
+	{
+		return -1;
+	}
+	(void) memcpy ( field, spec, test - spec );
+	field[test - spec] = 0;
+
+	unsigned int offset;
+	unsigned int size;
+	int          isSigned;
+
+	if ( statsParseField ( field, &offset, &size, &isSigned ) != 0 )
+	{
+		return -1;
+	}
+	(void) memset ( term, 0, sizeof(*term) );
+	term->offset   = offset;
+	term->size     = size;
+	term->isSigned = isSigned;
+	term->mask     = fieldMask ( size );
+
+	char* end;
+
+	if ( *test == '&' )
+	{
+		term->mask = strtoul ( test + 1, &end, 0 );
+		if ( end == test + 1 || *end != '=' ||
+			 ( term->mask & ~fieldMask ( size ) ) != 0 )
+		{
+			return -1;
+		}
+		test = end;
+	}
+	test++;
+
+	//
+	// Get the bounds.  A single value is a range of one.
+	//
+	if ( isSigned && term->mask == fieldMask ( size ) )
+	{
+		term->low = strtol ( test, &end, 0 );
+	}
+	else
+	{
+		term->low = strtoul ( test, &end, 0 );
+	}
+	if ( end == test )
+	{
+		return -1;
+	}
+	term->high = term->low;
+
+	if ( end[0] == '.' && end[1] == '.' )
+	{
+		test = end + 2;
+		if ( isSigned && term->mask == fieldMask ( size ) )
+		{
+			term->high = strtol ( test, &end, 0 );
+		}
+		else
+		{
+			term->high = strtoul ( test, &end, 0 );
+		}
+		if ( end == test )
+		{
+			return -1;
+		}
+	}
+	return *end == 0 ? 0 : -1;
+}
+
+
+//
+// Compile the terms of a predicate.  A term with a mask that doesn't cover
+// the whole field is unsigned.  Bounds outside the values of the field are
+// clamped to them and a range that is empty never matches.
+//
+// This function returns 0 if the terms are valid and -1 if they are not.
+//
+int scanCompile ( const scanTerm_t* terms, unsigned int termCount,
+				  scanProgram_t* program )
+{
+	if ( termCount > SCAN_MAX_TERMS )
+	{
+		return -1;
+	}
+	(void) memset ( program, 0, sizeof(*program) );
+
+	for ( unsigned int i = 0; i < termCount; i++ )
+	{
+		const scanTerm_t* term = &terms[i];
+		scanTest_t*       test = &program->tests[i];
+
+		if ( ( term->size != 1 && term->size != 2 && term->size != 4 &&
+			   term->size != 8 ) || term->offset + term->size > CAN_MAX_DLEN )
+		{
+			return -1;
+		}
+		unsigned long all  = fieldMask ( term->size );
+		unsigned int  bits = term->size * 8;
+		int           empty;
+
+		test->shift = term->offset * 8;
+		test->mask  = term->mask & all;
+
+		if ( term->isSigned && test->mask == all )
+		{
+			//
+			// Flip the sign bit of a short field so it is ordered as an
+			// unsigned value.  An 8 byte field is already a signed long.
+			//
+			long low  = (long)term->low;
+			long high = (long)term->high;
+			long min  = bits == 64 ? LONG_MIN : -( 1L << ( bits - 1 ) );
+			long max  = bits == 64 ? LONG_MAX : ( 1L << ( bits - 1 ) ) - 1;
+
+			low   = low  < min ? min : low;
+			high  = high > max ? max : high;
+			empty = low > high;
+
+			test->flip = bits == 64 ? 0 : 1UL << ( bits - 1 );
+			test->low  = ( (unsigned long)low  & all ) ^ test->flip;
+			test->high = ( (unsigned long)high & all ) ^ test->flip;
+		}
+		else
+		{
+			//
+			// Flip the top bit of an 8 byte field so it is ordered as a
+			// signed long.  A short field is always positive.
+			//
+			unsigned long low  = term->low;
+			unsigned long high = term->high > all ? all : term->high;
+
+			empty = low > high;
+
+			test->flip = bits == 64 ? 1UL << 63 : 0;
+			test->low  = low  ^ test->flip;
+			test->high = high ^ test->flip;
+		}
+		if ( empty )
+		{
+			test->low  = 1;
+			test->high = 0;
+		}
+		if ( term->offset + term->size > program->minLength )
+		{
+			program->minLength = term->offset + term->size;
+		}
+	}
+	program->testCount = termCount;
+
+	return 0;
+}
+
+
+//
+// Evaluate a compiled predicate on the data and length of a message.
+//
+static inline int evaluate ( const scanProgram_t* program, unsigned long data,
+							 unsigned int length )
+{
+	if ( length < program->minLength )
+	{
+		return 0;
+	}
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	data = __builtin_bswap64 ( data );
+#endif
+	for ( unsigned int i = 0; i < program->testCount; i++ )
+	{
+		const scanTest_t* test = &program->tests[i];
+		long              key  = ( ( data >> test->shift ) & test->mask ) ^ test->flip;
+
+		if ( key < test->low || key > test->high )
+		{
+			return 0;
+		}
+	}
+	return 1;
+}
+
+
+//
+// Return 1 if a message matches a compiled predicate and 0 if it doesn't.
+//
+int scanMatch ( const scanProgram_t* program, const canMessage_t* message )
+{
+	unsigned long data;
+
+	(void) memcpy ( &data, message->canMessage.data, sizeof(data) );
+
+	return evaluate ( program, data, message->canMessage.can_dlc );
+}
+
+
+//
+// Check one slot.  The slot is read as by sharedMemoryReadMessage but
+// without retrying: a slot whose sequence number is odd or changes is
+// reported as changed.
+//
+static inline int scanSlot ( const scanProgram_t* program,
+							 const canMessage_t* slot, unsigned long bit,
+							 unsigned long* changed )
+{
+	unsigned int  before = __atomic_load_n ( &slot->sequence, __ATOMIC_ACQUIRE );
+	unsigned int  length = slot->canMessage.can_dlc;
+	unsigned long data;
+
+	(void) memcpy ( &data, slot->canMessage.data, sizeof(data) );
+	__atomic_thread_fence ( __ATOMIC_ACQUIRE );
+
+	if ( ( before & 1 ) != 0 ||
+		 __atomic_load_n ( &slot->sequence, __ATOMIC_RELAXED ) != before )
+	{
+		*changed |= bit;
+		return 0;
+	}
+	return evaluate ( program, data, length );
+}
+
+
+//
+// The scalar kernel.
+//
+static unsigned long scanScalar ( const scanProgram_t* program,
+								  const canMessage_t* slots, unsigned int count,
+								  unsigned long* changed )
+{
+	unsigned long match = 0;
+
+	for ( unsigned int i = 0; i < count; i++ )
+	{
+		if ( scanSlot ( program, &slots[i], 1UL << i, changed ) )
+		{
+			match |= 1UL << i;
+		}
+	}
+	return match;
+}
+
+
+#ifdef SCAN_X86
+
+//
+// The SSE4.2 kernel.  Two slots are 6 words, loaded as 3 registers and
+// shuffled into a register of the two headers, lengths and data words.
+//
+__attribute__ ((target ("sse4.2")))
+static unsigned long scanSse ( const scanProgram_t* program,
+							   const canMessage_t* slots, unsigned int count,
+							   unsigned long* changed )
+{
+	const __m128i sequenceMask = _mm_set1_epi64x ( 0xffffffff00000000L );
+	const __m128i oddBit       = _mm_set1_epi64x ( 1L << 32 );
+	const __m128i lengthMask   = _mm_set1_epi64x ( 0xff );
+	const __m128i minLength    = _mm_set1_epi64x ( (long)program->minLength - 1 );
+	unsigned long match        = 0;
+	unsigned int  i;
+
+	for ( i = 0; i + 2 <= count; i += 2 )
+	{
+		const __m128i* words = (const __m128i*)&slots[i];
+
+		_mm_prefetch ( (const char*)words + SCAN_PREFETCH_BYTES, _MM_HINT_T0 );
+
+		__m128d w0     = _mm_castsi128_pd ( _mm_loadu_si128 ( words ) );
+		__m128d w1     = _mm_castsi128_pd ( _mm_loadu_si128 ( words + 1 ) );
+		__m128i before = _mm_castpd_si128 ( _mm_shuffle_pd ( w0, w1, 2 ) );
+
+		__atomic_thread_fence ( __ATOMIC_ACQUIRE );
+
+		w0         = _mm_castsi128_pd ( _mm_loadu_si128 ( words ) );
+		__m128d w2 = _mm_castsi128_pd ( _mm_loadu_si128 ( words + 2 ) );
+		w1         = _mm_castsi128_pd ( _mm_loadu_si128 ( words + 1 ) );
+
+		__m128i length = _mm_castpd_si128 ( _mm_shuffle_pd ( w0, w2, 1 ) );
+		__m128i data   = _mm_castpd_si128 ( _mm_shuffle_pd ( w1, w2, 2 ) );
+
+		__atomic_thread_fence ( __ATOMIC_ACQUIRE );
+
+		w0 = _mm_castsi128_pd ( _mm_loadu_si128 ( words ) );
+		w1 = _mm_castsi128_pd ( _mm_loadu_si128 ( words + 1 ) );
+		__m128i after = _mm_castpd_si128 ( _mm_shuffle_pd ( w0, w1, 2 ) );
+
+		//
+		// A slot changed if its sequence number was odd or isn't the same.
+		//
+		__m128i same = _mm_cmpeq_epi64 ( _mm_and_si128 ( before, sequenceMask ),
+										 _mm_and_si128 ( after, sequenceMask ) );
+		__m128i odd  = _mm_cmpeq_epi64 ( _mm_and_si128 ( before, oddBit ), oddBit );
+
+		unsigned int moved = ( ~_mm_movemask_pd ( _mm_castsi128_pd ( same ) ) |
+							   _mm_movemask_pd ( _mm_castsi128_pd ( odd ) ) ) & 3;
+
+		length = _mm_and_si128 ( _mm_srli_epi64 ( length, 32 ), lengthMask );
+
+		__m128i fail = _mm_cmpgt_epi64 ( minLength, length );
+
+		for ( unsigned int t = 0; t < program->testCount; t++ )
+		{
+			const scanTest_t* test = &program->tests[t];
+
+			__m128i key = _mm_srl_epi64 ( data, _mm_cvtsi64_si128 ( test->shift ) );
+			key = _mm_and_si128 ( key, _mm_set1_epi64x ( test->mask ) );
+			key = _mm_xor_si128 ( key, _mm_set1_epi64x ( test->flip ) );
+			fail = _mm_or_si128 ( fail,
+				   _mm_or_si128 ( _mm_cmpgt_epi64 ( _mm_set1_epi64x ( test->low ), key ),
+								  _mm_cmpgt_epi64 ( key, _mm_set1_epi64x ( test->high ) ) ) );
+		}
+		unsigned int failed = _mm_movemask_pd ( _mm_castsi128_pd ( fail ) );
+
+		*changed |= (unsigned long)moved << i;
+		match    |= (unsigned long)( ~( failed | moved ) & 3 ) << i;
+	}
+	for ( ; i < count; i++ )
+	{
+		if ( scanSlot ( program, &slots[i], 1UL << i, changed ) )
+		{
+			match |= 1UL << i;
+		}
+	}
+	return match;
+}
+
+
+//
+// Gather the headers (word 0) of four slots from their 12 words.
+//
+__attribute__ ((target ("avx2")))
+static inline __m256i headers ( __m256i v0, __m256i v1, __m256i v2 )
+{
+	__m256i words = _mm256_blend_epi32 ( v0, v1, 0x30 );       // w0 - w6 w3
+	words = _mm256_blend_epi32 ( words, v2, 0x0c );            // w0 w9 w6 w3
+
+	return _mm256_permute4x64_epi64 ( words, 0x6c );           // w0 w3 w6 w9
+}
+
+
+//
+// The AVX2 kernel.  Four slots are 12 words, loaded as 3 registers and
+// blended and permuted into a register of the four headers, lengths and
+// data words.
+//
+__attribute__ ((target ("avx2")))
+static unsigned long scanAvx2 ( const scanProgram_t* program,
+								const canMessage_t* slots, unsigned int count,
+								unsigned long* changed )
+{
+	const __m256i sequenceMask = _mm256_set1_epi64x ( 0xffffffff00000000L );
+	const __m256i oddBit       = _mm256_set1_epi64x ( 1L << 32 );
+	const __m256i lengthMask   = _mm256_set1_epi64x ( 0xff );
+	const __m256i minLength    = _mm256_set1_epi64x ( (long)program->minLength - 1 );
+	unsigned long match        = 0;
+	unsigned int  i;
+
+	for ( i = 0; i + 4 <= count; i += 4 )
+	{
+		const __m256i* words = (const __m256i*)&slots[i];
+
+		_mm_prefetch ( (const char*)words + SCAN_PREFETCH_BYTES, _MM_HINT_T0 );
+		_mm_prefetch ( (const char*)words + SCAN_PREFETCH_BYTES + 64, _MM_HINT_T0 );
+
+		__m256i before = headers ( _mm256_loadu_si256 ( words ),
+								   _mm256_loadu_si256 ( words + 1 ),
+								   _mm256_loadu_si256 ( words + 2 ) );
+
+		__atomic_thread_fence ( __ATOMIC_ACQUIRE );
+
+		__m256i v0 = _mm256_loadu_si256 ( words );
+		__m256i v1 = _mm256_loadu_si256 ( words + 1 );
+		__m256i v2 = _mm256_loadu_si256 ( words + 2 );
+
+		//
+		// The lengths are words 1, 4, 7 and 10 and the data words 2, 5, 8
+		// and 11.
+		//
+		__m256i length = _mm256_blend_epi32 ( v0, v1, 0xc3 );     // w4 w1 - w7
+		length = _mm256_blend_epi32 ( length, v2, 0x30 );          // w4 w1 w10 w7
+		length = _mm256_permute4x64_epi64 ( length, 0xb1 );        // w1 w4 w7 w10
+
+		__m256i data = _mm256_blend_epi32 ( v0, v1, 0x0c );       // - w5 w2 -
+		data = _mm256_blend_epi32 ( data, v2, 0xc3 );              // w8 w5 w2 w11
+		data = _mm256_permute4x64_epi64 ( data, 0xc6 );            // w2 w5 w8 w11
+
+		__atomic_thread_fence ( __ATOMIC_ACQUIRE );
+
+		__m256i after = headers ( _mm256_loadu_si256 ( words ),
+								  _mm256_loadu_si256 ( words + 1 ),
+								  _mm256_loadu_si256 ( words + 2 ) );
+
+		//
+		// A slot changed if its sequence number was odd or isn't the same.
+		//
+		__m256i same = _mm256_cmpeq_epi64 ( _mm256_and_si256 ( before, sequenceMask ),
+											_mm256_and_si256 ( after, sequenceMask ) );
+		__m256i odd  = _mm256_cmpeq_epi64 ( _mm256_and_si256 ( before, oddBit ), oddBit );
+
+		unsigned int moved = ( ~_mm256_movemask_pd ( _mm256_castsi256_pd ( same ) ) |
+							   _mm256_movemask_pd ( _mm256_castsi256_pd ( odd ) ) ) & 0xf;
+
+		length = _mm256_and_si256 ( _mm256_srli_epi64 ( length, 32 ), lengthMask );
+
+		__m256i fail = _mm256_cmpgt_epi64 ( minLength, length );
+
+		for ( unsigned int t = 0; t < program->testCount; t++ )
+		{
+			const scanTest_t* test = &program->tests[t];
+
+			__m256i key = _mm256_srl_epi64 ( data, _mm_cvtsi64_si128 ( test->shift ) );
+			key = _mm256_and_si256 ( key, _mm256_set1_epi64x ( test->mask ) );
+			key = _mm256_xor_si256 ( key, _mm256_set1_epi64x ( test->flip ) );
+			fail = _mm256_or_si256 ( fail,
+				   _mm256_or_si256 ( _mm256_cmpgt_epi64 ( _mm256_set1_epi64x ( test->low ), key ),
+									 _mm256_cmpgt_epi64 ( key, _mm256_set1_epi64x ( test->high ) ) ) );
+		}
+		unsigned int failed = _mm256_movemask_pd ( _mm256_castsi256_pd ( fail ) );
+
+		*changed |= (unsigned long)moved << i;
+		match    |= (unsigned long)( ~( failed | moved ) & 0xf ) << i;
+	}
+	for ( ; i < count; i++ )
+	{
+		if ( scanSlot ( program, &slots[i], 1UL << i, changed ) )
+		{
+			match |= 1UL << i;
+		}
+	}
+	return match;
+}
+
+#endif
+
+
+//
+// Choose the kernel used by scanBlock.  SCAN_KERNEL_AUTO chooses the fastest
+// one the processor can run.
+//
+// This function returns the kernel chosen or -1 if the processor can't run
+// the one that was asked for.
+//
+int scanSetKernel ( int kernel )
+{
+	int best = SCAN_KERNEL_SCALAR;
+
+#ifdef SCAN_X86
+	__builtin_cpu_init();
+	if ( __builtin_cpu_supports ( "avx2" ) )
+	{
+		best = SCAN_KERNEL_AVX2;
+	}
+	else if ( __builtin_cpu_supports ( "sse4.2" ) )
+	{
+		best = SCAN_KERNEL_SSE;
+	}
+#endif
+	if ( kernel == SCAN_KERNEL_AUTO )
+	{
+		kernel = best;
+	}
+	if ( kernel < SCAN_KERNEL_SCALAR || kernel > best )
+	{
+		return -1;
+	}
+	__atomic_store_n ( &activeKernel, kernel, __ATOMIC_RELAXED );
+
+	return kernel;
+}
+
+
+//
+// Return the name of a kernel.
+//
+const char* scanKernelName ( int kernel )
+{
+	switch ( kernel )
+	{
+	  case SCAN_KERNEL_AUTO:   return "auto";
+	  case SCAN_KERNEL_SCALAR: return "scalar";
+	  case SCAN_KERNEL_SSE:    return "sse4.2";
+	  case SCAN_KERNEL_AVX2:   return "avx2";
+	  default:                 return "unknown";
+	}
+}
+
+
+//
+// Scan up to 64 consecutive slots.  The bits of the slots that match are
+// returned and the bits of the slots that changed while they were read are
+// set in "changed".  These must be read again with the shared memory
+// functions, which follow them to the hot slots.
+//
+unsigned long scanBlock ( const scanProgram_t* program,
+						  const canMessage_t* slots, unsigned int count,
+						  unsigned long* changed )
+{
+	int kernel = __atomic_load_n ( &activeKernel, __ATOMIC_RELAXED );
+
+	if ( kernel == SCAN_KERNEL_AUTO )
+	{
+		kernel = scanSetKernel ( SCAN_KERNEL_AUTO );
+	}
+	*changed = 0;
+
+	switch ( kernel )
+	{
+#ifdef SCAN_X86
+	  case SCAN_KERNEL_AVX2:
+		return scanAvx2 ( program, slots, count, changed );
+
+	  case SCAN_KERNEL_SSE:
+		return scanSse ( program, slots, count, changed );
+#endif
+	  default:
+		return scanScalar ( program, slots, count, changed );
+	}
+}
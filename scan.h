@@ -0,0 +1,111 @@
+#pragma once
+#ifndef SCAN_H
+#define SCAN_H
+
+#include "canMessage.h"
+
+//
+// A scan finds every message in the pool whose data matches a predicate,
+// like "bit 5 of byte 2 is set" or "the 2 byte field at offset 4 is over
+// 3000", without fetching the messages one at a time.
+//
+// A predicate is one or more terms that must all be true.  Each term is a
+// field of the data, a little endian integer of 1, 2, 4 or 8 bytes at a byte
+// offset (as for the statistics and derived signals), that is either:
+//
+//   - compared with a mask: the field ANDed with the mask must equal a value,
+//   - or checked against a range: the field, signed or unsigned, must be
+//     between a low and a high bound (both included).
+//
+// A message only matches if it is long enough to hold all of the fields.
+//
+// Terms are written "<offset>:<size>[:s]" followed by "&<mask>=<value>" or
+// by "=<low>[..<high>]", for example "2:1&0x20=0x20" or "4:2:s=-100..100".
+//
+// Every term is compiled to the same test: the field is shifted and masked
+// out of the 8 data bytes as a 64 bit integer and its sign bit flipped as
+// needed so that a signed 64 bit comparison orders it correctly, and the
+// result must be between two bounds.  A masked equality is a range whose
+// bounds are equal.  This lets the pool be scanned four messages at a time
+// with AVX2 or two at a time with SSE4.2 with no branches, and the scan is
+// bound by the memory bandwidth.  The scalar version is used on other
+// processors.
+//
+// The scan doesn't take the shared memory lock.  Each message is checked
+// with its sequence number as by sharedMemoryReadMessage, and the few that
+// were being written, or that have been moved to the hot slots of the
+// placement map (see placement.h), are read again one at a time.  The
+// result is the state of each message at some point during the scan.  Scans
+// aren't counted in the heat map.
+//
+
+//
+// Define the largest number of terms in a predicate.
+//
+#define SCAN_MAX_TERMS 8
+
+//
+// Define the scan kernels.
+//
+#define SCAN_KERNEL_AUTO   0               // The fastest one available
+#define SCAN_KERNEL_SCALAR 1
+#define SCAN_KERNEL_SSE    2
+#define SCAN_KERNEL_AVX2   3
+
+//
+// Define a term of a predicate as it is given.  The mask is applied to the
+// raw field and is all ones for a range.  The bounds of a signed field are
+// stored as the bits of a long.
+//
+typedef struct scanTerm_t
+{
+	unsigned char offset;
+	unsigned char size;
+	unsigned char isSigned;
+	unsigned char pad;
+	unsigned long mask;
+	unsigned long low;
+	unsigned long high;
+
+}   scanTerm_t;
+
+//
+// Define a compiled term: the key (data >> shift & mask) ^ flip, compared as
+// a signed 64 bit integer, must be between low and high.
+//
+typedef struct scanTest_t
+{
+	unsigned long shift;
+	unsigned long mask;
+	unsigned long flip;
+	long          low;
+	long          high;
+
+}   scanTest_t;
+
+//
+// Define a compiled predicate.
+//
+typedef struct scanProgram_t
+{
+	unsigned int testCount;
+	unsigned int minLength;                 // Covers every field
+	scanTest_t   tests[SCAN_MAX_TERMS];
+
+}   scanProgram_t;
+
+//
+// Define the scan functions.
+//
+int           scanParseTerm  ( const char* spec, scanTerm_t* term );
+int           scanCompile    ( const scanTerm_t* terms, unsigned int termCount,
+							   scanProgram_t* program );
+int           scanMatch      ( const scanProgram_t* program,
+							   const canMessage_t* message );
+unsigned long scanBlock      ( const scanProgram_t* program,
+							   const canMessage_t* slots, unsigned int count,
+							   unsigned long* changed );
+int           scanSetKernel  ( int kernel );
+const char*   scanKernelName ( int kernel );
+
+#endif		// End of SCAN_H
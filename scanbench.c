@@ -0,0 +1,440 @@
+//
+//	s c a n b e n c h . c
+//
+//  Measure the predicate scan of the message pool (see scan.h) and use it
+//  to look for messages.
+//
+//  The pool is first filled with pseudo random data (unless "-k" is given
+//  to scan what is already there).  Each predicate is then scanned with
+//  each kernel the processor can run (scalar, SSE4.2 and AVX2) and, as the
+//  baseline, by fetching every message with fetchMessage and testing it,
+//  which takes the shared memory lock once per message.  The time per scan,
+//  the time per message and the rate at which the pool was read are
+//  reported for each, and the messages found by every method must be the
+//  same.
+//
+//  A predicate is given with "-t" as one or more terms that must all be
+//  true (see scan.h for their syntax), for example:
+//
+//      scanbench -k -t 2:1&0x20=0x20 -l 20
+//
+//  lists the first 20 IDs whose byte 2 has bit 5 set.  Without "-t" a few
+//  sample predicates are scanned.
+//
+//  With "-w" a writer process rewrites every message with the same data
+//  while the scans run, so the scans see messages change under them and
+//  must read them again, yet still find the same messages.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <locale.h>
+#include <sys/wait.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the sample predicates scanned when none are given, as term lists
+// separated by spaces.
+//
+static const char* samplePredicates[] =
+{
+	"2:1&0x20=0x20",
+	"0:1=7",
+	"4:2=60000..65535",
+	"6:2:s=-100..100",
+	"2:1&0x20=0x20 4:2=0..9999 0:4&0xff000000=0",
+};
+
+#define SAMPLE_COUNT ( sizeof(samplePredicates) / sizeof(samplePredicates[0]) )
+
+//
+// Define the benchmark parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static unsigned int passCount  = 10;
+static unsigned int listCount  = 0;
+static int          keepData   = 0;
+static int          withWriter = 0;
+static char         predicate[256];
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -t    Term             string   Samples \n\
+    -n    Passes           int          10 \n\
+    -l    IDs to List      int           0 \n\
+    -k    Keep the Data    bool      false \n\
+    -w    With a Writer    bool      false \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\
+  A term is \"<offset>:<size>[:s]&<mask>=<value>\" or\n\
+  \"<offset>:<size>[:s]=<low>[..<high>]\".  Give -t once for each term of\n\
+  the predicate.\n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Return the current monotonic time in nanoseconds.
+//
+static unsigned long nowNs ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// Return the pseudo random data of a message (splitmix64 of its ID).
+//
+static unsigned long messageData ( canMessageIndex_t id )
+{
+	unsigned long x = id + 0x9e3779b97f4a7c15UL;
+
+	x = ( x ^ ( x >> 30 ) ) * 0xbf58476d1ce4e5b9UL;
+	x = ( x ^ ( x >> 27 ) ) * 0x94d049bb133111ebUL;
+
+	return x ^ ( x >> 31 );
+}
+
+
+//
+// Write every message in the pool with its pseudo random data.  One in
+// sixteen messages is 4 bytes long, so the length check is exercised.
+//
+static void writePool ( sharedMemory_t* sharedMemory, unsigned int poolSize )
+{
+	canMessage_t messages[256];
+
+	(void) memset ( messages, 0, sizeof(messages) );
+
+	for ( canMessageIndex_t first = 0; first < poolSize; first += 256 )
+	{
+		int count = poolSize - first < 256 ? poolSize - first : 256;
+
+		for ( int i = 0; i < count; i++ )
+		{
+			unsigned long data = messageData ( first + i );
+
+			messages[i].canMessage.can_id  = first + i;
+			messages[i].canMessage.can_dlc = ( first + i ) % 16 == 0 ? 4 : 8;
+			(void) memcpy ( messages[i].canMessage.data, &data, sizeof(data) );
+		}
+		(void) insertMessages ( sharedMemory, messages, count );
+	}
+}
+
+
+//
+// Rewrite the messages of the pool with the data they already have until
+// the process is killed.
+//
+static void runWriter ( sharedMemory_t* sharedMemory, unsigned int poolSize )
+{
+	canMessage_t message;
+
+	while ( 1 )
+	{
+		for ( canMessageIndex_t id = 0; id < poolSize; id += 7 )
+		{
+			message.canMessage.can_id = id;
+			(void) fetchMessage ( sharedMemory, &message );
+			(void) insertMessage ( sharedMemory, &message );
+		}
+	}
+}
+
+
+//
+// Scan a predicate with every kernel and with fetchMessage and print the
+// results.  This returns 0 if they all found the same messages.
+//
+static int benchPredicate ( sharedMemory_t* sharedMemory, unsigned int poolSize,
+							const char* text )
+{
+	scanTerm_t    terms[SCAN_MAX_TERMS];
+	unsigned int  termCount = 0;
+	scanProgram_t program;
+	char          copy[256];
+
+	(void) strncpy ( copy, text, sizeof(copy) - 1 );
+	copy[sizeof(copy) - 1] = 0;
+
+	for ( char* token = strtok ( copy, " " ); token != 0; token = strtok ( 0, " " ) )
+	{
+		if ( termCount == SCAN_MAX_TERMS ||
+			 scanParseTerm ( token, &terms[termCount] ) != 0 )
+		{
+			printf ( "Invalid term[%s] specified.\n", token );
+			return -1;
+		}
+		termCount++;
+	}
+	if ( scanCompile ( terms, termCount, &program ) != 0 )
+	{
+		printf ( "Invalid predicate[%s] specified.\n", text );
+		return -1;
+	}
+	unsigned int   words    = ( poolSize + 63 ) / 64;
+	unsigned long* expected = calloc ( words, sizeof(unsigned long) );
+	unsigned long* bitmap   = calloc ( words, sizeof(unsigned long) );
+	int            failed   = 0;
+
+	if ( expected == 0 || bitmap == 0 )
+	{
+		printf ( "Unable to allocate the bitmaps of %'u IDs.\n", poolSize );
+		exit (255);
+	}
+	printf ( "\n%s\n", text );
+	printf ( "  %-12s %12s %12s %12s %12s\n", "Method", "msec/scan", "ns/ID",
+			 "MB/sec", "Matches" );
+
+	//
+	// Scan one message at a time with the lock, for the baseline.
+	//
+	canMessage_t  message;
+	long          matches = 0;
+	unsigned long start   = nowNs();
+
+	for ( canMessageIndex_t id = 0; id < poolSize; id++ )
+	{
+		message.canMessage.can_id = id;
+		(void) fetchMessage ( sharedMemory, &message );
+		if ( scanMatch ( &program, &message ) )
+		{
+			expected[id / 64] |= 1UL << ( id % 64 );
+			matches++;
+		}
+	}
+	unsigned long elapsed = nowNs() - start;
+	double        poolMb  = (double)poolSize * sizeof(canMessage_t) / 1e6;
+
+	printf ( "  %-12s %12.2f %12.2f %12.0f %'12ld\n", "fetchMessage",
+			 elapsed / 1e6, (double)elapsed / poolSize, poolMb / ( elapsed / 1e9 ),
+			 matches );
+
+	//
+	// Scan with each kernel the processor can run.
+	//
+	for ( int kernel = SCAN_KERNEL_SCALAR; kernel <= SCAN_KERNEL_AVX2; kernel++ )
+	{
+		if ( scanSetKernel ( kernel ) != kernel )
+		{
+			continue;
+		}
+		long scanned = 0;
+
+		start = nowNs();
+		for ( unsigned int pass = 0; pass < passCount; pass++ )
+		{
+			scanned = sharedMemoryScan ( sharedMemory, &program, bitmap );
+		}
+		elapsed = ( nowNs() - start ) / passCount;
+
+		int same = memcmp ( bitmap, expected, words * sizeof(unsigned long) ) == 0;
+
+		printf ( "  %-12s %12.2f %12.2f %12.0f %'12ld%s\n", scanKernelName ( kernel ),
+				 elapsed / 1e6, (double)elapsed / poolSize,
+				 poolMb / ( elapsed / 1e9 ), scanned,
+				 same ? "" : "  Different messages" );
+		failed |= ! same;
+	}
+	(void) scanSetKernel ( SCAN_KERNEL_AUTO );
+
+	if ( listCount > 0 )
+	{
+		canMessageIndex_t* ids = calloc ( listCount, sizeof(canMessageIndex_t) );
+		long               found;
+
+		if ( ids == 0 )
+		{
+			printf ( "Unable to allocate a list of %'u IDs.\n", listCount );
+			exit (255);
+		}
+		found = sharedMemoryScanIds ( sharedMemory, &program, ids, listCount );
+
+		printf ( "  %'ld IDs:", found );
+		for ( long i = 0; i < found && i < listCount; i++ )
+		{
+			printf ( " %u", ids[i] );
+		}
+		printf ( "%s\n", found > listCount ? " ..." : "" );
+		free ( ids );
+	}
+	free ( expected );
+	free ( bitmap );
+
+	return failed ? -1 : 0;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:hkl:n:t:w?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  //
+		  // Add a term to the predicate.
+		  //
+		  case 't':
+			if ( strlen ( predicate ) + strlen ( optarg ) + 2 > sizeof(predicate) )
+			{
+				printf ( "The predicate is too long.\n" );
+				exit (255);
+			}
+			if ( predicate[0] != 0 )
+			{
+				strcat ( predicate, " " );
+			}
+			strcat ( predicate, optarg );
+			break;
+
+		  case 'n':
+		    passCount = atol ( optarg );
+			if ( passCount < 1 )
+			{
+				printf ( "Invalid pass count[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'l':
+		    listCount = atol ( optarg );
+			break;
+
+		  case 'k':
+			keepData = 1;
+			break;
+
+		  case 'w':
+			withWriter = 1;
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( optind != argc )
+	{
+		printf ( "Invalid parameter encountered: %s\n", argv[optind] );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	unsigned int poolSize = sharedMemoryGetPoolSize ( sharedMemory );
+
+	if ( ! keepData )
+	{
+		printf ( "Writing %'u messages...\n", poolSize );
+		fflush ( stdout );
+		writePool ( sharedMemory, poolSize );
+	}
+	printf ( "Scanning %'u messages (%'lu bytes) with the %s kernel by default%s\n",
+			 poolSize, poolSize * sizeof(canMessage_t),
+			 scanKernelName ( scanSetKernel ( SCAN_KERNEL_AUTO ) ),
+			 withWriter ? ", with a writer" : "" );
+	fflush ( stdout );
+
+	pid_t writer = 0;
+
+	if ( withWriter )
+	{
+		writer = fork();
+		if ( writer == 0 )
+		{
+			runWriter ( sharedMemory, poolSize );
+			exit ( 0 );
+		}
+	}
+	int failed = 0;
+
+	if ( predicate[0] != 0 )
+	{
+		failed |= benchPredicate ( sharedMemory, poolSize, predicate ) != 0;
+	}
+	else
+	{
+		for ( unsigned int i = 0; i < SAMPLE_COUNT; i++ )
+		{
+			failed |= benchPredicate ( sharedMemory, poolSize,
+									   samplePredicates[i] ) != 0;
+		}
+	}
+	if ( writer > 0 )
+	{
+		kill ( writer, SIGKILL );
+		waitpid ( writer, 0, 0 );
+	}
+	sharedMemoryClose ( sharedMemory );
+
+	if ( failed )
+	{
+		printf ( "\nThe scans found different messages - Failed\n" );
+		exit (255);
+	}
+	return 0;
+}
@@ -7,23 +7,72 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
 
-#include "sharedMemory.h"
+#include "sharedMemorySegment.h"
 
 //
-// Open the shared memory segment being used for this test.
+// Define the number of bytes that will be copied out of the shared memory
+// segment for each acquisition of the shared memory lock while a checkpoint
+// is being written.  This keeps the time that writers are held off down to a
+// single short memcpy rather than the time it takes to write the entire
+// segment to disk.
 //
-sharedMemory_t* sharedMemoryOpen ( void )
+#define CHECKPOINT_CHUNK_SIZE ( 256 * 1024 )
+
+//
+// Define the largest number of frames of a batch insert that are compared
+// and stored with one acquisition of the shared memory lock when change
+// suppression is on.  The frames that were stored are remembered in a bit
+// map of this size on the stack.
+//
+#define CHANGE_BATCH_FRAMES 1024
+
+//
+// Build the name of the shared memory segment that holds the partition for
+// the specified CAN bus.  Each bus has its own segment (and therefore its own
+// message pool, lock and journal) so traffic on one bus never contends with
+// traffic on another.  SHARED_MEMORY_NO_BUS gives the original unpartitioned
+// segment name.
+//
+void sharedMemoryPartitionName ( int bus, char* name, unsigned int nameSize )
+{
+	if ( bus == SHARED_MEMORY_NO_BUS )
+	{
+		(void) snprintf ( name, nameSize, "%s", SHARED_MEMORY_DEFAULT_NAME );
+	}
+	else
+	{
+		(void) snprintf ( name, nameSize, "%s.bus%d", SHARED_MEMORY_DEFAULT_NAME,
+						  bus );
+	}
+}
+
+
+//
+// Open the named shared memory segment, map it into memory and validate it.
+// If the name is null, the default segment is opened.  The handle returned
+// is used for all further operations on the segment and a process may have
+// any number of segments open at once.
+//
+// This function returns 0 if the segment could not be opened.
+//
+sharedMemory_t* sharedMemoryOpen ( const char* name )
 {
+	if ( name == 0 )
+	{
+		name = SHARED_MEMORY_DEFAULT_NAME;
+	}
 	//
 	// Open the shared memory file.
 	//
 	int fd = 0;
-	fd = open ( sharedMemoryName, O_RDWR|O_CREAT, 0666);
+	fd = open ( name, O_RDWR );
 	if (fd < 0)
 	{
 		printf ( "Unable to open the shared memory segment[%s] errno: %u[%s].\n",
-				 sharedMemoryName, errno, strerror(errno) );
+				 name, errno, strerror(errno) );
 		return 0;
 	}
     //
@@ -35,7 +84,7 @@ sharedMemory_t* sharedMemoryOpen ( void )
     if ( status == -1 )
     {
         printf ( "Unable to get the size of the shared memory segment[%s] errno: "
-                 "%u[%s].\n", sharedMemoryName, errno, strerror(errno) );
+                 "%u[%s].\n", name, errno, strerror(errno) );
         (void) close ( fd );
         return 0;
     }
@@ -44,190 +93,2087 @@ sharedMemory_t* sharedMemoryOpen ( void )
     //
     if ( stats.st_size <= 0 )
     {
-        printf ( "Shared memory segment[%s] is empty - Aborting\n",
-                 sharedMemoryName );
+        printf ( "Shared memory segment[%s] is empty - Aborting\n", name );
+        (void) close ( fd );
+        return 0;
     }
 	//
 	// Map the shared memory file into virtual memory.
 	//
-	sharedMemory = mmap ( NULL, stats.st_size, PROT_READ|PROT_WRITE,
-					      MAP_SHARED, fd, 0 );
+	sharedMemory_t* segment = mmap ( NULL, stats.st_size, PROT_READ|PROT_WRITE,
+									 MAP_SHARED, fd, 0 );
 	(void) close ( fd );
-	if ( sharedMemory == MAP_FAILED )
+	if ( segment == MAP_FAILED )
 	{
 		printf ( "Unable to map the shared memory segment. errno: %u[%s].\n",
 				 errno, strerror(errno) );
 		return 0;
 	}
-	return sharedMemory;
+	//
+	// Make sure that what we just mapped is really a shared memory segment
+	// that was built with the same layout that we are using.
+	//
+	if ( sharedMemoryValidate ( segment, stats.st_size ) != 0 )
+	{
+		(void) munmap ( segment, stats.st_size );
+		return 0;
+	}
+	return segment;
 }
 
 
 //
-// Close the shared memory segment being used for this test.
+// Open the shared memory segment for the specified CAN bus.
 //
-// Note that this call will cause the data that has been modified in memory to
-// be synchronized to the disk file that stores the data persistently.
+sharedMemory_t* sharedMemoryOpenBus ( int bus )
+{
+	char name[4096];
+
+	sharedMemoryPartitionName ( bus, name, sizeof(name) );
+
+	return sharedMemoryOpen ( name );
+}
+
+
+//
+// Return the number of bytes from the start of an optional region to the end
+// of the segment, or 0 if the offset doesn't point past the message pool to
+// an aligned region header that fits in the segment.
 //
-void sharedMemoryClose ( sharedMemory_t* sharedMemory, 
-						 unsigned int sharedMemorySegmentSize )
+static unsigned long regionSpace ( sharedMemory_t* sharedMemory,
+								   unsigned int offset, unsigned long headerSize )
 {
-	(void) munmap ( sharedMemory, sharedMemorySegmentSize );
+	unsigned long poolEnd = sizeof(sharedMemory_t) +
+		(unsigned long)sharedMemory->totalMessageCount * sizeof(canMessage_t);
+
+	if ( offset < poolEnd || offset % 64 != 0 ||
+		 offset + headerSize > sharedMemory->totalSharedMemorySize )
+	{
+		return 0;
+	}
+	return sharedMemory->totalSharedMemorySize - offset;
 }
 
 
 //
-// Return the size of the shared memory segment from the shared memory segment.
+// Return 1 if a count is a power of 2.
 //
-unsigned int sharedMemoryGetSegmentSize ( sharedMemory_t* sharedMemory )
+static int powerOfTwo ( unsigned long count )
 {
-	return sharedMemory->totalSharedMemorySize;
+	return count != 0 && ( count & ( count - 1 ) ) == 0;
 }
 
 
 //
-// Return the number of message buffers in the shared memory segment from the
-// shared memory segment.
+// Check every optional region of a segment.  The counts in each region
+// header are bounded by the space the region has before they are used to
+// compute its size so the computation can't overflow, and the region must
+// fit in the segment.  The tables that are indexed by message ID must cover
+// the whole pool.  The regions that keep their layout when a checkpoint is
+// restored check the rest of their layout themselves.
 //
-unsigned int sharedMemoryGetPoolSize ( sharedMemory_t* sharedMemory )
+// This function will return 0 if every region is valid and -1 if one is not.
+//
+static int validateRegions ( sharedMemory_t* sharedMemory )
 {
-	return sharedMemory->totalMessageCount;
+	unsigned int  messageCount = sharedMemory->totalMessageCount;
+	unsigned long space;
+	const char*   region = 0;
+
+	if ( sharedMemory->journalOffset != 0 )
+	{
+		journal_t* journal = SHARED_MEMORY_REGION ( sharedMemory,
+													sharedMemory->journalOffset );
+
+		space = regionSpace ( sharedMemory, sharedMemory->journalOffset,
+							  sizeof(journal_t) );
+		if ( space == 0 ||
+			 ! powerOfTwo ( journal->chunkCount ) ||
+			 ! powerOfTwo ( journal->chunkRecords ) ||
+			 journal->chunkCount > space / sizeof(journalRecord_t) ||
+			 journal->chunkRecords > space / sizeof(journalRecord_t) ||
+			 journalRegionSize ( journal->chunkCount,
+								 journal->chunkRecords ) > space )
+		{
+			region = "journal";
+		}
+	}
+	if ( region == 0 && sharedMemory->deliveryOffset != 0 )
+	{
+		deliveryTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+														sharedMemory->deliveryOffset );
+
+		space = regionSpace ( sharedMemory, sharedMemory->deliveryOffset,
+							  sizeof(deliveryTable_t) );
+		if ( space == 0 || table->maxConsumers == 0 ||
+			 table->maxConsumers > space / sizeof(deliveryConsumer_t) ||
+			 table->maxSubscriptions > space / sizeof(deliverySubscription_t) ||
+			 deliveryRegionSize ( table->maxConsumers,
+								  table->maxSubscriptions ) > space )
+		{
+			region = "delivery";
+		}
+	}
+	if ( region == 0 && sharedMemory->statsOffset != 0 )
+	{
+		statsTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+													 sharedMemory->statsOffset );
+
+		space = regionSpace ( sharedMemory, sharedMemory->statsOffset,
+							  sizeof(statsTable_t) );
+		if ( space == 0 || table->entryCount != messageCount ||
+			 ( table->fieldSize != 1 && table->fieldSize != 2 &&
+			   table->fieldSize != 4 && table->fieldSize != 8 ) ||
+			 table->fieldOffset + table->fieldSize > CAN_MAX_DLEN ||
+			 statsRegionSize ( table->entryCount ) > space )
+		{
+			region = "statistics";
+		}
+	}
+	if ( region == 0 && sharedMemory->notifyOffset != 0 )
+	{
+		notifyTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+													  sharedMemory->notifyOffset );
+
+		space = regionSpace ( sharedMemory, sharedMemory->notifyOffset,
+							  sizeof(notifyTable_t) );
+		if ( space == 0 || table->messageCount != messageCount ||
+			 table->maxSubscribers == 0 ||
+			 table->maxSubscribers > NOTIFY_MAX_SUBSCRIBERS ||
+			 notifyRegionSize ( table->messageCount ) > space )
+		{
+			region = "notification";
+		}
+	}
+	if ( region == 0 && sharedMemory->streamOffset != 0 )
+	{
+		streamRing_t* ring = SHARED_MEMORY_REGION ( sharedMemory,
+													sharedMemory->streamOffset );
+
+		space = regionSpace ( sharedMemory, sharedMemory->streamOffset,
+							  sizeof(streamRing_t) );
+		if ( space == 0 || ! powerOfTwo ( ring->capacity ) ||
+			 ring->capacity > space / sizeof(streamFrame_t) ||
+			 ring->maxConsumers == 0 ||
+			 ring->maxConsumers > STREAM_MAX_CONSUMERS ||
+			 ( ring->policy != STREAM_BLOCK && ring->policy != STREAM_DROP ) ||
+			 streamRegionSize ( ring->capacity ) > space )
+		{
+			region = "stream";
+		}
+	}
+	if ( region == 0 && sharedMemory->mirrorOffset != 0 )
+	{
+		mirrorMap_t* map = SHARED_MEMORY_REGION ( sharedMemory,
+												  sharedMemory->mirrorOffset );
+
+		space = regionSpace ( sharedMemory, sharedMemory->mirrorOffset,
+							  sizeof(mirrorMap_t) );
+		if ( space == 0 || map->messageCount != messageCount ||
+			 mirrorRegionSize ( map->messageCount ) > space )
+		{
+			region = "mirror";
+		}
+	}
+	if ( region == 0 && sharedMemory->groupOffset != 0 )
+	{
+		space = regionSpace ( sharedMemory, sharedMemory->groupOffset,
+							  sizeof(groupTable_t) );
+		if ( space == 0 ||
+			 groupValidate ( SHARED_MEMORY_REGION ( sharedMemory,
+													sharedMemory->groupOffset ),
+							 space, messageCount ) != 0 )
+		{
+			region = "group";
+		}
+	}
+	if ( region == 0 && sharedMemory->recorderOffset != 0 )
+	{
+		recorderTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+														sharedMemory->recorderOffset );
+
+		space = regionSpace ( sharedMemory, sharedMemory->recorderOffset,
+							  sizeof(recorderTable_t) );
+		if ( space == 0 || table->ringCount == 0 ||
+			 table->ringCount > space / sizeof(recorderRing_t) ||
+			 ! powerOfTwo ( table->ringSamples ) ||
+			 table->ringSamples > space / sizeof(recorderSample_t) ||
+			 table->ticksPerSecond == 0 ||
+			 recorderRegionSize ( table->ringCount, table->ringSamples ) > space )
+		{
+			region = "flight recorder";
+		}
+	}
+	if ( region == 0 && sharedMemory->derivedOffset != 0 )
+	{
+		space = regionSpace ( sharedMemory, sharedMemory->derivedOffset,
+							  sizeof(derivedTable_t) );
+		if ( space == 0 ||
+			 derivedValidate ( SHARED_MEMORY_REGION ( sharedMemory,
+													  sharedMemory->derivedOffset ),
+							   space, messageCount ) != 0 )
+		{
+			region = "derived signal";
+		}
+	}
+	if ( region == 0 && sharedMemory->rollupOffset != 0 )
+	{
+		space = regionSpace ( sharedMemory, sharedMemory->rollupOffset,
+							  sizeof(rollupTable_t) );
+		if ( space == 0 ||
+			 rollupValidate ( SHARED_MEMORY_REGION ( sharedMemory,
+													 sharedMemory->rollupOffset ),
+							  space, messageCount ) != 0 )
+		{
+			region = "rollup";
+		}
+	}
+	if ( region == 0 && sharedMemory->changeOffset != 0 )
+	{
+		changeTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+													  sharedMemory->changeOffset );
+
+		space = regionSpace ( sharedMemory, sharedMemory->changeOffset,
+							  sizeof(changeTable_t) );
+		if ( space == 0 || table->entryCount != messageCount ||
+			 changeRegionSize ( table->entryCount ) > space )
+		{
+			region = "change";
+		}
+	}
+	if ( region == 0 && sharedMemory->heatOffset != 0 )
+	{
+		heatTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+													sharedMemory->heatOffset );
+
+		space = regionSpace ( sharedMemory, sharedMemory->heatOffset,
+							  sizeof(heatTable_t) );
+		if ( space == 0 || table->messageCount != messageCount ||
+			 table->shardCount == 0 || table->shardCount > space / 64 ||
+			 heatRegionSize ( table->messageCount, table->shardCount ) > space )
+		{
+			region = "heat map";
+		}
+	}
+	if ( region == 0 && sharedMemory->placementOffset != 0 )
+	{
+		space = regionSpace ( sharedMemory, sharedMemory->placementOffset,
+							  sizeof(placementMap_t) );
+		if ( space == 0 ||
+			 placementValidate ( SHARED_MEMORY_REGION ( sharedMemory,
+														sharedMemory->placementOffset ),
+								 space, messageCount ) != 0 )
+		{
+			region = "placement map";
+		}
+	}
+	if ( region == 0 && sharedMemory->triggerOffset != 0 )
+	{
+		triggerTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+													   sharedMemory->triggerOffset );
+
+		space = regionSpace ( sharedMemory, sharedMemory->triggerOffset,
+							  sizeof(triggerTable_t) );
+		if ( space == 0 || table->messageCount != messageCount ||
+			 table->triggerCount == 0 ||
+			 table->triggerCount > TRIGGER_MAX_TRIGGERS ||
+			 ! powerOfTwo ( table->queueEvents ) ||
+			 table->queueEvents > space / sizeof(triggerEvent_t) ||
+			 triggerRegionSize ( table->triggerCount, table->messageCount,
+								 table->queueEvents ) > space )
+		{
+			region = "trigger";
+		}
+	}
+	if ( region != 0 )
+	{
+		printf ( "Shared memory segment has an invalid %s region.\n", region );
+		return -1;
+	}
+	return 0;
 }
 
 
 //
-//  I n s e r t M e s s a g e 
+// Validate the header of a shared memory segment (or a checkpoint image of a
+// shared memory segment) that has been mapped into memory, and the headers of
+// its optional regions.  The file size is the number of bytes that are
+// actually backing the mapping.
 //
-// Insert a new message into the message buffer.
+// This function will return 0 if the segment is valid and -1 if it is not.
 //
-// This function does not actually do anything to change the structure of the
-// data message pools.  It will use the ID field in the incoming message to
-// compute the index into the message pool for this message and then it will
-// copy the contents of the ID and data fields from the incoming message into
-// the message pool to simulate changing data in the pool (in case it effects
-// caching and such).  To assure us that this is all working, the flags field
-// in the CAN message will be incremented each time a message is copied into
-// the pool so we can get an idea of the distribution and assure ourselves
-// that the writing is actually happening.
+int sharedMemoryValidate ( sharedMemory_t* sharedMemory,
+						   unsigned long fileSize )
+{
+	if ( fileSize < sizeof(sharedMemory_t) )
+	{
+		printf ( "Shared memory segment is too small[%lu] to be valid.\n",
+				 fileSize );
+		return -1;
+	}
+	if ( sharedMemory->magic != SHARED_MEMORY_MAGIC )
+	{
+		printf ( "Shared memory segment has an invalid magic number[%#x].\n",
+				 sharedMemory->magic );
+		return -1;
+	}
+	if ( sharedMemory->version     != SHARED_MEMORY_VERSION  ||
+		 sharedMemory->headerSize  != sizeof(sharedMemory_t) ||
+		 sharedMemory->messageSize != sizeof(canMessage_t) )
+	{
+		printf ( "Shared memory segment layout mismatch - version %u[%u] "
+				 "header %u[%zu] message %u[%zu].\n",
+				 sharedMemory->version, SHARED_MEMORY_VERSION,
+				 sharedMemory->headerSize, sizeof(sharedMemory_t),
+				 sharedMemory->messageSize, sizeof(canMessage_t) );
+		return -1;
+	}
+	if ( sharedMemory->totalSharedMemorySize > fileSize ||
+		 sharedMemory->totalSharedMemorySize < sizeof(sharedMemory_t) +
+			(unsigned long)sharedMemory->totalMessageCount * sizeof(canMessage_t) )
+	{
+		printf ( "Shared memory segment size[%u] is inconsistent with the "
+				 "file size[%lu] and message count[%u].\n",
+				 sharedMemory->totalSharedMemorySize, fileSize,
+				 sharedMemory->totalMessageCount );
+		return -1;
+	}
+	return validateRegions ( sharedMemory );
+}
+
+
 //
-int insertMessage ( struct canMessage_t* newMessage )
+// Move the end of a checkpoint chunk back to the start of the record it
+// falls in, if it falls inside an array of records.
+//
+static unsigned long recordBoundary ( unsigned long end, unsigned long start,
+									  unsigned long size, unsigned long count )
 {
-    canMessageIndex_t newIndex = 0;
-	canMessage_t*     message = 0;
+	if ( end > start && end < start + size * count )
+	{
+		end = start + ( end - start ) / size * size;
+	}
+	return end;
+}
 
-	//
-	// Get the message ID to be used as the index into the array of messages
-	// in the message pool.
-	//
-	newIndex = newMessage->canMessage.can_id;
 
-	//
-	// Get the address of this message in the share memory pool.
-	//
-	message = &( sharedMemory->messagePoolBase[newIndex] );
+//
+// Return the size of the group table region or 0 if there isn't one.
+//
+static unsigned long checkpointGroupSize ( sharedMemory_t* sharedMemory )
+{
+	if ( sharedMemory->groupOffset == 0 )
+	{
+		return 0;
+	}
+	groupTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+												 sharedMemory->groupOffset );
 
-    //
-    // Acquire the lock on the shared memory segment.
-	//
-	// Note that this call will hang if someone else is currently using the
-	// shared memory segment.  It will return once the lock is acquired and it
-	// is safe to manipulate the share memory data.
-    //
-	sharedMemoryLock();
+	return groupRegionSize ( table->groupCount, table->memberCount );
+}
 
-	//
-	// Copy the message ID into the Id and data fields from the incoming
-	// message into the message pool entry.
-	//
-    message->canMessage.can_id = newMessage->canMessage.can_id;
 
-    //
-    // Give up the shared memory block lock.
-    //
-    sharedMemoryUnlock();
+//
+// Return the end of the checkpoint chunk that starts at an offset in the
+// segment.  A chunk is at most CHECKPOINT_CHUNK_SIZE bytes and never ends
+// inside a frame of the message pool or a hot slot of the placement map, so
+// every frame is copied with one acquisition of the lock.
+//
+// The sequence number of a group and its frames are in different parts of
+// the group table, so the whole table is copied as one chunk, which may be
+// larger than CHECKPOINT_CHUNK_SIZE.  Every group in the image is then the
+// complete commit that its sequence number says it is.
+//
+static unsigned long checkpointChunkEnd ( sharedMemory_t* sharedMemory,
+										  unsigned long offset )
+{
+	unsigned long segmentSize = sharedMemory->totalSharedMemorySize;
+	unsigned long end         = offset + CHECKPOINT_CHUNK_SIZE;
 
-    //
-    // Return the index of the incoming CAN message block to the caller.
-    //
-    return newIndex;
+	if ( end >= segmentSize )
+	{
+		return segmentSize;
+	}
+	end = recordBoundary ( end, offsetof ( sharedMemory_t, messagePoolBase ),
+						   sizeof(canMessage_t), sharedMemory->totalMessageCount );
+
+	if ( sharedMemory->placementOffset != 0 )
+	{
+		placementMap_t* map = SHARED_MEMORY_REGION ( sharedMemory,
+													 sharedMemory->placementOffset );
+
+		end = recordBoundary ( end, sharedMemory->placementOffset +
+									offsetof ( placementMap_t, slots ),
+							   sizeof(canMessage_t), map->slotCount );
+	}
+	unsigned long groupSize = checkpointGroupSize ( sharedMemory );
+
+	if ( groupSize != 0 && end > sharedMemory->groupOffset &&
+		 end < sharedMemory->groupOffset + groupSize )
+	{
+		end = offset < sharedMemory->groupOffset ? sharedMemory->groupOffset :
+			  sharedMemory->groupOffset + groupSize;
+	}
+	return end;
 }
 
 
 //
-//	f e t c h M e s s a g e 
+//	s h a r e d M e m o r y C h e c k p o i n t
 //
-// Retrieve a new message into the message buffer.
+// Write a consistent image of the shared memory segment to the specified
+// file.
 //
-// This function does not do anything to change the structure of the data
-// message pools, it is a read only function.  It will use the ID field in the
-// incoming message to compute the index into the message pool for this
-// message and then it will copy the contents of the message into the message
-// structure supplied by the caller.  To assure us that this is all working,
-// the flags field in the CAN message will be incremented each time a message
-// is copied out of the pool so we can get an idea of the distribution and
-// assure ourselves that the reading is actually happening.
+// The segment is copied in pieces of up to CHECKPOINT_CHUNK_SIZE bytes with
+// the shared memory lock held only while each piece is being copied into a
+// local buffer.  A piece never ends inside a frame (see checkpointChunkEnd)
+// and every writer holds the same lock while it updates a frame, so every
+// frame in the image is internally consistent but the writers are never held
+// off for longer than one chunk copy.  The disk I/O is all done without the
+// lock.
 //
-int fetchMessage ( struct canMessage_t* newMessage )
+// The image is written to a temporary file first and then renamed over the
+// requested file name so that a crash in the middle of a checkpoint will
+// never leave a partial image behind.
+//
+// This function will return 0 if the checkpoint was written and -1 if it was
+// not.
+//
+int sharedMemoryCheckpoint ( sharedMemory_t* sharedMemory,
+							 const char* fileName )
 {
-    canMessageIndex_t newIndex = 0;
-	canMessage_t*     message = 0;
+	char tempFileName[4096];
+	(void) snprintf ( tempFileName, sizeof(tempFileName), "%s.tmp", fileName );
 
+	int fd = open ( tempFileName, O_WRONLY|O_CREAT|O_TRUNC, 0666 );
+	if ( fd < 0 )
+	{
+		printf ( "Unable to open the checkpoint file[%s] errno: %u[%s].\n",
+				 tempFileName, errno, strerror(errno) );
+		return -1;
+	}
+	unsigned long bufferSize = checkpointGroupSize ( sharedMemory );
+	if ( bufferSize < CHECKPOINT_CHUNK_SIZE )
+	{
+		bufferSize = CHECKPOINT_CHUNK_SIZE;
+	}
+	char* buffer = malloc ( bufferSize );
+	if ( buffer == 0 )
+	{
+		printf ( "Unable to allocate the checkpoint buffer.\n" );
+		(void) close ( fd );
+		return -1;
+	}
 	//
-	// Get the message ID to be used as the index into the array of messages
-	// in the message pool.
+	// Copy the segment out one chunk at a time.  The header is included in
+	// the first chunk so the mutex in the image may appear to be locked.  The
+	// restore logic always initializes a new mutex so this doesn't matter.
 	//
-	newIndex = newMessage->canMessage.can_id;
+	unsigned long segmentSize = sharedMemory->totalSharedMemorySize;
+	unsigned long offset      = 0;
+	int           status      = 0;
 
-	//
-	// Get the address of this message in the share memory pool.
-	//
-	message = &( sharedMemory->messagePoolBase[newIndex] );
+	while ( offset < segmentSize && status == 0 )
+	{
+		unsigned long length = checkpointChunkEnd ( sharedMemory, offset ) - offset;
 
-    //
-    // Acquire the lock on the shared memory segment.
-	//
-	// Note that this call will hang if someone else is currently using the
-	// shared memory segment.  It will return once the lock is acquired and it
-	// is safe to manipulate the share memory data.
-    //
-	sharedMemoryLock();
+		pthread_mutex_lock ( &sharedMemory->lock );
+		(void) memcpy ( buffer, (char*)sharedMemory + offset, length );
+		pthread_mutex_unlock ( &sharedMemory->lock );
+
+		//
+		// Write this chunk out to the file.
+		//
+		unsigned long written = 0;
+		while ( written < length )
+		{
+			ssize_t count = write ( fd, buffer + written, length - written );
+			if ( count < 0 )
+			{
+				if ( errno == EINTR )
+				{
+					continue;
+				}
+				printf ( "Unable to write the checkpoint file[%s] errno: "
+						 "%u[%s].\n", tempFileName, errno, strerror(errno) );
+				status = -1;
+				break;
+			}
+			written += count;
+		}
+		offset += length;
+	}
+	free ( buffer );
 
 	//
-	// Copy the message ID and data fields from the message in the shared
-	// memory message pool into the user supplied message.
+	// Make sure the data is on the disk before we make it the current image.
 	//
-    newMessage->canMessage.can_id = message->canMessage.can_id;
+	if ( status == 0 && fsync ( fd ) != 0 )
+	{
+		printf ( "Unable to sync the checkpoint file[%s] errno: %u[%s].\n",
+				 tempFileName, errno, strerror(errno) );
+		status = -1;
+	}
+	(void) close ( fd );
 
-    //
-    // Give up the shared memory block lock.
-    //
-    sharedMemoryUnlock();
+	if ( status == 0 && rename ( tempFileName, fileName ) != 0 )
+	{
+		printf ( "Unable to rename the checkpoint file[%s] errno: %u[%s].\n",
+				 tempFileName, errno, strerror(errno) );
+		status = -1;
+	}
+	if ( status != 0 )
+	{
+		(void) unlink ( tempFileName );
+	}
+	return status;
+}
 
-    //
-    // Return the index of the incoming CAN message block to the caller.
-    //
-    return newIndex;
+
+//
+// Close the shared memory segment being used for this test.
+//
+// Note that this call will cause the data that has been modified in memory to
+// be synchronized to the disk file that stores the data persistently.
+//
+void sharedMemoryClose ( sharedMemory_t* sharedMemory )
+{
+	(void) munmap ( sharedMemory, sharedMemory->totalSharedMemorySize );
 }
 
 
 //
-// Acquire the shared memory lock.  This call will hang if the lock is
-// currently not available and return when the lock has been successfully
-// acquired.
+// Return the size of the shared memory segment from the shared memory segment.
 //
-void sharedMemoryLock ( void )
+unsigned int sharedMemoryGetSegmentSize ( sharedMemory_t* sharedMemory )
 {
-	pthread_mutex_lock ( &sharedMemory->lock );
+	return sharedMemory->totalSharedMemorySize;
 }
 
 
 //
-// Release the shared memory lock.  If another process or thread is waiting on
-// this lock, the scheduler will decide which will run so the order of
-// processes/threads may not be the same as the order in which they called the
-// lock function.
+// Return the number of message buffers in the shared memory segment from the
+// shared memory segment.
 //
-void sharedMemoryUnlock ( void )
+unsigned int sharedMemoryGetPoolSize ( sharedMemory_t* sharedMemory )
 {
-	pthread_mutex_unlock ( &sharedMemory->lock );
+	return sharedMemory->totalMessageCount;
+}
+
+
+//
+// Return the CAN bus number of the shared memory segment or
+// SHARED_MEMORY_NO_BUS if it is not a bus partition.
+//
+int sharedMemoryGetBusId ( sharedMemory_t* sharedMemory )
+{
+	return sharedMemory->busId;
+}
+
+
+//
+// Return the address of the journal in the shared memory segment or 0 if the
+// segment was created without one.
+//
+journal_t* sharedMemoryGetJournal ( sharedMemory_t* sharedMemory )
+{
+	if ( sharedMemory->journalOffset == 0 )
+	{
+		return 0;
+	}
+	return SHARED_MEMORY_REGION ( sharedMemory, sharedMemory->journalOffset );
+}
+
+
+//
+// Return the address of the delivery table in the shared memory segment or 0
+// if the segment was created without one.
+//
+deliveryTable_t* sharedMemoryGetDeliveryTable ( sharedMemory_t* sharedMemory )
+{
+	if ( sharedMemory->deliveryOffset == 0 )
+	{
+		return 0;
+	}
+	return SHARED_MEMORY_REGION ( sharedMemory, sharedMemory->deliveryOffset );
+}
+
+
+//
+// Return the address of the statistics table in the shared memory segment or
+// 0 if the segment was created without one.
+//
+statsTable_t* sharedMemoryGetStatsTable ( sharedMemory_t* sharedMemory )
+{
+	if ( sharedMemory->statsOffset == 0 )
+	{
+		return 0;
+	}
+	return SHARED_MEMORY_REGION ( sharedMemory, sharedMemory->statsOffset );
+}
+
+
+//
+// Return the address of the notification table in the shared memory segment
+// or 0 if the segment was created without one.
+//
+notifyTable_t* sharedMemoryGetNotifyTable ( sharedMemory_t* sharedMemory )
+{
+	if ( sharedMemory->notifyOffset == 0 )
+	{
+		return 0;
+	}
+	return SHARED_MEMORY_REGION ( sharedMemory, sharedMemory->notifyOffset );
+}
+
+
+//
+// Return the address of the stream ring in the shared memory segment or 0 if
+// the segment was created without one.
+//
+streamRing_t* sharedMemoryGetStreamRing ( sharedMemory_t* sharedMemory )
+{
+	if ( sharedMemory->streamOffset == 0 )
+	{
+		return 0;
+	}
+	return SHARED_MEMORY_REGION ( sharedMemory, sharedMemory->streamOffset );
+}
+
+
+//
+// Return the address of the mirror map in the shared memory segment or 0 if
+// the segment was created without one.
+//
+mirrorMap_t* sharedMemoryGetMirrorMap ( sharedMemory_t* sharedMemory )
+{
+	if ( sharedMemory->mirrorOffset == 0 )
+	{
+		return 0;
+	}
+	return SHARED_MEMORY_REGION ( sharedMemory, sharedMemory->mirrorOffset );
+}
+
+
+//
+// Return the address of the group table in the shared memory segment or 0 if
+// the segment was created without one.
+//
+groupTable_t* sharedMemoryGetGroupTable ( sharedMemory_t* sharedMemory )
+{
+	if ( sharedMemory->groupOffset == 0 )
+	{
+		return 0;
+	}
+	return SHARED_MEMORY_REGION ( sharedMemory, sharedMemory->groupOffset );
+}
+
+
+//
+// Return the address of the flight recorder in the shared memory segment or
+// 0 if the segment was created without one.
+//
+recorderTable_t* sharedMemoryGetRecorder ( sharedMemory_t* sharedMemory )
+{
+	if ( sharedMemory->recorderOffset == 0 )
+	{
+		return 0;
+	}
+	return SHARED_MEMORY_REGION ( sharedMemory, sharedMemory->recorderOffset );
+}
+
+
+//
+// Return the address of the derived signal table in the shared memory
+// segment or 0 if the segment was created without one.
+//
+derivedTable_t* sharedMemoryGetDerivedTable ( sharedMemory_t* sharedMemory )
+{
+	if ( sharedMemory->derivedOffset == 0 )
+	{
+		return 0;
+	}
+	return SHARED_MEMORY_REGION ( sharedMemory, sharedMemory->derivedOffset );
+}
+
+
+//
+// Return the address of the rollup table in the shared memory segment or 0
+// if the segment was created without one.
+//
+rollupTable_t* sharedMemoryGetRollupTable ( sharedMemory_t* sharedMemory )
+{
+	if ( sharedMemory->rollupOffset == 0 )
+	{
+		return 0;
+	}
+	return SHARED_MEMORY_REGION ( sharedMemory, sharedMemory->rollupOffset );
+}
+
+
+//
+// Return the address of the change table in the shared memory segment or 0
+// if the segment was created without one.
+//
+changeTable_t* sharedMemoryGetChangeTable ( sharedMemory_t* sharedMemory )
+{
+	if ( sharedMemory->changeOffset == 0 )
+	{
+		return 0;
+	}
+	return SHARED_MEMORY_REGION ( sharedMemory, sharedMemory->changeOffset );
+}
+
+
+//
+// Return the address of the heat map in the shared memory segment or 0 if
+// the segment was created without one.
+//
+heatTable_t* sharedMemoryGetHeatMap ( sharedMemory_t* sharedMemory )
+{
+	if ( sharedMemory->heatOffset == 0 )
+	{
+		return 0;
+	}
+	return SHARED_MEMORY_REGION ( sharedMemory, sharedMemory->heatOffset );
+}
+
+
+//
+// Return the address of the placement map in the shared memory segment or 0
+// if the segment was created without one.
+//
+placementMap_t* sharedMemoryGetPlacementMap ( sharedMemory_t* sharedMemory )
+{
+	if ( sharedMemory->placementOffset == 0 )
+	{
+		return 0;
+	}
+	return SHARED_MEMORY_REGION ( sharedMemory, sharedMemory->placementOffset );
+}
+
+
+//
+// Return the address of the trigger table in the shared memory segment or 0
+// if the segment was created without one.
+//
+triggerTable_t* sharedMemoryGetTriggerTable ( sharedMemory_t* sharedMemory )
+{
+	if ( sharedMemory->triggerOffset == 0 )
+	{
+		return 0;
+	}
+	return SHARED_MEMORY_REGION ( sharedMemory, sharedMemory->triggerOffset );
+}
+
+
+//
+// Return the slot that holds a message ID: its hot slot if the placement map
+// has moved it there or else its home slot in the message pool.  A writer
+// must hold the shared memory lock.  A reader without the lock must look the
+// ID up again every time it retries a copy and check the ID of the frame it
+// copied.
+//
+canMessage_t* sharedMemorySlot ( sharedMemory_t* sharedMemory,
+								 canMessageIndex_t index )
+{
+	if ( sharedMemory->placementOffset != 0 )
+	{
+		canMessage_t* hot = placementFind ( SHARED_MEMORY_REGION ( sharedMemory,
+																	sharedMemory->placementOffset ),
+											index );
+		if ( hot != 0 )
+		{
+			return hot;
+		}
+	}
+	return &sharedMemory->messagePoolBase[index];
+}
+
+
+//
+// If the flight recorder is configured, decide whether the operation that is
+// starting is to be timed (see recorderBegin) and if it is, store the time
+// stamp counter at its start in the caller's variable.
+//
+static unsigned int recordStart ( sharedMemory_t* sharedMemory,
+								  unsigned long* start )
+{
+	if ( sharedMemory->recorderOffset == 0 )
+	{
+		return RECORDER_OFF;
+	}
+	unsigned int recording = recorderBegin ( SHARED_MEMORY_REGION ( sharedMemory,
+																	sharedMemory->recorderOffset ) );
+	if ( recording != RECORDER_OFF )
+	{
+		*start = recorderNow();
+	}
+	return recording;
+}
+
+
+//
+// Acquire the shared memory lock for an operation and, if it is being timed,
+// return the time stamp counter when the lock was acquired.  The lock is
+// tried first so an uncontended lock costs no second read of the counter.
+//
+static unsigned long recordLock ( sharedMemory_t* sharedMemory,
+								  unsigned int recording, unsigned long start )
+{
+	if ( recording == RECORDER_OFF )
+	{
+		sharedMemoryLock ( sharedMemory );
+		return 0;
+	}
+	if ( pthread_mutex_trylock ( &sharedMemory->lock ) == 0 )
+	{
+		return start;
+	}
+	sharedMemoryLock ( sharedMemory );
+
+	return recorderNow();
+}
+
+
+//
+// Record an operation that recordStart said was to be timed.
+//
+static void recordEnd ( sharedMemory_t* sharedMemory, unsigned int recording,
+						unsigned int op, canMessageIndex_t id,
+						unsigned long start, unsigned long locked )
+{
+	recorderEnd ( SHARED_MEMORY_REGION ( sharedMemory, sharedMemory->recorderOffset ),
+				  recording, op, id, start, locked );
+}
+
+
+//
+// Take the shared memory lock once the stream ring has room for the "count"
+// frames about to be inserted.  The writer waits for the room before it
+// takes the lock (see streamWaitForSpace).  If another writer took the room
+// first, the lock is released and the writer waits again, so a writer never
+// waits for a consumer with the lock held.
+//
+// This function returns the time the lock was taken as recordLock does.
+//
+static unsigned long lockForStream ( sharedMemory_t* sharedMemory,
+									 unsigned long count, unsigned int recording,
+									 unsigned long start )
+{
+	if ( sharedMemory->streamOffset == 0 )
+	{
+		return recordLock ( sharedMemory, recording, start );
+	}
+	streamRing_t* ring = SHARED_MEMORY_REGION ( sharedMemory,
+												sharedMemory->streamOffset );
+	while ( 1 )
+	{
+		streamWaitForSpace ( ring, count );
+
+		unsigned long locked = recordLock ( sharedMemory, recording, start );
+
+		if ( streamReserve ( ring, count ) )
+		{
+			return locked;
+		}
+		sharedMemoryUnlock ( sharedMemory );
+	}
+}
+
+
+//
+// Copy a new message into its entry in the message pool and publish it to
+// the stream ring.  This must be called with the shared memory lock held.
+// "now" is the arrival time for the statistics table, if there is one.
+//
+static void updateMessage ( sharedMemory_t* sharedMemory,
+							struct canMessage_t* newMessage,
+							unsigned long now )
+{
+	//
+	// Get the address of this message in the share memory pool using the
+	// message ID as the index into the array of messages (or its hot slot if
+	// it has been placed in one).
+	//
+	canMessage_t* message = sharedMemorySlot ( sharedMemory,
+											   newMessage->canMessage.can_id );
+
+	//
+	// If the trigger table is configured, check the triggers of this message
+	// against the frame it replaces.
+	//
+	if ( sharedMemory->triggerOffset != 0 )
+	{
+		triggerEvaluate ( SHARED_MEMORY_REGION ( sharedMemory,
+												 sharedMemory->triggerOffset ),
+						  message, newMessage, now );
+	}
+
+	//
+	// Copy the message ID, length and data fields from the incoming message
+	// into the message pool entry.  The sequence number is bumped before and
+	// after the copy so lock free readers can tell if they saw a partial
+	// update.
+	//
+	__atomic_store_n ( &message->sequence, message->sequence + 1,
+					   __ATOMIC_RELAXED );
+	__atomic_thread_fence ( __ATOMIC_RELEASE );
+
+    message->canMessage.can_id  = newMessage->canMessage.can_id;
+    message->canMessage.can_dlc = newMessage->canMessage.can_dlc;
+    (void) memcpy ( message->canMessage.data, newMessage->canMessage.data,
+					CAN_MAX_DLEN );
+
+	//
+	// If the statistics table is configured, update the statistics of this
+	// message while its sequence number still shows an update in progress.
+	//
+	if ( sharedMemory->statsOffset != 0 )
+	{
+		statsUpdate ( SHARED_MEMORY_REGION ( sharedMemory,
+											 sharedMemory->statsOffset ),
+					  newMessage, now );
+	}
+
+	__atomic_store_n ( &message->sequence, message->sequence + 1,
+					   __ATOMIC_RELEASE );
+
+	//
+	// If the stream ring is configured, publish this frame to its consumers.
+	// This is done while we hold the lock so that the ring only ever has one
+	// producer and the frames in it are in the same order as the updates.
+	//
+	if ( sharedMemory->streamOffset != 0 )
+	{
+		streamPublishMessage ( SHARED_MEMORY_REGION ( sharedMemory,
+													  sharedMemory->streamOffset ),
+							   newMessage );
+	}
+}
+
+
+//
+// Pass an update of the message pool on to the journal, the mirror and the
+// subscribers.  This doesn't need the shared memory lock.
+//
+static void publishMessage ( sharedMemory_t* sharedMemory,
+							 struct canMessage_t* newMessage )
+{
+	//
+	// If the trigger table is configured, wake the consumers that the update
+	// posted events to.
+	//
+	if ( sharedMemory->triggerOffset != 0 )
+	{
+		triggerWake ( SHARED_MEMORY_REGION ( sharedMemory,
+											 sharedMemory->triggerOffset ) );
+	}
+	//
+	// If the journal is configured, append a copy of this message to it.
+	// This doesn't need the shared memory lock since the journal record is
+	// reserved atomically.
+	//
+	if ( sharedMemory->journalOffset != 0 )
+	{
+		journalAppend ( SHARED_MEMORY_REGION ( sharedMemory,
+											   sharedMemory->journalOffset ),
+						newMessage );
+	}
+	//
+	// If the mirror map is configured, mark this message as changed so the
+	// mirror sends it at its next flush.
+	//
+	if ( sharedMemory->mirrorOffset != 0 )
+	{
+		mirrorMarkDirty ( SHARED_MEMORY_REGION ( sharedMemory,
+												 sharedMemory->mirrorOffset ),
+						  newMessage->canMessage.can_id );
+	}
+	//
+	// If the notification table is configured, wake up the subscribers that
+	// are interested in this message.
+	//
+	if ( sharedMemory->notifyOffset != 0 )
+	{
+		notifyTable_t*    table = SHARED_MEMORY_REGION ( sharedMemory,
+														 sharedMemory->notifyOffset );
+		canMessageIndex_t index = newMessage->canMessage.can_id;
+
+		if ( index < table->messageCount )
+		{
+			unsigned long mask = __atomic_load_n ( &table->interest[index],
+												   __ATOMIC_RELAXED );
+			if ( mask != 0 )
+			{
+				notifySignal ( table, mask );
+			}
+		}
+	}
+}
+
+
+//
+// Do the work that follows an update of the message pool and doesn't need
+// the shared memory lock.
+//
+static void completeMessage ( sharedMemory_t* sharedMemory,
+							  struct canMessage_t* newMessage )
+{
+	publishMessage ( sharedMemory, newMessage );
+
+	//
+	// If the derived signal table is configured, mark the signals that use
+	// this message as dirty.
+	//
+	if ( sharedMemory->derivedOffset != 0 )
+	{
+		derivedMarkDependents ( SHARED_MEMORY_REGION ( sharedMemory,
+													   sharedMemory->derivedOffset ),
+								newMessage->canMessage.can_id );
+	}
+}
+
+
+//
+// Compute a dirty derived signal, after any dirty signals that it uses, and
+// store it in the message pool.  This must be called with the shared memory
+// lock held.  The messages that were stored are added to the caller's array
+// so they can be published once the lock has been released.
+//
+// The signal is marked clean before its inputs are read so an insert of one
+// of them that finishes after this marks it dirty again.  The signals that
+// use it were marked dirty when it was, so they are not marked again when
+// the new value is published.
+//
+// An input that is dirtied again during the refresh may be computed more than
+// once, so the array can fill up.  A signal that doesn't fit is left dirty
+// and is computed by the next refresh.
+//
+static void computeDerived ( sharedMemory_t* sharedMemory,
+							 derivedTable_t* table, unsigned int signal,
+							 unsigned long now, canMessage_t* outputs,
+							 unsigned int* outputCount )
+{
+	derivedSignal_t*      entry  = &table->signals[signal];
+	const derivedInput_t* inputs = derivedInputs ( table, signal );
+
+	for ( unsigned int i = 0; i < entry->inputCount; i++ )
+	{
+		int used = derivedFindOutput ( table, inputs[i].id );
+
+		if ( used >= 0 && __atomic_load_n ( &table->signals[used].dirty,
+											__ATOMIC_ACQUIRE ) != 0 )
+		{
+			computeDerived ( sharedMemory, table, used, now, outputs,
+							 outputCount );
+		}
+	}
+	if ( *outputCount == DERIVED_MAX_SIGNALS )
+	{
+		return;
+	}
+	__atomic_store_n ( &entry->dirty, 0, __ATOMIC_SEQ_CST );
+
+	canMessage_t* output = &outputs[*outputCount];
+	if ( derivedEvaluate ( table, signal, sharedMemory, now, output ) == 0 )
+	{
+		updateMessage ( sharedMemory, output, now );
+		(*outputCount)++;
+	}
+}
+
+
+//
+//	s h a r e d M e m o r y R e f r e s h D e r i v e d
+//
+// Recompute a derived signal (see derived.h) if it is dirty.  Only one
+// process computes it; any other process that finds it dirty waits for the
+// shared memory lock and then finds it clean.
+//
+// This function returns the number of signals that were stored (the signal
+// and any dirty signals that it uses) or -1 if there is no such signal.
+//
+int sharedMemoryRefreshDerived ( sharedMemory_t* sharedMemory,
+								 unsigned int signal )
+{
+	if ( sharedMemory->derivedOffset == 0 )
+	{
+		return -1;
+	}
+	derivedTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+												   sharedMemory->derivedOffset );
+	if ( signal >= table->signalCount )
+	{
+		return -1;
+	}
+	if ( __atomic_load_n ( &table->signals[signal].dirty, __ATOMIC_ACQUIRE ) == 0 )
+	{
+		return 0;
+	}
+	canMessage_t outputs[DERIVED_MAX_SIGNALS];
+	unsigned int outputCount = 0;
+	unsigned long now        = statsNow();
+
+	//
+	// The signals that are computed are published to the stream ring, so
+	// room is made there for as many as the refresh can store.
+	//
+	(void) lockForStream ( sharedMemory, DERIVED_MAX_SIGNALS, RECORDER_OFF, 0 );
+
+	if ( __atomic_load_n ( &table->signals[signal].dirty, __ATOMIC_ACQUIRE ) != 0 )
+	{
+		computeDerived ( sharedMemory, table, signal, now, outputs, &outputCount );
+	}
+	sharedMemoryUnlock ( sharedMemory );
+
+	for ( unsigned int i = 0; i < outputCount; i++ )
+	{
+		publishMessage ( sharedMemory, &outputs[i] );
+	}
+	return outputCount;
+}
+
+
+//
+// If the derived signal table is configured and a message that is about to
+// be read is a dirty derived signal, recompute it first.
+//
+static void refreshDerived ( sharedMemory_t* sharedMemory,
+							 canMessageIndex_t index )
+{
+	int signal = derivedFindOutput ( SHARED_MEMORY_REGION ( sharedMemory,
+															sharedMemory->derivedOffset ),
+									 index );
+	if ( signal >= 0 )
+	{
+		(void) sharedMemoryRefreshDerived ( sharedMemory, signal );
+	}
+}
+
+
+//
+// If the heat map is configured, count an insert of a message ID.
+//
+static void countWrite ( sharedMemory_t* sharedMemory, canMessageIndex_t id )
+{
+	if ( sharedMemory->heatOffset != 0 )
+	{
+		heatCountWrite ( SHARED_MEMORY_REGION ( sharedMemory,
+												sharedMemory->heatOffset ), id );
+	}
+}
+
+
+//
+// If the heat map is configured, count a read of a message ID.
+//
+static void countRead ( sharedMemory_t* sharedMemory, canMessageIndex_t id )
+{
+	if ( sharedMemory->heatOffset != 0 )
+	{
+		heatCountRead ( SHARED_MEMORY_REGION ( sharedMemory,
+											   sharedMemory->heatOffset ), id );
+	}
+}
+
+
+//
+// Return the change table if change suppression is on or 0 if it is off or
+// the segment has no change table.
+//
+static changeTable_t* changeSuppression ( sharedMemory_t* sharedMemory )
+{
+	if ( sharedMemory->changeOffset == 0 )
+	{
+		return 0;
+	}
+	changeTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+												  sharedMemory->changeOffset );
+
+	return __atomic_load_n ( &table->enabled, __ATOMIC_RELAXED ) ? table : 0;
+}
+
+
+//
+// Insert part of a batch of messages with change suppression on.
+//
+// The leading frames that are the same as the frames in the pool are
+// dropped without the lock, as insertMessage does.  If that leaves any
+// frames, the rest are compared and stored in order while the lock is held
+// so a frame that repeats the one before it in the batch is compared with
+// that frame and not with what the pool held before the batch.
+//
+static void insertChanges ( sharedMemory_t* sharedMemory,
+							changeTable_t* changes,
+							struct canMessage_t* newMessages, int count )
+{
+	unsigned long now   = sharedMemory->statsOffset != 0 ? statsNow() :
+														   changeNow();
+	int           first = 0;
+
+	while ( first < count &&
+			changeUnchanged ( sharedMemorySlot ( sharedMemory,
+												 newMessages[first].canMessage.can_id ),
+							  &newMessages[first] ) )
+	{
+		changeSeen ( changes, newMessages[first].canMessage.can_id, 0, now );
+		first++;
+	}
+	if ( first == count )
+	{
+		return;
+	}
+	unsigned long stored[CHANGE_BATCH_FRAMES / 64] = { 0 };
+	unsigned long start     = 0;
+	unsigned int  recording = recordStart ( sharedMemory, &start );
+
+	unsigned long locked = lockForStream ( sharedMemory, count - first, recording,
+										   start );
+
+	for ( int i = first; i < count; i++ )
+	{
+		if ( ! changeUnchanged ( sharedMemorySlot ( sharedMemory,
+													newMessages[i].canMessage.can_id ),
+								 &newMessages[i] ) )
+		{
+			updateMessage ( sharedMemory, &newMessages[i], now );
+			stored[i / 64] |= 1UL << ( i % 64 );
+		}
+	}
+	sharedMemoryUnlock ( sharedMemory );
+
+	for ( int i = first; i < count; i++ )
+	{
+		int isStored = ( stored[i / 64] >> ( i % 64 ) ) & 1;
+
+		if ( isStored )
+		{
+			completeMessage ( sharedMemory, &newMessages[i] );
+		}
+		changeSeen ( changes, newMessages[i].canMessage.can_id, isStored, now );
+	}
+	if ( recording != RECORDER_OFF )
+	{
+		recordEnd ( sharedMemory, recording, RECORDER_OP_INSERT_BATCH,
+					newMessages[first].canMessage.can_id, start, locked );
+	}
+}
+
+
+//
+//  I n s e r t M e s s a g e 
+//
+// Insert a new message into the message buffer.
+//
+// This function does not actually do anything to change the structure of the
+// data message pools.  It will use the ID field in the incoming message to
+// compute the index into the message pool for this message and then it will
+// copy the contents of the ID and data fields from the incoming message into
+// the message pool to simulate changing data in the pool (in case it effects
+// caching and such).  To assure us that this is all working, the insert is
+// counted for its ID in the heat map, if there is one (see heat.h), so we
+// can get an idea of the distribution and assure ourselves that the writing
+// is actually happening.
+//
+int insertMessage ( sharedMemory_t* sharedMemory,
+					struct canMessage_t* newMessage )
+{
+	countWrite ( sharedMemory, newMessage->canMessage.can_id );
+
+	//
+	// If change suppression is on and the pool already holds this frame,
+	// just record its arrival.  Nothing in the pool is written so the lock
+	// isn't needed.
+	//
+	changeTable_t* changes = changeSuppression ( sharedMemory );
+
+	if ( changes != 0 )
+	{
+		canMessageIndex_t index = newMessage->canMessage.can_id;
+
+		if ( changeUnchanged ( sharedMemorySlot ( sharedMemory, index ),
+							   newMessage ) )
+		{
+			changeSeen ( changes, index, 0, changeNow() );
+			return index;
+		}
+	}
+	unsigned long start     = 0;
+	unsigned int  recording = recordStart ( sharedMemory, &start );
+
+	//
+	// If the statistics table is configured, get the arrival time of this
+	// message before we take the lock to keep the lock hold time down.
+	//
+	unsigned long now = 0;
+	if ( sharedMemory->statsOffset != 0 )
+	{
+		now = statsNow();
+	}
+
+    //
+    // Acquire the lock on the shared memory segment.
+	//
+	// Note that this call will hang if someone else is currently using the
+	// shared memory segment, or if the stream ring is full.  It will return
+	// once the lock is acquired and it is safe to manipulate the share memory
+	// data.
+    //
+	unsigned long locked = lockForStream ( sharedMemory, 1, recording, start );
+
+	updateMessage ( sharedMemory, newMessage, now );
+
+    //
+    // Give up the shared memory block lock.
+    //
+    sharedMemoryUnlock ( sharedMemory );
+
+	completeMessage ( sharedMemory, newMessage );
+
+	if ( changes != 0 )
+	{
+		changeSeen ( changes, newMessage->canMessage.can_id, 1,
+					 now != 0 ? now : changeNow() );
+	}
+	if ( recording != RECORDER_OFF )
+	{
+		recordEnd ( sharedMemory, recording, RECORDER_OP_INSERT,
+					newMessage->canMessage.can_id, start, locked );
+	}
+
+    //
+    // Return the index of the incoming CAN message block to the caller.
+    //
+    return newMessage->canMessage.can_id;
+}
+
+
+//
+//	i n s e r t M e s s a g e s
+//
+// Insert a batch of messages into the message buffer, in order, with a
+// single acquisition of the shared memory lock.  A writer that receives
+// several frames at once (from recvmmsg for instance) pays for the lock once
+// per batch instead of once per frame.  All of the messages in the batch get
+// the same arrival time in the statistics table.
+//
+// With change suppression on (see change.h), the batch is taken
+// CHANGE_BATCH_FRAMES frames at a time and the frames that wouldn't change
+// the pool are counted as inserted but not stored.
+//
+// This function returns the number of messages inserted.
+//
+int insertMessages ( sharedMemory_t* sharedMemory,
+					 struct canMessage_t* newMessages, int count )
+{
+	for ( int i = 0; i < count; i++ )
+	{
+		countWrite ( sharedMemory, newMessages[i].canMessage.can_id );
+	}
+	changeTable_t* changes = changeSuppression ( sharedMemory );
+
+	if ( changes != 0 )
+	{
+		for ( int i = 0; i < count; i += CHANGE_BATCH_FRAMES )
+		{
+			insertChanges ( sharedMemory, changes, &newMessages[i],
+							count - i < CHANGE_BATCH_FRAMES ?
+							count - i : CHANGE_BATCH_FRAMES );
+		}
+		return count;
+	}
+	unsigned long start     = 0;
+	unsigned int  recording = recordStart ( sharedMemory, &start );
+
+	unsigned long now = 0;
+	if ( sharedMemory->statsOffset != 0 )
+	{
+		now = statsNow();
+	}
+
+	unsigned long locked = lockForStream ( sharedMemory, count, recording,
+										   start );
+
+	for ( int i = 0; i < count; i++ )
+	{
+		updateMessage ( sharedMemory, &newMessages[i], now );
+	}
+	sharedMemoryUnlock ( sharedMemory );
+
+	for ( int i = 0; i < count; i++ )
+	{
+		completeMessage ( sharedMemory, &newMessages[i] );
+	}
+	if ( recording != RECORDER_OFF && count > 0 )
+	{
+		recordEnd ( sharedMemory, recording, RECORDER_OP_INSERT_BATCH,
+					newMessages[0].canMessage.can_id, start, locked );
+	}
+	return count;
+}
+
+
+//
+//	i n s e r t G r o u p
+//
+// Commit all of the frames of a signal group at once (see group.h).  The
+// frames must be given in the same order as the member IDs of the group.
+// They are inserted into the message pool and copied into the group table
+// with a single acquisition of the shared memory lock.  Writers of other IDs
+// are held off only for as long as a batch insert of the same size.
+//
+// This function returns the number of frames inserted or -1 if there is no
+// such group or the frames don't match its member IDs.
+//
+int insertGroup ( sharedMemory_t* sharedMemory, unsigned int group,
+				  struct canMessage_t* newMessages )
+{
+	if ( sharedMemory->groupOffset == 0 )
+	{
+		return -1;
+	}
+	groupTable_t*            table   = SHARED_MEMORY_REGION ( sharedMemory,
+															  sharedMemory->groupOffset );
+	unsigned int             count   = 0;
+	const canMessageIndex_t* members = groupMembers ( table, group, &count );
+
+	if ( members == 0 )
+	{
+		return -1;
+	}
+	for ( unsigned int i = 0; i < count; i++ )
+	{
+		if ( newMessages[i].canMessage.can_id != members[i] )
+		{
+			return -1;
+		}
+	}
+	for ( unsigned int i = 0; i < count; i++ )
+	{
+		countWrite ( sharedMemory, members[i] );
+	}
+	unsigned long start     = 0;
+	unsigned int  recording = recordStart ( sharedMemory, &start );
+
+	unsigned long now = 0;
+	if ( sharedMemory->statsOffset != 0 )
+	{
+		now = statsNow();
+	}
+
+	unsigned long locked = lockForStream ( sharedMemory, count, recording,
+										   start );
+
+	for ( unsigned int i = 0; i < count; i++ )
+	{
+		updateMessage ( sharedMemory, &newMessages[i], now );
+	}
+	groupWrite ( table, group, newMessages );
+
+	sharedMemoryUnlock ( sharedMemory );
+
+	//
+	// A group commit is always stored, even with change suppression on, so
+	// the group table and the pool stay the same.
+	//
+	changeTable_t* changes = changeSuppression ( sharedMemory );
+	unsigned long  seen    = changes != 0 && now == 0 ? changeNow() : now;
+
+	for ( unsigned int i = 0; i < count; i++ )
+	{
+		completeMessage ( sharedMemory, &newMessages[i] );
+		if ( changes != 0 )
+		{
+			changeSeen ( changes, members[i], 1, seen );
+		}
+	}
+	if ( recording != RECORDER_OFF )
+	{
+		recordEnd ( sharedMemory, recording, RECORDER_OP_GROUP, members[0],
+					start, locked );
+	}
+	return count;
+}
+
+
+//
+//	f e t c h G r o u p
+//
+// Read a consistent copy of the last commit of a signal group into the
+// caller's array, which must have room for GROUP_MAX_MEMBERS frames.  This
+// doesn't take the shared memory lock so it never holds off a writer.
+//
+// This function returns the number of frames copied or -1 if there is no
+// such group.
+//
+int fetchGroup ( sharedMemory_t* sharedMemory, unsigned int group,
+				 struct canMessage_t* messages )
+{
+	if ( sharedMemory->groupOffset == 0 )
+	{
+		return -1;
+	}
+	groupTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+												 sharedMemory->groupOffset );
+	if ( group >= table->groupCount )
+	{
+		return -1;
+	}
+	int count = groupRead ( table, group, messages );
+
+	for ( int i = 0; i < count; i++ )
+	{
+		countRead ( sharedMemory, messages[i].canMessage.can_id );
+	}
+	return count;
+}
+
+
+//
+//	f e t c h M e s s a g e 
+//
+// Retrieve a new message into the message buffer.
+//
+// This function does not do anything to change the structure of the data
+// message pools, it is a read only function.  It will use the ID field in the
+// incoming message to compute the index into the message pool for this
+// message and then it will copy the contents of the message into the message
+// structure supplied by the caller.  To assure us that this is all working,
+// the read is counted for its ID in the heat map, if there is one, so we can
+// get an idea of the distribution and assure ourselves that the reading is
+// actually happening.
+//
+int fetchMessage ( sharedMemory_t* sharedMemory,
+				   struct canMessage_t* newMessage )
+{
+    canMessageIndex_t newIndex = 0;
+	canMessage_t*     message = 0;
+
+	//
+	// Get the message ID to be used as the index into the array of messages
+	// in the message pool.
+	//
+	newIndex = newMessage->canMessage.can_id;
+
+	countRead ( sharedMemory, newIndex );
+
+	if ( sharedMemory->derivedOffset != 0 )
+	{
+		refreshDerived ( sharedMemory, newIndex );
+	}
+
+	unsigned long start     = 0;
+	unsigned int  recording = recordStart ( sharedMemory, &start );
+
+    //
+    // Acquire the lock on the shared memory segment.
+	//
+	// Note that this call will hang if someone else is currently using the
+	// shared memory segment.  It will return once the lock is acquired and it
+	// is safe to manipulate the share memory data.
+    //
+	unsigned long locked = recordLock ( sharedMemory, recording, start );
+
+	//
+	// Get the address of this message in the share memory pool.  This is
+	// done with the lock held so the message can't be moved in the meantime
+	// (see placement.h).
+	//
+	message = sharedMemorySlot ( sharedMemory, newIndex );
+
+	//
+	// Copy the message ID and data fields from the message in the shared
+	// memory message pool into the user supplied message.
+	//
+    newMessage->canMessage.can_id  = message->canMessage.can_id;
+    newMessage->canMessage.can_dlc = message->canMessage.can_dlc;
+    (void) memcpy ( newMessage->canMessage.data, message->canMessage.data,
+					CAN_MAX_DLEN );
+    newMessage->sequence = message->sequence;
+
+    //
+    // Give up the shared memory block lock.
+    //
+    sharedMemoryUnlock ( sharedMemory );
+
+	if ( recording != RECORDER_OFF )
+	{
+		recordEnd ( sharedMemory, recording, RECORDER_OP_FETCH, newIndex,
+					start, locked );
+	}
+
+    //
+    // Return the index of the incoming CAN message block to the caller.
+    //
+    return newIndex;
+}
+
+
+//
+// Read a consistent copy of a message from the message pool without taking
+// the shared memory lock.
+//
+// The message's sequence number is read before and after the copy.  If it is
+// odd (a writer is in the middle of an update) or it changed during the copy,
+// the copy is repeated.  The slot of the message is looked up again for each
+// try and the ID of the copy is checked, since the placement map may have
+// moved the message to another slot (see placement.h).  This function
+// returns the (even) sequence number of the copy.
+//
+// The lock is only taken if the message is a derived signal that has to be
+// recomputed.
+//
+unsigned int sharedMemoryReadMessage ( sharedMemory_t* sharedMemory,
+									   canMessageIndex_t index,
+									   canMessage_t* message )
+{
+	unsigned int before;
+
+	countRead ( sharedMemory, index );
+
+	if ( sharedMemory->derivedOffset != 0 )
+	{
+		refreshDerived ( sharedMemory, index );
+	}
+
+	while ( 1 )
+	{
+		canMessage_t* source = sharedMemorySlot ( sharedMemory, index );
+
+		before = __atomic_load_n ( &source->sequence, __ATOMIC_ACQUIRE );
+		if ( ( before & 1 ) == 0 )
+		{
+			message->canMessage.can_id  = source->canMessage.can_id;
+			message->canMessage.can_dlc = source->canMessage.can_dlc;
+			(void) memcpy ( message->canMessage.data, source->canMessage.data,
+							CAN_MAX_DLEN );
+			__atomic_thread_fence ( __ATOMIC_ACQUIRE );
+			if ( __atomic_load_n ( &source->sequence, __ATOMIC_RELAXED ) == before &&
+				 message->canMessage.can_id == index )
+			{
+				break;
+			}
+		}
+		SHARED_MEMORY_CPU_RELAX();
+	}
+	message->sequence = before;
+
+	return before;
+}
+
+
+//
+// Compare two message IDs for qsort and bsearch.
+//
+static int compareIds ( const void* a, const void* b )
+{
+	canMessageIndex_t left  = *(const canMessageIndex_t*)a;
+	canMessageIndex_t right = *(const canMessageIndex_t*)b;
+
+	return left < right ? -1 : left > right;
+}
+
+
+//
+//	s h a r e d M e m o r y P l a c e
+//
+// Change the placement map (see placement.h) so the hot slots hold the given
+// message IDs.  The IDs should be given busiest first (as placementSelect
+// returns them) since they are promoted in that order and so the busiest
+// IDs share the first cache lines of the hot slots.  IDs beyond the number
+// of hot slots are ignored.
+//
+// The IDs that are in hot slots and aren't in the list are demoted first to
+// make room.  The shared memory lock is released and taken again after every
+// PLACEMENT_BATCH_MOVES moves so the writers are never held off for long.
+// The readers are never held off at all.
+//
+// This function returns the number of IDs that were moved or -1 if the
+// segment has no placement map.
+//
+int sharedMemoryPlace ( sharedMemory_t* sharedMemory,
+						const canMessageIndex_t* ids, unsigned int count )
+{
+	if ( sharedMemory->placementOffset == 0 )
+	{
+		return -1;
+	}
+	placementMap_t* map  = SHARED_MEMORY_REGION ( sharedMemory,
+												  sharedMemory->placementOffset );
+	canMessage_t*   pool = sharedMemory->messagePoolBase;
+
+	if ( count > map->slotCount )
+	{
+		count = map->slotCount;
+	}
+	canMessageIndex_t* wanted = malloc ( ( count + 1 ) * sizeof(canMessageIndex_t) );
+	if ( wanted == 0 )
+	{
+		printf ( "Unable to allocate the list of %'u placed IDs.\n", count );
+		return -1;
+	}
+	(void) memcpy ( wanted, ids, count * sizeof(canMessageIndex_t) );
+	qsort ( wanted, count, sizeof(canMessageIndex_t), compareIds );
+
+	int          moves = 0;
+	unsigned int batch = 0;
+
+	sharedMemoryLock ( sharedMemory );
+
+	if ( __atomic_load_n ( &map->repair, __ATOMIC_ACQUIRE ) != 0 )
+	{
+		placementRepair ( map, pool );
+		map->repair = 0;
+	}
+	for ( unsigned int slot = 0; slot < map->slotCount; slot++ )
+	{
+		canMessageIndex_t id = map->slots[slot].canMessage.can_id;
+
+		if ( id == PLACEMENT_FREE_SLOT ||
+			 bsearch ( &id, wanted, count, sizeof(canMessageIndex_t),
+					   compareIds ) != 0 )
+		{
+			continue;
+		}
+		placementDemote ( map, pool, id );
+		moves++;
+		if ( ++batch == PLACEMENT_BATCH_MOVES )
+		{
+			sharedMemoryUnlock ( sharedMemory );
+			sharedMemoryLock ( sharedMemory );
+			batch = 0;
+		}
+	}
+	for ( unsigned int i = 0; i < count; i++ )
+	{
+		if ( ids[i] >= sharedMemory->totalMessageCount ||
+			 placementPromote ( map, pool, ids[i] ) != 0 )
+		{
+			continue;
+		}
+		moves++;
+		if ( ++batch == PLACEMENT_BATCH_MOVES )
+		{
+			sharedMemoryUnlock ( sharedMemory );
+			sharedMemoryLock ( sharedMemory );
+			batch = 0;
+		}
+	}
+	map->passes++;
+
+	sharedMemoryUnlock ( sharedMemory );
+	free ( wanted );
+
+	return moves;
+}
+
+
+//
+// Return the address where a message is stored at the moment, for the tools
+// that study the layout of the pool.  The message may be moved at any time
+// so the address must not be used to read it.
+//
+const void* sharedMemoryMessageAddress ( sharedMemory_t* sharedMemory,
+										 canMessageIndex_t index )
+{
+	return sharedMemorySlot ( sharedMemory, index );
+}
+
+
+//
+// Check a message that changed while it was scanned.  It is read as by
+// sharedMemoryReadMessage, following it to its hot slot if it has one, but
+// it isn't counted in the heat map.
+//
+static int rescanMessage ( sharedMemory_t* sharedMemory,
+						   const scanProgram_t* program,
+						   canMessageIndex_t index )
+{
+	canMessage_t message;
+
+	while ( 1 )
+	{
+		canMessage_t* source = sharedMemorySlot ( sharedMemory, index );
+		unsigned int  before = __atomic_load_n ( &source->sequence, __ATOMIC_ACQUIRE );
+
+		if ( ( before & 1 ) == 0 )
+		{
+			message.canMessage.can_id  = source->canMessage.can_id;
+			message.canMessage.can_dlc = source->canMessage.can_dlc;
+			(void) memcpy ( message.canMessage.data, source->canMessage.data,
+							CAN_MAX_DLEN );
+			__atomic_thread_fence ( __ATOMIC_ACQUIRE );
+			if ( __atomic_load_n ( &source->sequence, __ATOMIC_RELAXED ) == before &&
+				 message.canMessage.can_id == index )
+			{
+				break;
+			}
+		}
+		SHARED_MEMORY_CPU_RELAX();
+	}
+	return scanMatch ( program, &message );
+}
+
+
+//
+// Scan the whole pool 64 messages at a time and store the bits of the
+// messages that match in the bitmap and their IDs in the ID list, either of
+// which may be 0.
+//
+static long scanPool ( sharedMemory_t* sharedMemory,
+					   const scanProgram_t* program, unsigned long* bitmap,
+					   canMessageIndex_t* ids, long maxIds )
+{
+	canMessageIndex_t messageCount = sharedMemory->totalMessageCount;
+	long              matches      = 0;
+
+	//
+	// Bring the derived signals up to date first, as reading them would.
+	//
+	if ( sharedMemory->derivedOffset != 0 )
+	{
+		derivedTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+													   sharedMemory->derivedOffset );
+
+		for ( unsigned int signal = 0; signal < table->signalCount; signal++ )
+		{
+			(void) sharedMemoryRefreshDerived ( sharedMemory, signal );
+		}
+	}
+	for ( canMessageIndex_t first = 0; first < messageCount; first += 64 )
+	{
+		unsigned int  count   = messageCount - first < 64 ? messageCount - first : 64;
+		unsigned long changed;
+		unsigned long match   = scanBlock ( program,
+											&sharedMemory->messagePoolBase[first],
+											count, &changed );
+		while ( changed != 0 )
+		{
+			unsigned int bit = __builtin_ctzl ( changed );
+
+			changed &= changed - 1;
+			if ( rescanMessage ( sharedMemory, program, first + bit ) )
+			{
+				match |= 1UL << bit;
+			}
+		}
+		if ( bitmap != 0 )
+		{
+			bitmap[first / 64] = match;
+		}
+		while ( match != 0 )
+		{
+			if ( matches < maxIds )
+			{
+				ids[matches] = first + __builtin_ctzl ( match );
+			}
+			match &= match - 1;
+			matches++;
+		}
+	}
+	return matches;
+}
+
+
+//
+//	s h a r e d M e m o r y S c a n
+//
+// Find the messages whose data matches a compiled predicate (see scan.h)
+// without taking the shared memory lock.  The bitmap must have a bit for
+// each message in the pool, ( sharedMemoryGetPoolSize + 63 ) / 64 words,
+// and the bit of each message that matches is set.
+//
+// This function returns the number of messages that match.
+//
+long sharedMemoryScan ( sharedMemory_t* sharedMemory,
+						const scanProgram_t* program, unsigned long* bitmap )
+{
+	return scanPool ( sharedMemory, program, bitmap, 0, 0 );
+}
+
+
+//
+// Find the messages whose data matches a compiled predicate, as for
+// sharedMemoryScan, and store the IDs of the first maxIds of them in
+// ascending order.
+//
+// This function returns the number of messages that match, which may be
+// more than maxIds.
+//
+long sharedMemoryScanIds ( sharedMemory_t* sharedMemory,
+						   const scanProgram_t* program,
+						   canMessageIndex_t* ids, long maxIds )
+{
+	return scanPool ( sharedMemory, program, 0, ids, maxIds );
+}
+
+
+//
+//	s h a r e d M e m o r y T r i g g e r A t t a c h
+//
+// Claim a consumer slot of the trigger table (see trigger.h) for the calling
+// process.  Its triggers are added with sharedMemoryTriggerAdd and its
+// events are taken with triggerWait and triggerNext.
+//
+// This function returns the consumer slot or -1 if the segment has no
+// trigger table or all of the slots are in use.
+//
+int sharedMemoryTriggerAttach ( sharedMemory_t* sharedMemory )
+{
+	triggerTable_t* table = sharedMemoryGetTriggerTable ( sharedMemory );
+
+	if ( table == 0 )
+	{
+		return -1;
+	}
+	sharedMemoryLock ( sharedMemory );
+	int consumer = triggerClaim ( table );
+	sharedMemoryUnlock ( sharedMemory );
+
+	return consumer;
+}
+
+
+//
+// Register a trigger for a consumer.  The triggers are only changed with the
+// shared memory lock held, so the writers always see a complete list.
+//
+// This function returns the number of the trigger or -1 if it is invalid or
+// the table is full.
+//
+int sharedMemoryTriggerAdd ( sharedMemory_t* sharedMemory, int consumer,
+							 const trigger_t* trigger )
+{
+	triggerTable_t* table = sharedMemoryGetTriggerTable ( sharedMemory );
+
+	if ( table == 0 || consumer < 0 )
+	{
+		return -1;
+	}
+	sharedMemoryLock ( sharedMemory );
+	int index = triggerAdd ( table, consumer, trigger );
+	sharedMemoryUnlock ( sharedMemory );
+
+	return index;
+}
+
+
+//
+// Remove a trigger of a consumer.
+//
+// This function returns 0 if the trigger was removed and -1 if the consumer
+// doesn't have it.
+//
+int sharedMemoryTriggerRemove ( sharedMemory_t* sharedMemory, int consumer,
+								int trigger )
+{
+	triggerTable_t* table = sharedMemoryGetTriggerTable ( sharedMemory );
+
+	if ( table == 0 || consumer < 0 || trigger < 0 )
+	{
+		return -1;
+	}
+	sharedMemoryLock ( sharedMemory );
+	int status = triggerRemove ( table, consumer, trigger );
+	sharedMemoryUnlock ( sharedMemory );
+
+	return status;
+}
+
+
+//
+// Remove the triggers of a consumer and give up its slot.
+//
+void sharedMemoryTriggerDetach ( sharedMemory_t* sharedMemory, int consumer )
+{
+	triggerTable_t* table = sharedMemoryGetTriggerTable ( sharedMemory );
+
+	if ( table == 0 || consumer < 0 || consumer >= TRIGGER_MAX_CONSUMERS )
+	{
+		return;
+	}
+	sharedMemoryLock ( sharedMemory );
+	if ( table->consumers[consumer].pid == getpid() )
+	{
+		triggerRelease ( table, consumer );
+	}
+	sharedMemoryUnlock ( sharedMemory );
+}
+
+
+//
+// Acquire the shared memory lock.  This call will hang if the lock is
+// currently not available and return when the lock has been successfully
+// acquired.
+//
+void sharedMemoryLock ( sharedMemory_t* sharedMemory )
+{
+	pthread_mutex_lock ( &sharedMemory->lock );
+}
+
+
+//
+// Release the shared memory lock.  If another process or thread is waiting on
+// this lock, the scheduler will decide which will run so the order of
+// processes/threads may not be the same as the order in which they called the
+// lock function.
+//
+void sharedMemoryUnlock ( sharedMemory_t* sharedMemory )
+{
+	pthread_mutex_unlock ( &sharedMemory->lock );
+}
+
+
+//
+// Parse a list of message IDs given on a command line.  The list is a comma
+// separated list of IDs and ID ranges (e.g. "0-99,200,0x300-0x30f").  The IDs
+// may be given in decimal or in hex with a "0x" prefix.
+//
+// This function returns the number of IDs stored in the caller's array or -1
+// if the list is invalid or contains more than maxIds IDs.
+//
+int parseMessageIdList ( const char* list, canMessageIndex_t* ids, int maxIds )
+{
+	int   count = 0;
+	char* next  = (char*)list;
+
+	while ( *next != 0 )
+	{
+		char*         end;
+		unsigned long first = strtoul ( next, &end, 0 );
+		unsigned long last  = first;
+
+		if ( end == next )
+		{
+			return -1;
+		}
+		if ( *end == '-' )
+		{
+			next = end + 1;
+			last = strtoul ( next, &end, 0 );
+			if ( end == next || last < first )
+			{
+				return -1;
+			}
+		}
+		for ( unsigned long id = first; id <= last; id++ )
+		{
+			if ( count == maxIds )
+			{
+				return -1;
+			}
+			ids[count++] = id;
+		}
+		if ( *end == ',' )
+		{
+			end++;
+		}
+		else if ( *end != 0 )
+		{
+			return -1;
+		}
+		next = end;
+	}
+	return count;
 }
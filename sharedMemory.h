@@ -2,93 +2,139 @@
 #ifndef SHARED_MEMORY_H
 #define SHARED_MEMORY_H
 
-#include "canMessage.h"
-
 //
-// Note: All references (and pointers) to data in the data message pool are
-// performed by using the index into the array of messages.  All of these
-// references need to be relocatable references so this will work in multiple
-// processes that have their shared memory segments mapped to different base
-// addresses.
+// The library is written in C.  C++ programs can include this header
+// directly or use the typed layer in sharedMemory.hpp.
 //
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "canMessage.h"
+#include "journal.h"
+#include "delivery.h"
+#include "stats.h"
+#include "notify.h"
+#include "stream.h"
+#include "mirror.h"
+#include "group.h"
+#include "recorder.h"
+#include "derived.h"
+#include "rollup.h"
+#include "change.h"
+#include "heat.h"
+#include "placement.h"
+#include "scan.h"
+#include "trigger.h"
 
 //
-// Define the shared memory segment that will be shared among multiple
-// processes.  This structure will be mapped into a shared memory segment for
-// all processes to use.
+// This is the interface to the shared memory library (libvsi).
 //
-typedef struct sharedMemory_t
-{
-	//
-	// Define the global constants and variables.
-	//
-	unsigned int totalMessageCount;
-	unsigned int totalSharedMemorySize;
-
-	//
-	// The free buffers (those not currently in use by a process) will be kept
-	// on a simple singly linked list.  Buffers are removed from the head of
-	// the list and added to the tail.
-	//
-	// [This feature is not implemented for this demo code.]
-	//
-	int               freeListCount;
-	canMessageIndex_t freeListHead;
-	canMessageIndex_t freeListTail;
-
-	//
-	// Define the global shared memory lock.
-	//
-    pthread_mutexattr_t mutexAttributes;
-	pthread_mutex_t     lock;
-
-	//
-	// Define the start of the array of CAN message records.  This array will
-	// be created with a specified size before anyone tries to read or write
-	// any of the records in it.
-	//
-	canMessage_t messagePoolBase[0];
-
-}   sharedMemory_t;
-
+// A process can open any number of shared memory segments at once.  Each
+// open segment is identified by an opaque sharedMemory_t handle that is
+// passed to every function that operates on the segment.  The layout of the
+// segment itself is private to the library (see sharedMemorySegment.h).
 //
-// Define the address of the global shared memory segment.  This value will be
-// filled in when the shared memory segment file is mapped into the virtual
-// memory space.
+// The library is built with link time optimization so when a program is
+// linked with the static library (and -flto), the insert and fetch functions
+// are inlined into the program's hot loops just as if they were defined in
+// this header.
 //
-static sharedMemory_t* sharedMemory;
+typedef struct sharedMemory_t sharedMemory_t;
 
 //
-// Define the name of the shared memory segment.
+// Define the name of the default shared memory segment.
 //
-static const char* sharedMemoryName = "/var/run/shm/CanSharedMemorySegment";
+#define SHARED_MEMORY_DEFAULT_NAME "/var/run/shm/CanSharedMemorySegment"
 
 //
-// Define the size of the shared memory segment.  Note that this is a
-// calculation that will be performed at runtime when the shared memory
-// segment is loaded.  The calculation is the size of the shared memory
-// structure plus the size of the CAN message pool (which is calculated
-// based on a runtime parameter that is supplied when the system starts).
+// Define the value used for the bus number of the original unpartitioned
+// segment and the largest number of bus partitions.  The segment for bus N is
+// named SHARED_MEMORY_DEFAULT_NAME with ".busN" appended.
 //
-static unsigned int sharedMemorySize;
+#define SHARED_MEMORY_NO_BUS    ( -1 )
+#define SHARED_MEMORY_MAX_BUSES 16
 
 //
 // Define the member functions.
 //
-sharedMemory_t* sharedMemoryOpen ( void );
-void            sharedMemoryClose ( sharedMemory_t* sharedMemory,
-									unsigned int sharedMemorySegmentSize );
+sharedMemory_t* sharedMemoryOpen ( const char* name );
+sharedMemory_t* sharedMemoryOpenBus ( int bus );
+void            sharedMemoryPartitionName ( int bus, char* name,
+											unsigned int nameSize );
+void            sharedMemoryClose ( sharedMemory_t* sharedMemory );
 unsigned int    sharedMemoryGetSegmentSize ( sharedMemory_t* sharedMemory );
 unsigned int    sharedMemoryGetPoolSize ( sharedMemory_t* sharedMemory );
+int             sharedMemoryGetBusId ( sharedMemory_t* sharedMemory );
+journal_t*      sharedMemoryGetJournal ( sharedMemory_t* sharedMemory );
+deliveryTable_t* sharedMemoryGetDeliveryTable ( sharedMemory_t* sharedMemory );
+statsTable_t*   sharedMemoryGetStatsTable ( sharedMemory_t* sharedMemory );
+notifyTable_t*  sharedMemoryGetNotifyTable ( sharedMemory_t* sharedMemory );
+streamRing_t*   sharedMemoryGetStreamRing ( sharedMemory_t* sharedMemory );
+mirrorMap_t*    sharedMemoryGetMirrorMap ( sharedMemory_t* sharedMemory );
+groupTable_t*   sharedMemoryGetGroupTable ( sharedMemory_t* sharedMemory );
+recorderTable_t* sharedMemoryGetRecorder ( sharedMemory_t* sharedMemory );
+derivedTable_t* sharedMemoryGetDerivedTable ( sharedMemory_t* sharedMemory );
+rollupTable_t*  sharedMemoryGetRollupTable ( sharedMemory_t* sharedMemory );
+changeTable_t*  sharedMemoryGetChangeTable ( sharedMemory_t* sharedMemory );
+heatTable_t*    sharedMemoryGetHeatMap ( sharedMemory_t* sharedMemory );
+placementMap_t* sharedMemoryGetPlacementMap ( sharedMemory_t* sharedMemory );
+triggerTable_t* sharedMemoryGetTriggerTable ( sharedMemory_t* sharedMemory );
 
-void            sharedMemoryLock ( void );
-void            sharedMemoryUnlock ( void );
+int             sharedMemoryValidate ( sharedMemory_t* sharedMemory,
+									   unsigned long fileSize );
+int             sharedMemoryCheckpoint ( sharedMemory_t* sharedMemory,
+										 const char* fileName );
+
+void            sharedMemoryLock ( sharedMemory_t* sharedMemory );
+void            sharedMemoryUnlock ( sharedMemory_t* sharedMemory );
 
 //
 // Message manipulation functions.
 //
-int insertMessage ( struct canMessage_t* message );
-int fetchMessage  ( struct canMessage_t* message );
+int insertMessage ( sharedMemory_t* sharedMemory,
+					struct canMessage_t* message );
+int insertMessages ( sharedMemory_t* sharedMemory,
+					 struct canMessage_t* messages, int count );
+int fetchMessage  ( sharedMemory_t* sharedMemory,
+					struct canMessage_t* message );
+
+int insertGroup ( sharedMemory_t* sharedMemory, unsigned int group,
+				  struct canMessage_t* messages );
+int fetchGroup  ( sharedMemory_t* sharedMemory, unsigned int group,
+				  struct canMessage_t* messages );
+
+unsigned int sharedMemoryReadMessage ( sharedMemory_t* sharedMemory,
+									   canMessageIndex_t index,
+									   canMessage_t* message );
+
+int sharedMemoryRefreshDerived ( sharedMemory_t* sharedMemory,
+								 unsigned int signal );
+
+int sharedMemoryPlace ( sharedMemory_t* sharedMemory,
+						const canMessageIndex_t* ids, unsigned int count );
+const void* sharedMemoryMessageAddress ( sharedMemory_t* sharedMemory,
+										 canMessageIndex_t index );
+long sharedMemoryScan ( sharedMemory_t* sharedMemory,
+						const scanProgram_t* program, unsigned long* bitmap );
+long sharedMemoryScanIds ( sharedMemory_t* sharedMemory,
+						   const scanProgram_t* program,
+						   canMessageIndex_t* ids, long maxIds );
+int  sharedMemoryTriggerAttach ( sharedMemory_t* sharedMemory );
+int  sharedMemoryTriggerAdd ( sharedMemory_t* sharedMemory, int consumer,
+							  const trigger_t* trigger );
+int  sharedMemoryTriggerRemove ( sharedMemory_t* sharedMemory, int consumer,
+								 int trigger );
+void sharedMemoryTriggerDetach ( sharedMemory_t* sharedMemory, int consumer );
+
+//
+// Utility functions for the programs.
+//
+int parseMessageIdList ( const char* list, canMessageIndex_t* ids,
+						 int maxIds );
 
+#ifdef __cplusplus
+}
+#endif
 
 #endif		// End of SHARED_MEMORY_H
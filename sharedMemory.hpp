@@ -0,0 +1,506 @@
+#pragma once
+#ifndef SHARED_MEMORY_HPP
+#define SHARED_MEMORY_HPP
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <ratio>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+
+#include "sharedMemory.h"
+
+//
+// This is a header only C++ layer over the shared memory library (see
+// sharedMemory.h).  It needs C++17.
+//
+// A message is described once as a type: its ID and the layout of its
+// signals.  A signal is a little endian field of 1, 2, 4 or 8 bytes at a
+// byte offset in the data, signed or unsigned, with a scale and a bias given
+// as std::ratio, the same fields that the derived signals use (see
+// derived.h):
+//
+//     using Speed  = vsi::Field<0, 2, false, std::ratio<1, 100>>;
+//     using Torque = vsi::Field<2, 2, true>;
+//     using Engine = vsi::Message<0x1a0, Speed, Torque>;
+//
+//     vsi::Segment<> segment;                  // 1,000,000 IDs
+//     auto   frame = segment.read<Engine>();
+//     double speed = frame.get<Speed>();
+//
+// Everything about the layout is checked when the program is compiled: a
+// field must fit in the 8 data bytes, a message ID must be inside the pool
+// the program was built for and a field can only be read from a message
+// that has it.  The segment is checked once, when it is opened, to make sure
+// its pool is at least that large, so no access needs a run time check.
+// The offsets, sizes and scales are constants, so a field read compiles to
+// the same load (and multiply) as hand written C, and the library calls are
+// inlined when the program is linked with the static library and -flto.
+//
+// A Slice is a range of IDs in the pool that can be used in a range based
+// for loop.  Each step reads a consistent copy of a message without the
+// shared memory lock (sharedMemoryReadMessage).
+//
+// The layer throws std::runtime_error if the segment can't be opened or is
+// too small and std::out_of_range for a slice given at run time that isn't
+// inside the pool.  Nothing else throws.
+//
+namespace vsi
+{
+
+//
+// Define the integer type of a field of each size.
+//
+template <unsigned Size, bool Signed> struct fieldType;
+
+template <> struct fieldType<1, false> { using type = std::uint8_t; };
+template <> struct fieldType<2, false> { using type = std::uint16_t; };
+template <> struct fieldType<4, false> { using type = std::uint32_t; };
+template <> struct fieldType<8, false> { using type = std::uint64_t; };
+template <> struct fieldType<1, true>  { using type = std::int8_t; };
+template <> struct fieldType<2, true>  { using type = std::int16_t; };
+template <> struct fieldType<4, true>  { using type = std::int32_t; };
+template <> struct fieldType<8, true>  { using type = std::int64_t; };
+
+//
+// Define a signal: a little endian field of the data bytes.  The physical
+// value is the raw value times Scale plus Bias.
+//
+template <unsigned Offset, unsigned Size, bool Signed = false,
+		  class Scale = std::ratio<1>, class Bias = std::ratio<0>>
+struct Field
+{
+	static_assert ( Size == 1 || Size == 2 || Size == 4 || Size == 8,
+					"A field must be 1, 2, 4 or 8 bytes" );
+	static_assert ( Offset + Size <= CAN_MAX_DLEN,
+					"A field must fit in the 8 data bytes" );
+	static_assert ( Scale::num != 0, "A field can't have a scale of 0" );
+
+	using rawType = typename fieldType<Size, Signed>::type;
+
+	static constexpr unsigned offset = Offset;
+	static constexpr unsigned size   = Size;
+	static constexpr unsigned end    = Offset + Size;
+	static constexpr double   scale  = (double)Scale::num / Scale::den;
+	static constexpr double   bias   = (double)Bias::num / Bias::den;
+	static constexpr bool     scaled = Scale::num != Scale::den;
+	static constexpr bool     biased = Bias::num != 0;
+
+	//
+	// Read the raw value from the data bytes of a frame.
+	//
+	static rawType raw ( const unsigned char* data ) noexcept
+	{
+		rawType value;
+
+		std::memcpy ( &value, data + Offset, Size );
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		if constexpr ( Size == 2 ) value = __builtin_bswap16 ( value );
+		if constexpr ( Size == 4 ) value = __builtin_bswap32 ( value );
+		if constexpr ( Size == 8 ) value = __builtin_bswap64 ( value );
+#endif
+		return value;
+	}
+
+	//
+	// Store a raw value in the data bytes of a frame.
+	//
+	static void setRaw ( unsigned char* data, rawType value ) noexcept
+	{
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+		if constexpr ( Size == 2 ) value = __builtin_bswap16 ( value );
+		if constexpr ( Size == 4 ) value = __builtin_bswap32 ( value );
+		if constexpr ( Size == 8 ) value = __builtin_bswap64 ( value );
+#endif
+		std::memcpy ( data + Offset, &value, Size );
+	}
+
+	//
+	// Read the physical value.
+	//
+	static double value ( const unsigned char* data ) noexcept
+	{
+		double value = raw ( data );
+
+		if constexpr ( scaled )
+		{
+			value *= scale;
+		}
+		if constexpr ( biased )
+		{
+			value += bias;
+		}
+		return value;
+	}
+
+	//
+	// Convert a physical value to the nearest raw value.
+	//
+	static rawType encode ( double value ) noexcept
+	{
+		if constexpr ( biased )
+		{
+			value -= bias;
+		}
+		if constexpr ( scaled )
+		{
+			value /= scale;
+		}
+		return static_cast<rawType> ( std::llround ( value ) );
+	}
+};
+
+//
+// Define a message: its ID and the fields of its signal layout.  The length
+// of a frame built for the message covers its last field.
+//
+template <canMessageIndex_t Id, class... Fields>
+struct Message
+{
+	static_assert ( Id <= CAN_EFF_MASK, "A message ID must be a CAN ID" );
+
+	static constexpr canMessageIndex_t id = Id;
+
+	static constexpr unsigned length ( void ) noexcept
+	{
+		unsigned end = 0;
+
+		( ( end = Fields::end > end ? Fields::end : end ), ... );
+
+		return end;
+	}
+
+	template <class F>
+	static constexpr bool has = ( std::is_same_v<F, Fields> || ... );
+};
+
+//
+// Define the tag that asks for a frame that isn't initialized because it is
+// about to be read into.
+//
+struct Uninitialized {};
+
+//
+// Define a copy of a frame of a message type.  A default constructed frame
+// has the message's ID and length and zero data, ready to be filled in and
+// inserted.
+//
+template <class M>
+class Frame
+{
+  public:
+	Frame ( void ) noexcept
+	{
+		std::memset ( &frame, 0, sizeof(frame) );
+		frame.canMessage.can_id  = M::id;
+		frame.canMessage.can_dlc = M::length();
+	}
+
+	explicit Frame ( Uninitialized ) noexcept
+	{
+	}
+
+	//
+	// Read a field.  The field must be part of the message.
+	//
+	template <class F>
+	typename F::rawType raw ( void ) const noexcept
+	{
+		static_assert ( M::template has<F>, "The field is not part of the message" );
+
+		return F::raw ( frame.canMessage.data );
+	}
+
+	template <class F>
+	double get ( void ) const noexcept
+	{
+		static_assert ( M::template has<F>, "The field is not part of the message" );
+
+		return F::value ( frame.canMessage.data );
+	}
+
+	//
+	// Return true if the frame that was read is long enough to hold a field.
+	// A sender may send fewer bytes than the layout describes.
+	//
+	template <class F>
+	bool present ( void ) const noexcept
+	{
+		static_assert ( M::template has<F>, "The field is not part of the message" );
+
+		return frame.canMessage.can_dlc >= F::end;
+	}
+
+	//
+	// Store a field.
+	//
+	template <class F>
+	Frame& setRaw ( typename F::rawType value ) noexcept
+	{
+		static_assert ( M::template has<F>, "The field is not part of the message" );
+
+		F::setRaw ( frame.canMessage.data, value );
+		return *this;
+	}
+
+	template <class F>
+	Frame& set ( double value ) noexcept
+	{
+		static_assert ( M::template has<F>, "The field is not part of the message" );
+
+		F::setRaw ( frame.canMessage.data, F::encode ( value ) );
+		return *this;
+	}
+
+	unsigned int sequence ( void ) const noexcept
+	{
+		return frame.sequence;
+	}
+
+	const canMessage_t& message ( void ) const noexcept
+	{
+		return frame;
+	}
+
+	canMessage_t& message ( void ) noexcept
+	{
+		return frame;
+	}
+
+  private:
+	canMessage_t frame;
+};
+
+//
+// Define a range of IDs in the pool, [first, last).  Dereferencing an
+// iterator reads a consistent copy of the message at its ID without the
+// shared memory lock.
+//
+class Slice
+{
+  public:
+	class iterator
+	{
+	  public:
+		using iterator_category = std::input_iterator_tag;
+		using value_type        = canMessage_t;
+		using difference_type   = std::ptrdiff_t;
+		using pointer           = const canMessage_t*;
+		using reference         = canMessage_t;
+
+		iterator ( sharedMemory_t* sharedMemory, canMessageIndex_t id ) noexcept
+			: sharedMemory ( sharedMemory ), index ( id )
+		{
+		}
+
+		canMessage_t operator* ( void ) const noexcept
+		{
+			canMessage_t message;
+
+			(void) sharedMemoryReadMessage ( sharedMemory, index, &message );
+			return message;
+		}
+
+		iterator& operator++ ( void ) noexcept
+		{
+			index++;
+			return *this;
+		}
+
+		iterator operator++ ( int ) noexcept
+		{
+			iterator previous = *this;
+
+			index++;
+			return previous;
+		}
+
+		bool operator== ( const iterator& other ) const noexcept
+		{
+			return index == other.index;
+		}
+
+		bool operator!= ( const iterator& other ) const noexcept
+		{
+			return index != other.index;
+		}
+
+		canMessageIndex_t id ( void ) const noexcept
+		{
+			return index;
+		}
+
+	  private:
+		sharedMemory_t*   sharedMemory;
+		canMessageIndex_t index;
+	};
+
+	Slice ( sharedMemory_t* sharedMemory, canMessageIndex_t first,
+			canMessageIndex_t last ) noexcept
+		: sharedMemory ( sharedMemory ), firstId ( first ), lastId ( last )
+	{
+	}
+
+	iterator begin ( void ) const noexcept
+	{
+		return iterator ( sharedMemory, firstId );
+	}
+
+	iterator end ( void ) const noexcept
+	{
+		return iterator ( sharedMemory, lastId );
+	}
+
+	std::size_t size ( void ) const noexcept
+	{
+		return lastId - firstId;
+	}
+
+	bool empty ( void ) const noexcept
+	{
+		return firstId == lastId;
+	}
+
+	canMessageIndex_t first ( void ) const noexcept
+	{
+		return firstId;
+	}
+
+	canMessageIndex_t last ( void ) const noexcept
+	{
+		return lastId;
+	}
+
+  private:
+	sharedMemory_t*   sharedMemory;
+	canMessageIndex_t firstId;
+	canMessageIndex_t lastId;
+};
+
+//
+// Define an open shared memory segment whose pool holds at least Capacity
+// IDs.  Every message type used with it must have an ID below Capacity.
+//
+template <canMessageIndex_t Capacity = 1000000>
+class Segment
+{
+  public:
+	explicit Segment ( int bus = SHARED_MEMORY_NO_BUS )
+		: sharedMemory ( sharedMemoryOpenBus ( bus ) )
+	{
+		if ( sharedMemory == nullptr )
+		{
+			throw std::runtime_error ( "Unable to open the shared memory segment" );
+		}
+		unsigned int poolSize = sharedMemoryGetPoolSize ( sharedMemory );
+
+		if ( poolSize < Capacity )
+		{
+			sharedMemoryClose ( sharedMemory );
+			throw std::runtime_error ( "The shared memory segment has " +
+									   std::to_string ( poolSize ) +
+									   " IDs but the program needs " +
+									   std::to_string ( Capacity ) );
+		}
+	}
+
+	~Segment ( void )
+	{
+		if ( sharedMemory != nullptr )
+		{
+			sharedMemoryClose ( sharedMemory );
+		}
+	}
+
+	Segment ( const Segment& ) = delete;
+	Segment& operator= ( const Segment& ) = delete;
+
+	Segment ( Segment&& other ) noexcept
+		: sharedMemory ( other.sharedMemory )
+	{
+		other.sharedMemory = nullptr;
+	}
+
+	//
+	// Read a consistent copy of a message without the shared memory lock.
+	//
+	template <class M>
+	Frame<M> read ( void ) const noexcept
+	{
+		static_assert ( M::id < Capacity, "The message ID is outside the pool" );
+
+		Frame<M> frame { Uninitialized() };
+
+		(void) sharedMemoryReadMessage ( sharedMemory, M::id, &frame.message() );
+		return frame;
+	}
+
+	//
+	// Read a copy of a message with the shared memory lock held (fetchMessage).
+	//
+	template <class M>
+	Frame<M> fetch ( void ) const noexcept
+	{
+		static_assert ( M::id < Capacity, "The message ID is outside the pool" );
+
+		Frame<M> frame;
+
+		(void) fetchMessage ( sharedMemory, &frame.message() );
+		return frame;
+	}
+
+	//
+	// Insert a frame.  insertMessage only reads the frame it is given.
+	//
+	template <class M>
+	void insert ( const Frame<M>& frame ) const noexcept
+	{
+		static_assert ( M::id < Capacity, "The message ID is outside the pool" );
+
+		(void) insertMessage ( sharedMemory,
+							   const_cast<canMessage_t*> ( &frame.message() ) );
+	}
+
+	//
+	// Return a slice of the pool given at compile time.
+	//
+	template <canMessageIndex_t First, canMessageIndex_t Last>
+	Slice slice ( void ) const noexcept
+	{
+		static_assert ( First <= Last && Last <= Capacity,
+						"The slice is outside the pool" );
+
+		return Slice ( sharedMemory, First, Last );
+	}
+
+	//
+	// Return a slice of the pool given at run time.
+	//
+	Slice slice ( canMessageIndex_t first, canMessageIndex_t last ) const
+	{
+		if ( first > last || last > sharedMemoryGetPoolSize ( sharedMemory ) )
+		{
+			throw std::out_of_range ( "The slice is outside the pool" );
+		}
+		return Slice ( sharedMemory, first, last );
+	}
+
+	//
+	// Return the C handle for the rest of the library.
+	//
+	sharedMemory_t* handle ( void ) const noexcept
+	{
+		return sharedMemory;
+	}
+
+  private:
+	sharedMemory_t* sharedMemory;
+};
+
+}		// End of namespace vsi
+
+#endif		// End of SHARED_MEMORY_HPP
@@ -0,0 +1,128 @@
+#pragma once
+#ifndef SHARED_MEMORY_SEGMENT_H
+#define SHARED_MEMORY_SEGMENT_H
+
+#include "sharedMemory.h"
+
+//
+// This is the private definition of the layout of a shared memory segment.
+// It is only used by the library modules and by the "create" program that
+// builds new segments.  Everyone else uses the opaque sharedMemory_t handle
+// and the functions declared in sharedMemory.h.
+//
+
+//
+// Note: All references (and pointers) to data in the data message pool are
+// performed by using the index into the array of messages.  All of these
+// references need to be relocatable references so this will work in multiple
+// processes that have their shared memory segments mapped to different base
+// addresses.
+//
+
+//
+// Define the values that identify a valid shared memory segment.  These are
+// stored at the start of the segment when it is created and checked whenever
+// a segment (or a checkpoint image of one) is mapped so that we never try to
+// use a file that was written with a different layout.
+//
+#define SHARED_MEMORY_MAGIC   0x56534953        // "VSIS"
+#define SHARED_MEMORY_VERSION 18
+
+//
+// Define the shared memory segment that will be shared among multiple
+// processes.  This structure will be mapped into a shared memory segment for
+// all processes to use.
+//
+struct sharedMemory_t
+{
+	//
+	// Define the segment identification fields.  The header and message sizes
+	// are recorded so that a mismatched build can be detected.
+	//
+	unsigned int magic;
+	unsigned int version;
+	unsigned int headerSize;
+	unsigned int messageSize;
+
+	//
+	// Define the global constants and variables.
+	//
+	unsigned int totalMessageCount;
+	unsigned int totalSharedMemorySize;
+
+	//
+	// The CAN bus whose messages are kept in this segment or
+	// SHARED_MEMORY_NO_BUS if the segment is not a bus partition.
+	//
+	int busId;
+
+	//
+	// The free buffers (those not currently in use by a process) will be kept
+	// on a simple singly linked list.  Buffers are removed from the head of
+	// the list and added to the tail.
+	//
+	// [This feature is not implemented for this demo code.]
+	//
+	int               freeListCount;
+	canMessageIndex_t freeListHead;
+	canMessageIndex_t freeListTail;
+
+	//
+	// Define the offsets of the optional regions that follow the message pool
+	// in the shared memory segment.  An offset of zero means that the region
+	// was not configured when the segment was created.
+	//
+	unsigned int journalOffset;
+	unsigned int deliveryOffset;
+	unsigned int statsOffset;
+	unsigned int notifyOffset;
+	unsigned int streamOffset;
+	unsigned int mirrorOffset;
+	unsigned int groupOffset;
+	unsigned int recorderOffset;
+	unsigned int derivedOffset;
+	unsigned int rollupOffset;
+	unsigned int changeOffset;
+	unsigned int heatOffset;
+	unsigned int placementOffset;
+	unsigned int triggerOffset;
+
+	//
+	// Define the global shared memory lock.
+	//
+    pthread_mutexattr_t mutexAttributes;
+	pthread_mutex_t     lock;
+
+	//
+	// Define the start of the array of CAN message records.  This array will
+	// be created with a specified size before anyone tries to read or write
+	// any of the records in it.
+	//
+	canMessage_t messagePoolBase[0];
+
+};
+
+//
+// Return the address of an optional region in the shared memory segment given
+// its offset from the start of the segment.
+//
+#define SHARED_MEMORY_REGION(segment,offset) \
+	( (void*)( (char*)(segment) + (offset) ) )
+
+//
+// Return the slot that holds a message ID (see placement.h).
+//
+canMessage_t* sharedMemorySlot ( sharedMemory_t* sharedMemory,
+								 canMessageIndex_t index );
+
+//
+// Tell the processor that we are spinning waiting for another processor.
+//
+#if defined(__x86_64__) || defined(__i386__)
+#define SHARED_MEMORY_CPU_RELAX() __builtin_ia32_pause()
+#else
+#define SHARED_MEMORY_CPU_RELAX() __asm__ __volatile__ ( "" ::: "memory" )
+#endif
+
+
+#endif		// End of SHARED_MEMORY_SEGMENT_H
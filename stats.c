@@ -0,0 +1,299 @@
+//
+//	s t a t s . c
+//
+//  Incrementally maintained statistics for every message ID in the message
+//  pool.  See stats.h for a description.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "sharedMemorySegment.h"
+#include "stats.h"
+
+//
+// Return the number of bytes needed for a statistics table region.
+//
+unsigned long statsRegionSize ( unsigned int entryCount )
+{
+	return sizeof(statsTable_t) + (unsigned long)entryCount * sizeof(statsEntry_t);
+}
+
+
+//
+// Initialize a statistics table region.  All of the entries are cleared.
+//
+void statsInitialize ( statsTable_t* table, unsigned int entryCount,
+					   unsigned int fieldOffset, unsigned int fieldSize,
+					   int fieldSigned, unsigned long timeout )
+{
+	(void) memset ( table, 0, statsRegionSize ( entryCount ) );
+
+	table->entryCount  = entryCount;
+	table->fieldOffset = fieldOffset;
+	table->fieldSize   = fieldSize;
+	table->fieldSigned = fieldSigned;
+	table->timeout     = timeout;
+}
+
+
+//
+// Parse a payload field specification of the form "offset:size" or
+// "offset:size:s" for a signed field.  The size must be 1, 2, 4 or 8 bytes
+// and the field must fit in the message data.
+//
+// This function returns 0 if the specification is valid and -1 if it is not.
+//
+int statsParseField ( const char* spec, unsigned int* fieldOffset,
+					  unsigned int* fieldSize, int* fieldSigned )
+{
+	char*         end;
+	unsigned long offset = strtoul ( spec, &end, 0 );
+
+	if ( end == spec || *end != ':' )
+	{
+		return -1;
+	}
+	spec = end + 1;
+	unsigned long size = strtoul ( spec, &end, 0 );
+	if ( end == spec || ( size != 1 && size != 2 && size != 4 && size != 8 ) ||
+		 offset + size > CAN_MAX_DLEN )
+	{
+		return -1;
+	}
+	*fieldSigned = 0;
+	if ( *end == ':' && end[1] == 's' && end[2] == 0 )
+	{
+		*fieldSigned = 1;
+	}
+	else if ( *end != 0 )
+	{
+		return -1;
+	}
+	*fieldOffset = offset;
+	*fieldSize   = size;
+
+	return 0;
+}
+
+
+//
+// Extract the configured payload field from a message.
+//
+static inline long fieldValue ( statsTable_t* table, canMessage_t* message )
+{
+	unsigned long value = 0;
+
+	for ( int i = table->fieldSize - 1; i >= 0; i-- )
+	{
+		value = ( value << 8 ) | message->canMessage.data[table->fieldOffset + i];
+	}
+	if ( table->fieldSigned && table->fieldSize < 8 )
+	{
+		unsigned int shift = 64 - table->fieldSize * 8;
+
+		return (long)( value << shift ) >> shift;
+	}
+	return (long)value;
+}
+
+
+//
+//	s t a t s U p d a t e
+//
+// Update the statistics of a message that is being inserted into the message
+// pool.  This must be called while the shared memory lock is held and the
+// message's sequence number is odd.
+//
+void statsUpdate ( statsTable_t* table, canMessage_t* message,
+				   unsigned long now )
+{
+	canMessageIndex_t id = message->canMessage.can_id;
+
+	if ( id >= table->entryCount )
+	{
+		return;
+	}
+	statsEntry_t* entry = &table->entries[id];
+
+	//
+	// The arrival time is taken before the lock so two writers of the same
+	// ID can arrive here out of order.  Don't let time run backwards.
+	//
+	if ( now < entry->lastArrival )
+	{
+		now = entry->lastArrival;
+	}
+	//
+	// Update the arrival times.  The first interval seeds the average.
+	//
+	if ( entry->count != 0 )
+	{
+		unsigned long interval = now - entry->lastArrival;
+
+		entry->lastInterval = interval;
+		if ( entry->count == 1 )
+		{
+			entry->averageInterval = interval;
+		}
+		else
+		{
+			entry->averageInterval += ( (long)interval -
+										(long)entry->averageInterval ) /
+									  STATS_EWMA_WEIGHT;
+		}
+	}
+	entry->lastArrival = now;
+
+	//
+	// Update the range of the payload field if the message is long enough to
+	// contain it.
+	//
+	if ( message->canMessage.can_dlc >= table->fieldOffset + table->fieldSize )
+	{
+		long value = fieldValue ( table, message );
+
+		if ( entry->count == 0 || value < entry->minimum )
+		{
+			entry->minimum = value;
+		}
+		if ( entry->count == 0 || value > entry->maximum )
+		{
+			entry->maximum = value;
+		}
+	}
+	entry->count++;
+}
+
+
+//
+//	s t a t s R e a d
+//
+// Read a consistent snapshot of the statistics of a message ID without
+// taking the shared memory lock.
+//
+// This function returns 0 if the snapshot was returned and -1 if the segment
+// has no statistics table or the ID is out of range.
+//
+int statsRead ( sharedMemory_t* sharedMemory, canMessageIndex_t id,
+				statsSnapshot_t* snapshot )
+{
+	if ( sharedMemory->statsOffset == 0 )
+	{
+		return -1;
+	}
+	statsTable_t* table = SHARED_MEMORY_REGION ( sharedMemory,
+												 sharedMemory->statsOffset );
+	if ( id >= table->entryCount || id >= sharedMemory->totalMessageCount )
+	{
+		return -1;
+	}
+	statsEntry_t* source = &table->entries[id];
+	statsEntry_t  entry;
+
+	//
+	// Copy the entry using the message's sequence number to detect an
+	// update in progress.  The message's slot is looked up for each try
+	// since the placement map may move it (see placement.h).
+	//
+	while ( 1 )
+	{
+		canMessage_t* message = sharedMemorySlot ( sharedMemory, id );
+		unsigned int  before  = __atomic_load_n ( &message->sequence,
+												  __ATOMIC_ACQUIRE );
+		if ( ( before & 1 ) == 0 )
+		{
+			canMessageIndex_t slotId = message->canMessage.can_id;
+
+			entry = *source;
+			__atomic_thread_fence ( __ATOMIC_ACQUIRE );
+			if ( __atomic_load_n ( &message->sequence, __ATOMIC_RELAXED ) == before &&
+				 slotId == id )
+			{
+				break;
+			}
+		}
+		SHARED_MEMORY_CPU_RELAX();
+	}
+	//
+	// Compute the derived values.
+	//
+	unsigned long now = statsNow();
+
+	snapshot->count           = entry.count;
+	snapshot->lastInterval    = entry.lastInterval;
+	snapshot->averageInterval = entry.averageInterval;
+	snapshot->minimum         = entry.minimum;
+	snapshot->maximum         = entry.maximum;
+	snapshot->age             = entry.count != 0 && now > entry.lastArrival ?
+								now - entry.lastArrival : 0;
+	snapshot->rate            = entry.averageInterval != 0 ?
+								1000000000.0 / entry.averageInterval : 0.0;
+
+	//
+	// With change suppression on, the frames that were the same as the last
+	// one aren't stored or counted here.  They are counted in the change
+	// table, so the count includes them and, if the change table has the
+	// later arrival, the age and the intervals are taken from there.  The
+	// suppressed frames carry the stored payload so the range still holds.
+	//
+	if ( sharedMemory->changeOffset != 0 )
+	{
+		changeTable_t* changes = SHARED_MEMORY_REGION ( sharedMemory,
+														sharedMemory->changeOffset );
+		if ( id < changes->entryCount )
+		{
+			changeEntry_t* change   = &changes->entries[id];
+			unsigned long  lastSeen = __atomic_load_n ( &change->lastSeen,
+														__ATOMIC_RELAXED );
+			unsigned long  seen     = __atomic_load_n ( &change->seen,
+														__ATOMIC_RELAXED );
+			unsigned long  stored   = __atomic_load_n ( &change->stored,
+														__ATOMIC_RELAXED );
+			if ( seen > stored )
+			{
+				snapshot->count += seen - stored;
+			}
+			if ( seen != 0 && lastSeen >= entry.lastArrival )
+			{
+				snapshot->age = now > lastSeen ? now - lastSeen : 0;
+
+				if ( seen > 1 )
+				{
+					snapshot->lastInterval    = __atomic_load_n ( &change->lastInterval,
+																  __ATOMIC_RELAXED );
+					snapshot->averageInterval = __atomic_load_n ( &change->averageInterval,
+																  __ATOMIC_RELAXED );
+					snapshot->rate            = snapshot->averageInterval != 0 ?
+												1000000000.0 /
+												snapshot->averageInterval : 0.0;
+				}
+			}
+		}
+	}
+
+	unsigned long timeout = table->timeout;
+	if ( timeout == 0 )
+	{
+		timeout = snapshot->averageInterval * STATS_TIMEOUT_FACTOR;
+	}
+	snapshot->timedOut = snapshot->count != 0 && timeout != 0 &&
+						 snapshot->age > timeout;
+
+	return 0;
+}
+
+
+//
+// Return the current time in nanoseconds.
+//
+unsigned long statsNow ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
@@ -0,0 +1,113 @@
+#pragma once
+#ifndef STATS_H
+#define STATS_H
+
+#include "canMessage.h"
+
+//
+// The statistics table is an optional region of the shared memory segment
+// that holds running statistics for every message ID in the message pool.
+// Monitoring consumers used to compute these themselves by polling every ID
+// with fetchMessage.  Instead, insertMessage updates the entry for the ID it
+// is inserting in constant time while it holds the shared memory lock and
+// every monitoring process just reads the result.
+//
+// Each entry holds:
+//
+//     count           - The number of times the ID has been inserted.
+//     lastArrival     - The time of the last insert.
+//     lastInterval    - The time between the last two inserts.
+//     averageInterval - An exponentially weighted moving average of the
+//                       interval (weight 1/STATS_EWMA_WEIGHT) from which the
+//                       rate is computed.
+//     minimum/maximum - The smallest and largest value seen in the payload
+//                       field configured for the table.
+//
+// The entries are updated while the message's sequence number is odd so a
+// reader can get a consistent copy of an entry without the shared memory
+// lock by using the same sequence number check as sharedMemoryReadMessage.
+//
+// An ID is considered to have timed out if it hasn't been inserted for
+// longer than the timeout configured for the table.  If no timeout is
+// configured, each ID times out after STATS_TIMEOUT_FACTOR times its own
+// average interval.
+//
+// All times are CLOCK_MONOTONIC nanoseconds.
+//
+
+//
+// Define the statistics of a single message ID.  Each entry is on its own
+// cache line.
+//
+typedef struct statsEntry_t
+{
+	unsigned long count;
+	unsigned long lastArrival;
+	unsigned long lastInterval;
+	unsigned long averageInterval;
+	long          minimum;
+	long          maximum;
+
+}   __attribute__((aligned(64))) statsEntry_t;
+
+//
+// Define the header of the statistics table region.  The payload field is
+// given as a little endian field of fieldSize bytes starting at byte
+// fieldOffset of the message data.
+//
+typedef struct statsTable_t
+{
+	unsigned int  entryCount;
+	unsigned char fieldOffset;
+	unsigned char fieldSize;                // 1, 2, 4 or 8
+	unsigned char fieldSigned;
+	unsigned char pad;
+	unsigned long timeout;                  // nsec, 0 for adaptive
+
+	statsEntry_t  entries[0];
+
+}   statsTable_t;
+
+//
+// Define the snapshot of the statistics of a message ID that is returned to
+// the readers.
+//
+typedef struct statsSnapshot_t
+{
+	unsigned long count;
+	unsigned long lastInterval;             // nsec
+	unsigned long averageInterval;          // nsec
+	unsigned long age;                      // nsec since the last insert
+	double        rate;                     // inserts/sec
+	long          minimum;
+	long          maximum;
+	int           timedOut;
+
+}   statsSnapshot_t;
+
+//
+// Define the averaging weight and the adaptive timeout factor.
+//
+#define STATS_EWMA_WEIGHT    16
+#define STATS_TIMEOUT_FACTOR 4
+
+//
+// Define the statistics functions.
+//
+struct sharedMemory_t;
+
+unsigned long statsRegionSize ( unsigned int entryCount );
+void          statsInitialize ( statsTable_t* table, unsigned int entryCount,
+								unsigned int fieldOffset,
+								unsigned int fieldSize, int fieldSigned,
+								unsigned long timeout );
+int           statsParseField ( const char* spec, unsigned int* fieldOffset,
+								unsigned int* fieldSize, int* fieldSigned );
+void          statsUpdate     ( statsTable_t* table, canMessage_t* message,
+								unsigned long now );
+int           statsRead       ( struct sharedMemory_t* sharedMemory,
+								canMessageIndex_t id,
+								statsSnapshot_t* snapshot );
+unsigned long statsNow        ( void );
+
+#endif		// End of STATS_H
@@ -0,0 +1,216 @@
+//
+//	s t a t s d u m p . c
+//
+//  Display the running statistics that insertMessage maintains for each
+//  message ID (see stats.h).
+//
+//  The shared memory segment must have been created with a statistics table
+//  (see the "-s" option of the "create" program).  The statistics of the
+//  requested message IDs are read without taking the shared memory lock and
+//  printed along with the time it took to read them.  In continuous mode the
+//  table is printed again every few seconds.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <locale.h>
+#include <stdbool.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the largest number of message IDs that can be displayed.
+//
+#define MAX_IDS ( 1024 * 1024 )
+
+//
+// Define the display parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static const char*  idList          = "0-9";
+static unsigned int refreshSeconds  = 1;
+static bool         continuousRun   = false;
+static bool         timedOutOnly    = false;
+static bool         quiet           = false;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -i    Message IDs      list        0-9 \n\
+    -c    Continuous       bool      false \n\
+    -r    Refresh (sec)    int           1 \n\
+    -t    Timed Out Only   bool      false \n\
+    -q    Summary Only     bool      false \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:chi:qr:t?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'c':
+			continuousRun = true;
+			break;
+
+		  case 'i':
+			idList = optarg;
+			break;
+
+		  case 'q':
+			quiet = true;
+			break;
+
+		  case 'r':
+		    refreshSeconds = atol ( optarg );
+			if ( refreshSeconds <= 0 )
+			{
+				printf ( "Invalid refresh interval[%u] specified.\n",
+						 refreshSeconds );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 't':
+			timedOutOnly = true;
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	canMessageIndex_t* ids     = malloc ( MAX_IDS * sizeof(canMessageIndex_t) );
+	int                idCount = parseMessageIdList ( idList, ids, MAX_IDS );
+	if ( idCount <= 0 || optind != argc )
+	{
+		printf ( "Invalid message ID list[%s] specified.\n", idList );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	if ( sharedMemoryGetStatsTable ( sharedMemory ) == 0 )
+	{
+		printf ( "The shared memory segment has no statistics table - Use "
+				 "\"create -s\" to create one.\n" );
+		exit (255);
+	}
+	statsSnapshot_t* snapshots = malloc ( idCount * sizeof(statsSnapshot_t) );
+
+	do
+	{
+		//
+		// Read the statistics of all of the IDs first so that we time only
+		// the reads and not the printing.
+		//
+		unsigned long startNs = statsNow();
+		for ( int i = 0; i < idCount; i++ )
+		{
+			if ( statsRead ( sharedMemory, ids[i], &snapshots[i] ) != 0 )
+			{
+				printf ( "Message ID %#x is out of range.\n", ids[i] );
+				exit (255);
+			}
+		}
+		unsigned long readNs = statsNow() - startNs;
+
+		//
+		// Print the results.
+		//
+		int timedOut = 0;
+		if ( ! quiet )
+		{
+			printf ( "%10s %12s %12s %12s %12s %12s %12s %s\n", "ID", "Count",
+					 "Rate/sec", "Last usec", "Age usec", "Minimum", "Maximum",
+					 "Status" );
+		}
+		for ( int i = 0; i < idCount; i++ )
+		{
+			statsSnapshot_t* snapshot = &snapshots[i];
+
+			timedOut += snapshot->timedOut;
+			if ( quiet || ( timedOutOnly && ! snapshot->timedOut ) )
+			{
+				continue;
+			}
+			printf ( "%#10x %'12lu %'12.1f %'12lu %'12lu %'12ld %'12ld %s\n",
+					 ids[i], snapshot->count, snapshot->rate,
+					 snapshot->lastInterval / 1000, snapshot->age / 1000,
+					 snapshot->minimum, snapshot->maximum,
+					 snapshot->count == 0 ? "never seen" :
+					 snapshot->timedOut   ? "TIMED OUT" : "ok" );
+		}
+		printf ( "%'d IDs read in %'lu usec (%'lu nsec/ID), %'d timed out\n",
+				 idCount, readNs / 1000, readNs / idCount, timedOut );
+
+		if ( continuousRun )
+		{
+			sleep ( refreshSeconds );
+		}
+
+	}   while ( continuousRun );
+
+	sharedMemoryClose ( sharedMemory );
+
+    return 0;
+}
@@ -0,0 +1,436 @@
+//
+//	s t r e a m . c
+//
+//  Single producer, multiple consumer ring of every frame inserted into the
+//  message pool.  See stream.h for a description.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <sched.h>
+
+#include "sharedMemorySegment.h"
+#include "stream.h"
+
+//
+// Define the number of times a writer that is waiting for space spins before
+// it starts yielding the processor.  Once it yields, it checks for consumers
+// that have died each time it finds there is still no space.
+//
+#define STREAM_SPIN_LIMIT  100
+
+//
+// Return the number of bytes needed for a stream ring region.
+//
+unsigned long streamRegionSize ( unsigned long capacity )
+{
+	return sizeof(streamRing_t) + capacity * sizeof(streamFrame_t);
+}
+
+
+//
+// Initialize a stream ring region.  All of the consumer slots are freed.
+//
+void streamInitialize ( streamRing_t* ring, unsigned long capacity,
+						unsigned int maxConsumers, streamPolicy_t policy )
+{
+	(void) memset ( ring, 0, sizeof(streamRing_t) );
+
+	ring->capacity     = capacity;
+	ring->mask         = capacity - 1;
+	ring->maxConsumers = maxConsumers;
+	ring->policy       = policy;
+}
+
+
+//
+// Return the lowest cursor of the attached consumers.  If there are none,
+// the producer is free to overwrite everything that has been published.
+//
+static unsigned long lowestCursor ( streamRing_t* ring )
+{
+	unsigned long lowest = ring->claimed;
+
+	for ( unsigned int i = 0; i < ring->maxConsumers; i++ )
+	{
+		streamConsumer_t* consumer = &ring->consumers[i];
+
+		if ( __atomic_load_n ( &consumer->pid, __ATOMIC_ACQUIRE ) != 0 )
+		{
+			unsigned long cursor = __atomic_load_n ( &consumer->cursor,
+													 __ATOMIC_ACQUIRE );
+			if ( cursor < lowest )
+			{
+				lowest = cursor;
+			}
+		}
+	}
+	return lowest;
+}
+
+
+//
+// Detach the consumers whose processes have died so they don't block the
+// producer forever.
+//
+static void reapConsumers ( streamRing_t* ring )
+{
+	for ( unsigned int i = 0; i < ring->maxConsumers; i++ )
+	{
+		pid_t pid = __atomic_load_n ( &ring->consumers[i].pid, __ATOMIC_ACQUIRE );
+
+		if ( pid != 0 && kill ( pid, 0 ) != 0 && errno == ESRCH )
+		{
+			(void) __atomic_compare_exchange_n ( &ring->consumers[i].pid, &pid,
+												 0, 0, __ATOMIC_RELEASE,
+												 __ATOMIC_RELAXED );
+		}
+	}
+}
+
+
+//
+// Return true if the producer can publish "count" more frames without
+// overwriting a frame that a consumer hasn't released, according to a
+// consumer cursor the producer saw.  A batch that is bigger than the ring
+// only waits for every consumer to catch up, since it overwrites its own
+// frames anyway.
+//
+static int hasSpace ( streamRing_t* ring, unsigned long claimed,
+					  unsigned long count, unsigned long cursor )
+{
+	if ( count > ring->capacity )
+	{
+		count = ring->capacity;
+	}
+	return claimed + count - cursor <= ring->capacity;
+}
+
+
+//
+//	s t r e a m W a i t F o r S p a c e
+//
+// Wait, with the STREAM_BLOCK policy, until the slowest consumer has
+// released enough frames for "count" more to be published.  This is called
+// by the writers before they take the shared memory lock, so a stalled
+// consumer holds up the writers but never the readers or a writer that
+// already has the lock.
+//
+// The gate is checked first so an insert only reads the cursors of the
+// consumers when the ring looks full.  The consumers of processes that have
+// died are detached each time a wait that has started yielding still finds
+// no space.
+//
+// Another writer may take the space before this one gets the lock, so the
+// writer checks it again with streamReserve.
+//
+void streamWaitForSpace ( streamRing_t* ring, unsigned long count )
+{
+	if ( ring->policy != STREAM_BLOCK ||
+		 hasSpace ( ring, __atomic_load_n ( &ring->claimed, __ATOMIC_RELAXED ),
+					count, __atomic_load_n ( &ring->gate, __ATOMIC_RELAXED ) ) )
+	{
+		return;
+	}
+	unsigned long waits = 0;
+
+	while ( ! hasSpace ( ring, __atomic_load_n ( &ring->claimed, __ATOMIC_RELAXED ),
+						 count, lowestCursor ( ring ) ) )
+	{
+		if ( waits == 0 )
+		{
+			__atomic_fetch_add ( &ring->producerWaits, 1, __ATOMIC_RELAXED );
+		}
+		if ( ++waits < STREAM_SPIN_LIMIT )
+		{
+			SHARED_MEMORY_CPU_RELAX();
+		}
+		else
+		{
+			reapConsumers ( ring );
+			(void) sched_yield();
+		}
+	}
+}
+
+
+//
+//	s t r e a m R e s e r v e
+//
+// Check, with the shared memory lock held, that "count" more frames can be
+// published under the STREAM_BLOCK policy.  The cursors of the consumers
+// are only read if the gate says the ring is full.
+//
+// This function returns true if the frames can be claimed and false if
+// another writer took the space since streamWaitForSpace returned.  The
+// writer must then release the lock and wait again.
+//
+int streamReserve ( streamRing_t* ring, unsigned long count )
+{
+	if ( ring->policy != STREAM_BLOCK ||
+		 hasSpace ( ring, ring->claimed, count, ring->gate ) )
+	{
+		return 1;
+	}
+	__atomic_store_n ( &ring->gate, lowestCursor ( ring ), __ATOMIC_RELAXED );
+
+	return hasSpace ( ring, ring->claimed, count, ring->gate );
+}
+
+
+//
+//	s t r e a m C l a i m
+//
+// Claim the next "count" sequence numbers for the producer and return the
+// first one.  The producer fills in the frames with STREAM_FRAME and then
+// calls streamPublish.  There must only ever be one producer at a time.
+//
+// With the STREAM_BLOCK policy, the producer has already made sure there is
+// space with streamWaitForSpace and, if there is more than one writer,
+// streamReserve.  If it claims more than it reserved it waits here for the
+// consumers to release the frames, detaching the consumers that have died.
+// A frame that a live consumer hasn't released is never overwritten, except
+// by a batch that is bigger than the ring.
+//
+unsigned long streamClaim ( streamRing_t* ring, unsigned long count )
+{
+	unsigned long first = ring->claimed;
+	unsigned long end   = first + count;
+
+	if ( ring->policy == STREAM_BLOCK && ! hasSpace ( ring, first, count, ring->gate ) )
+	{
+		unsigned long waits = 0;
+
+		__atomic_store_n ( &ring->gate, lowestCursor ( ring ), __ATOMIC_RELAXED );
+		while ( ! hasSpace ( ring, first, count, ring->gate ) )
+		{
+			if ( ++waits < STREAM_SPIN_LIMIT )
+			{
+				SHARED_MEMORY_CPU_RELAX();
+			}
+			else
+			{
+				reapConsumers ( ring );
+				(void) sched_yield();
+			}
+			__atomic_store_n ( &ring->gate, lowestCursor ( ring ), __ATOMIC_RELAXED );
+		}
+	}
+	//
+	// Let the consumers know that these frames are about to be overwritten
+	// before we touch them.
+	//
+	__atomic_store_n ( &ring->claimed, end, __ATOMIC_RELAXED );
+	__atomic_thread_fence ( __ATOMIC_RELEASE );
+
+	return first;
+}
+
+
+//
+// Publish the frames that the producer has claimed and filled in.
+//
+void streamPublish ( streamRing_t* ring, unsigned long first,
+					 unsigned long count )
+{
+	__atomic_store_n ( &ring->published, first + count, __ATOMIC_RELEASE );
+}
+
+
+//
+// Publish a single message.  This is called by insertMessage while it holds
+// the shared memory lock, which is what makes insertMessage the single
+// producer.
+//
+void streamPublishMessage ( streamRing_t* ring, canMessage_t* message )
+{
+	unsigned long  sequence = streamClaim ( ring, 1 );
+	streamFrame_t* frame    = STREAM_FRAME ( ring, sequence );
+
+	frame->id  = message->canMessage.can_id;
+	frame->dlc = message->canMessage.can_dlc;
+	(void) memcpy ( frame->data, message->canMessage.data, CAN_MAX_DLEN );
+
+	streamPublish ( ring, sequence, 1 );
+}
+
+
+//
+// Attach a consumer to the stream ring.  The consumer will see the frames
+// published after this call.  A slot held by a process that has died is
+// reclaimed.
+//
+// This function returns 0 if there are no free consumer slots.
+//
+streamConsumer_t* streamAttach ( streamRing_t* ring )
+{
+	pid_t self = getpid();
+
+	for ( unsigned int i = 0; i < ring->maxConsumers; i++ )
+	{
+		streamConsumer_t* consumer = &ring->consumers[i];
+		pid_t             pid      = __atomic_load_n ( &consumer->pid,
+													   __ATOMIC_ACQUIRE );
+
+		if ( pid != 0 && ( kill ( pid, 0 ) == 0 || errno != ESRCH ) )
+		{
+			continue;
+		}
+		if ( __atomic_compare_exchange_n ( &consumer->pid, &pid, self, 0,
+										   __ATOMIC_ACQ_REL, __ATOMIC_RELAXED ) )
+		{
+			consumer->lagged  = 0;
+			consumer->dropped = 0;
+			__atomic_store_n ( &consumer->cursor,
+							   __atomic_load_n ( &ring->published,
+												 __ATOMIC_ACQUIRE ),
+							   __ATOMIC_RELEASE );
+			return consumer;
+		}
+	}
+	return 0;
+}
+
+
+//
+// Detach a consumer from the stream ring.
+//
+void streamDetach ( streamConsumer_t* consumer )
+{
+	__atomic_store_n ( &consumer->pid, 0, __ATOMIC_RELEASE );
+}
+
+
+//
+// Return the oldest sequence number whose frame can't be in the middle of
+// being overwritten.
+//
+static unsigned long oldestIntact ( streamRing_t* ring )
+{
+	unsigned long claimed = __atomic_load_n ( &ring->claimed, __ATOMIC_RELAXED );
+
+	return claimed > ring->capacity ? claimed - ring->capacity : 0;
+}
+
+
+//
+//	s t r e a m C o n s u m e r C l a i m
+//
+// Claim a batch of up to "maxCount" published frames for a consumer.  The
+// sequence number of the first frame is returned in "first" and the frames
+// are read in place with STREAM_FRAME.  The batch must be released with
+// streamConsumerRelease when the consumer is done with it.
+//
+// A consumer that has been lapped by the producer (with the STREAM_DROP
+// policy, or with STREAM_BLOCK by a batch bigger than the ring) skips ahead
+// to the oldest frame still in the ring and is flagged as lagged.
+//
+// This function returns the number of frames in the batch, which is zero if
+// nothing new has been published.
+//
+unsigned long streamConsumerClaim ( streamRing_t* ring,
+									streamConsumer_t* consumer,
+									unsigned long* first,
+									unsigned long maxCount )
+{
+	unsigned long cursor    = consumer->cursor;
+	unsigned long published = __atomic_load_n ( &ring->published,
+												__ATOMIC_ACQUIRE );
+
+	unsigned long oldest    = oldestIntact ( ring );
+
+	if ( cursor < oldest )
+	{
+		consumer->dropped += oldest - cursor;
+		consumer->lagged   = 1;
+		cursor             = oldest;
+	}
+	unsigned long count = published > cursor ? published - cursor : 0;
+	if ( count > maxCount )
+	{
+		count = maxCount;
+	}
+	*first = cursor;
+
+	return count;
+}
+
+
+//
+//	s t r e a m C o n s u m e r R e l e a s e
+//
+// Release a batch of frames claimed by a consumer and advance its cursor.
+//
+// The producer may have overwritten the start of the batch while the
+// consumer was reading it.  This function returns the number of frames at
+// the start of the batch that were overwritten (and must be discarded),
+// which is only ever non-zero with the STREAM_BLOCK policy if a batch bigger
+// than the ring lapped the consumer.
+//
+unsigned long streamConsumerRelease ( streamRing_t* ring,
+									  streamConsumer_t* consumer,
+									  unsigned long first,
+									  unsigned long count )
+{
+	unsigned long overwritten = 0;
+
+	__atomic_thread_fence ( __ATOMIC_ACQUIRE );
+
+	unsigned long oldest = oldestIntact ( ring );
+	if ( first < oldest )
+	{
+		overwritten = oldest - first;
+		if ( overwritten > count )
+		{
+			overwritten = count;
+		}
+		consumer->dropped += overwritten;
+		consumer->lagged   = 1;
+	}
+	__atomic_store_n ( &consumer->cursor, first + count, __ATOMIC_RELEASE );
+
+	return overwritten;
+}
+
+
+//
+// Copy up to "maxCount" frames for a consumer into the caller's buffer.
+//
+// This function returns the number of frames copied.
+//
+unsigned long streamRead ( streamRing_t* ring, streamConsumer_t* consumer,
+						   streamFrame_t* frames, unsigned long maxCount )
+{
+	unsigned long first;
+	unsigned long count = streamConsumerClaim ( ring, consumer, &first,
+												maxCount );
+	if ( count == 0 )
+	{
+		return 0;
+	}
+	//
+	// Copy the batch in at most two pieces since it may wrap around the end
+	// of the ring.
+	//
+	unsigned long start = first & ring->mask;
+	unsigned long piece = ring->capacity - start;
+	if ( piece > count )
+	{
+		piece = count;
+	}
+	(void) memcpy ( frames, &ring->frames[start], piece * sizeof(streamFrame_t) );
+	(void) memcpy ( frames + piece, ring->frames,
+					( count - piece ) * sizeof(streamFrame_t) );
+
+	unsigned long overwritten = streamConsumerRelease ( ring, consumer, first,
+														count );
+	if ( overwritten != 0 )
+	{
+		(void) memmove ( frames, frames + overwritten,
+						 ( count - overwritten ) * sizeof(streamFrame_t) );
+	}
+	return count - overwritten;
+}
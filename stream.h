@@ -0,0 +1,153 @@
+#pragma once
+#ifndef STREAM_H
+#define STREAM_H
+
+#include <sys/types.h>
+
+#include "canMessage.h"
+
+//
+// The stream ring is an optional region of the shared memory segment that
+// gives consumers every frame inserted into the message pool, in order.  The
+// message pool only holds the latest value of each message ID and the
+// journal is meant for one flusher, so consumers that need every frame (a
+// logger, a gateway, a signal decoder) read the stream ring instead.
+//
+// The ring is a power of two number of frames with a single producer
+// sequence and a cursor per consumer, in the style of the LMAX disruptor.
+// There is a single producer because insertMessage publishes to the ring
+// while it holds the shared memory lock.  The producer claims a range of
+// sequence numbers, fills in the frames and then publishes the range with
+// one store.  A consumer claims every frame between its cursor and the
+// published sequence as a batch, processes them in place and then releases
+// the batch by advancing its cursor.
+//
+// When a consumer falls a full ring behind, one of two overrun policies
+// applies:
+//
+//     STREAM_BLOCK - The writers wait for the slowest consumer to release
+//                    frames before they take the shared memory lock to
+//                    overwrite them.  A stalled consumer stalls the writers
+//                    but never the readers, and a consumer process that
+//                    dies is detached by the first writer that has to wait
+//                    for it.  A writer that finds, once it has the lock,
+//                    that another writer took the space releases the lock
+//                    and waits again, so a live consumer is never overrun
+//                    (except by a batch that is bigger than the ring).
+//
+//     STREAM_DROP  - The producer never waits.  A lagging consumer finds
+//                    that frames were overwritten, skips ahead to the oldest
+//                    frame still in the ring and is flagged as lagged with a
+//                    count of the frames it missed.
+//
+// Every field that is written by one party and read by others is on its own
+// pair of cache lines so the producer and the consumers never false share
+// (the adjacent line prefetcher works on 128 byte pairs).
+//
+
+//
+// Define the structure of a single frame in the ring.
+//
+typedef struct streamFrame_t
+{
+	canid_t       id;
+	unsigned char dlc;
+	unsigned char pad[3];
+	unsigned char data[CAN_MAX_DLEN];
+
+}   streamFrame_t;                          // 16 bytes
+
+//
+// Define the overrun policies.
+//
+typedef enum streamPolicy_t
+{
+	STREAM_BLOCK = 1,
+	STREAM_DROP  = 2,
+
+}   streamPolicy_t;
+
+//
+// Define the state of a consumer.
+//
+typedef struct streamConsumer_t
+{
+	pid_t         pid;                      // 0 if the slot is free
+	unsigned int  lagged;                   // Set when frames were dropped
+	unsigned long cursor;                   // Next sequence to read
+	unsigned long dropped;
+
+}   __attribute__((aligned(128))) streamConsumer_t;
+
+//
+// Define the header of the stream ring region.
+//
+#define STREAM_MAX_CONSUMERS 32
+
+typedef struct streamRing_t
+{
+	unsigned long capacity;                 // Frames (power of 2)
+	unsigned long mask;                     // capacity - 1
+	unsigned int  maxConsumers;
+	unsigned int  policy;
+
+	//
+	// The producer sequences.  The frames before "published" are ready to be
+	// read.  The frames before "claimed" may be in the middle of being
+	// written.
+	//
+	unsigned long published __attribute__((aligned(128)));
+	unsigned long claimed;
+
+	//
+	// The producer's state.  The gate is the lowest consumer cursor the
+	// producer saw the last time it looked, so the writers only read the
+	// consumer cursors when it says the ring is full.  The waits are counted
+	// by the writers before they take the lock.
+	//
+	unsigned long gate __attribute__((aligned(128)));
+	unsigned long producerWaits;            // Writers that waited for space
+
+	streamConsumer_t consumers[STREAM_MAX_CONSUMERS];
+
+	streamFrame_t    frames[0] __attribute__((aligned(128)));
+
+}   streamRing_t;
+
+//
+// Return the frame in the ring that holds a sequence number.
+//
+#define STREAM_FRAME(ring,sequence) ( &(ring)->frames[(sequence) & (ring)->mask] )
+
+//
+// Define the stream functions.
+//
+unsigned long     streamRegionSize ( unsigned long capacity );
+void              streamInitialize ( streamRing_t* ring, unsigned long capacity,
+									 unsigned int maxConsumers,
+									 streamPolicy_t policy );
+
+void              streamWaitForSpace ( streamRing_t* ring, unsigned long count );
+int               streamReserve    ( streamRing_t* ring, unsigned long count );
+unsigned long     streamClaim      ( streamRing_t* ring, unsigned long count );
+void              streamPublish    ( streamRing_t* ring, unsigned long first,
+									 unsigned long count );
+void              streamPublishMessage ( streamRing_t* ring,
+										 canMessage_t* message );
+
+streamConsumer_t* streamAttach     ( streamRing_t* ring );
+void              streamDetach     ( streamConsumer_t* consumer );
+unsigned long     streamConsumerClaim ( streamRing_t* ring,
+										streamConsumer_t* consumer,
+										unsigned long* first,
+										unsigned long maxCount );
+unsigned long     streamConsumerRelease ( streamRing_t* ring,
+										  streamConsumer_t* consumer,
+										  unsigned long first,
+										  unsigned long count );
+unsigned long     streamRead       ( streamRing_t* ring,
+									 streamConsumer_t* consumer,
+									 streamFrame_t* frames,
+									 unsigned long maxCount );
+
+#endif		// End of STREAM_H
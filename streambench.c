@@ -0,0 +1,414 @@
+//
+//	s t r e a m b e n c h . c
+//
+//  Measure the throughput of the stream ring (see stream.h) with a single
+//  producer and a number of consumer processes.
+//
+//  The program forks the consumers, waits for them to attach to the ring and
+//  then produces a fixed number of frames as fast as it can.  Each frame
+//  carries its own sequence number in its data so the consumers can check
+//  that they saw every frame, in order, and that none of them was torn.  The
+//  consumers claim whole batches and read the frames in place.
+//
+//  By default the frames are produced with insertMessage so the numbers
+//  include the update of the message pool.  With the "-B" option the
+//  producer claims and publishes batches of frames directly, which shows the
+//  cost of the ring itself.  Don't run any other writers on the segment with
+//  "-B" since the ring must only ever have one producer.
+//
+//  The shared memory segment must have been created with a stream ring
+//  ("create -r").  The overrun policy is the one the ring was created with.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <locale.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the most frames a consumer claims at once.
+//
+#define MAX_BATCH 4096
+
+//
+// Define the benchmark parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static unsigned int  consumerCount = 8;
+static unsigned long frameCount    = 20000000;
+static unsigned int  batchSize     = 0;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the results that each consumer passes back to the parent through an
+// anonymous shared mapping.
+//
+typedef struct consumerResults_t
+{
+	volatile int  ready;
+	unsigned long frames;
+	unsigned long batches;
+	unsigned long errors;
+	unsigned long dropped;
+	unsigned long finishNs;
+
+}   __attribute__((aligned(128))) consumerResults_t;
+
+typedef struct benchResults_t
+{
+	volatile int      stop;
+	unsigned long     lastSequence;
+	consumerResults_t consumers[STREAM_MAX_CONSUMERS];
+
+}   benchResults_t;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -c    Consumers        int           8 \n\
+    -n    Frames           int     20,000,000 \n\
+    -B    Producer Batch   int     insertMessage \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Return the current monotonic time in nanoseconds.
+//
+static unsigned long nowNs ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// Run a consumer process.
+//
+static void runConsumer ( streamRing_t* ring, benchResults_t* bench,
+						  consumerResults_t* results )
+{
+	streamConsumer_t* consumer = streamAttach ( ring );
+	if ( consumer == 0 )
+	{
+		printf ( "No free stream ring reader slot.\n" );
+		_exit (255);
+	}
+	results->ready = 1;
+
+	for ( ;; )
+	{
+		unsigned long first;
+		unsigned long count = streamConsumerClaim ( ring, consumer, &first,
+													MAX_BATCH );
+		if ( count == 0 )
+		{
+			if ( bench->stop && consumer->cursor >= bench->lastSequence )
+			{
+				break;
+			}
+			//
+			// Give the processor to the producer.
+			//
+			(void) sched_yield();
+			continue;
+		}
+
+		//
+		// Check the frames in place.
+		//
+		unsigned long errors = 0;
+		for ( unsigned long i = 0; i < count; i++ )
+		{
+			streamFrame_t* frame = STREAM_FRAME ( ring, first + i );
+			unsigned long  sequence;
+
+			(void) memcpy ( &sequence, frame->data, sizeof(sequence) );
+			errors += sequence != first + i;
+		}
+		unsigned long overwritten = streamConsumerRelease ( ring, consumer, first,
+															count );
+		//
+		// Frames that were overwritten while we looked at them are expected to
+		// be wrong with the drop policy.  The rest were intact when we read
+		// them so they are checked again.
+		//
+		if ( errors != 0 && overwritten != 0 )
+		{
+			errors = 0;
+			for ( unsigned long i = overwritten; i < count; i++ )
+			{
+				streamFrame_t* frame = STREAM_FRAME ( ring, first + i );
+				unsigned long  sequence;
+
+				(void) memcpy ( &sequence, frame->data, sizeof(sequence) );
+				errors += sequence != first + i;
+			}
+		}
+		results->frames  += count - overwritten;
+		results->errors  += errors;
+		results->batches++;
+	}
+	results->dropped  = consumer->dropped;
+	results->finishNs = nowNs();
+
+	streamDetach ( consumer );
+	_exit (0);
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:B:c:hn:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'c':
+		    consumerCount = atol ( optarg );
+			if ( consumerCount <= 0 || consumerCount > STREAM_MAX_CONSUMERS )
+			{
+				printf ( "Invalid consumer count[%u] specified.\n",
+						 consumerCount );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'n':
+		    frameCount = atol ( optarg );
+			break;
+
+		  case 'B':
+		    batchSize = atol ( optarg );
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( optind != argc )
+	{
+		printf ( "Invalid parameter encountered: %s\n", argv[optind] );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Open the shared memory file and find the stream ring.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	streamRing_t* ring = sharedMemoryGetStreamRing ( sharedMemory );
+	if ( ring == 0 )
+	{
+		printf ( "The shared memory segment has no stream ring - Use "
+				 "\"create -r\" to create one.\n" );
+		exit (255);
+	}
+	if ( batchSize > ring->capacity )
+	{
+		printf ( "The producer batch size must not be larger than the ring.\n" );
+		exit (255);
+	}
+	benchResults_t* bench = mmap ( NULL, sizeof(benchResults_t),
+								   PROT_READ|PROT_WRITE,
+								   MAP_SHARED|MAP_ANONYMOUS, -1, 0 );
+	if ( bench == MAP_FAILED )
+	{
+		printf ( "Unable to map the results area.\n" );
+		exit (255);
+	}
+	//
+	// Start the consumers and wait for them to attach.
+	//
+	pid_t pids[STREAM_MAX_CONSUMERS];
+
+	fflush ( stdout );
+	for ( unsigned int i = 0; i < consumerCount; i++ )
+	{
+		pids[i] = fork();
+		if ( pids[i] == 0 )
+		{
+			runConsumer ( ring, bench, &bench->consumers[i] );
+		}
+	}
+	for ( unsigned int i = 0; i < consumerCount; i++ )
+	{
+		while ( ! bench->consumers[i].ready )
+		{
+			int status;
+			if ( waitpid ( pids[i], &status, WNOHANG ) == pids[i] )
+			{
+				printf ( "Consumer %u failed to start - Aborting\n", i );
+				exit (255);
+			}
+			usleep ( 1000 );
+		}
+	}
+	//
+	// Produce the frames.  Each frame carries its sequence number in the
+	// ring so the consumers can check it.
+	//
+	unsigned long waits   = ring->producerWaits;
+	unsigned long startNs = nowNs();
+
+	if ( batchSize == 0 )
+	{
+		canMessage_t       message;
+		unsigned long      sequence = ring->claimed;
+		unsigned int       poolSize = sharedMemoryGetPoolSize ( sharedMemory );
+
+		(void) memset ( &message, 0, sizeof(message) );
+		message.canMessage.can_dlc = CAN_MAX_DLEN;
+
+		for ( unsigned long i = 0; i < frameCount; i++, sequence++ )
+		{
+			message.canMessage.can_id = i % poolSize;
+			(void) memcpy ( message.canMessage.data, &sequence, sizeof(sequence) );
+			(void) insertMessage ( sharedMemory, &message );
+		}
+	}
+	else
+	{
+		for ( unsigned long done = 0; done < frameCount; )
+		{
+			unsigned long count = frameCount - done;
+			if ( count > batchSize )
+			{
+				count = batchSize;
+			}
+			streamWaitForSpace ( ring, count );
+
+			unsigned long first = streamClaim ( ring, count );
+			for ( unsigned long i = 0; i < count; i++ )
+			{
+				streamFrame_t* frame    = STREAM_FRAME ( ring, first + i );
+				unsigned long  sequence = first + i;
+
+				frame->id  = ( done + i ) & CAN_SFF_MASK;
+				frame->dlc = CAN_MAX_DLEN;
+				(void) memcpy ( frame->data, &sequence, sizeof(sequence) );
+			}
+			streamPublish ( ring, first, count );
+			done += count;
+		}
+	}
+	unsigned long producedNs = nowNs() - startNs;
+
+	//
+	// Tell the consumers where the end is and wait for them to drain the
+	// ring.
+	//
+	bench->lastSequence = ring->published;
+	__atomic_store_n ( &bench->stop, 1, __ATOMIC_RELEASE );
+
+	unsigned long lastFinishNs = startNs;
+	for ( unsigned int i = 0; i < consumerCount; i++ )
+	{
+		(void) waitpid ( pids[i], 0, 0 );
+		if ( bench->consumers[i].finishNs > lastFinishNs )
+		{
+			lastFinishNs = bench->consumers[i].finishNs;
+		}
+	}
+	unsigned long totalNs = lastFinishNs - startNs;
+
+	//
+	// Report the results.
+	//
+	unsigned long frames  = 0;
+	unsigned long batches = 0;
+	unsigned long errors  = 0;
+	unsigned long dropped = 0;
+
+	printf ( "\n  Consumer     Frames      Batches     Dropped   Errors\n" );
+	for ( unsigned int i = 0; i < consumerCount; i++ )
+	{
+		consumerResults_t* results = &bench->consumers[i];
+
+		printf ( "  %8u  %'12lu  %'10lu  %'10lu  %'6lu\n", i, results->frames,
+				 results->batches, results->dropped, results->errors );
+
+		frames  += results->frames;
+		batches += results->batches;
+		errors  += results->errors;
+		dropped += results->dropped;
+	}
+	printf ( "\nPolicy: %s, ring of %'lu frames, producer %s.\n",
+			 ring->policy == STREAM_BLOCK ? "block" : "drop", ring->capacity,
+			 batchSize == 0 ? "insertMessage" : "batch" );
+	printf ( "Produced %'lu frames in %'lu us (%'lu frames/sec), %'lu producer "
+			 "waits.\n", frameCount, producedNs / 1000,
+			 (unsigned long)( frameCount * 1e9 / producedNs ),
+			 ring->producerWaits - waits );
+	printf ( "Delivered %'lu frames to %u consumers in %'lu us (%'lu frames/sec "
+			 "through the ring, %'lu per consumer), average batch %'lu.\n",
+			 frames, consumerCount, totalNs / 1000,
+			 (unsigned long)( frameCount * 1e9 / totalNs ),
+			 (unsigned long)( frames * 1e9 / totalNs / consumerCount ),
+			 batches == 0 ? 0 : frames / batches );
+	printf ( "Dropped %'lu frames, %'lu errors.\n\n", dropped, errors );
+
+	sharedMemoryClose ( sharedMemory );
+
+	return errors == 0 ? 0 : 1;
+}
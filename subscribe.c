@@ -0,0 +1,285 @@
+//
+//	s u b s c r i b e . c
+//
+//  Consume messages from the message pool using one of the per consumer
+//  delivery policies (see delivery.h) and report how much work that took.
+//
+//  The shared memory segment must have been created with a delivery table
+//  (see the "-d" option of the "create" program).  The program subscribes to
+//  the requested message IDs, then repeatedly polls for deliveries and
+//  sleeps until the next subscription is due.  At the end of the run it
+//  reports the number of wakeups, deliveries and the CPU time used.
+//
+//  The "-b" option runs the same consumer as a fetch style busy poller
+//  instead so the two can be compared.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <locale.h>
+#include <stdbool.h>
+#include <sys/resource.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the largest number of message IDs that can be subscribed to.
+//
+#define MAX_IDS 4096
+
+//
+// Define the subscription parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static const char*      idList       = "0-99";
+static deliveryPolicy_t policy       = DELIVERY_COALESCE;
+static unsigned long    intervalMs   = 100;
+static unsigned int     runSeconds   = 10;
+static bool             busyPoll     = false;
+static bool             verbose      = false;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-B" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -i    Message IDs      list       0-99 \n\
+    -p    Policy          string   coalesce \n\
+    -t    Interval (ms)    int         100 \n\
+    -d    Duration (sec)   int          10 \n\
+    -b    Busy Poll        bool      false \n\
+    -v    Verbose          bool      false \n\
+    -B    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\
+  Policies are \"coalesce\", \"change\" and \"periodic\".\n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Return the CPU time used by this process in microseconds.
+//
+static unsigned long cpuTimeUs ( void )
+{
+	struct rusage usage;
+
+	(void) getrusage ( RUSAGE_SELF, &usage );
+
+	return usage.ru_utime.tv_sec * 1000000UL + usage.ru_utime.tv_usec +
+		   usage.ru_stime.tv_sec * 1000000UL + usage.ru_stime.tv_usec;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "B:bd:hi:p:t:v?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'b':
+			busyPoll = true;
+			break;
+
+		  case 'd':
+		    runSeconds = atol ( optarg );
+			break;
+
+		  case 'i':
+			idList = optarg;
+			break;
+
+		  case 'p':
+			if ( strcmp ( optarg, "coalesce" ) == 0 )
+			{
+				policy = DELIVERY_COALESCE;
+			}
+			else if ( strcmp ( optarg, "change" ) == 0 )
+			{
+				policy = DELIVERY_ON_CHANGE;
+			}
+			else if ( strcmp ( optarg, "periodic" ) == 0 )
+			{
+				policy = DELIVERY_PERIODIC;
+			}
+			else
+			{
+				printf ( "Invalid policy[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 't':
+		    intervalMs = atol ( optarg );
+			if ( intervalMs <= 0 )
+			{
+				printf ( "Invalid interval[%lu] specified.\n", intervalMs );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'v':
+			verbose = true;
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'B':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	canMessageIndex_t ids[MAX_IDS];
+	int               idCount = parseMessageIdList ( idList, ids, MAX_IDS );
+	if ( idCount <= 0 || optind != argc )
+	{
+		printf ( "Invalid message ID list[%s] specified.\n", idList );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+
+	unsigned long startNs   = deliveryNow();
+	unsigned long stopNs    = startNs + runSeconds * 1000000000UL;
+	unsigned long startCpu  = cpuTimeUs();
+	unsigned long wakeups   = 0;
+	unsigned long delivered = 0;
+
+	canMessage_t messages[MAX_IDS];
+
+	if ( busyPoll )
+	{
+		//
+		// Poll every ID as fast as we can, the way a fetch based consumer
+		// would have to in order to see every update promptly.
+		//
+		printf ( "Busy polling %d message IDs for %u seconds...\n", idCount,
+				 runSeconds );
+		while ( deliveryNow() < stopNs )
+		{
+			for ( int i = 0; i < idCount; i++ )
+			{
+				messages[i].canMessage.can_id = ids[i];
+				(void) fetchMessage ( sharedMemory, &messages[i] );
+			}
+			wakeups++;
+			delivered += idCount;
+		}
+	}
+	else
+	{
+		deliveryTable_t* table = sharedMemoryGetDeliveryTable ( sharedMemory );
+		if ( table == 0 )
+		{
+			printf ( "The shared memory segment has no delivery table - Use "
+					 "\"create -d\" to create one.\n" );
+			exit (255);
+		}
+		deliveryConsumer_t* consumer = deliveryAttach ( table );
+		if ( consumer == 0 )
+		{
+			printf ( "No delivery table slots are available - Aborting\n" );
+			exit (255);
+		}
+		for ( int i = 0; i < idCount; i++ )
+		{
+			if ( deliverySubscribe ( sharedMemory, consumer, ids[i], policy,
+									 intervalMs * 1000000UL ) != 0 )
+			{
+				exit (255);
+			}
+		}
+		printf ( "Consuming %d message IDs for %u seconds...\n", idCount,
+				 runSeconds );
+
+		unsigned long nextDue = startNs;
+		while ( nextDue < stopNs )
+		{
+			deliveryWait ( nextDue );
+			wakeups++;
+
+			int count = deliveryPoll ( sharedMemory, consumer, messages,
+									   MAX_IDS, &nextDue );
+			delivered += count;
+			if ( verbose )
+			{
+				for ( int i = 0; i < count; i++ )
+				{
+					printf ( "  %03X [%u] seq %u\n",
+							 messages[i].canMessage.can_id,
+							 messages[i].canMessage.can_dlc,
+							 messages[i].sequence );
+				}
+			}
+		}
+		deliveryDetach ( consumer );
+	}
+	//
+	// Report the results.
+	//
+	double seconds = ( deliveryNow() - startNs ) / 1000000000.0;
+	unsigned long cpuUs = cpuTimeUs() - startCpu;
+
+	printf ( "%'lu wakeups (%'lu/sec), %'lu messages delivered (%'lu/sec), "
+			 "CPU %'lu msec (%.1f%%)\n", wakeups,
+			 (unsigned long)( wakeups / seconds ), delivered,
+			 (unsigned long)( delivered / seconds ), cpuUs / 1000,
+			 cpuUs / 10000.0 / seconds );
+
+	sharedMemoryClose ( sharedMemory );
+
+    return 0;
+}
@@ -0,0 +1,376 @@
+//
+//	t r a c e . c
+//
+//  Write a columnar compressed trace file from the message pool's insert
+//  stream.
+//
+//  The insert stream can either be read live from the journal in the shared
+//  memory segment (the default) or from the journal files written by the
+//  "record" program (given as arguments).  When reading journal files, the
+//  same records can also be written as a candump text log with the "-d"
+//  option so the two formats can be compared.  The throughput of the trace
+//  encoder and of the candump writer are timed separately and the sizes of
+//  the raw journal, the trace file and the candump log are reported.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <locale.h>
+#include <stdbool.h>
+#include <sys/stat.h>
+
+#include "sharedMemory.h"
+#include "traceFile.h"
+
+//
+// Define the number of journal records read from a journal file at a time.
+//
+#define READ_RECORDS ( 32 * 1024 )
+
+//
+// Define the name of the trace file to be written.  Note that this default
+// value can be overridden using the "-o" command line option.
+//
+static const char* traceFileName = "trace.vsit";
+
+//
+// Define the name of the candump log to be written (if any) and the
+// interface name to be used in it.
+//
+static const char* candumpFileName  = 0;
+static const char* candumpInterface = "can0";
+
+//
+// Define the flag that is set by the signal handler to stop a live trace.
+//
+static volatile sig_atomic_t stopRequested = 0;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options [journal files...]\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -o    Trace File      string   trace.vsit \n\
+    -d    Candump Log     string     None \n\
+    -I    Candump Iface   string     can0 \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\
+  If no journal files are given, the journal in the shared memory segment\n\
+  is traced live until <ctrl-c> is hit.\n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Stop a live trace when the user hits <ctrl-c>.
+//
+static void stopHandler ( int signalNumber )
+{
+	stopRequested = 1;
+}
+
+
+//
+// Return the current monotonic time in nanoseconds.
+//
+static unsigned long nowNs ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// Return the size of a file.
+//
+static unsigned long fileSize ( const char* fileName )
+{
+	struct stat stats;
+
+	if ( stat ( fileName, &stats ) != 0 )
+	{
+		return 0;
+	}
+	return stats.st_size;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:d:hI:o:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'd':
+			candumpFileName = optarg;
+			break;
+
+		  case 'I':
+			candumpInterface = optarg;
+			break;
+
+		  case 'o':
+			traceFileName = optarg;
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	//
+	// Open the output files.
+	//
+	traceWriter_t* writer = traceWriterOpen ( traceFileName );
+	if ( writer == 0 )
+	{
+		exit (255);
+	}
+	FILE* candump = 0;
+	if ( candumpFileName != 0 )
+	{
+		candump = fopen ( candumpFileName, "w" );
+		if ( candump == 0 )
+		{
+			printf ( "Unable to open candump log[%s] errno: %u[%s].\n",
+					 candumpFileName, errno, strerror(errno) );
+			exit (255);
+		}
+		(void) setvbuf ( candump, NULL, _IOFBF, 1024 * 1024 );
+	}
+	unsigned long records   = 0;
+	unsigned long traceNs   = 0;
+	unsigned long candumpNs = 0;
+	unsigned long startNs;
+
+	//
+	// If there are no journal files, trace the live journal.
+	//
+	if ( optind == argc )
+	{
+		sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+		journal_t*      journal      = 0;
+		if ( sharedMemory != 0 )
+		{
+			journal = sharedMemoryGetJournal ( sharedMemory );
+		}
+		if ( journal == 0 )
+		{
+			printf ( "Unable to find a journal in the shared memory segment - "
+					 "Aborting\n" );
+			exit (255);
+		}
+		unsigned long   cursor = __atomic_load_n ( &journal->head,
+												   __ATOMIC_ACQUIRE );
+		unsigned long   lost   = 0;
+		journalRecord_t record;
+
+		signal ( SIGINT,  stopHandler );
+		signal ( SIGTERM, stopHandler );
+		printf ( "Tracing the live journal to %s. <ctrl-c> to quit...\n",
+				 traceFileName );
+
+		startNs = nowNs();
+		while ( ! stopRequested )
+		{
+			int status = journalRead ( journal, &cursor, &record );
+			if ( status > 0 )
+			{
+				if ( traceWriterAppend ( writer, &record ) != 0 )
+				{
+					exit (255);
+				}
+				if ( candump != 0 )
+				{
+					traceWriteCandump ( candump, candumpInterface, &record );
+				}
+				records++;
+			}
+			else if ( status < 0 )
+			{
+				lost++;
+			}
+			else
+			{
+				struct timespec delay = { 0, 100 * 1000 };
+				(void) nanosleep ( &delay, NULL );
+			}
+		}
+		traceNs = nowNs() - startNs;
+		if ( lost != 0 )
+		{
+			printf ( "Warning: the journal was overrun %'lu times while "
+					 "tracing.\n", lost );
+		}
+		sharedMemoryClose ( sharedMemory );
+	}
+	//
+	// Otherwise, convert each of the journal files in turn.
+	//
+	else
+	{
+		journalRecord_t* buffer = malloc ( READ_RECORDS * sizeof(journalRecord_t) );
+		if ( buffer == 0 )
+		{
+			printf ( "Unable to allocate the read buffer.\n" );
+			exit (255);
+		}
+		for ( int file = optind; file < argc; file++ )
+		{
+			int fd = open ( argv[file], O_RDONLY );
+			journalFileHeader_t header;
+
+			if ( fd < 0 ||
+				 read ( fd, &header, sizeof(header) ) != sizeof(header) ||
+				 header.magic      != JOURNAL_FILE_MAGIC ||
+				 header.version    != JOURNAL_FILE_VERSION ||
+				 header.recordSize != sizeof(journalRecord_t) )
+			{
+				printf ( "File[%s] is not a valid journal file - Skipped.\n",
+						 argv[file] );
+				if ( fd >= 0 )
+				{
+					(void) close ( fd );
+				}
+				continue;
+			}
+			ssize_t length;
+			while ( ( length = read ( fd, buffer, READ_RECORDS *
+									  sizeof(journalRecord_t) ) ) > 0 )
+			{
+				unsigned long count = length / sizeof(journalRecord_t);
+
+				//
+				// Run the trace encoder and the candump writer over the
+				// records separately so each can be timed on its own.
+				// Records that were dropped in the journal (sequence of 0)
+				// are skipped.
+				//
+				startNs = nowNs();
+				for ( unsigned long i = 0; i < count; i++ )
+				{
+					if ( buffer[i].sequence != 0 &&
+						 traceWriterAppend ( writer, &buffer[i] ) != 0 )
+					{
+						exit (255);
+					}
+				}
+				traceNs += nowNs() - startNs;
+
+				if ( candump != 0 )
+				{
+					startNs = nowNs();
+					for ( unsigned long i = 0; i < count; i++ )
+					{
+						if ( buffer[i].sequence != 0 )
+						{
+							traceWriteCandump ( candump, candumpInterface,
+												&buffer[i] );
+						}
+					}
+					candumpNs += nowNs() - startNs;
+				}
+				records += count;
+			}
+			(void) close ( fd );
+		}
+		free ( buffer );
+	}
+	//
+	// Finish the files and report the results.
+	//
+	traceFileHeader_t header;
+
+	startNs = nowNs();
+	if ( traceWriterClose ( writer, &header ) != 0 )
+	{
+		exit (255);
+	}
+	traceNs += nowNs() - startNs;
+
+	if ( candump != 0 )
+	{
+		startNs = nowNs();
+		(void) fclose ( candump );
+		candumpNs += nowNs() - startNs;
+	}
+	unsigned long rawBytes   = header.frameCount * sizeof(journalRecord_t);
+	unsigned long traceBytes = fileSize ( traceFileName );
+
+	printf ( "%'lu records, %'lu frames in %'lu blocks.\n", records,
+			 header.frameCount, header.blockCount );
+	printf ( "Trace ingest:   %'lu frames/sec\n",
+			 traceNs ? (unsigned long)( header.frameCount /
+										( traceNs / 1000000000.0 ) ) : 0 );
+	if ( candump != 0 )
+	{
+		printf ( "Candump ingest: %'lu frames/sec\n",
+				 candumpNs ? (unsigned long)( header.frameCount /
+											  ( candumpNs / 1000000000.0 ) ) : 0 );
+	}
+	printf ( "Journal size:   %'lu bytes\n", rawBytes );
+	printf ( "Trace size:     %'lu bytes - %.1f:1 vs journal - %.2f bytes/frame\n",
+			 traceBytes, traceBytes ? (double)rawBytes / traceBytes : 0.0,
+			 header.frameCount ? (double)traceBytes / header.frameCount : 0.0 );
+	if ( candump != 0 )
+	{
+		unsigned long candumpBytes = fileSize ( candumpFileName );
+
+		printf ( "Candump size:   %'lu bytes - trace is %.1f:1 smaller\n",
+				 candumpBytes,
+				 traceBytes ? (double)candumpBytes / traceBytes : 0.0 );
+	}
+    return 0;
+}
@@ -0,0 +1,790 @@
+//
+//	t r a c e F i l e . c
+//
+//  Read and write columnar compressed trace files.  See traceFile.h for a
+//  description of the file format.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "traceFile.h"
+
+//
+// Define the initial size of the table of message IDs being written.  It
+// doubles every time it gets half full.
+//
+#define TRACE_INITIAL_IDS 1024
+
+//
+// Define the initial number of frames buffered for each message ID.  It
+// doubles whenever it fills up until it reaches TRACE_BLOCK_FRAMES so that
+// traces with many rarely seen IDs don't need a full block buffer for each.
+//
+#define TRACE_INITIAL_FRAMES 16
+
+//
+// Define the largest number of bytes a block can encode to.  This is the
+// block header plus the worst case sizes of each of the columns.
+//
+#define TRACE_MAX_BLOCK_SIZE ( sizeof(traceBlockHeader_t) +                \
+							   TRACE_BLOCK_FRAMES * ( 10 + 11 + 9 ) )
+
+//
+// Define the frames that have been collected for one message ID but not yet
+// written as a block.
+//
+typedef struct tracePending_t
+{
+	canid_t          id;
+	unsigned int     count;
+	unsigned int     capacity;
+	journalRecord_t* frames;
+
+}   tracePending_t;
+
+//
+// Define the state of a trace file being written.
+//
+struct traceWriter_t
+{
+	FILE*              file;
+	traceFileHeader_t  header;
+
+	tracePending_t*    pending;
+	unsigned int       pendingSize;
+	unsigned int       pendingUsed;
+
+	traceBlockIndex_t* index;
+	unsigned long      indexSize;
+
+	unsigned char*     encodeBuffer;
+};
+
+
+//
+// Encode a value as a varint (7 bits per byte, high bit set on all but the
+// last byte) and return the number of bytes used.
+//
+static unsigned int putVarint ( unsigned char* output, unsigned long value )
+{
+	unsigned int length = 0;
+
+	while ( value >= 0x80 )
+	{
+		output[length++] = (unsigned char)( value | 0x80 );
+		value >>= 7;
+	}
+	output[length++] = (unsigned char)value;
+
+	return length;
+}
+
+
+//
+// Decode a varint and return the number of bytes used or 0 if the varint
+// runs off the end of the input.
+//
+static unsigned int getVarint ( const unsigned char* input, unsigned int limit,
+								unsigned long* value )
+{
+	unsigned long result = 0;
+	unsigned int  shift  = 0;
+
+	for ( unsigned int i = 0; i < limit && shift < 64; i++, shift += 7 )
+	{
+		result |= (unsigned long)( input[i] & 0x7f ) << shift;
+		if ( ( input[i] & 0x80 ) == 0 )
+		{
+			*value = result;
+			return i + 1;
+		}
+	}
+	return 0;
+}
+
+
+//
+// Map signed values onto unsigned ones so small negative numbers encode as
+// small varints.
+//
+static inline unsigned long zigzagEncode ( long value )
+{
+	return ( (unsigned long)value << 1 ) ^ (unsigned long)( value >> 63 );
+}
+
+static inline long zigzagDecode ( unsigned long value )
+{
+	return (long)( value >> 1 ) ^ -(long)( value & 1 );
+}
+
+
+//
+// Encode the pending frames of one message ID as a block and return the
+// encoded size.
+//
+static unsigned int encodeBlock ( tracePending_t* pending,
+								  unsigned char* output )
+{
+	traceBlockHeader_t* header = (traceBlockHeader_t*)output;
+	unsigned char*      next   = output + sizeof(traceBlockHeader_t);
+	unsigned char*      start;
+
+	header->id             = pending->id;
+	header->frameCount     = pending->count;
+	header->firstTimestamp = pending->frames[0].timestamp;
+	header->reserved       = 0;
+
+	//
+	// The timestamp column.
+	//
+	start = next;
+	long previousDelta = 0;
+	for ( unsigned int i = 1; i < pending->count; i++ )
+	{
+		long delta = pending->frames[i].timestamp - pending->frames[i-1].timestamp;
+
+		next += putVarint ( next, zigzagEncode ( delta - previousDelta ) );
+		previousDelta = delta;
+	}
+	header->timestampBytes = next - start;
+
+	//
+	// The dlc column.
+	//
+	start = next;
+	for ( unsigned int i = 0; i < pending->count; )
+	{
+		unsigned int run = 1;
+		while ( i + run < pending->count &&
+				pending->frames[i+run].dlc == pending->frames[i].dlc )
+		{
+			run++;
+		}
+		*next++ = pending->frames[i].dlc;
+		next += putVarint ( next, run );
+		i += run;
+	}
+	header->dlcBytes = next - start;
+
+	//
+	// The payload column.
+	//
+	start = next;
+	unsigned char previous[CAN_MAX_DLEN] = { 0 };
+	for ( unsigned int i = 0; i < pending->count; i++ )
+	{
+		unsigned char* mask = next++;
+
+		*mask = 0;
+		for ( unsigned int j = 0; j < CAN_MAX_DLEN; j++ )
+		{
+			unsigned char difference = pending->frames[i].data[j] ^ previous[j];
+			if ( difference != 0 )
+			{
+				*mask |= 1 << j;
+				*next++ = difference;
+			}
+		}
+		(void) memcpy ( previous, pending->frames[i].data, CAN_MAX_DLEN );
+	}
+	header->payloadBytes = next - start;
+
+	return next - output;
+}
+
+
+//
+// Decode a block into an array of frames.  This function will return the
+// number of frames decoded or -1 if the block is corrupt.
+//
+static long decodeBlock ( const unsigned char* input, unsigned long length,
+						  traceFrame_t* frames )
+{
+	const traceBlockHeader_t* header = (const traceBlockHeader_t*)input;
+
+	if ( length < sizeof(traceBlockHeader_t) ||
+		 header->frameCount > TRACE_BLOCK_FRAMES ||
+		 sizeof(traceBlockHeader_t) + (unsigned long)header->timestampBytes +
+		 header->dlcBytes + header->payloadBytes > length )
+	{
+		return -1;
+	}
+	const unsigned char* column = input + sizeof(traceBlockHeader_t);
+	unsigned int         used;
+	unsigned long        value;
+
+	//
+	// The timestamp column.
+	//
+	unsigned int offset = 0;
+	long         delta  = 0;
+
+	frames[0].timestamp = header->firstTimestamp;
+	for ( unsigned int i = 1; i < header->frameCount; i++ )
+	{
+		used = getVarint ( column + offset, header->timestampBytes - offset,
+						   &value );
+		if ( used == 0 )
+		{
+			return -1;
+		}
+		offset += used;
+		delta  += zigzagDecode ( value );
+		frames[i].timestamp = frames[i-1].timestamp + delta;
+	}
+	column += header->timestampBytes;
+
+	//
+	// The dlc column.
+	//
+	offset = 0;
+	for ( unsigned int i = 0; i < header->frameCount; )
+	{
+		if ( offset >= header->dlcBytes )
+		{
+			return -1;
+		}
+		unsigned char dlc = column[offset++];
+		used = getVarint ( column + offset, header->dlcBytes - offset, &value );
+		if ( used == 0 || value == 0 || i + value > header->frameCount )
+		{
+			return -1;
+		}
+		offset += used;
+		for ( unsigned long j = 0; j < value; j++ )
+		{
+			frames[i++].dlc = dlc;
+		}
+	}
+	column += header->dlcBytes;
+
+	//
+	// The payload column.
+	//
+	offset = 0;
+	unsigned char previous[CAN_MAX_DLEN] = { 0 };
+	for ( unsigned int i = 0; i < header->frameCount; i++ )
+	{
+		if ( offset >= header->payloadBytes )
+		{
+			return -1;
+		}
+		unsigned char mask = column[offset++];
+		for ( unsigned int j = 0; j < CAN_MAX_DLEN; j++ )
+		{
+			if ( mask & ( 1 << j ) )
+			{
+				if ( offset >= header->payloadBytes )
+				{
+					return -1;
+				}
+				previous[j] ^= column[offset++];
+			}
+		}
+		(void) memcpy ( frames[i].data, previous, CAN_MAX_DLEN );
+		frames[i].id = header->id;
+	}
+	return header->frameCount;
+}
+
+
+//
+// Write the pending frames of one message ID to the file as a block and add
+// the block to the index.
+//
+static int flushPending ( traceWriter_t* writer, tracePending_t* pending )
+{
+	if ( pending->count == 0 )
+	{
+		return 0;
+	}
+	unsigned int length = encodeBlock ( pending, writer->encodeBuffer );
+
+	if ( fwrite ( writer->encodeBuffer, 1, length, writer->file ) != length )
+	{
+		printf ( "Unable to write trace block errno: %u[%s].\n",
+				 errno, strerror(errno) );
+		return -1;
+	}
+	//
+	// Add this block to the index, growing the index if necessary.
+	//
+	if ( writer->header.blockCount == writer->indexSize )
+	{
+		writer->indexSize = writer->indexSize ? writer->indexSize * 2 : 1024;
+		writer->index = realloc ( writer->index,
+								  writer->indexSize * sizeof(traceBlockIndex_t) );
+		if ( writer->index == 0 )
+		{
+			printf ( "Unable to allocate the trace block index.\n" );
+			return -1;
+		}
+	}
+	traceBlockIndex_t* entry = &writer->index[writer->header.blockCount++];
+
+	entry->id             = pending->id;
+	entry->frameCount     = pending->count;
+	entry->firstTimestamp = pending->frames[0].timestamp;
+	entry->lastTimestamp  = pending->frames[pending->count - 1].timestamp;
+	entry->offset         = writer->header.indexOffset;
+	entry->length         = length;
+
+	writer->header.indexOffset += length;
+	pending->count = 0;
+
+	return 0;
+}
+
+
+//
+// Find the pending frames for a message ID, adding the ID to the table if
+// it's not there yet.
+//
+static tracePending_t* findPending ( traceWriter_t* writer, canid_t id )
+{
+	//
+	// Grow the table if it is half full.
+	//
+	if ( writer->pendingUsed * 2 >= writer->pendingSize )
+	{
+		unsigned int    oldSize = writer->pendingSize;
+		tracePending_t* old     = writer->pending;
+
+		writer->pendingSize = oldSize ? oldSize * 2 : TRACE_INITIAL_IDS;
+		writer->pending     = calloc ( writer->pendingSize,
+									   sizeof(tracePending_t) );
+		if ( writer->pending == 0 )
+		{
+			return 0;
+		}
+		for ( unsigned int i = 0; i < oldSize; i++ )
+		{
+			if ( old[i].frames != 0 )
+			{
+				unsigned int slot = ( old[i].id * 2654435761U ) &
+									( writer->pendingSize - 1 );
+				while ( writer->pending[slot].frames != 0 )
+				{
+					slot = ( slot + 1 ) & ( writer->pendingSize - 1 );
+				}
+				writer->pending[slot] = old[i];
+			}
+		}
+		free ( old );
+	}
+	unsigned int slot = ( id * 2654435761U ) & ( writer->pendingSize - 1 );
+
+	while ( writer->pending[slot].frames != 0 )
+	{
+		if ( writer->pending[slot].id == id )
+		{
+			return &writer->pending[slot];
+		}
+		slot = ( slot + 1 ) & ( writer->pendingSize - 1 );
+	}
+	writer->pending[slot].id       = id;
+	writer->pending[slot].count    = 0;
+	writer->pending[slot].capacity = TRACE_INITIAL_FRAMES;
+	writer->pending[slot].frames   = malloc ( TRACE_INITIAL_FRAMES *
+											  sizeof(journalRecord_t) );
+	if ( writer->pending[slot].frames == 0 )
+	{
+		return 0;
+	}
+	writer->pendingUsed++;
+
+	return &writer->pending[slot];
+}
+
+
+//
+// Order the block index by message ID and then by time.
+//
+static int compareIndex ( const void* left, const void* right )
+{
+	const traceBlockIndex_t* a = left;
+	const traceBlockIndex_t* b = right;
+
+	if ( a->id != b->id )
+	{
+		return a->id < b->id ? -1 : 1;
+	}
+	if ( a->firstTimestamp != b->firstTimestamp )
+	{
+		return a->firstTimestamp < b->firstTimestamp ? -1 : 1;
+	}
+	return 0;
+}
+
+
+//
+// Open a new trace file for writing.
+//
+traceWriter_t* traceWriterOpen ( const char* fileName )
+{
+	traceWriter_t* writer = calloc ( 1, sizeof(traceWriter_t) );
+	if ( writer == 0 )
+	{
+		return 0;
+	}
+	writer->encodeBuffer = malloc ( TRACE_MAX_BLOCK_SIZE );
+	writer->file         = fopen ( fileName, "w" );
+	if ( writer->file == 0 || writer->encodeBuffer == 0 )
+	{
+		printf ( "Unable to open trace file[%s] errno: %u[%s].\n",
+				 fileName, errno, strerror(errno) );
+		free ( writer->encodeBuffer );
+		free ( writer );
+		return 0;
+	}
+	(void) setvbuf ( writer->file, NULL, _IOFBF, 1024 * 1024 );
+
+	//
+	// Write a placeholder header.  The real one is written when the file is
+	// closed.  The index offset is used as the running file offset until
+	// then.
+	//
+	writer->header.magic       = TRACE_FILE_MAGIC;
+	writer->header.version     = TRACE_FILE_VERSION;
+	writer->header.indexOffset = sizeof(traceFileHeader_t);
+	writer->header.firstTimestamp = ~0UL;
+
+	(void) fwrite ( &writer->header, sizeof(writer->header), 1, writer->file );
+
+	return writer;
+}
+
+
+//
+// Add a journal record to a trace file.
+//
+int traceWriterAppend ( traceWriter_t* writer, journalRecord_t* record )
+{
+	tracePending_t* pending = findPending ( writer, record->id );
+	if ( pending == 0 )
+	{
+		printf ( "Unable to allocate trace buffers.\n" );
+		return -1;
+	}
+	if ( pending->count == pending->capacity )
+	{
+		pending->capacity *= 2;
+		pending->frames = realloc ( pending->frames, pending->capacity *
+									sizeof(journalRecord_t) );
+		if ( pending->frames == 0 )
+		{
+			printf ( "Unable to allocate trace buffers.\n" );
+			return -1;
+		}
+	}
+	pending->frames[pending->count++] = *record;
+
+	if ( record->timestamp < writer->header.firstTimestamp )
+	{
+		writer->header.firstTimestamp = record->timestamp;
+	}
+	if ( record->timestamp > writer->header.lastTimestamp )
+	{
+		writer->header.lastTimestamp = record->timestamp;
+	}
+	writer->header.frameCount++;
+
+	if ( pending->count == TRACE_BLOCK_FRAMES )
+	{
+		return flushPending ( writer, pending );
+	}
+	return 0;
+}
+
+
+//
+// Finish writing a trace file.  The remaining partial blocks are written,
+// followed by the sorted block index and the final file header.  The header
+// is returned to the caller if requested.
+//
+int traceWriterClose ( traceWriter_t* writer, traceFileHeader_t* header )
+{
+	int status = 0;
+
+	for ( unsigned int i = 0; i < writer->pendingSize; i++ )
+	{
+		if ( writer->pending[i].frames != 0 )
+		{
+			if ( flushPending ( writer, &writer->pending[i] ) != 0 )
+			{
+				status = -1;
+			}
+			free ( writer->pending[i].frames );
+		}
+	}
+	qsort ( writer->index, writer->header.blockCount, sizeof(traceBlockIndex_t),
+			compareIndex );
+
+	if ( fwrite ( writer->index, sizeof(traceBlockIndex_t),
+				  writer->header.blockCount, writer->file ) !=
+		 writer->header.blockCount ||
+		 fseek ( writer->file, 0, SEEK_SET ) != 0 ||
+		 fwrite ( &writer->header, sizeof(writer->header), 1,
+				  writer->file ) != 1 )
+	{
+		printf ( "Unable to write trace index errno: %u[%s].\n",
+				 errno, strerror(errno) );
+		status = -1;
+	}
+	if ( fclose ( writer->file ) != 0 )
+	{
+		status = -1;
+	}
+	if ( header != 0 )
+	{
+		*header = writer->header;
+	}
+	free ( writer->pending );
+	free ( writer->index );
+	free ( writer->encodeBuffer );
+	free ( writer );
+
+	return status;
+}
+
+
+//
+// Map a range of a file into memory.  The mapping has to start on a page
+// boundary so the address of the requested offset within the mapping is
+// returned separately.
+//
+static void* mapRange ( int fd, unsigned long offset, unsigned long length,
+						void** mapping, unsigned long* mappingSize )
+{
+	unsigned long pageSize  = sysconf ( _SC_PAGESIZE );
+	unsigned long mapOffset = offset & ~( pageSize - 1 );
+
+	*mappingSize = length + ( offset - mapOffset );
+	*mapping     = mmap ( NULL, *mappingSize, PROT_READ, MAP_PRIVATE, fd,
+						  mapOffset );
+	if ( *mapping == MAP_FAILED )
+	{
+		return 0;
+	}
+	return (char*)*mapping + ( offset - mapOffset );
+}
+
+
+//
+// Return true if a range of bytes lies entirely within a file of the given
+// size.
+//
+static int inFile ( unsigned long fileSize, unsigned long offset,
+					unsigned long length )
+{
+	return offset <= fileSize && length <= fileSize - offset;
+}
+
+
+//
+// Open a trace file for reading.  Only the header is read and the block
+// index is mapped into memory.  The index has to lie within the file, since
+// touching a mapping past the end of a file (one whose writer was killed
+// before the index was written, for instance) raises SIGBUS.
+//
+// This function will return 0 if the file was opened and -1 if it was not.
+//
+int traceReaderOpen ( traceReader_t* reader, const char* fileName )
+{
+	(void) memset ( reader, 0, sizeof(traceReader_t) );
+
+	reader->fd = open ( fileName, O_RDONLY );
+	if ( reader->fd < 0 )
+	{
+		printf ( "Unable to open trace file[%s] errno: %u[%s].\n",
+				 fileName, errno, strerror(errno) );
+		return -1;
+	}
+	struct stat status;
+
+	if ( fstat ( reader->fd, &status ) != 0 ||
+		 pread ( reader->fd, &reader->header, sizeof(reader->header), 0 ) !=
+		 sizeof(reader->header) ||
+		 reader->header.magic   != TRACE_FILE_MAGIC ||
+		 reader->header.version != TRACE_FILE_VERSION )
+	{
+		printf ( "File[%s] is not a valid trace file.\n", fileName );
+		(void) close ( reader->fd );
+		return -1;
+	}
+	reader->fileSize = status.st_size;
+
+	if ( reader->header.blockCount > reader->fileSize / sizeof(traceBlockIndex_t) ||
+		 ! inFile ( reader->fileSize, reader->header.indexOffset,
+					reader->header.blockCount * sizeof(traceBlockIndex_t) ) )
+	{
+		printf ( "The index of trace file[%s] is not within the file - it may "
+				 "be truncated.\n", fileName );
+		(void) close ( reader->fd );
+		return -1;
+	}
+	if ( reader->header.blockCount != 0 )
+	{
+		reader->index = mapRange ( reader->fd, reader->header.indexOffset,
+								   reader->header.blockCount *
+								   sizeof(traceBlockIndex_t),
+								   &reader->indexMapping,
+								   &reader->indexMappingSize );
+		if ( reader->index == 0 )
+		{
+			printf ( "Unable to map the trace index errno: %u[%s].\n",
+					 errno, strerror(errno) );
+			(void) close ( reader->fd );
+			return -1;
+		}
+	}
+	return 0;
+}
+
+
+//
+// Close a trace file that was opened for reading.
+//
+void traceReaderClose ( traceReader_t* reader )
+{
+	if ( reader->indexMapping != 0 )
+	{
+		(void) munmap ( reader->indexMapping, reader->indexMappingSize );
+	}
+	(void) close ( reader->fd );
+}
+
+
+//
+//	t r a c e Q u e r y
+//
+// Extract the frames of one message ID with timestamps in the range
+// [startTime, endTime] from a trace file.
+//
+// The block index is binary searched for the first block of the ID that ends
+// at or after the start time and then each block that overlaps the range is
+// mapped into memory, decoded and unmapped.  No other part of the file is
+// touched.
+//
+// Up to maxFrames frames are stored in the caller's array.  This function
+// returns the total number of frames that matched (which may be more than
+// maxFrames) or -1 if the file is corrupt, including a block that isn't
+// within the file.
+//
+long traceQuery ( traceReader_t* reader, canid_t id, unsigned long startTime,
+				  unsigned long endTime, traceFrame_t* frames,
+				  unsigned long maxFrames )
+{
+	traceFrame_t  decoded[TRACE_BLOCK_FRAMES];
+	unsigned long matched = 0;
+
+	//
+	// Find the first block of this ID that isn't entirely before the start
+	// time.
+	//
+	unsigned long low  = 0;
+	unsigned long high = reader->header.blockCount;
+
+	while ( low < high )
+	{
+		unsigned long      middle = ( low + high ) / 2;
+		traceBlockIndex_t* entry  = &reader->index[middle];
+
+		if ( entry->id < id || ( entry->id == id &&
+								 entry->lastTimestamp < startTime ) )
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	//
+	// Decode every block of this ID that overlaps the time range.
+	//
+	for ( unsigned long i = low; i < reader->header.blockCount; i++ )
+	{
+		traceBlockIndex_t* entry = &reader->index[i];
+
+		if ( entry->id != id || entry->firstTimestamp > endTime )
+		{
+			break;
+		}
+		if ( entry->length == 0 ||
+			 ! inFile ( reader->fileSize, entry->offset, entry->length ) )
+		{
+			return -1;
+		}
+		void*         mapping;
+		unsigned long mappingSize;
+		unsigned char* block = mapRange ( reader->fd, entry->offset,
+										  entry->length, &mapping,
+										  &mappingSize );
+		if ( block == 0 )
+		{
+			return -1;
+		}
+		long count = decodeBlock ( block, entry->length, decoded );
+		(void) munmap ( mapping, mappingSize );
+		if ( count < 0 )
+		{
+			return -1;
+		}
+		for ( long j = 0; j < count; j++ )
+		{
+			if ( decoded[j].timestamp >= startTime &&
+				 decoded[j].timestamp <= endTime )
+			{
+				if ( matched < maxFrames )
+				{
+					frames[matched] = decoded[j];
+				}
+				matched++;
+			}
+		}
+	}
+	return matched;
+}
+
+
+//
+// Write a journal record to a file as a line of a candump text log.  This is
+// the "candump -l" format used by the can-utils tools.
+//
+void traceWriteCandump ( FILE* file, const char* interface,
+						 journalRecord_t* record )
+{
+	char line[128];
+	int  length;
+
+	length = snprintf ( line, sizeof(line), "(%lu.%06lu) %s ",
+						record->timestamp / 1000000000UL,
+						( record->timestamp % 1000000000UL ) / 1000,
+						interface );
+	if ( ( record->id & CAN_EFF_FLAG ) || record->id > CAN_SFF_MASK )
+	{
+		length += snprintf ( line + length, sizeof(line) - length, "%08X#",
+							 record->id & CAN_EFF_MASK );
+	}
+	else
+	{
+		length += snprintf ( line + length, sizeof(line) - length, "%03X#",
+							 record->id & CAN_SFF_MASK );
+	}
+	for ( unsigned int i = 0; i < record->dlc && i < CAN_MAX_DLEN; i++ )
+	{
+		length += snprintf ( line + length, sizeof(line) - length, "%02X",
+							 record->data[i] );
+	}
+	line[length++] = '\n';
+
+	(void) fwrite ( line, 1, length, file );
+}
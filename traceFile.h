@@ -0,0 +1,147 @@
+#pragma once
+#ifndef TRACE_FILE_H
+#define TRACE_FILE_H
+
+#include <stdio.h>
+
+#include "journal.h"
+
+//
+// The trace file is a compact columnar file format for recordings of the
+// messages inserted into the message pool.  It is much smaller than a
+// candump text log of the same traffic and a single message ID can be
+// extracted over a time window without reading the rest of the file.
+//
+// The file is laid out as follows:
+//
+//     traceFileHeader_t
+//     block 0
+//     block 1
+//     ...
+//     traceBlockIndex_t[blockCount]
+//
+// Each block holds up to TRACE_BLOCK_FRAMES frames of a single message ID in
+// time order.  The frames are stored as three columns:
+//
+//     timestamps - The first timestamp is in the block header.  The rest are
+//                  stored as zigzag varint encoded deltas of the delta from
+//                  the previous frame, so strictly periodic messages cost one
+//                  byte per frame.
+//
+//     dlc        - Run length encoded (dlc, run length) pairs.
+//
+//     payloads   - Each payload is XORed with the previous one.  The result
+//                  is stored as a one byte mask of the non-zero bytes followed
+//                  by those bytes, so an unchanged payload costs one byte.
+//
+// The block index at the end of the file is sorted by message ID and then by
+// time so a reader can binary search it for the blocks of one ID that overlap
+// a time range and map only those blocks into memory.
+//
+
+#define TRACE_FILE_MAGIC   0x54495356           // "VSIT"
+#define TRACE_FILE_VERSION 1
+
+//
+// Define the maximum number of frames in a block.
+//
+#define TRACE_BLOCK_FRAMES 1024
+
+//
+// Define the file header.
+//
+typedef struct traceFileHeader_t
+{
+	unsigned int  magic;
+	unsigned int  version;
+	unsigned long blockCount;
+	unsigned long indexOffset;
+	unsigned long frameCount;
+	unsigned long firstTimestamp;
+	unsigned long lastTimestamp;
+
+}   traceFileHeader_t;
+
+//
+// Define a block index entry.
+//
+typedef struct traceBlockIndex_t
+{
+	canid_t       id;
+	unsigned int  frameCount;
+	unsigned long firstTimestamp;
+	unsigned long lastTimestamp;
+	unsigned long offset;
+	unsigned long length;
+
+}   traceBlockIndex_t;
+
+//
+// Define the header at the start of each block.  The three columns follow
+// the header in order.
+//
+typedef struct traceBlockHeader_t
+{
+	canid_t       id;
+	unsigned int  frameCount;
+	unsigned long firstTimestamp;
+	unsigned int  timestampBytes;
+	unsigned int  dlcBytes;
+	unsigned int  payloadBytes;
+	unsigned int  reserved;
+
+}   traceBlockHeader_t;
+
+//
+// Define a single decoded frame.
+//
+typedef struct traceFrame_t
+{
+	unsigned long timestamp;
+	canid_t       id;
+	unsigned char dlc;
+	unsigned char data[CAN_MAX_DLEN];
+
+}   traceFrame_t;
+
+//
+// Define the state of a trace file being written.  The contents of this are
+// private to traceFile.c.
+//
+typedef struct traceWriter_t traceWriter_t;
+
+//
+// Define the state of a trace file being read.
+//
+typedef struct traceReader_t
+{
+	int                fd;
+	unsigned long      fileSize;
+	traceFileHeader_t  header;
+	traceBlockIndex_t* index;
+	void*              indexMapping;
+	unsigned long      indexMappingSize;
+
+}   traceReader_t;
+
+//
+// Define the trace file functions.
+//
+traceWriter_t* traceWriterOpen   ( const char* fileName );
+int            traceWriterAppend ( traceWriter_t* writer,
+								   journalRecord_t* record );
+int            traceWriterClose  ( traceWriter_t* writer,
+								   traceFileHeader_t* header );
+
+int            traceReaderOpen   ( traceReader_t* reader, const char* fileName );
+void           traceReaderClose  ( traceReader_t* reader );
+long           traceQuery        ( traceReader_t* reader, canid_t id,
+								   unsigned long startTime,
+								   unsigned long endTime,
+								   traceFrame_t* frames,
+								   unsigned long maxFrames );
+
+void           traceWriteCandump ( FILE* file, const char* interface,
+								   journalRecord_t* record );
+
+#endif		// End of TRACE_FILE_H
@@ -0,0 +1,571 @@
+//
+//	t r i g g e r . c
+//
+//  The content triggers and their event queues.  See trigger.h for a
+//  description.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+#include "trigger.h"
+#include "stats.h"
+
+//
+// Round a size up to a whole number of cache lines.
+//
+#define TRIGGER_ROUND_UP(size) ( ( (size) + 63UL ) & ~63UL )
+
+//
+// Define the parts of the region that follow the triggers.
+//
+static unsigned long* triggerMap ( triggerTable_t* table )
+{
+	return (unsigned long*)( (char*)table + table->mapOffset );
+}
+
+static unsigned short* triggerHeads ( triggerTable_t* table )
+{
+	return (unsigned short*)( (char*)table + table->headsOffset );
+}
+
+static triggerEvent_t* triggerQueue ( triggerTable_t* table, unsigned int consumer )
+{
+	return (triggerEvent_t*)( (char*)table + table->queuesOffset ) +
+		   (unsigned long)consumer * table->queueEvents;
+}
+
+
+//
+// Return the size of the trigger table region for the given number of
+// triggers, messages and events per consumer queue.
+//
+unsigned long triggerRegionSize ( unsigned int triggerCount,
+								  unsigned int messageCount,
+								  unsigned int queueEvents )
+{
+	return TRIGGER_ROUND_UP ( sizeof(triggerTable_t) +
+							  (unsigned long)triggerCount * sizeof(trigger_t) ) +
+		   TRIGGER_ROUND_UP ( ( messageCount + 63UL ) / 64 * sizeof(unsigned long) ) +
+		   TRIGGER_ROUND_UP ( messageCount * sizeof(unsigned short) ) +
+		   (unsigned long)TRIGGER_MAX_CONSUMERS * queueEvents * sizeof(triggerEvent_t);
+}
+
+
+//
+// Initialize the trigger table with no consumers and no triggers.
+//
+void triggerInitialize ( triggerTable_t* table, unsigned int triggerCount,
+						 unsigned int messageCount, unsigned int queueEvents )
+{
+	unsigned long triggersEnd = TRIGGER_ROUND_UP ( sizeof(triggerTable_t) +
+												   (unsigned long)triggerCount *
+												   sizeof(trigger_t) );
+	unsigned long mapSize     = TRIGGER_ROUND_UP ( ( messageCount + 63UL ) / 64 *
+												   sizeof(unsigned long) );
+	unsigned long headsSize   = TRIGGER_ROUND_UP ( messageCount *
+												   sizeof(unsigned short) );
+
+	(void) memset ( table, 0, triggersEnd + mapSize + headsSize );
+
+	table->triggerCount = triggerCount;
+	table->messageCount = messageCount;
+	table->queueEvents  = queueEvents;
+	table->mapOffset    = triggersEnd;
+	table->headsOffset  = triggersEnd + mapSize;
+	table->queuesOffset = triggersEnd + mapSize + headsSize;
+}
+
+
+//
+// Parse a trigger of the form "<ID>:<offset>:<size>[:s] <kind> <argument>"
+// (see trigger.h).  The change mask defaults to the whole field.
+//
+// This function returns 0 if the trigger is valid and -1 if it is not.
+//
+int triggerParse ( const char* text, trigger_t* trigger )
+{
+	char  copy[128];
+	char* save;
+	char* end;
+
+	if ( strlen ( text ) >= sizeof(copy) )
+	{
+		return -1;
+	}
+	(void) strcpy ( copy, text );
+	(void) memset ( trigger, 0, sizeof(*trigger) );
+
+	char* field    = strtok_r ( copy, " \t", &save );
+	char* kind     = strtok_r ( 0, " \t", &save );
+	char* argument = strtok_r ( 0, " \t", &save );
+
+	if ( field == 0 || kind == 0 || strtok_r ( 0, " \t", &save ) != 0 )
+	{
+		return -1;
+	}
+	unsigned long id = strtoul ( field, &end, 0 );
+	if ( end == field || *end != ':' || id > CAN_EFF_MASK )
+	{
+		return -1;
+	}
+	unsigned int offset;
+	unsigned int size;
+	int          isSigned;
+
+	if ( statsParseField ( end + 1, &offset, &size, &isSigned ) != 0 )
+	{
+		return -1;
+	}
+	trigger->id       = id;
+	trigger->offset   = offset;
+	trigger->size     = size;
+	trigger->isSigned = isSigned;
+
+	if ( strcmp ( kind, "change" ) == 0 )
+	{
+		trigger->kind = TRIGGER_CHANGE;
+		trigger->mask = size == 8 ? ~0UL : ( 1UL << ( size * 8 ) ) - 1;
+		if ( argument != 0 )
+		{
+			trigger->mask = strtoul ( argument, &end, 0 );
+			if ( end == argument || *end != 0 || trigger->mask == 0 ||
+				 ( size < 8 && trigger->mask >> ( size * 8 ) != 0 ) )
+			{
+				return -1;
+			}
+		}
+		return 0;
+	}
+	if ( strcmp ( kind, "rise" ) == 0 || strcmp ( kind, "fall" ) == 0 )
+	{
+		trigger->kind = kind[0] == 'r' ? TRIGGER_RISE : TRIGGER_FALL;
+		if ( argument == 0 )
+		{
+			return -1;
+		}
+		trigger->low = isSigned ? strtol ( argument, &end, 0 ) :
+								  (long)strtoul ( argument, &end, 0 );
+		return end == argument || *end != 0 ? -1 : 0;
+	}
+	if ( strcmp ( kind, "outside" ) == 0 )
+	{
+		trigger->kind = TRIGGER_OUTSIDE;
+		if ( argument == 0 )
+		{
+			return -1;
+		}
+		trigger->low = isSigned ? strtol ( argument, &end, 0 ) :
+								  (long)strtoul ( argument, &end, 0 );
+		if ( end == argument || end[0] != '.' || end[1] != '.' )
+		{
+			return -1;
+		}
+		argument      = end + 2;
+		trigger->high = isSigned ? strtol ( argument, &end, 0 ) :
+								   (long)strtoul ( argument, &end, 0 );
+		return end == argument || *end != 0 ? -1 : 0;
+	}
+	return -1;
+}
+
+
+//
+// Return 1 if a field value is below another, compared as the field's type.
+//
+static inline int below ( const trigger_t* trigger, long value, long limit )
+{
+	return trigger->isSigned ? value < limit :
+							   (unsigned long)value < (unsigned long)limit;
+}
+
+
+//
+// Extract the field of a trigger from a frame, sign extended if it is
+// signed.
+//
+static inline long fieldValue ( const trigger_t* trigger,
+								const canMessage_t* message )
+{
+	unsigned long data;
+
+	(void) memcpy ( &data, message->canMessage.data, sizeof(data) );
+
+	unsigned int  shift = 64 - trigger->size * 8;
+	unsigned long value = data >> ( trigger->offset * 8 ) << shift;
+
+	return trigger->isSigned ? (long)value >> shift : (long)( value >> shift );
+}
+
+
+//
+// Remove a trigger from the list of its ID and free it.  This must be called
+// with the shared memory lock held.
+//
+static void unlinkTrigger ( triggerTable_t* table, unsigned int index )
+{
+	trigger_t*      trigger = &table->triggers[index];
+	unsigned short* heads   = triggerHeads ( table );
+	unsigned short* link    = &heads[trigger->id];
+
+	while ( *link != 0 && *link != index + 1 )
+	{
+		link = &table->triggers[*link - 1].next;
+	}
+	if ( *link == index + 1 )
+	{
+		*link = trigger->next;
+	}
+	if ( heads[trigger->id] == 0 )
+	{
+		triggerMap ( table )[trigger->id / 64] &= ~( 1UL << ( trigger->id % 64 ) );
+	}
+	table->consumers[trigger->consumer].triggers--;
+	table->used--;
+	trigger->kind = 0;
+}
+
+
+//
+// Free a consumer slot and remove its triggers.  This must be called with
+// the shared memory lock held.
+//
+void triggerRelease ( triggerTable_t* table, unsigned int consumer )
+{
+	if ( consumer >= TRIGGER_MAX_CONSUMERS )
+	{
+		return;
+	}
+	for ( unsigned int i = 0; i < table->triggerCount &&
+							  table->consumers[consumer].triggers != 0; i++ )
+	{
+		if ( table->triggers[i].kind != 0 && table->triggers[i].consumer == consumer )
+		{
+			unlinkTrigger ( table, i );
+		}
+	}
+	__atomic_store_n ( &table->consumers[consumer].pid, 0, __ATOMIC_RELEASE );
+}
+
+
+//
+//	t r i g g e r C l a i m
+//
+// Claim a consumer slot for the calling process.  A slot left by a process
+// that has exited is taken over and its triggers are removed.  This must be
+// called with the shared memory lock held.
+//
+// This function returns the consumer slot or -1 if they are all in use.
+//
+int triggerClaim ( triggerTable_t* table )
+{
+	for ( unsigned int c = 0; c < TRIGGER_MAX_CONSUMERS; c++ )
+	{
+		triggerConsumer_t* consumer = &table->consumers[c];
+		pid_t              pid      = consumer->pid;
+
+		if ( pid != 0 && ( kill ( pid, 0 ) == 0 || errno != ESRCH ) )
+		{
+			continue;
+		}
+		if ( pid != 0 )
+		{
+			triggerRelease ( table, c );
+		}
+		consumer->waiting = 0;
+		consumer->posted  = 0;
+		consumer->head    = 0;
+		consumer->dropped = 0;
+		consumer->tail    = 0;
+		__atomic_store_n ( &consumer->pid, getpid(), __ATOMIC_RELEASE );
+
+		return c;
+	}
+	return -1;
+}
+
+
+//
+// Register a trigger for a consumer.  This must be called with the shared
+// memory lock held.
+//
+// This function returns the number of the trigger or -1 if the trigger is
+// invalid or the table is full.
+//
+int triggerAdd ( triggerTable_t* table, unsigned int consumer,
+				 const trigger_t* trigger )
+{
+	if ( consumer >= TRIGGER_MAX_CONSUMERS ||
+		 table->consumers[consumer].pid != getpid() ||
+		 trigger->kind < TRIGGER_CHANGE || trigger->kind > TRIGGER_OUTSIDE ||
+		 trigger->id >= table->messageCount ||
+		 ( trigger->size != 1 && trigger->size != 2 && trigger->size != 4 &&
+		   trigger->size != 8 ) || trigger->offset + trigger->size > CAN_MAX_DLEN ||
+		 ( trigger->kind == TRIGGER_OUTSIDE &&
+		   below ( trigger, trigger->high, trigger->low ) ) )
+	{
+		return -1;
+	}
+	for ( unsigned int i = 0; i < table->triggerCount; i++ )
+	{
+		trigger_t* entry = &table->triggers[i];
+
+		if ( entry->kind != 0 )
+		{
+			continue;
+		}
+		unsigned short* heads = triggerHeads ( table );
+
+		*entry          = *trigger;
+		entry->consumer = consumer;
+		entry->hits     = 0;
+		entry->next     = heads[trigger->id];
+		heads[trigger->id] = i + 1;
+		triggerMap ( table )[trigger->id / 64] |= 1UL << ( trigger->id % 64 );
+
+		table->consumers[consumer].triggers++;
+		table->used++;
+
+		return i;
+	}
+	return -1;
+}
+
+
+//
+// Remove a trigger of a consumer.  This must be called with the shared memory
+// lock held.
+//
+// This function returns 0 if the trigger was removed and -1 if the consumer
+// doesn't have it.
+//
+int triggerRemove ( triggerTable_t* table, unsigned int consumer,
+					unsigned int trigger )
+{
+	if ( consumer >= TRIGGER_MAX_CONSUMERS || trigger >= table->triggerCount ||
+		 table->consumers[consumer].pid != getpid() ||
+		 table->triggers[trigger].kind == 0 ||
+		 table->triggers[trigger].consumer != consumer )
+	{
+		return -1;
+	}
+	unlinkTrigger ( table, trigger );
+
+	return 0;
+}
+
+
+//
+// Post a hit to the queue of the consumer that owns the trigger.
+//
+static void post ( triggerTable_t* table, trigger_t* trigger,
+				   const canMessage_t* stored, const canMessage_t* incoming,
+				   long value, long previous, unsigned long now )
+{
+	unsigned int       c        = trigger->consumer;
+	triggerConsumer_t* consumer = &table->consumers[c];
+	unsigned long      head     = consumer->head;
+
+	trigger->hits++;
+
+	if ( head - __atomic_load_n ( &consumer->tail, __ATOMIC_ACQUIRE ) >=
+		 table->queueEvents )
+	{
+		consumer->dropped++;
+		return;
+	}
+	triggerEvent_t* event = &triggerQueue ( table, c )[head & ( table->queueEvents - 1 )];
+
+	event->time     = now != 0 ? now : statsNow();
+	event->trigger  = trigger - table->triggers;
+	event->kind     = trigger->kind;
+	event->value    = value;
+	event->previous = previous;
+	event->frame    = *incoming;
+	event->frame.nextMessageIndex = CAN_END_OF_LIST;
+	event->frame.sequence         = stored->sequence + 2;
+
+	__atomic_store_n ( &consumer->head, head + 1, __ATOMIC_RELEASE );
+	__atomic_store_n ( &consumer->posted, (unsigned int)( head + 1 ), __ATOMIC_SEQ_CST );
+
+	if ( __atomic_load_n ( &consumer->waiting, __ATOMIC_SEQ_CST ) != 0 )
+	{
+		__atomic_fetch_or ( &table->wakeMask, 1UL << c, __ATOMIC_RELEASE );
+	}
+}
+
+
+//
+//	t r i g g e r E v a l u a t e
+//
+// Evaluate the triggers of a frame that is about to replace the stored one
+// and post the hits.  The arrival time of the frame is used as the time of
+// the events if it is known (not 0).  This must be called with the shared
+// memory lock held, before the stored frame is changed.
+//
+void triggerEvaluate ( triggerTable_t* table, const canMessage_t* stored,
+					   const canMessage_t* incoming, unsigned long now )
+{
+	canMessageIndex_t id = incoming->canMessage.can_id;
+
+	if ( id >= table->messageCount ||
+		 ( triggerMap ( table )[id / 64] & ( 1UL << ( id % 64 ) ) ) == 0 )
+	{
+		return;
+	}
+	table->evaluations++;
+
+	//
+	// A stored frame with a sequence number of 0 has never been written.
+	//
+	int written = stored->sequence != 0;
+
+	for ( unsigned int next = triggerHeads ( table )[id]; next != 0; )
+	{
+		trigger_t*   trigger = &table->triggers[next - 1];
+		unsigned int end     = trigger->offset + trigger->size;
+
+		next = trigger->next;
+
+		if ( incoming->canMessage.can_dlc < end )
+		{
+			continue;
+		}
+		int  hasPrevious = written && stored->canMessage.can_dlc >= end;
+		long value       = fieldValue ( trigger, incoming );
+		long previous    = hasPrevious ? fieldValue ( trigger, stored ) : 0;
+		int  fired       = 0;
+
+		switch ( trigger->kind )
+		{
+		  case TRIGGER_CHANGE:
+			fired = hasPrevious && ( ( value ^ previous ) & trigger->mask ) != 0;
+			break;
+
+		  case TRIGGER_RISE:
+			fired = hasPrevious && below ( trigger, previous, trigger->low ) &&
+					! below ( trigger, value, trigger->low );
+			break;
+
+		  case TRIGGER_FALL:
+			fired = hasPrevious && ! below ( trigger, previous, trigger->low ) &&
+					below ( trigger, value, trigger->low );
+			break;
+
+		  case TRIGGER_OUTSIDE:
+			fired = ( below ( trigger, value, trigger->low ) ||
+					  below ( trigger, trigger->high, value ) ) &&
+					( ! hasPrevious ||
+					  ( ! below ( trigger, previous, trigger->low ) &&
+						! below ( trigger, trigger->high, previous ) ) );
+			break;
+		}
+		if ( fired )
+		{
+			post ( table, trigger, stored, incoming, value, previous, now );
+		}
+	}
+}
+
+
+//
+// Wake the consumers that were posted to while they were waiting.  This is
+// called by the writers once the shared memory lock has been released.
+//
+void triggerWake ( triggerTable_t* table )
+{
+	if ( __atomic_load_n ( &table->wakeMask, __ATOMIC_RELAXED ) == 0 )
+	{
+		return;
+	}
+	unsigned long mask = __atomic_exchange_n ( &table->wakeMask, 0, __ATOMIC_ACQ_REL );
+
+	while ( mask != 0 )
+	{
+		unsigned int c = __builtin_ctzl ( mask );
+
+		mask &= mask - 1;
+		(void) syscall ( SYS_futex, &table->consumers[c].posted, FUTEX_WAKE,
+						 INT_MAX, NULL, NULL, 0 );
+	}
+}
+
+
+//
+// Take the next event from the queue of a consumer.
+//
+// This function returns 1 if an event was taken and 0 if the queue is empty.
+//
+int triggerNext ( triggerTable_t* table, unsigned int consumer,
+				  triggerEvent_t* event )
+{
+	triggerConsumer_t* entry = &table->consumers[consumer];
+	unsigned long      tail  = entry->tail;
+
+	if ( __atomic_load_n ( &entry->head, __ATOMIC_ACQUIRE ) == tail )
+	{
+		return 0;
+	}
+	*event = triggerQueue ( table, consumer )[tail & ( table->queueEvents - 1 )];
+	__atomic_store_n ( &entry->tail, tail + 1, __ATOMIC_RELEASE );
+
+	return 1;
+}
+
+
+//
+// Wait until the queue of a consumer has an event or the timeout (in
+// nanoseconds) expires.
+//
+// This function returns 0 if there is an event and -1 on a timeout.
+//
+int triggerWait ( triggerTable_t* table, unsigned int consumer,
+				  unsigned long timeoutNs )
+{
+	triggerConsumer_t* entry   = &table->consumers[consumer];
+	struct timespec    timeout = { timeoutNs / 1000000000UL, timeoutNs % 1000000000UL };
+
+	__atomic_store_n ( &entry->waiting, 1, __ATOMIC_SEQ_CST );
+
+	while ( 1 )
+	{
+		unsigned int posted = __atomic_load_n ( &entry->posted, __ATOMIC_SEQ_CST );
+
+		if ( __atomic_load_n ( &entry->head, __ATOMIC_SEQ_CST ) != entry->tail )
+		{
+			break;
+		}
+		if ( syscall ( SYS_futex, &entry->posted, FUTEX_WAIT, posted, &timeout,
+					   NULL, 0 ) != 0 && errno == ETIMEDOUT )
+		{
+			break;
+		}
+	}
+	__atomic_store_n ( &entry->waiting, 0, __ATOMIC_RELAXED );
+
+	return __atomic_load_n ( &entry->head, __ATOMIC_ACQUIRE ) != entry->tail ? 0 : -1;
+}
+
+
+//
+// Return the name of a kind of trigger.
+//
+const char* triggerKindName ( unsigned int kind )
+{
+	switch ( kind )
+	{
+	  case TRIGGER_CHANGE:  return "change";
+	  case TRIGGER_RISE:    return "rise";
+	  case TRIGGER_FALL:    return "fall";
+	  case TRIGGER_OUTSIDE: return "outside";
+	  default:              return "unknown";
+	}
+}
@@ -0,0 +1,184 @@
+#pragma once
+#ifndef TRIGGER_H
+#define TRIGGER_H
+
+#include <sys/types.h>
+
+#include "canMessage.h"
+
+//
+// The trigger table is an optional region of the shared memory segment that
+// lets a consumer, like a safety monitor, be told within microseconds when a
+// signal crosses a threshold or changes bits, instead of polling the IDs it
+// watches.
+//
+// A consumer claims one of the consumer slots (sharedMemoryTriggerAttach)
+// and registers its triggers in the table.  A trigger watches a field of a
+// message, a little endian integer of 1, 2, 4 or 8 bytes at a byte offset,
+// signed or unsigned (as for the statistics and derived signals), and fires
+// when a frame is stored that:
+//
+//     change  <mask>         changes any of the bits of the field in the mask
+//     rise    <threshold>    takes the field from below the threshold to at
+//                            or above it
+//     fall    <threshold>    takes the field from at or above the threshold
+//                            to below it
+//     outside <low>..<high>  takes the field out of the range, including the
+//                            first frame of the ID
+//
+// The change, rise and fall triggers compare the new frame with the one it
+// replaces, so they don't fire for the first frame of an ID.  A frame that
+// is too short to hold the field is ignored.  A trigger is written as
+// "<ID>:<offset>:<size>[:s] <kind> <argument>", for example
+// "0x1a0:0:2 rise 3000" or "0x3c2:2:1 change 0x20".
+//
+// The triggers are evaluated by the writers in updateMessage, with the
+// shared memory lock held, against the frame that is about to be replaced.
+// The triggers of each ID are kept on a list and the IDs that have any are
+// marked in a bitmap, so an insert of any other ID costs one bit test.  The
+// table is only changed with the lock held, so a writer always sees a
+// complete list.  Change suppression (see change.h) drops frames that are
+// the same as the stored one before they get here, and those can't fire a
+// trigger anyway.
+//
+// Each hit is posted, with the new frame and the new and previous values of
+// the field, to the event queue of the consumer that owns the trigger.  The
+// queue is a ring with a single producer at a time (the writer that holds
+// the lock) and a single consumer.  If the ring is full the event is
+// dropped and counted, so a slow consumer never holds up a writer.
+//
+// A consumer that is out of events sleeps on a futex in its slot
+// (triggerWait).  The writer that posts to it marks it to be woken and
+// wakes it once the lock has been released, so the system call is not made
+// with the lock held.
+//
+// A consumer slot left by a process that has exited is taken over, with its
+// triggers removed, by the next consumer that attaches.
+//
+
+//
+// Define the limits of the trigger table.
+//
+#define TRIGGER_MAX_CONSUMERS 32
+#define TRIGGER_MAX_TRIGGERS  65535
+
+//
+// Define the kinds of trigger.  A free trigger has a kind of 0.
+//
+#define TRIGGER_CHANGE  1
+#define TRIGGER_RISE    2
+#define TRIGGER_FALL    3
+#define TRIGGER_OUTSIDE 4
+
+//
+// Define a trigger.  The triggers of an ID are linked through "next", which
+// is the index of the next trigger plus 1, or 0 at the end of the list.
+//
+typedef struct trigger_t
+{
+	canMessageIndex_t id;
+	unsigned short    next;
+	unsigned char     kind;
+	unsigned char     consumer;
+	unsigned char     offset;
+	unsigned char     size;
+	unsigned char     isSigned;
+	unsigned char     pad[5];
+	unsigned long     mask;                 // Change
+	long              low;                  // Threshold or lower bound
+	long              high;                 // Upper bound
+	unsigned long     hits;
+
+}   trigger_t;
+
+//
+// Define an event: a hit of a trigger and the frame that fired it.  The
+// frame's sequence number is the one it was stored with.  Each event is on
+// its own cache line.
+//
+typedef struct triggerEvent_t
+{
+	unsigned long time;                     // CLOCK_MONOTONIC nsec
+	unsigned int  trigger;
+	unsigned int  kind;
+	long          value;
+	long          previous;
+	canMessage_t  frame;
+
+}   __attribute__((aligned(64))) triggerEvent_t;
+
+//
+// Define a consumer slot.  The head (the events posted) is only written
+// with the shared memory lock held and the tail (the events taken) only by
+// the consumer, each on its own cache line.  "posted" is the low half of the
+// head, which the consumer sleeps on.
+//
+typedef struct triggerConsumer_t
+{
+	pid_t         pid;                      // 0 if the slot is free
+	unsigned int  waiting;
+	unsigned int  posted;
+	unsigned int  triggers;                 // Registered
+	unsigned long head;
+	unsigned long dropped;
+
+	unsigned long tail __attribute__((aligned(64)));
+
+}   __attribute__((aligned(64))) triggerConsumer_t;
+
+//
+// Define the header of the trigger table region.  The triggers are followed
+// by the bitmap of the IDs that have triggers, the head of the trigger list
+// of each ID and the event queue of each consumer.
+//
+typedef struct triggerTable_t
+{
+	unsigned int      triggerCount;
+	unsigned int      messageCount;
+	unsigned int      queueEvents;          // A power of 2
+	unsigned int      used;                 // Triggers registered
+	unsigned long     mapOffset;            // From the start of the region
+	unsigned long     headsOffset;
+	unsigned long     queuesOffset;
+	unsigned long     wakeMask;             // Consumers to wake
+	unsigned long     evaluations;          // Frames with triggers
+
+	triggerConsumer_t consumers[TRIGGER_MAX_CONSUMERS];
+
+	trigger_t         triggers[0] __attribute__((aligned(64)));
+
+}   triggerTable_t;
+
+//
+// Define the trigger table functions.
+//
+unsigned long triggerRegionSize ( unsigned int triggerCount,
+								  unsigned int messageCount,
+								  unsigned int queueEvents );
+void          triggerInitialize ( triggerTable_t* table,
+								  unsigned int triggerCount,
+								  unsigned int messageCount,
+								  unsigned int queueEvents );
+int           triggerParse      ( const char* text, trigger_t* trigger );
+
+int           triggerClaim      ( triggerTable_t* table );
+int           triggerAdd        ( triggerTable_t* table, unsigned int consumer,
+								  const trigger_t* trigger );
+int           triggerRemove     ( triggerTable_t* table, unsigned int consumer,
+								  unsigned int trigger );
+void          triggerRelease    ( triggerTable_t* table, unsigned int consumer );
+
+void          triggerEvaluate   ( triggerTable_t* table,
+								  const canMessage_t* stored,
+								  const canMessage_t* incoming,
+								  unsigned long now );
+void          triggerWake       ( triggerTable_t* table );
+
+int           triggerNext       ( triggerTable_t* table, unsigned int consumer,
+								  triggerEvent_t* event );
+int           triggerWait       ( triggerTable_t* table, unsigned int consumer,
+								  unsigned long timeoutNs );
+
+const char*   triggerKindName   ( unsigned int kind );
+
+#endif		// End of TRIGGER_H
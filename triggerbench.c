@@ -0,0 +1,546 @@
+//
+//	t r i g g e r b e n c h . c
+//
+//  Check and measure the content triggers (see trigger.h).
+//
+//  The program first inserts a fixed series of frames for one ID that has a
+//  rise, a fall, an out of range and a masked change trigger and checks that
+//  each of them fires for exactly the frames it should, with the right
+//  values.
+//
+//  It then measures what the triggers cost the writers: the time of an
+//  insert of an ID that has no triggers, which only tests its bit in the
+//  bitmap of the IDs with triggers, and of an ID with "-n" triggers that
+//  don't fire.
+//
+//  Finally a child process registers a change trigger and sleeps in
+//  triggerWait while the parent inserts frames that fire it, and the program
+//  reports the time from each hit being posted by the writer to the consumer
+//  having the event in hand.
+//
+//  The shared memory segment must have been created with a trigger table
+//  ("create -t").  The program uses four IDs from "-i" on.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <time.h>
+#include <locale.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the largest number of latency samples.
+//
+#define MAX_SAMPLES 100000
+
+//
+// Define the benchmark parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static unsigned int firstId        = 0x100;
+static unsigned int quietTriggers  = 4;
+static unsigned int insertCount    = 1000000;
+static unsigned int sampleCount    = 1000;
+static unsigned int intervalUs     = 200;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the results that the consumer child passes back to the parent
+// through an anonymous shared mapping.
+//
+typedef struct latencyResults_t
+{
+	volatile int  ready;
+	volatile int  failed;
+	unsigned int  samples;
+	unsigned long latencies[MAX_SAMPLES];
+
+}   latencyResults_t;
+
+//
+// Define one frame of the semantics check and the triggers it must fire.
+//
+typedef struct checkFrame_t
+{
+	short         value;                    // Bytes 0-1, signed
+	unsigned char flags;                    // Byte 2
+	unsigned char length;
+	unsigned char fires;                    // A bit per check trigger
+
+}   checkFrame_t;
+
+//
+// Define the triggers of the semantics check.  The field of the first three
+// is a signed 16 bit value and the change trigger watches bit 0 of byte 2.
+//
+static const char* checkTriggers[] =
+{
+	"%u:0:2:s rise 100",
+	"%u:0:2:s fall 100",
+	"%u:0:2:s outside -50..50",
+	"%u:2:1 change 0x01",
+};
+
+#define CHECK_TRIGGERS ( sizeof(checkTriggers) / sizeof(checkTriggers[0]) )
+
+//
+// Define the frames of the semantics check.  The ID is first written with a
+// value of 0 and flags of 0 before the triggers are registered.
+//
+static const checkFrame_t checkFrames[] =
+{
+	{  150, 0x00, 8, 0x1|0x4 },             // Rises and leaves the range
+	{  150, 0x01, 8, 0x8     },             // Bit 0 changes
+	{   50, 0x01, 8, 0x2     },             // Falls, back in range
+	{  200, 0x03, 8, 0x1|0x4 },             // Bit 1 doesn't count
+	{ -100, 0x02, 8, 0x2|0x8 },             // Falls but was already outside
+	{ -100, 0x02, 8, 0       },             // The same frame
+	{    0, 0x00, 8, 0       },             // Back in range
+	{  -60, 0x01, 8, 0x4|0x8 },             // Below the range
+	{  300, 0x00, 1, 0       },             // Too short for any field
+	{  300, 0x00, 8, 0x4     },             // No previous value to compare
+};
+
+#define CHECK_FRAMES ( sizeof(checkFrames) / sizeof(checkFrames[0]) )
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -i    First ID         int        0x100 \n\
+    -n    Triggers         int           4 \n\
+    -c    Inserts          int     1,000,000 \n\
+    -e    Events           int         1,000 \n\
+    -t    Interval (us)    int          200 \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\
+  -n is the number of triggers on the ID whose insert time is measured.\n\
+  -e events are fired, one every -t microseconds, to measure the latency.\n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Insert a frame with a 16 bit value and a flags byte.
+//
+static void insertFrame ( sharedMemory_t* sharedMemory, canMessageIndex_t id,
+						  short value, unsigned char flags, unsigned char length )
+{
+	canMessage_t message;
+
+	(void) memset ( &message, 0, sizeof(message) );
+	message.canMessage.can_id  = id;
+	message.canMessage.can_dlc = length;
+	(void) memcpy ( message.canMessage.data, &value, sizeof(value) );
+	message.canMessage.data[2] = flags;
+
+	(void) insertMessage ( sharedMemory, &message );
+}
+
+
+//
+// Register a trigger given as a format with the ID in it.
+//
+static int addTrigger ( sharedMemory_t* sharedMemory, int consumer,
+						const char* format, canMessageIndex_t id )
+{
+	char      text[128];
+	trigger_t trigger;
+
+	(void) snprintf ( text, sizeof(text), format, id );
+	if ( triggerParse ( text, &trigger ) != 0 )
+	{
+		printf ( "Unable to parse trigger[%s].\n", text );
+		return -1;
+	}
+	int number = sharedMemoryTriggerAdd ( sharedMemory, consumer, &trigger );
+	if ( number < 0 )
+	{
+		printf ( "Unable to register trigger[%s] - the table is full.\n", text );
+	}
+	return number;
+}
+
+
+//
+// Insert the frames of the semantics check and compare the events with the
+// ones expected.  This returns the number of differences.
+//
+static int runCheck ( sharedMemory_t* sharedMemory, triggerTable_t* table,
+					  int consumer )
+{
+	canMessageIndex_t id = firstId;
+	int               numbers[CHECK_TRIGGERS];
+	triggerEvent_t    event;
+
+	insertFrame ( sharedMemory, id, 0, 0, 8 );
+
+	for ( unsigned int t = 0; t < CHECK_TRIGGERS; t++ )
+	{
+		numbers[t] = addTrigger ( sharedMemory, consumer, checkTriggers[t], id );
+		if ( numbers[t] < 0 )
+		{
+			return 1;
+		}
+	}
+	int errors = 0;
+
+	for ( unsigned int f = 0; f < CHECK_FRAMES; f++ )
+	{
+		const checkFrame_t* frame = &checkFrames[f];
+		unsigned int        fired = 0;
+
+		insertFrame ( sharedMemory, id, frame->value, frame->flags,
+					  frame->length );
+
+		while ( triggerNext ( table, consumer, &event ) )
+		{
+			unsigned int t = 0;
+			while ( t < CHECK_TRIGGERS && numbers[t] != (int)event.trigger )
+			{
+				t++;
+			}
+			if ( t == CHECK_TRIGGERS || ( fired & ( 1 << t ) ) != 0 ||
+				 event.frame.canMessage.can_id != id ||
+				 event.value != ( t == 3 ? frame->flags : frame->value ) )
+			{
+				printf ( "  Frame %u: unexpected event of trigger %u, value "
+						 "%ld.\n", f, event.trigger, event.value );
+				errors++;
+				continue;
+			}
+			fired |= 1 << t;
+		}
+		if ( fired != frame->fires )
+		{
+			printf ( "  Frame %u (%d, 0x%02x): fired 0x%x, expected 0x%x.\n", f,
+					 frame->value, frame->flags, fired, frame->fires );
+			errors++;
+		}
+	}
+	for ( unsigned int t = 0; t < CHECK_TRIGGERS; t++ )
+	{
+		(void) sharedMemoryTriggerRemove ( sharedMemory, consumer, numbers[t] );
+	}
+	return errors;
+}
+
+
+//
+// Return the average time in nanoseconds of an insert of an ID.  The value
+// changes on every insert so change suppression doesn't skip any of them.
+//
+static double timeInserts ( sharedMemory_t* sharedMemory, canMessageIndex_t id )
+{
+	unsigned long start = statsNow();
+
+	for ( unsigned int i = 0; i < insertCount; i++ )
+	{
+		insertFrame ( sharedMemory, id, i & 0x3fff, 0, 8 );
+	}
+	return (double)( statsNow() - start ) / insertCount;
+}
+
+
+//
+// Run the consumer child of the latency test.  It registers a change trigger
+// on the ID and takes the events as they are posted.
+//
+static void runConsumer ( sharedMemory_t* sharedMemory, triggerTable_t* table,
+						  canMessageIndex_t id, latencyResults_t* results )
+{
+	int consumer = sharedMemoryTriggerAttach ( sharedMemory );
+
+	if ( consumer < 0 || addTrigger ( sharedMemory, consumer, "%u:0:4 change",
+									  id ) < 0 )
+	{
+		results->failed = 1;
+		results->ready  = 1;
+		_exit (255);
+	}
+	results->ready = 1;
+
+	triggerEvent_t event;
+
+	while ( results->samples < sampleCount )
+	{
+		if ( triggerWait ( table, consumer, 1000000000UL ) != 0 )
+		{
+			break;
+		}
+		while ( triggerNext ( table, consumer, &event ) &&
+				results->samples < sampleCount )
+		{
+			unsigned long now = statsNow();
+
+			results->latencies[results->samples++] = now > event.time ?
+													 now - event.time : 0;
+		}
+	}
+	sharedMemoryTriggerDetach ( sharedMemory, consumer );
+	_exit (0);
+}
+
+
+//
+// Compare two latencies for qsort.
+//
+static int compareLatency ( const void* a, const void* b )
+{
+	unsigned long x = *(const unsigned long*)a;
+	unsigned long y = *(const unsigned long*)b;
+
+	return x < y ? -1 : x > y;
+}
+
+
+//
+// Measure the time from the hits being posted to the consumer having them.
+//
+static int runLatency ( sharedMemory_t* sharedMemory, triggerTable_t* table )
+{
+	canMessageIndex_t id      = firstId + 3;
+	latencyResults_t* results = mmap ( NULL, sizeof(latencyResults_t),
+									   PROT_READ|PROT_WRITE,
+									   MAP_SHARED|MAP_ANONYMOUS, -1, 0 );
+	if ( results == MAP_FAILED )
+	{
+		printf ( "Unable to map the results area.\n" );
+		return -1;
+	}
+	insertFrame ( sharedMemory, id, 0, 0, 8 );
+
+	pid_t child = fork();
+	if ( child == 0 )
+	{
+		runConsumer ( sharedMemory, table, id, results );
+	}
+	while ( ! results->ready )
+	{
+		usleep ( 1000 );
+	}
+	for ( unsigned int i = 1; i <= sampleCount && ! results->failed; i++ )
+	{
+		usleep ( intervalUs );
+		insertFrame ( sharedMemory, id, i & 0x7fff, 0, 8 );
+	}
+	int status;
+	(void) waitpid ( child, &status, 0 );
+
+	if ( results->failed || ! WIFEXITED ( status ) ||
+		 WEXITSTATUS ( status ) != 0 || results->samples == 0 )
+	{
+		printf ( "The consumer failed (%u events taken).\n", results->samples );
+		(void) munmap ( results, sizeof(latencyResults_t) );
+		return -1;
+	}
+	unsigned int   samples   = results->samples;
+	unsigned long* latencies = results->latencies;
+	unsigned long  total     = 0;
+
+	qsort ( latencies, samples, sizeof(latencies[0]), compareLatency );
+	for ( unsigned int i = 0; i < samples; i++ )
+	{
+		total += latencies[i];
+	}
+	printf ( "Hit to consumer latency over %'u events (one every %u usec):\n",
+			 samples, intervalUs );
+	printf ( "  Minimum %'lu  median %'lu  99%% %'lu  maximum %'lu  average "
+			 "%'lu nsec\n", latencies[0], latencies[samples / 2],
+			 latencies[(unsigned long)samples * 99 / 100], latencies[samples - 1],
+			 total / samples );
+
+	(void) munmap ( results, sizeof(latencyResults_t) );
+
+	return 0;
+}
+
+
+//
+// Parse a count argument.
+//
+static unsigned int countArgument ( const char* argument, unsigned int minimum,
+									unsigned int maximum, const char* name,
+									const char* executable )
+{
+	unsigned int value = strtoul ( argument, 0, 0 );
+
+	if ( value < minimum || value > maximum )
+	{
+		printf ( "Invalid %s[%s] specified - must be %u to %u.\n", name,
+				 argument, minimum, maximum );
+		usage ( executable );
+		exit (255);
+	}
+	return value;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:c:e:hi:n:t:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'i':
+			firstId = countArgument ( optarg, 0, CAN_EFF_MASK, "first ID",
+									  argv[0] );
+			break;
+
+		  case 'n':
+			quietTriggers = countArgument ( optarg, 1, 1000, "trigger count",
+											argv[0] );
+			break;
+
+		  case 'c':
+			insertCount = countArgument ( optarg, 1, 0xffffffff, "insert count",
+										  argv[0] );
+			break;
+
+		  case 'e':
+			sampleCount = countArgument ( optarg, 1, MAX_SAMPLES, "event count",
+										  argv[0] );
+			break;
+
+		  case 't':
+			intervalUs = countArgument ( optarg, 0, 1000000, "interval",
+										 argv[0] );
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( optind != argc )
+	{
+		printf ( "Invalid parameter encountered: %s\n", argv[optind] );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	triggerTable_t* table = sharedMemoryGetTriggerTable ( sharedMemory );
+	if ( table == 0 )
+	{
+		printf ( "The shared memory segment has no trigger table - Use "
+				 "\"create -t\" to create one.\n" );
+		exit (255);
+	}
+	if ( firstId + 4 > table->messageCount )
+	{
+		printf ( "Invalid first ID[%u] specified - the pool has %u IDs.\n",
+				 firstId, table->messageCount );
+		exit (255);
+	}
+	if ( table->triggerCount - table->used < quietTriggers + CHECK_TRIGGERS + 1 )
+	{
+		printf ( "The trigger table only has %u free triggers.\n",
+				 table->triggerCount - table->used );
+		exit (255);
+	}
+	int consumer = sharedMemoryTriggerAttach ( sharedMemory );
+	if ( consumer < 0 )
+	{
+		printf ( "No trigger consumer slots are available - Aborting\n" );
+		exit (255);
+	}
+	//
+	// Check that the triggers fire for the right frames.
+	//
+	int errors = runCheck ( sharedMemory, table, consumer );
+
+	printf ( "Trigger check: %u frames, %s.\n", (unsigned int)CHECK_FRAMES,
+			 errors == 0 ? "passed" : "FAILED" );
+
+	//
+	// Time the inserts of an ID without triggers and of one with triggers
+	// that never fire: the values stay below the rise threshold.
+	//
+	for ( unsigned int i = 0; i < quietTriggers; i++ )
+	{
+		if ( addTrigger ( sharedMemory, consumer, "%u:0:2 rise 0x8000",
+						  firstId + 1 ) < 0 )
+		{
+			sharedMemoryTriggerDetach ( sharedMemory, consumer );
+			exit (255);
+		}
+	}
+	(void) timeInserts ( sharedMemory, firstId + 2 );
+
+	double without = timeInserts ( sharedMemory, firstId + 2 );
+	double with    = timeInserts ( sharedMemory, firstId + 1 );
+
+	printf ( "Insert of an ID without triggers: %6.1f nsec\n", without );
+	printf ( "Insert of an ID with %u triggers:  %6.1f nsec (%+.1f)\n",
+			 quietTriggers, with, with - without );
+
+	sharedMemoryTriggerDetach ( sharedMemory, consumer );
+	fflush ( stdout );
+
+	//
+	// Measure the latency from a hit to the consumer.
+	//
+	if ( runLatency ( sharedMemory, table ) != 0 )
+	{
+		errors++;
+	}
+	sharedMemoryClose ( sharedMemory );
+
+	return errors == 0 ? 0 : 255;
+}
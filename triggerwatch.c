@@ -0,0 +1,285 @@
+//
+//	t r i g g e r w a t c h . c
+//
+//  Register content triggers (see trigger.h) in the shared memory segment and
+//  print their events as they are posted.
+//
+//  Each "-t" option adds one trigger, for example:
+//
+//      triggerwatch -t "0x1a0:0:2 rise 3000" -t "0x3c2:2:1 change 0x20"
+//
+//  For each event the program prints the trigger, the ID, the old and new
+//  values of the field, the data of the frame and the time from the insert
+//  that fired it to the event being taken from the queue.  At the end of the
+//  run it prints the hits of each trigger and the events that were dropped
+//  because the queue was full.
+//
+//  The shared memory segment must have been created with a trigger table
+//  ("create -t").
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <signal.h>
+#include <locale.h>
+#include <stdbool.h>
+
+#include "sharedMemory.h"
+
+//
+// Define the largest number of triggers the program registers.
+//
+#define MAX_TRIGGERS 64
+
+//
+// Define the watch parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static const char*   triggerSpecs[MAX_TRIGGERS];
+static unsigned int  triggerSpecCount = 0;
+static unsigned int  runSeconds       = 0;
+static bool          quiet            = false;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the flag that the signal handler sets to stop the program.
+//
+static volatile sig_atomic_t stopping = 0;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -t    Trigger         string     None \n\
+    -d    Duration (sec)   int      Forever \n\
+    -q    Quiet            bool      false \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\
+  Each -t option adds a trigger written as\n\
+      \"<ID>:<offset>:<size>[:s] <kind> <argument>\"\n\
+  where the kind is change [<mask>], rise <threshold>, fall <threshold> or\n\
+  outside <low>..<high>.  -q only prints the totals at the end.\n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Stop the program at the next event or timeout.
+//
+static void stop ( int signal )
+{
+	(void) signal;
+	stopping = 1;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	char ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:d:hqt:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 't':
+			if ( triggerSpecCount == MAX_TRIGGERS )
+			{
+				printf ( "Too many triggers specified - the limit is %u.\n",
+						 MAX_TRIGGERS );
+				exit (255);
+			}
+			triggerSpecs[triggerSpecCount++] = optarg;
+			break;
+
+		  case 'd':
+		    runSeconds = atol ( optarg );
+			break;
+
+		  case 'q':
+			quiet = true;
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( triggerSpecCount == 0 || optind != argc )
+	{
+		printf ( "At least one trigger must be specified.\n" );
+		usage ( argv[0] );
+		exit (255);
+	}
+	//
+	// Parse the triggers before anything is registered.
+	//
+	trigger_t triggers[MAX_TRIGGERS];
+
+	for ( unsigned int i = 0; i < triggerSpecCount; i++ )
+	{
+		if ( triggerParse ( triggerSpecs[i], &triggers[i] ) != 0 )
+		{
+			printf ( "Invalid trigger[%s] specified.\n", triggerSpecs[i] );
+			usage ( argv[0] );
+			exit (255);
+		}
+	}
+	//
+	// Open the shared memory file.
+	//
+	sharedMemory_t* sharedMemory = sharedMemoryOpenBus ( busId );
+	if ( sharedMemory == 0 )
+	{
+		printf ( "Unable to open the shared memory segment - Aborting\n" );
+		exit (255);
+	}
+	triggerTable_t* table = sharedMemoryGetTriggerTable ( sharedMemory );
+	if ( table == 0 )
+	{
+		printf ( "The shared memory segment has no trigger table - Use "
+				 "\"create -t\" to create one.\n" );
+		exit (255);
+	}
+	int consumer = sharedMemoryTriggerAttach ( sharedMemory );
+	if ( consumer < 0 )
+	{
+		printf ( "No trigger consumer slots are available - Aborting\n" );
+		exit (255);
+	}
+	//
+	// Register the triggers.  The numbers of the triggers in the table are
+	// kept so the events can be matched with the specifications.
+	//
+	int numbers[MAX_TRIGGERS];
+
+	for ( unsigned int i = 0; i < triggerSpecCount; i++ )
+	{
+		numbers[i] = sharedMemoryTriggerAdd ( sharedMemory, consumer,
+											  &triggers[i] );
+		if ( numbers[i] < 0 )
+		{
+			printf ( "Unable to register trigger[%s] - the ID is not in the "
+					 "pool or the table is full.\n", triggerSpecs[i] );
+			sharedMemoryTriggerDetach ( sharedMemory, consumer );
+			exit (255);
+		}
+	}
+	(void) signal ( SIGINT, stop );
+	(void) signal ( SIGTERM, stop );
+
+	printf ( "Watching %u triggers as consumer %d%s...\n", triggerSpecCount,
+			 consumer, runSeconds != 0 ? "" : " (^C to stop)" );
+	fflush ( stdout );
+
+	//
+	// Take the events until the run is over.  The wait times out every 100
+	// msec so a signal or the end of the run is noticed.
+	//
+	unsigned long  startNs  = statsNow();
+	unsigned long  stopNs   = startNs + runSeconds * 1000000000UL;
+	unsigned long  events   = 0;
+	unsigned long  latency  = 0;
+	unsigned long  slowest  = 0;
+	triggerEvent_t event;
+
+	while ( ! stopping && ( runSeconds == 0 || statsNow() < stopNs ) )
+	{
+		if ( triggerWait ( table, consumer, 100 * 1000000UL ) != 0 )
+		{
+			continue;
+		}
+		while ( triggerNext ( table, consumer, &event ) )
+		{
+			unsigned long now   = statsNow();
+			unsigned long delay = now > event.time ? now - event.time : 0;
+
+			events++;
+			latency += delay;
+			slowest  = delay > slowest ? delay : slowest;
+
+			if ( quiet )
+			{
+				continue;
+			}
+			unsigned int spec = 0;
+			while ( spec < triggerSpecCount && numbers[spec] != (int)event.trigger )
+			{
+				spec++;
+			}
+			printf ( "%10.6f %-24s %03X %ld -> %ld [%u]",
+					 ( event.time - startNs ) / 1000000000.0,
+					 spec < triggerSpecCount ? triggerSpecs[spec] :
+					 triggerKindName ( event.kind ),
+					 event.frame.canMessage.can_id, event.previous, event.value,
+					 event.frame.canMessage.can_dlc );
+			for ( unsigned int i = 0; i < event.frame.canMessage.can_dlc; i++ )
+			{
+				printf ( " %02x", event.frame.canMessage.data[i] );
+			}
+			printf ( "  %'lu nsec\n", delay );
+		}
+		fflush ( stdout );
+	}
+	//
+	// Report the hits of each trigger and the events dropped.
+	//
+	printf ( "\n%'lu events taken", events );
+	if ( events != 0 )
+	{
+		printf ( ", latency average %'lu nsec, maximum %'lu nsec",
+				 latency / events, slowest );
+	}
+	printf ( ", %'lu dropped.\n", table->consumers[consumer].dropped );
+	for ( unsigned int i = 0; i < triggerSpecCount; i++ )
+	{
+		printf ( "  %-32s %'12lu hits\n", triggerSpecs[i],
+				 table->triggers[numbers[i]].hits );
+	}
+	sharedMemoryTriggerDetach ( sharedMemory, consumer );
+	sharedMemoryClose ( sharedMemory );
+
+    return 0;
+}
@@ -0,0 +1,305 @@
+//
+//	t y p e d b e n c h . c p p
+//
+//  Compare the typed C++ layer (see sharedMemory.hpp) with the same work
+//  written by hand in C.
+//
+//  A few messages with different signal layouts are described as types and
+//  written with known values.  Each of them is then read and decoded over
+//  and over, once with sharedMemoryReadMessage and explicit offsets, sizes
+//  and scales, and once with Segment::read and Frame::get.  A slice of the
+//  pool is also walked both ways.  The sums of the decoded values must be
+//  identical and the times per read should be the same: the typed layer
+//  only moves the layout from the code into the types.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <locale.h>
+#include <time.h>
+
+#include "sharedMemory.hpp"
+
+//
+// Define the messages of the test.
+//
+using Speed    = vsi::Field<0, 2, false, std::ratio<1, 100>>;
+using Torque   = vsi::Field<2, 2, true>;
+using Rpm      = vsi::Field<4, 4, false, std::ratio<1, 4>>;
+using Engine   = vsi::Message<0x1a0, Speed, Torque, Rpm>;
+
+using Voltage  = vsi::Field<0, 1, false, std::ratio<1, 10>>;
+using Current  = vsi::Field<1, 2, true, std::ratio<1, 1000>, std::ratio<-5>>;
+using Battery  = vsi::Message<0x3c2, Voltage, Current>;
+
+using Odometer = vsi::Field<0, 8>;
+using Trip     = vsi::Message<250000, Odometer>;
+
+//
+// Define the test parameters.  Note that these default values can be
+// overridden using the command line options.
+//
+static unsigned int passCount  = 1000000;
+static unsigned int sliceFirst = 0;
+static unsigned int sliceCount = 4096;
+
+//
+// Define the CAN bus partition to use.  If this is not specified with the
+// "-b" option, the original unpartitioned segment is used.
+//
+static int busId = SHARED_MEMORY_NO_BUS;
+
+//
+// Define the usage message function.
+//
+static void usage ( const char* executable )
+{
+    printf ( " \n\
+Usage: %s options\n\
+\n\
+  Option     Meaning       Type     Default \n\
+  ======  ==============  ======  =========== \n\
+    -n    Passes           int      1,000,000 \n\
+    -f    Slice First ID   int          0 \n\
+    -s    Slice Size       int        4096 \n\
+    -b    CAN Bus          int       None \n\
+    -h    Help Message     N/A        N/A \n\
+    -?    Help Message     N/A        N/A \n\
+\n\n\
+",
+             executable );
+}
+
+
+//
+// Return the current time in nanoseconds.
+//
+static unsigned long nowNs ( void )
+{
+	struct timespec now;
+
+	clock_gettime ( CLOCK_MONOTONIC, &now );
+
+	return now.tv_sec * 1000000000UL + now.tv_nsec;
+}
+
+
+//
+// Decode the test messages by hand.
+//
+static double readByHand ( sharedMemory_t* sharedMemory )
+{
+	canMessage_t   message;
+	unsigned short u16;
+	short          s16;
+	unsigned int   u32;
+	unsigned long  u64;
+	double         sum = 0;
+
+	sharedMemoryReadMessage ( sharedMemory, 0x1a0, &message );
+	memcpy ( &u16, &message.canMessage.data[0], 2 );
+	memcpy ( &s16, &message.canMessage.data[2], 2 );
+	memcpy ( &u32, &message.canMessage.data[4], 4 );
+	sum += u16 * 0.01 + s16 + u32 * 0.25;
+
+	sharedMemoryReadMessage ( sharedMemory, 0x3c2, &message );
+	memcpy ( &s16, &message.canMessage.data[1], 2 );
+	sum += message.canMessage.data[0] * 0.1 + ( s16 * 0.001 - 5 );
+
+	sharedMemoryReadMessage ( sharedMemory, 250000, &message );
+	memcpy ( &u64, &message.canMessage.data[0], 8 );
+	sum += u64;
+
+	return sum;
+}
+
+
+//
+// Decode the test messages with the typed layer.
+//
+static double readTyped ( const vsi::Segment<>& segment )
+{
+	double sum = 0;
+
+	auto engine = segment.read<Engine>();
+	sum += engine.get<Speed>() + engine.get<Torque>() + engine.get<Rpm>();
+
+	auto battery = segment.read<Battery>();
+	sum += battery.get<Voltage>() + battery.get<Current>();
+
+	sum += segment.read<Trip>().get<Odometer>();
+
+	return sum;
+}
+
+
+//
+// M A I N
+//
+int main ( int argc, char* const argv[] )
+{
+	//
+	// Set the locale so our fancy printf formats work correctly.
+	//
+	setlocale ( LC_ALL, "");
+
+    //
+    // Parse any command line options the user may have supplied.
+    //
+	int ch;
+
+    while ( ( ch = getopt ( argc, argv, "b:f:hn:s:?" ) ) != -1 )
+    {
+        switch ( ch )
+        {
+		  case 'n':
+		    passCount = atol ( optarg );
+			if ( passCount < 1 )
+			{
+				printf ( "Invalid pass count[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  case 'f':
+		    sliceFirst = atol ( optarg );
+			break;
+
+		  case 's':
+		    sliceCount = atol ( optarg );
+			if ( sliceCount < 1 )
+			{
+				printf ( "Invalid slice size[%s] specified.\n", optarg );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+		  //
+		  // Get the CAN bus partition number and validate it.
+		  //
+		  case 'b':
+		    busId = atoi ( optarg );
+			if ( busId < 0 || busId >= SHARED_MEMORY_MAX_BUSES )
+			{
+				printf ( "Invalid CAN bus[%d] specified.\n", busId );
+				usage ( argv[0] );
+				exit (255);
+			}
+			break;
+
+          case 'h':
+          case '?':
+          default:
+            usage ( argv[0] );
+            exit ( 0 );
+        }
+    }
+	if ( optind != argc )
+	{
+		printf ( "Invalid parameter encountered: %s\n", argv[optind] );
+		usage ( argv[0] );
+		exit (255);
+	}
+	try
+	{
+		vsi::Segment<> segment ( busId );
+		sharedMemory_t* sharedMemory = segment.handle();
+
+		//
+		// Write the test messages.
+		//
+		vsi::Frame<Engine>  engine;
+		vsi::Frame<Battery> battery;
+		vsi::Frame<Trip>    trip;
+
+		engine.set<Speed> ( 88.5 ).set<Torque> ( -120 ).set<Rpm> ( 2450.25 );
+		battery.set<Voltage> ( 13.8 ).set<Current> ( -2.125 );
+		trip.setRaw<Odometer> ( 123456789 );
+
+		segment.insert ( engine );
+		segment.insert ( battery );
+		segment.insert ( trip );
+
+		auto check = segment.read<Engine>();
+		printf ( "Engine %.2f km/h %.0f Nm %.2f rpm, battery %.1f V %.3f A, "
+				 "odometer %'lu\n", check.get<Speed>(), check.get<Torque>(),
+				 check.get<Rpm>(), segment.read<Battery>().get<Voltage>(),
+				 segment.read<Battery>().get<Current>(),
+				 segment.read<Trip>().raw<Odometer>() );
+
+		//
+		// Time the reads of the messages.
+		//
+		double        handSum  = 0;
+		double        typedSum = 0;
+		unsigned long start    = nowNs();
+
+		for ( unsigned int pass = 0; pass < passCount; pass++ )
+		{
+			handSum += readByHand ( sharedMemory );
+		}
+		unsigned long handNs = nowNs() - start;
+
+		start = nowNs();
+		for ( unsigned int pass = 0; pass < passCount; pass++ )
+		{
+			typedSum += readTyped ( segment );
+		}
+		unsigned long typedNs = nowNs() - start;
+
+		//
+		// Time a walk over a slice of the pool.  The slice is walked once
+		// first so both timed walks start with it in the cache.
+		//
+		vsi::Slice    slice     = segment.slice ( sliceFirst, sliceFirst + sliceCount );
+		unsigned long handDlc   = 0;
+		unsigned long typedDlc  = 0;
+		canMessage_t  message;
+
+		for ( canMessageIndex_t id = slice.first(); id < slice.last(); id++ )
+		{
+			sharedMemoryReadMessage ( sharedMemory, id, &message );
+		}
+		start = nowNs();
+		for ( canMessageIndex_t id = slice.first(); id < slice.last(); id++ )
+		{
+			sharedMemoryReadMessage ( sharedMemory, id, &message );
+			handDlc += message.canMessage.can_dlc;
+		}
+		unsigned long handSliceNs = nowNs() - start;
+
+		start = nowNs();
+		for ( const canMessage_t& frame : slice )
+		{
+			typedDlc += frame.canMessage.can_dlc;
+		}
+		unsigned long typedSliceNs = nowNs() - start;
+
+		unsigned long reads = passCount * 3UL;
+
+		printf ( "\n%-12s %14s %14s %18s\n", "", "ns/read", "slice ns/ID",
+				 "decoded sum" );
+		printf ( "%-12s %14.1f %14.1f %18.2f\n", "C by hand",
+				 (double)handNs / reads, (double)handSliceNs / sliceCount,
+				 handSum );
+		printf ( "%-12s %14.1f %14.1f %18.2f\n", "Typed C++",
+				 (double)typedNs / reads, (double)typedSliceNs / sliceCount,
+				 typedSum );
+
+		if ( handSum != typedSum || handDlc != typedDlc )
+		{
+			printf ( "\nThe typed layer decoded different values - Failed\n" );
+			exit (255);
+		}
+	}
+	catch ( const std::exception& error )
+	{
+		printf ( "%s - Aborting\n", error.what() );
+		exit (255);
+	}
+	return 0;
+}
@@ -0,0 +1,621 @@
+//
+//	w o r k l o a d . c
+//
+//  Realistic periodic CAN traffic generator.  See workload.h for a
+//  description.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "workload.h"
+
+//
+// Define the distribution of cycle times and data lengths used for a
+// generated profile.  These follow the usual mix on a vehicle powertrain or
+// body bus: most traffic is 10 to 100 msec and 8 bytes long.
+//
+typedef struct workloadMix_t
+{
+	unsigned int value;
+	unsigned int weight;
+
+}   workloadMix_t;
+
+static const workloadMix_t cycleMix[] =
+{
+	{ 10, 15 }, { 20, 20 }, { 50, 15 }, { 100, 30 }, { 200, 5 }, { 500, 10 },
+	{ 1000, 5 }, { 0, 0 }
+};
+
+static const workloadMix_t dlcMix[] =
+{
+	{ 8, 70 }, { 6, 5 }, { 4, 10 }, { 2, 10 }, { 1, 5 }, { 0, 0 }
+};
+
+//
+// Define the percentage of generated IDs that send bursts and the shape of
+// their bursts.
+//
+#define WORKLOAD_BURST_PERCENT 5
+#define WORKLOAD_BURST_FRAMES  3
+#define WORKLOAD_BURST_GAP_NS  ( 500 * 1000 )
+
+
+//
+//	w o r k l o a d R a n d o m
+//
+// Return the next number from a xorshift64* generator.  This is a handful of
+// instructions with no shared state, unlike rand(), so it can be called in a
+// timed loop by any number of threads, each with its own state.  The state
+// must never be zero.
+//
+unsigned long workloadRandom ( unsigned long* state )
+{
+	unsigned long x = *state;
+
+	x ^= x >> 12;
+	x ^= x << 25;
+	x ^= x >> 27;
+	*state = x;
+
+	return x * 0x2545F4914F6CDD1DUL;
+}
+
+
+//
+// Initialize a generator with no messages.  Generators with the same seed
+// and profile produce the same traffic.
+//
+// This function returns 0.
+//
+int workloadCreate ( workload_t* workload, unsigned long seed )
+{
+	(void) memset ( workload, 0, sizeof(workload_t) );
+
+	workload->bitrate = WORKLOAD_DEFAULT_BITRATE;
+
+	//
+	// Spread the seed out with a splitmix64 step so that small seeds give
+	// unrelated sequences and the state is never zero.
+	//
+	seed += 0x9E3779B97F4A7C15UL;
+	seed  = ( seed ^ ( seed >> 30 ) ) * 0xBF58476D1CE4E5B9UL;
+	seed  = ( seed ^ ( seed >> 27 ) ) * 0x94D049BB133111EBUL;
+	seed ^= seed >> 31;
+
+	workload->random = seed != 0 ? seed : 1;
+
+	return 0;
+}
+
+
+//
+// Free the memory used by a generator.
+//
+void workloadDestroy ( workload_t* workload )
+{
+	free ( workload->entries );
+	free ( workload->heap );
+
+	workload->entries    = 0;
+	workload->heap       = 0;
+	workload->entryCount = 0;
+	workload->maxEntries = 0;
+}
+
+
+//
+// Add a message to a generator and return its entry, or 0 if we ran out of
+// memory.
+//
+static workloadEntry_t* addEntry ( workload_t* workload, canid_t id,
+								   unsigned long periodNs )
+{
+	if ( workload->entryCount == workload->maxEntries )
+	{
+		unsigned int     maxEntries = workload->maxEntries ? workload->maxEntries * 2 : 256;
+		workloadEntry_t* entries    = realloc ( workload->entries,
+												maxEntries * sizeof(workloadEntry_t) );
+		if ( entries == 0 )
+		{
+			printf ( "Unable to allocate the workload schedule.\n" );
+			return 0;
+		}
+		workload->entries    = entries;
+		workload->maxEntries = maxEntries;
+	}
+	workloadEntry_t* entry = &workload->entries[workload->entryCount++];
+
+	(void) memset ( entry, 0, sizeof(workloadEntry_t) );
+	entry->id          = id;
+	entry->periodNs    = periodNs;
+	entry->burstCount  = 1;
+	entry->dlcCount    = 1;
+	entry->dlcs[0]     = CAN_MAX_DLEN;
+	entry->dlcLimits[0] = 1;
+
+	return entry;
+}
+
+
+//
+// Parse a DLC mix of the form "<dlc>[:<weight>],..." into an entry.
+//
+// This function returns 0 if the mix is valid and -1 if it is not.
+//
+static int parseDlcMix ( const char* text, workloadEntry_t* entry )
+{
+	unsigned int total = 0;
+	char*        next  = (char*)text;
+
+	entry->dlcCount = 0;
+	while ( *next != 0 )
+	{
+		char*         end;
+		unsigned long dlc    = strtoul ( next, &end, 0 );
+		unsigned long weight = 1;
+
+		if ( end == next || dlc > CAN_MAX_DLEN ||
+			 entry->dlcCount == WORKLOAD_MAX_DLCS )
+		{
+			return -1;
+		}
+		if ( *end == ':' )
+		{
+			next   = end + 1;
+			weight = strtoul ( next, &end, 0 );
+			if ( end == next || weight == 0 )
+			{
+				return -1;
+			}
+		}
+		total += weight;
+		entry->dlcs[entry->dlcCount]      = dlc;
+		entry->dlcLimits[entry->dlcCount] = total;
+		entry->dlcCount++;
+
+		if ( *end == ',' )
+		{
+			end++;
+		}
+		else if ( *end != 0 )
+		{
+			return -1;
+		}
+		next = end;
+	}
+	return entry->dlcCount > 0 ? 0 : -1;
+}
+
+
+//
+//	w o r k l o a d L o a d P r o f i l e
+//
+// Add the messages described by a traffic profile file to a generator.
+//
+// This function returns 0 if the profile was loaded and -1 if it could not
+// be read or has an error in it.
+//
+int workloadLoadProfile ( workload_t* workload, const char* fileName )
+{
+	FILE* file = fopen ( fileName, "r" );
+	if ( file == 0 )
+	{
+		printf ( "Unable to open profile[%s] errno: %u[%s].\n", fileName, errno,
+				 strerror(errno) );
+		return -1;
+	}
+	char         line[1024];
+	unsigned int lineNumber = 0;
+	int          status     = 0;
+
+	while ( status == 0 && fgets ( line, sizeof(line), file ) != 0 )
+	{
+		lineNumber++;
+
+		char* comment = strchr ( line, '#' );
+		if ( comment != 0 )
+		{
+			*comment = 0;
+		}
+		char* save;
+		char* token = strtok_r ( line, " \t\r\n", &save );
+		if ( token == 0 )
+		{
+			continue;
+		}
+		if ( strcmp ( token, "bitrate" ) == 0 )
+		{
+			token = strtok_r ( 0, " \t\r\n", &save );
+			workload->bitrate = token ? strtoul ( token, 0, 0 ) : 0;
+			if ( workload->bitrate == 0 )
+			{
+				status = -1;
+			}
+			continue;
+		}
+		//
+		// Get the ID range and the cycle time.
+		//
+		char*         end;
+		unsigned long first = strtoul ( token, &end, 0 );
+		unsigned long last  = first;
+		if ( end == token )
+		{
+			status = -1;
+			continue;
+		}
+		if ( *end == '-' )
+		{
+			char* next = end + 1;
+			last = strtoul ( next, &end, 0 );
+			if ( end == next || last < first )
+			{
+				status = -1;
+				continue;
+			}
+		}
+		token = strtok_r ( 0, " \t\r\n", &save );
+		double cycleMs = token ? strtod ( token, &end ) : 0;
+		if ( token == 0 || *end != 0 || cycleMs <= 0 )
+		{
+			status = -1;
+			continue;
+		}
+		//
+		// Get the options that apply to every ID in the range.
+		//
+		workloadEntry_t options;
+		(void) memset ( &options, 0, sizeof(options) );
+		options.burstCount   = 1;
+		options.dlcCount     = 1;
+		options.dlcs[0]      = CAN_MAX_DLEN;
+		options.dlcLimits[0] = 1;
+
+		while ( status == 0 && ( token = strtok_r ( 0, " \t\r\n", &save ) ) != 0 )
+		{
+			if ( strncmp ( token, "dlc=", 4 ) == 0 )
+			{
+				status = parseDlcMix ( token + 4, &options );
+			}
+			else if ( strncmp ( token, "burst=", 6 ) == 0 )
+			{
+				double gapUs = 0;
+				if ( sscanf ( token + 6, "%u/%lf", &options.burstCount,
+							  &gapUs ) != 2 || options.burstCount == 0 ||
+					 gapUs < 0 )
+				{
+					status = -1;
+				}
+				options.burstGapNs = gapUs * 1000;
+			}
+			else if ( strncmp ( token, "jitter=", 7 ) == 0 )
+			{
+				options.jitterNs = strtod ( token + 7, 0 ) * 1000;
+			}
+			else
+			{
+				status = -1;
+			}
+		}
+		for ( unsigned long id = first; status == 0 && id <= last; id++ )
+		{
+			workloadEntry_t* entry = addEntry ( workload, id, cycleMs * 1000000 );
+			if ( entry == 0 )
+			{
+				status = -1;
+				break;
+			}
+			options.id       = id;
+			options.periodNs = entry->periodNs;
+			*entry = options;
+		}
+	}
+	if ( status != 0 )
+	{
+		printf ( "Invalid traffic profile line %u in [%s].\n", lineNumber,
+				 fileName );
+	}
+	(void) fclose ( file );
+
+	return status;
+}
+
+
+//
+// Pick a value from a weighted mix.
+//
+static unsigned int pickMix ( workload_t* workload, const workloadMix_t* mix )
+{
+	unsigned int total = 0;
+
+	for ( int i = 0; mix[i].weight != 0; i++ )
+	{
+		total += mix[i].weight;
+	}
+	unsigned int pick = workloadRandom ( &workload->random ) % total;
+	for ( int i = 0; ; i++ )
+	{
+		if ( pick < mix[i].weight )
+		{
+			return mix[i].value;
+		}
+		pick -= mix[i].weight;
+	}
+}
+
+
+//
+//	w o r k l o a d G e n e r a t e P r o f i l e
+//
+// Add "idCount" messages with a typical vehicle mix of cycle times, data
+// lengths and bursts to a generator.  The IDs are spread evenly over the
+// range 0 to "maxId" - 1.
+//
+// This function returns 0 if the messages were added and -1 if they were not.
+//
+int workloadGenerateProfile ( workload_t* workload, unsigned int idCount,
+							  unsigned int maxId )
+{
+	if ( idCount == 0 || idCount > maxId )
+	{
+		printf ( "Invalid generated profile of %u IDs out of %u.\n", idCount,
+				 maxId );
+		return -1;
+	}
+	unsigned int stride = maxId / idCount;
+
+	for ( unsigned int i = 0; i < idCount; i++ )
+	{
+		unsigned long    periodNs = pickMix ( workload, cycleMix ) * 1000000UL;
+		workloadEntry_t* entry    = addEntry ( workload, i * stride, periodNs );
+
+		if ( entry == 0 )
+		{
+			return -1;
+		}
+		entry->dlcs[0]  = pickMix ( workload, dlcMix );
+		entry->jitterNs = periodNs / 20;
+
+		if ( workloadRandom ( &workload->random ) % 100 < WORKLOAD_BURST_PERCENT )
+		{
+			entry->burstCount = WORKLOAD_BURST_FRAMES;
+			entry->burstGapNs = WORKLOAD_BURST_GAP_NS;
+		}
+	}
+	return 0;
+}
+
+
+//
+// Split the messages of a generator into "count" parts and set up a new
+// generator with part "index" of them.  This is used to give each of several
+// writers its own share of the traffic.
+//
+// This function returns 0 if the part was set up and -1 if it was not.
+//
+int workloadSplit ( workload_t* workload, workload_t* part, unsigned int index,
+					unsigned int count, unsigned long seed )
+{
+	(void) workloadCreate ( part, seed );
+	part->bitrate = workload->bitrate;
+
+	for ( unsigned int i = index; i < workload->entryCount; i += count )
+	{
+		workloadEntry_t* entry = addEntry ( part, 0, 0 );
+		if ( entry == 0 )
+		{
+			workloadDestroy ( part );
+			return -1;
+		}
+		*entry = workload->entries[i];
+	}
+	return 0;
+}
+
+
+//
+// Return the number of bits on the wire for a frame, including the worst
+// case bit stuffing.
+//
+static double frameBits ( canid_t id, unsigned int dlc )
+{
+	if ( id > CAN_SFF_MASK )
+	{
+		return 67 + 8 * dlc + ( 54 + 8 * dlc - 1 ) / 4;
+	}
+	return 47 + 8 * dlc + ( 34 + 8 * dlc - 1 ) / 4;
+}
+
+
+//
+//	w o r k l o a d B u s L o a d
+//
+// Return the load the generator puts on a bus of its bit rate, as a
+// percentage.
+//
+double workloadBusLoad ( workload_t* workload )
+{
+	double bitsPerSecond = 0;
+
+	for ( unsigned int i = 0; i < workload->entryCount; i++ )
+	{
+		workloadEntry_t* entry = &workload->entries[i];
+		double           bits  = 0;
+		unsigned int     last  = 0;
+
+		//
+		// Average the frame size over the DLC mix.
+		//
+		for ( unsigned int j = 0; j < entry->dlcCount; j++ )
+		{
+			bits += frameBits ( entry->id, entry->dlcs[j] ) *
+					( entry->dlcLimits[j] - last );
+			last  = entry->dlcLimits[j];
+		}
+		bits /= last;
+
+		bitsPerSecond += bits * entry->burstCount * 1e9 / entry->periodNs;
+	}
+	return bitsPerSecond * 100 / workload->bitrate;
+}
+
+
+//
+// Scale the cycle times of all of the messages so that the generator puts
+// the requested load on the bus.  The shape of the traffic is unchanged.
+//
+void workloadScaleLoad ( workload_t* workload, double loadPercent )
+{
+	double factor = workloadBusLoad ( workload ) / loadPercent;
+
+	for ( unsigned int i = 0; i < workload->entryCount; i++ )
+	{
+		workloadEntry_t* entry = &workload->entries[i];
+
+		entry->periodNs = entry->periodNs * factor;
+		if ( entry->periodNs == 0 )
+		{
+			entry->periodNs = 1;
+		}
+	}
+}
+
+
+//
+// Move an entry of the schedule heap down to where it belongs.
+//
+static void siftDown ( workload_t* workload, unsigned int slot )
+{
+	workloadDue_t* heap = workload->heap;
+	workloadDue_t  due  = heap[slot];
+	unsigned int   count = workload->entryCount;
+
+	for ( ;; )
+	{
+		unsigned int child = slot * 2 + 1;
+		if ( child >= count )
+		{
+			break;
+		}
+		if ( child + 1 < count && heap[child + 1].dueNs < heap[child].dueNs )
+		{
+			child++;
+		}
+		if ( heap[child].dueNs >= due.dueNs )
+		{
+			break;
+		}
+		heap[slot] = heap[child];
+		slot       = child;
+	}
+	heap[slot] = due;
+}
+
+
+//
+// Return the delay of a cycle for a message with jitter.
+//
+static unsigned long jitter ( workload_t* workload, workloadEntry_t* entry )
+{
+	if ( entry->jitterNs == 0 )
+	{
+		return 0;
+	}
+	return workloadRandom ( &workload->random ) % ( entry->jitterNs + 1 );
+}
+
+
+//
+//	w o r k l o a d S t a r t
+//
+// Build the schedule of a generator.  Each message starts at a random phase
+// within its first cycle so the IDs aren't all sent at once, just like the
+// ECUs on a real bus.  The times returned by workloadNext are relative to
+// this call.
+//
+void workloadStart ( workload_t* workload )
+{
+	free ( workload->heap );
+	workload->heap = malloc ( ( workload->entryCount + 1 ) * sizeof(workloadDue_t) );
+	if ( workload->heap == 0 )
+	{
+		printf ( "Unable to allocate the workload schedule.\n" );
+		workload->entryCount = 0;
+		return;
+	}
+	for ( unsigned int i = 0; i < workload->entryCount; i++ )
+	{
+		workloadEntry_t* entry  = &workload->entries[i];
+		unsigned long    random = workloadRandom ( &workload->random );
+
+		entry->cycleNs   = random % entry->periodNs;
+		entry->burstLeft = entry->burstCount;
+		(void) memcpy ( entry->data, &random, sizeof(entry->data) );
+
+		workload->heap[i].dueNs = entry->cycleNs + jitter ( workload, entry );
+		workload->heap[i].entry = i;
+	}
+	for ( int i = workload->entryCount / 2; i >= 0; i-- )
+	{
+		siftDown ( workload, i );
+	}
+}
+
+
+//
+//	w o r k l o a d N e x t
+//
+// Fill in the next frame that is due and return the time it is due, in
+// nanoseconds since workloadStart.  The frames are returned in time order.
+//
+// The payload changes the way real signals do: the first byte is a rolling
+// counter and one other byte changes a little on each frame.
+//
+unsigned long workloadNext ( workload_t* workload, canMessage_t* message )
+{
+	workloadDue_t*   due    = &workload->heap[0];
+	workloadEntry_t* entry  = &workload->entries[due->entry];
+	unsigned long    dueNs  = due->dueNs;
+	unsigned long    random = workloadRandom ( &workload->random );
+
+	//
+	// Pick the data length and update the payload.
+	//
+	unsigned int dlc = entry->dlcs[0];
+	if ( entry->dlcCount > 1 )
+	{
+		unsigned int pick = random % entry->dlcLimits[entry->dlcCount - 1];
+		for ( unsigned int i = 0; pick >= entry->dlcLimits[i]; i++ )
+		{
+			dlc = entry->dlcs[i + 1];
+		}
+	}
+	entry->data[0]++;
+	entry->data[1 + ( random >> 32 ) % ( CAN_MAX_DLEN - 1 )] ^= ( random >> 8 ) & 0x0f;
+
+	message->canMessage.can_id  = entry->id;
+	message->canMessage.can_dlc = dlc;
+	(void) memcpy ( message->canMessage.data, entry->data, CAN_MAX_DLEN );
+
+	//
+	// Schedule the next frame of this message.  The cycles are anchored to
+	// the start of the schedule so jitter never makes a message drift.
+	//
+	if ( --entry->burstLeft > 0 )
+	{
+		due->dueNs = dueNs + entry->burstGapNs;
+	}
+	else
+	{
+		entry->burstLeft = entry->burstCount;
+		entry->cycleNs  += entry->periodNs;
+		due->dueNs       = entry->cycleNs + jitter ( workload, entry );
+	}
+	siftDown ( workload, 0 );
+
+	return dueNs;
+}
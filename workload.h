@@ -0,0 +1,110 @@
+#pragma once
+#ifndef WORKLOAD_H
+#define WORKLOAD_H
+
+#include "canMessage.h"
+
+//
+// The workload generator produces CAN traffic that looks like a real
+// vehicle bus instead of a uniform random stream of IDs.  Each message ID
+// is sent periodically with its own cycle time, phase, jitter, data length
+// mix and optional bursts, as described by a traffic profile.  The
+// generator hands out the frames in the order they are due along with the
+// time each one is due, and the caller decides whether to wait for that
+// time or to replay the schedule as fast as it can.
+//
+// A profile is a text file with one line per message ID or range of IDs:
+//
+//     <id>[-<id>] <cycle ms> [dlc=<dlc>[:<weight>],...] [burst=<frames>/<gap usec>]
+//                            [jitter=<usec>]
+//
+// For example:
+//
+//     bitrate 500000
+//     0x100-0x10f  10   dlc=8
+//     0x200        100  dlc=2:1,8:3  burst=3/200  jitter=500
+//
+// Blank lines and anything after a "#" are ignored.  The "bitrate" line sets
+// the bit rate used to compute the bus load (500 kbit/sec by default).  The
+// data length of each frame is picked from the weighted "dlc" list (8 by
+// default).  A burst sends several frames a fixed gap apart every cycle, the
+// way a transport protocol or a diagnostic response does.  The jitter delays
+// each cycle by a random amount up to the given time without letting the
+// schedule drift.
+//
+// Each generator has its own random number state so several generators can
+// run in parallel without sharing anything.
+//
+
+//
+// Define the largest number of entries in the DLC mix of a message.
+//
+#define WORKLOAD_MAX_DLCS ( CAN_MAX_DLEN + 1 )
+
+//
+// Define the default bit rate used to compute the bus load.
+//
+#define WORKLOAD_DEFAULT_BITRATE 500000
+
+//
+// Define the schedule of a single message ID.
+//
+typedef struct workloadEntry_t
+{
+	canid_t        id;
+	unsigned int   burstCount;              // Frames per cycle
+	unsigned int   burstLeft;               // Frames left in this cycle
+	unsigned int   dlcCount;
+	unsigned char  dlcs[WORKLOAD_MAX_DLCS];
+	unsigned int   dlcLimits[WORKLOAD_MAX_DLCS]; // Cumulative weights
+	unsigned long  periodNs;
+	unsigned long  jitterNs;
+	unsigned long  burstGapNs;
+	unsigned long  cycleNs;                 // Start of the current cycle
+	unsigned char  data[CAN_MAX_DLEN];      // Last payload sent
+
+}   workloadEntry_t;
+
+//
+// Define an entry in the schedule heap.
+//
+typedef struct workloadDue_t
+{
+	unsigned long dueNs;
+	unsigned int  entry;
+
+}   workloadDue_t;
+
+//
+// Define the state of a generator.
+//
+typedef struct workload_t
+{
+	unsigned int     entryCount;
+	unsigned int     maxEntries;
+	unsigned long    bitrate;
+	unsigned long    random;                // PRNG state, never zero
+	workloadEntry_t* entries;
+	workloadDue_t*   heap;
+
+}   workload_t;
+
+//
+// Define the workload functions.
+//
+int           workloadCreate   ( workload_t* workload, unsigned long seed );
+void          workloadDestroy  ( workload_t* workload );
+int           workloadLoadProfile ( workload_t* workload, const char* fileName );
+int           workloadGenerateProfile ( workload_t* workload,
+										unsigned int idCount,
+										unsigned int maxId );
+int           workloadSplit    ( workload_t* workload, workload_t* part,
+								 unsigned int index, unsigned int count,
+								 unsigned long seed );
+double        workloadBusLoad  ( workload_t* workload );
+void          workloadScaleLoad ( workload_t* workload, double loadPercent );
+void          workloadStart    ( workload_t* workload );
+unsigned long workloadNext     ( workload_t* workload, canMessage_t* message );
+unsigned long workloadRandom   ( unsigned long* state );
+
+#endif		// End of WORKLOAD_H